@@ -0,0 +1,223 @@
+# Block device throughput benchmark for RISC-V-Emulator
+#
+# Reads the whole disk of the block device in requests of up to 1MB and
+# outputs the throughput in MB/s, measured by the clock_gettime64 system call.
+# Run it with a disk of any size, e.g.:
+#
+#    dd if=/dev/zero of=disk.img bs=1M count=1024
+#    ./build/RISC-V-Emulator -k disk.img ./Bench/BlockBench.bin
+#
+# The output looks like "1024 MB in 350 ms: 2925 MB/s". Without a disk, the
+# program outputs "No disk" and after a failed request "I/O error".
+
+.equ DISK,           0x10001000 # Registers of the block device (virtio-mmio)
+.equ QUEUE,          0x80010000 # Descriptor table of 4 entries
+.equ AVAIL,          0x80010100 # Available ring
+.equ USED,           0x80010200 # Used ring
+.equ HEADER,         0x80010300 # Header of the request: type and sector
+.equ STATUS,         0x80010310 # Status of the request
+.equ TIME,           0x80010320 # Two struct timespec
+.equ DIGITS,         0x80010340 # Buffer for printing numbers
+.equ BUFFER,         0x80100000 # The data read from the disk
+.equ CHUNK,          2048       # Sectors per request, i.e. 1MB
+
+.section .text
+.global _start
+_start:
+    .option push
+    .option norelax
+    li s0, DISK
+    lw t0, 0x000(s0)            # MagicValue
+    li t1, 0x74726976
+    bne t0, t1, nodisk
+    lw t0, 0x008(s0)            # DeviceID
+    li t1, 2
+    bne t0, t1, nodisk
+
+    # Initialize the device and its only queue
+    sw zero, 0x070(s0)          # Status: reset
+    li t0, 1 | 2                # ACKNOWLEDGE | DRIVER
+    sw t0, 0x070(s0)
+    li t0, 1 | 2 | 8            # FEATURES_OK
+    sw t0, 0x070(s0)
+    sw zero, 0x030(s0)          # QueueSel
+    li t0, 4
+    sw t0, 0x038(s0)            # QueueNum
+    li t0, QUEUE
+    sw t0, 0x080(s0)            # QueueDescLow
+    li t0, AVAIL
+    sw t0, 0x090(s0)            # QueueDriverLow
+    li t0, USED
+    sw t0, 0x0a0(s0)            # QueueDeviceLow
+    li t0, 1
+    sw t0, 0x044(s0)            # QueueReady
+    li t0, 1 | 2 | 4 | 8        # DRIVER_OK
+    sw t0, 0x070(s0)
+
+    # Every request uses the same three descriptors: header, data, status
+    li s1, QUEUE
+    li t0, HEADER
+    sw t0, 0(s1)
+    li t0, 16
+    sw t0, 8(s1)
+    li t0, 1 | (1 << 16)        # NEXT, next = 1
+    sw t0, 12(s1)
+    li t0, BUFFER
+    sw t0, 16(s1)
+    li t0, 1 | 2 | (2 << 16)    # NEXT | WRITE, next = 2
+    sw t0, 28(s1)
+    li t0, STATUS
+    sw t0, 32(s1)
+    li t0, 1
+    sw t0, 40(s1)
+    li t0, 2                    # WRITE
+    sw t0, 44(s1)
+
+    lw s4, 0x100(s0)            # Capacity in sectors: remaining sectors
+    lw s5, 0x104(s0)
+    srli s7, s4, 11             # The size in MB
+    slli t0, s5, 21
+    or s7, s7, t0
+    li s2, 0                    # The current sector
+    li s3, 0
+    li s6, 0                    # The index of the available ring
+
+    li a0, TIME
+    jal ra, gettime
+
+loop:
+    bnez s5, full
+    beqz s4, done
+    li t0, CHUNK
+    bgeu s4, t0, full
+    mv t1, s4
+    j request
+full:
+    li t1, CHUNK
+request:
+    li t2, HEADER
+    sw zero, 0(t2)              # Type: IN
+    sw s2, 8(t2)
+    sw s3, 12(t2)
+    slli t0, t1, 9
+    sw t0, 24(s1)               # Length of the data
+    li t2, AVAIL
+    andi t0, s6, 3
+    slli t0, t0, 1
+    add t0, t0, t2
+    sh zero, 4(t0)              # The request starts with descriptor 0
+    addi s6, s6, 1
+    fence w, w
+    sh s6, 2(t2)
+    sw zero, 0x050(s0)          # QueueNotify
+
+    li t2, USED
+    lhu t0, 2(t2)
+    slli t3, s6, 16
+    srli t3, t3, 16
+    bne t0, t3, ioerror
+    li t2, STATUS
+    lbu t0, 0(t2)
+    bnez t0, ioerror
+
+    add t0, s2, t1              # Next sector
+    sltu t2, t0, s2
+    add s3, s3, t2
+    mv s2, t0
+    sltu t2, s4, t1             # Remaining sectors
+    sub s4, s4, t1
+    sub s5, s5, t2
+    j loop
+
+done:
+    li a0, TIME + 16
+    jal ra, gettime
+
+    # Elapsed milliseconds
+    li t2, TIME
+    lw t0, 0(t2)
+    lw t1, 16(t2)
+    sub t0, t1, t0
+    li t1, 1000
+    mul s8, t0, t1
+    lw t0, 8(t2)
+    lw t1, 24(t2)
+    sub t0, t1, t0
+    li t1, 1000000
+    div t0, t0, t1
+    add s8, s8, t0
+    bnez s8, 1f
+    li s8, 1
+1:
+    mv a0, s7
+    jal ra, printu
+    la a0, msgMB
+    jal ra, prints
+    mv a0, s8
+    jal ra, printu
+    la a0, msgMS
+    jal ra, prints
+    li t0, 1000
+    mul a0, s7, t0
+    divu a0, a0, s8
+    jal ra, printu
+    la a0, msgRate
+    jal ra, prints
+    j halt
+
+nodisk:
+    la a0, msgNoDisk
+    jal ra, prints
+    j halt
+
+ioerror:
+    la a0, msgError
+    jal ra, prints
+
+halt:
+    sw zero, 4(zero)            # halt
+
+# Store the time of the monotonic clock at a0
+gettime:
+    mv a1, a0
+    li a0, 1                    # CLOCK_MONOTONIC
+    li a7, 403                  # clock_gettime64
+    ecall
+    ret
+
+# Output the zero-terminated string at a0
+prints:
+    lbu t0, 0(a0)
+    beqz t0, 1f
+    sb t0, 0(zero)
+    addi a0, a0, 1
+    j prints
+1:
+    ret
+
+# Output the unsigned number in a0
+printu:
+    li t0, DIGITS + 16
+    sb zero, 0(t0)
+    li t1, 10
+1:
+    remu t2, a0, t1
+    addi t2, t2, '0'
+    addi t0, t0, -1
+    sb t2, 0(t0)
+    divu a0, a0, t1
+    bnez a0, 1b
+    mv a0, t0
+    j prints
+
+msgNoDisk:
+    .asciz "No disk\n"
+msgError:
+    .asciz "I/O error\n"
+msgMB:
+    .asciz " MB in "
+msgMS:
+    .asciz " ms: "
+msgRate:
+    .asciz " MB/s\n"
+    .option pop
@@ -0,0 +1,57 @@
+# Store throughput microbenchmark for RISC-V-Emulator
+#
+# Executes 10 million iterations of a loop with 8 stores of different sizes
+# while a reservation taken by lr.w is held on another word, so every store
+# has to check it. Run it with -s to see the throughput in MIPS:
+#
+#    ./build/RISC-V-Emulator -s ./Bench/StoreBench.bin
+#
+# At the end, sc.w has to succeed, as none of the stores touched the reserved
+# word. The program outputs "OK" in that case and "FAIL" otherwise.
+
+.section .text
+.global _start
+_start:
+    .option push
+    .option norelax
+    li a0, 0x80100000           # buffer for the stores
+    li a1, 0x80100040           # reserved word
+    li t1, 10000000             # iterations
+    lr.w t2, (a1)
+
+loop:
+    sw t1, 0(a0)
+    sw t1, 4(a0)
+    sh t1, 8(a0)
+    sh t1, 10(a0)
+    sb t1, 12(a0)
+    sb t1, 13(a0)
+    sw t1, 16(a0)
+    sw t1, 20(a0)
+    addi t1, t1, -1
+    bnez t1, loop
+
+    sc.w t2, t2, (a1)
+    bnez t2, fail
+
+    li t0, 'O'
+    sb t0, 0(zero)
+    li t0, 'K'
+    sb t0, 0(zero)
+    j done
+
+fail:
+    li t0, 'F'
+    sb t0, 0(zero)
+    li t0, 'A'
+    sb t0, 0(zero)
+    li t0, 'I'
+    sb t0, 0(zero)
+    li t0, 'L'
+    sb t0, 0(zero)
+
+done:
+    li t0, '\n'
+    sb t0, 0(zero)
+    sw zero, 4(zero)            # halt
+    .option pop
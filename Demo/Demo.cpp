@@ -37,10 +37,15 @@ void numberToString( int number, char *pStr )
 
 void printString( const char *pStr )
 {
-   for( int i = 0; pStr[i]; i++ )
+   unsigned int len = 0;
+   while( pStr[len] )
    {
-      *( (unsigned char *)0 ) = pStr[i];
+      len++;
    }
+
+   // Hand the whole string over to the console in a single store
+   *( (volatile unsigned int *)0x8 ) = (unsigned int)pStr;
+   *( (volatile unsigned int *)0xc ) = len;
 }
 
 
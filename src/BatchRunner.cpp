@@ -0,0 +1,426 @@
+/*******************************************************************************
+ *  Copyright (c) 2024 Christian Nowak <chnowak@web.de>                        *
+ *   This file is part of chn's RISC-V-Emulator.                               *
+ *                                                                             *
+ *  RISC-V-Emulator is free software: you can redistribute it and/or modify it *
+ *  under the terms of the GNU General Public License as published by the Free *
+ *  Software Foundation, either version 3 of the License, or (at your option)  *
+ *  any later version.                                                         *
+ *                                                                             *          
+ *  RISC-V-Emulator is distributed in the hope that it will be useful, but     * 
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY *
+ *  or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License    *
+ *  for more details.                                                          *
+ *                                                                             *
+ *  You should have received a copy of the GNU General Public License along    *
+ *  with RISC-V-Emulator. If not, see <https://www.gnu.org/licenses/>.         *
+ *******************************************************************************/
+
+/*----------------------------------------------------------------------------*/
+/*!
+\file BatchRunner.cpp
+\author Christian Nowak <chnowak@web.de>
+\brief This implements the batch mode
+*/
+/*----------------------------------------------------------------------------*/
+#include <fstream>
+#include <thread>
+#include <chrono>
+#include <stdlib.h>
+
+#include "BatchRunner.h"
+#include "util.h"
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Constructor for class BatchRunner
+\param numThreads The number of host threads, or 0 for one per host CPU
+\param pOutput The file to write the results to
+*/
+/*----------------------------------------------------------------------------*/
+BatchRunner::BatchRunner( int numThreads, FILE *pOutput ) :
+   m_pOutput( pOutput ),
+   m_Engine( RISCV::ENGINE_INTERPRETER ),
+   m_DynamicBinding( false ),
+   m_HostRoutines( HostRoutines::MODE_OFF ),
+   m_RAMSize( Emulator::DEFAULT_RAM_SIZE ),
+   m_HugePages( false ),
+   m_pDeduplicator( 0 ),
+   m_DeduplicationInterval( 0 ),
+   m_pJobs( 0 ),
+   m_Instructions( 0 )
+{
+   if( numThreads < 1 )
+   {
+      numThreads = std::thread::hardware_concurrency();
+      if( numThreads < 1 )
+         numThreads = 1;
+   }
+
+   for( int i = 0; i < numThreads; i++ )
+   {
+      Worker *pWorker = new Worker;
+      pWorker->pEmulator = 0;
+      m_Workers.push_back( pWorker );
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Destructor for class BatchRunner
+*/
+/*----------------------------------------------------------------------------*/
+BatchRunner::~BatchRunner()
+{
+   for( size_t i = 0; i < m_Workers.size(); i++ )
+   {
+      delete m_Workers[i]->pEmulator;
+      delete m_Workers[i];
+   }
+   delete m_pDeduplicator;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Read the jobs from a manifest file. Every line contains the name of a binary
+file, optionally followed by the maximum number of instructions to execute.
+Empty lines and lines starting with # are ignored.
+\param fileName The manifest file
+\param defaultMaxInstructions The limit of jobs which don't specify one
+\param jobs Receives the jobs
+\return false if the manifest couldn't be read
+*/
+/*----------------------------------------------------------------------------*/
+bool BatchRunner::readManifest( std::string fileName, uint64_t defaultMaxInstructions, std::vector<Job> &jobs )
+{
+   std::ifstream manifest( fileName );
+   if( !manifest )
+      return( false );
+
+   const char *pSpace = " \t\r";
+   std::string line;
+   while( std::getline( manifest, line ) )
+   {
+      size_t begin = line.find_first_not_of( pSpace );
+      if( ( begin == std::string::npos ) || ( line[begin] == '#' ) )
+         continue;
+
+      size_t end = line.find_last_not_of( pSpace );
+      line = line.substr( begin, end - begin + 1 );
+
+      Job job;
+      job.fileName = line;
+      job.maxInstructions = defaultMaxInstructions;
+
+      // A trailing number is the limit, anything before it the file name
+      size_t split = line.find_last_of( pSpace );
+      if( split != std::string::npos )
+      {
+         std::string limit = line.substr( split + 1 );
+         char *pEnd;
+         uint64_t maxInstructions = strtoull( limit.c_str(), &pEnd, 0 );
+         if( *pEnd == '\0' )
+         {
+            job.fileName = line.substr( 0, line.find_last_not_of( pSpace, split ) + 1 );
+            job.maxInstructions = maxInstructions;
+         }
+      }
+
+      jobs.push_back( job );
+   }
+
+   return( true );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Select the execution engine of the Emulators. If the engine isn't supported
+on the host platform, the block engine is used instead.
+\param engine The execution engine
+*/
+/*----------------------------------------------------------------------------*/
+void BatchRunner::setEngine( RISCV::Engine engine )
+{
+   m_Engine = engine;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Select whether the Emulators bind the memory accesses of the CPU at compile
+time or through virtual calls, see Emulator::setDynamicBinding().
+\param dynamicBinding true for virtual calls
+*/
+/*----------------------------------------------------------------------------*/
+void BatchRunner::setDynamicBinding( bool dynamicBinding )
+{
+   m_DynamicBinding = dynamicBinding;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Select whether the Emulators carry out well-known routines of the programs on
+the host, see Emulator::setHostRoutines().
+\param mode The mode
+*/
+/*----------------------------------------------------------------------------*/
+void BatchRunner::setHostRoutines( HostRoutines::Mode mode )
+{
+   m_HostRoutines = mode;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Select the RAM of the Emulators, see Emulator::create().
+\param size The size of the RAM in bytes
+\param hugePages true to back the RAM by transparent huge pages of the host
+*/
+/*----------------------------------------------------------------------------*/
+void BatchRunner::setRAM( uint32_t size, bool hugePages )
+{
+   m_RAMSize = size;
+   m_HugePages = hugePages;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Share identical pages of the RAMs of all Emulators, see
+Emulator::deduplicate(). The jobs are interrupted for sharing the pages.
+\param interval The number of instructions between sharing the pages
+\return false if the host doesn't support sharing pages
+*/
+/*----------------------------------------------------------------------------*/
+bool BatchRunner::setDeduplication( uint64_t interval )
+{
+   if( !m_pDeduplicator )
+   {
+      m_pDeduplicator = PageDeduplicator::create();
+      if( !m_pDeduplicator )
+         return( false );
+   }
+
+   m_DeduplicationInterval = interval;
+
+   return( true );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\return The deduplicator shared by all Emulators, e.g. for the memory saved,
+or nullptr if pages aren't shared
+*/
+/*----------------------------------------------------------------------------*/
+const PageDeduplicator *BatchRunner::getDeduplicator() const
+{
+   return( m_pDeduplicator );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Run all jobs and write their results. The results appear in the order in
+which the jobs finish, every result contains the index of its job in the
+manifest.
+\param jobs The jobs
+\return The number of instructions executed by all jobs
+*/
+/*----------------------------------------------------------------------------*/
+uint64_t BatchRunner::run( const std::vector<Job> &jobs )
+{
+   m_pJobs = &jobs;
+   m_Instructions = 0;
+   for( size_t i = 0; i < jobs.size(); i++ )
+   {
+      m_Workers[i % m_Workers.size()]->jobs.push_back( i );
+   }
+
+   std::vector<std::thread> threads;
+   for( size_t i = 0; i < m_Workers.size(); i++ )
+   {
+      threads.push_back( std::thread( &BatchRunner::work, this, (int)i ) );
+   }
+
+   for( size_t i = 0; i < threads.size(); i++ )
+   {
+      threads[i].join();
+   }
+
+   m_pJobs = 0;
+
+   return( m_Instructions );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+The thread function of a worker: run jobs until there are none left.
+\param worker The index of the worker
+*/
+/*----------------------------------------------------------------------------*/
+void BatchRunner::work( int worker )
+{
+   size_t job;
+   while( takeJob( worker, &job ) )
+   {
+      std::string result = runJob( m_Workers[worker], job );
+
+      std::lock_guard<std::mutex> lock( m_OutputMutex );
+      fprintf( m_pOutput, "%s\n", result.c_str() );
+      fflush( m_pOutput );
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Take the next job of a worker from the front of its own queue. If the queue is
+empty, steal a job from the back of the queue of another worker, i.e. the one
+which the other worker would run last.
+\param worker The index of the worker
+\param pJob Receives the index of the job
+\return false if there are no jobs left
+*/
+/*----------------------------------------------------------------------------*/
+bool BatchRunner::takeJob( int worker, size_t *pJob )
+{
+   for( size_t i = 0; i < m_Workers.size(); i++ )
+   {
+      Worker *pWorker = m_Workers[( worker + i ) % m_Workers.size()];
+      std::lock_guard<std::mutex> lock( pWorker->mutex );
+      if( pWorker->jobs.empty() )
+         continue;
+
+      if( i == 0 )
+      {
+         *pJob = pWorker->jobs.front();
+         pWorker->jobs.pop_front();
+      } else
+      {
+         *pJob = pWorker->jobs.back();
+         pWorker->jobs.pop_back();
+      }
+
+      return( true );
+   }
+
+   return( false );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Run a job on the Emulator of a worker, creating the Emulator for the first
+job of the worker and reloading it for every following one. If the file is
+the same as in the previous job, the Emulator is reset to its baseline, which
+has been taken after loading the file, instead.
+\param pWorker The worker
+\param job The index of the job
+\return The result of the job as JSON
+*/
+/*----------------------------------------------------------------------------*/
+std::string BatchRunner::runJob( Worker *pWorker, size_t job )
+{
+   const Job &j = ( *m_pJobs )[job];
+   std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+   bool loaded;
+   bool reset = pWorker->pEmulator && ( j.fileName == pWorker->loadedFile );
+   if( !pWorker->pEmulator )
+   {
+      pWorker->pEmulator = Emulator::create( j.fileName, 1, m_RAMSize, m_HugePages );
+      loaded = pWorker->pEmulator != 0;
+      if( loaded )
+      {
+         if( !pWorker->pEmulator->setEngine( m_Engine ) )
+         {
+            pWorker->pEmulator->setEngine( RISCV::ENGINE_BLOCKS );
+         }
+         pWorker->pEmulator->setDynamicBinding( m_DynamicBinding );
+         pWorker->pEmulator->setHostRoutines( m_HostRoutines );
+         pWorker->pEmulator->captureOutput( &pWorker->output );
+      }
+   } else
+   if( reset )
+   {
+      loaded = pWorker->pEmulator->resetToBaseline();
+   } else
+   {
+      loaded = pWorker->pEmulator->load( j.fileName );
+   }
+
+   pWorker->loadedFile.clear();
+   if( !loaded )
+   {
+      return( stdformat( "{{\"job\":{},\"file\":{},\"reason\":\"load_error\"}}",
+         job, util::jsonString( j.fileName ) ) );
+   }
+
+   if( !reset )
+   {
+      pWorker->pEmulator->setBaseline();
+   }
+   pWorker->loadedFile = j.fileName;
+
+   pWorker->output.clear();
+   RISCV::RunResult result;
+   if( m_pDeduplicator && ( m_DeduplicationInterval > 0 ) )
+   {
+      result.reason = RISCV::STOP_BUDGET;
+      result.instructions = 0;
+      while( result.instructions < j.maxInstructions )
+      {
+         uint64_t remaining = j.maxInstructions - result.instructions;
+         RISCV::RunResult slice = pWorker->pEmulator->run( remaining < m_DeduplicationInterval ? remaining : m_DeduplicationInterval );
+         result.reason = slice.reason;
+         result.instructions += slice.instructions;
+         if( slice.reason != RISCV::STOP_BUDGET )
+            break;
+
+         pWorker->pEmulator->deduplicate( m_pDeduplicator );
+      }
+   } else
+   {
+      result = pWorker->pEmulator->run( j.maxInstructions );
+   }
+   double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - startTime ).count();
+   m_Instructions += result.instructions;
+
+   return( stdformat( "{{\"job\":{},\"file\":{},\"reason\":\"{}\",\"status\":{},\"instructions\":{},\"seconds\":{:.6f},\"mips\":{:.2f},\"resident\":{},\"shared\":{},\"output\":{}}}",
+      job, util::jsonString( j.fileName ), reasonName( result.reason ), pWorker->pEmulator->getExitStatus(), result.instructions,
+      seconds, seconds > 0 ? result.instructions / seconds / 1e6 : 0.0,
+      pWorker->pEmulator->getResidentRAM(), pWorker->pEmulator->getSharedRAM(), util::jsonString( pWorker->output ) ) );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\param reason The reason for a hart to stop
+\return The name of the reason as it appears in the results
+*/
+/*----------------------------------------------------------------------------*/
+const char *BatchRunner::reasonName( RISCV::StopReason reason )
+{
+   switch( reason )
+   {
+      case RISCV::STOP_BUDGET:
+         return( "limit" );
+      case RISCV::STOP_ILLEGAL_INSTRUCTION:
+         return( "illegal_instruction" );
+      case RISCV::STOP_BREAKPOINT:
+         return( "breakpoint" );
+      case RISCV::STOP_HALT:
+         return( "halt" );
+      case RISCV::STOP_DEADLINE:
+         return( "deadline" );
+      default:
+         return( "none" );
+   }
+}
@@ -0,0 +1,105 @@
+/*******************************************************************************
+ *  Copyright (c) 2024 Christian Nowak <chnowak@web.de>                        *
+ *   This file is part of chn's RISC-V-Emulator.                               *
+ *                                                                             *
+ *  RISC-V-Emulator is free software: you can redistribute it and/or modify it *
+ *  under the terms of the GNU General Public License as published by the Free *
+ *  Software Foundation, either version 3 of the License, or (at your option)  *
+ *  any later version.                                                         *
+ *                                                                             *          
+ *  RISC-V-Emulator is distributed in the hope that it will be useful, but     * 
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY *
+ *  or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License    *
+ *  for more details.                                                          *
+ *                                                                             *
+ *  You should have received a copy of the GNU General Public License along    *
+ *  with RISC-V-Emulator. If not, see <https://www.gnu.org/licenses/>.         *
+ *******************************************************************************/
+
+/*----------------------------------------------------------------------------*/
+/*!
+\file BatchRunner.h
+\author Christian Nowak <chnowak@web.de>
+\brief Headerfile for class BatchRunner.
+*/
+/*----------------------------------------------------------------------------*/
+#ifndef __BATCHRUNNER_H__
+#define __BATCHRUNNER_H__
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <stdio.h>
+
+#include "Emulator.h"
+#include "PageDeduplicator.h"
+
+/*----------------------------------------------------------------------------*/
+/*!
+\class BatchRunner
+\date  2026-10-16
+Runs many independent binary files, each with its own instruction limit, on a
+pool of host threads within one process. Every thread keeps one Emulator,
+which is reused for all jobs the thread runs. The jobs are distributed evenly
+over the threads at first; a thread which has run out of jobs steals them from
+the other threads. The result of every job is written as a line of JSON as
+soon as the job has finished. If a thread runs the same file as in its previous
+job, its Emulator is reset to the state after loading the file, which only
+restores the memory written to by the previous job. Optionally, the threads
+share identical pages of their RAMs at regular intervals.
+*/
+/*----------------------------------------------------------------------------*/
+class BatchRunner
+{
+   public:
+      struct Job
+      {
+         std::string fileName;
+         uint64_t maxInstructions;
+      };
+
+      BatchRunner( int numThreads, FILE *pOutput );
+      ~BatchRunner();
+
+      static bool readManifest( std::string fileName, uint64_t defaultMaxInstructions, std::vector<Job> &jobs );
+
+      void setEngine( RISCV::Engine engine );
+      void setDynamicBinding( bool dynamicBinding );
+      void setHostRoutines( HostRoutines::Mode mode );
+      void setRAM( uint32_t size, bool hugePages );
+      bool setDeduplication( uint64_t interval );
+      const PageDeduplicator *getDeduplicator() const;
+      uint64_t run( const std::vector<Job> &jobs );
+
+   private:
+      struct Worker
+      {
+         std::deque<size_t> jobs;
+         std::mutex mutex;
+         Emulator *pEmulator;
+         std::string loadedFile;
+         std::string output;
+      };
+
+      void work( int worker );
+      bool takeJob( int worker, size_t *pJob );
+      std::string runJob( Worker *pWorker, size_t job );
+      static const char *reasonName( RISCV::StopReason reason );
+
+      std::vector<Worker *> m_Workers;
+      FILE *m_pOutput;
+      std::mutex m_OutputMutex;
+      RISCV::Engine m_Engine;
+      bool m_DynamicBinding;
+      HostRoutines::Mode m_HostRoutines;
+      uint32_t m_RAMSize;
+      bool m_HugePages;
+      PageDeduplicator *m_pDeduplicator;
+      uint64_t m_DeduplicationInterval;
+      const std::vector<Job> *m_pJobs;
+      std::atomic<uint64_t> m_Instructions;
+};
+
+#endif
@@ -0,0 +1,565 @@
+/*******************************************************************************
+ *  Copyright (c) 2024 Christian Nowak <chnowak@web.de>                        *
+ *   This file is part of chn's RISC-V-Emulator.                               *
+ *                                                                             *
+ *  RISC-V-Emulator is free software: you can redistribute it and/or modify it *
+ *  under the terms of the GNU General Public License as published by the Free *
+ *  Software Foundation, either version 3 of the License, or (at your option)  *
+ *  any later version.                                                         *
+ *                                                                             *          
+ *  RISC-V-Emulator is distributed in the hope that it will be useful, but     * 
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY *
+ *  or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License    *
+ *  for more details.                                                          *
+ *                                                                             *
+ *  You should have received a copy of the GNU General Public License along    *
+ *  with RISC-V-Emulator. If not, see <https://www.gnu.org/licenses/>.         *
+ *******************************************************************************/
+
+/*----------------------------------------------------------------------------*/
+/*!
+\file BlockDevice.cpp
+\author Christian Nowak <chnowak@web.de>
+\brief This implements a disk modelled on virtio-blk
+*/
+/*----------------------------------------------------------------------------*/
+#include <string.h>
+#include <atomic>
+
+#if !defined( _WIN32 )
+#define BLOCKDEVICE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "BlockDevice.h"
+#include "Emulator.h"
+#include "util.h"
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Constructor for class BlockDevice. There is no disk until a file is attached.
+\param pEmulator The Emulator whose RAM holds the virtqueue and the buffers
+*/
+/*----------------------------------------------------------------------------*/
+BlockDevice::BlockDevice( Emulator *pEmulator ) :
+   m_pEmulator( pEmulator ),
+   m_File( -1 ),
+   m_pData( 0 ),
+   m_Size( 0 ),
+   m_ReadOnly( false )
+{
+   reset();
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Destructor for class BlockDevice
+*/
+/*----------------------------------------------------------------------------*/
+BlockDevice::~BlockDevice()
+{
+   detach();
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Use a host file as the disk. The file is mapped shared into the host memory,
+so the program writes to the file itself. If it can't be opened for writing,
+the disk is read-only. Only whole sectors of the file are used.
+\param fileName The file
+\return false if the file couldn't be mapped or is smaller than a sector
+*/
+/*----------------------------------------------------------------------------*/
+bool BlockDevice::attach( std::string fileName )
+{
+   detach();
+
+#ifdef BLOCKDEVICE_MMAP
+   bool readOnly = false;
+   int fd = open( fileName.c_str(), O_RDWR );
+   if( fd < 0 )
+   {
+      readOnly = true;
+      fd = open( fileName.c_str(), O_RDONLY );
+   }
+   if( fd < 0 )
+      return( false );
+
+   struct stat st;
+   if( ( fstat( fd, &st ) != 0 ) || !S_ISREG( st.st_mode ) || ( st.st_size < SECTOR_SIZE ) ||
+       ( (uint64_t)st.st_size > SIZE_MAX ) )
+   {
+      close( fd );
+      return( false );
+   }
+
+   uint64_t size = (uint64_t)st.st_size & ~(uint64_t)( SECTOR_SIZE - 1 );
+   void *p = mmap( 0, size, readOnly ? PROT_READ : PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+   if( p == MAP_FAILED )
+   {
+      close( fd );
+      return( false );
+   }
+
+   std::lock_guard<std::mutex> lock( m_Mutex );
+   m_File = fd;
+   m_pData = (uint8_t *)p;
+   m_Size = size;
+   m_ReadOnly = readOnly;
+   reset();
+
+   return( true );
+#else
+   return( false );
+#endif
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Remove the disk. The changes made by the program are written to the file.
+*/
+/*----------------------------------------------------------------------------*/
+void BlockDevice::detach()
+{
+   std::lock_guard<std::mutex> lock( m_Mutex );
+
+#ifdef BLOCKDEVICE_MMAP
+   if( m_pData )
+   {
+      munmap( m_pData, m_Size );
+      close( m_File );
+   }
+#endif
+
+   m_File = -1;
+   m_pData = 0;
+   m_Size = 0;
+   m_ReadOnly = false;
+   reset();
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\return The size of the disk in bytes, or 0 if there is no disk
+*/
+/*----------------------------------------------------------------------------*/
+uint64_t BlockDevice::getSize() const
+{
+   return( m_Size );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Reset the registers and the virtqueue, e.g. when the program writes 0 to
+STATUS.
+*/
+/*----------------------------------------------------------------------------*/
+void BlockDevice::reset()
+{
+   m_DeviceFeaturesSel = 0;
+   m_DriverFeaturesSel = 0;
+   m_QueueNum = 0;
+   m_QueueReady = 0;
+   m_InterruptStatus = 0;
+   m_Status = 0;
+   m_QueueDesc = 0;
+   m_QueueDriver = 0;
+   m_QueueDevice = 0;
+   m_LastAvail = 0;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Read a byte of a register. Drivers of virtio-mmio only read words.
+\param offset The address relative to the start of the device
+\return The value
+*/
+/*----------------------------------------------------------------------------*/
+uint8_t BlockDevice::readMem8( uint32_t offset )
+{
+   return( (uint8_t)( readMem32( offset & ~3 ) >> ( ( offset & 3 ) * 8 ) ) );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Read a register. The upper halves of the addresses of the virtqueue always
+read as 0, as are the registers which aren't implemented.
+\param offset The address relative to the start of the device
+\return The value
+*/
+/*----------------------------------------------------------------------------*/
+uint32_t BlockDevice::readMem32( uint32_t offset )
+{
+   std::lock_guard<std::mutex> lock( m_Mutex );
+
+   switch( offset )
+   {
+      case REG_MAGIC:
+         return( MAGIC );
+      case REG_VERSION:
+         return( 2 );
+      case REG_DEVICE_ID:
+         return( m_pData ? DEVICE_ID : 0 );
+      case REG_DEVICE_FEATURES:
+         if( m_DeviceFeaturesSel == 0 )
+            return( F_FLUSH | ( m_ReadOnly ? F_RO : 0 ) );
+         return( m_DeviceFeaturesSel == 1 ? F_VERSION_1 : 0 );
+      case REG_QUEUE_NUM_MAX:
+         return( QUEUE_NUM_MAX );
+      case REG_QUEUE_NUM:
+         return( m_QueueNum );
+      case REG_QUEUE_READY:
+         return( m_QueueReady );
+      case REG_INTERRUPT_STATUS:
+         return( m_InterruptStatus );
+      case REG_STATUS:
+         return( m_Status );
+      case REG_QUEUE_DESC:
+         return( m_QueueDesc );
+      case REG_QUEUE_DRIVER:
+         return( m_QueueDriver );
+      case REG_QUEUE_DEVICE:
+         return( m_QueueDevice );
+      case REG_CAPACITY:
+         return( (uint32_t)( m_Size / SECTOR_SIZE ) );
+      case REG_CAPACITY + 4:
+         return( (uint32_t)( ( m_Size / SECTOR_SIZE ) >> 32 ) );
+      default:
+         return( 0 );
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Byte writes to the registers are ignored.
+*/
+/*----------------------------------------------------------------------------*/
+void BlockDevice::writeMem8( uint32_t, uint8_t )
+{
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Write a register. Writing to QUEUE_NOTIFY processes all requests which the
+program has put into the available ring since the previous notification.
+\param offset The address relative to the start of the device
+\param d The value to write
+*/
+/*----------------------------------------------------------------------------*/
+void BlockDevice::writeMem32( uint32_t offset, uint32_t d )
+{
+   std::lock_guard<std::mutex> lock( m_Mutex );
+
+   switch( offset )
+   {
+      case REG_DEVICE_FEATURES_SEL:
+         m_DeviceFeaturesSel = d;
+         break;
+      case REG_DRIVER_FEATURES_SEL:
+         m_DriverFeaturesSel = d;
+         break;
+      case REG_QUEUE_NUM:
+         // The size of the queue has to be a power of 2
+         if( ( d > 0 ) && ( d <= QUEUE_NUM_MAX ) && !( d & ( d - 1 ) ) )
+            m_QueueNum = d;
+         break;
+      case REG_QUEUE_READY:
+         m_QueueReady = d & 1;
+         break;
+      case REG_QUEUE_NOTIFY:
+         processQueue();
+         break;
+      case REG_INTERRUPT_ACK:
+         m_InterruptStatus &= ~d;
+         break;
+      case REG_STATUS:
+         if( d == 0 )
+         {
+            reset();
+         } else
+         {
+            m_Status = d;
+         }
+         break;
+      case REG_QUEUE_DESC:
+         m_QueueDesc = d;
+         break;
+      case REG_QUEUE_DRIVER:
+         m_QueueDriver = d;
+         break;
+      case REG_QUEUE_DEVICE:
+         m_QueueDevice = d;
+         break;
+      default:
+         break;
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Process the new requests of the available ring and put them into the used
+ring. A request whose chain of descriptors is invalid is put into the used
+ring without being carried out.
+*/
+/*----------------------------------------------------------------------------*/
+void BlockDevice::processQueue()
+{
+   if( !m_pData || !m_QueueReady || ( m_QueueNum == 0 ) )
+      return;
+
+   const uint8_t *pAvail = m_pEmulator->getRAM( m_QueueDriver, 4 + 2 * m_QueueNum );
+   uint8_t *pUsed = m_pEmulator->touchRAM( m_QueueDevice, 4 + 8 * m_QueueNum );
+   if( !pAvail || !pUsed )
+      return;
+
+   // The requests have been written before the index of the available ring
+   uint16_t availIdx = util::loadLE16( pAvail + 2 );
+   std::atomic_thread_fence( std::memory_order_acquire );
+
+   uint16_t usedIdx = util::loadLE16( pUsed + 2 );
+   while( m_LastAvail != availIdx )
+   {
+      uint16_t head = util::loadLE16( pAvail + 4 + 2 * ( m_LastAvail & ( m_QueueNum - 1 ) ) );
+      m_LastAvail++;
+
+      // A chain is at most as long as the descriptor table
+      std::vector<Descriptor> chain;
+      Descriptor d;
+      d.flags = DESC_F_NEXT;
+      d.next = head;
+      while( ( d.flags & DESC_F_NEXT ) && ( chain.size() < m_QueueNum ) && readDescriptor( d.next, d ) )
+      {
+         chain.push_back( d );
+      }
+
+      uint32_t written = 0;
+      if( !chain.empty() && !( chain.back().flags & DESC_F_NEXT ) )
+      {
+         processRequest( chain, written );
+      }
+
+      uint8_t *pEntry = pUsed + 4 + 8 * ( usedIdx & ( m_QueueNum - 1 ) );
+      util::storeLE32( pEntry, head );
+      util::storeLE32( pEntry + 4, written );
+      usedIdx++;
+   }
+
+   // The program sees the used entries before their index
+   std::atomic_thread_fence( std::memory_order_release );
+   util::storeLE16( pUsed + 2, usedIdx );
+   m_InterruptStatus |= 1;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Read an entry of the descriptor table. Addresses above 4GB are invalid.
+\param index The index of the entry
+\param d Receives the entry
+\return false if the index or the descriptor table is invalid
+*/
+/*----------------------------------------------------------------------------*/
+bool BlockDevice::readDescriptor( uint32_t index, Descriptor &d ) const
+{
+   if( index >= m_QueueNum )
+      return( false );
+
+   const uint8_t *p = m_pEmulator->getRAM( m_QueueDesc + 16 * index, 16 );
+   if( !p || ( util::loadLE32( p + 4 ) != 0 ) )
+      return( false );
+
+   d.address = util::loadLE32( p );
+   d.length = util::loadLE32( p + 8 );
+   d.flags = util::loadLE16( p + 12 );
+   d.next = util::loadLE16( p + 14 );
+
+   return( true );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Carry out a request and write its status. A request consists of the header
+(type and sector), any number of data buffers and the status byte. As with
+stores of other harts, the harts see code read from the disk after executing
+fence.i.
+\param chain The descriptors of the request
+\param written Receives the number of bytes written to the RAM
+\return The status of the request
+*/
+/*----------------------------------------------------------------------------*/
+uint8_t BlockDevice::processRequest( const std::vector<Descriptor> &chain, uint32_t &written )
+{
+   const Descriptor &header = chain.front();
+   const Descriptor &status = chain.back();
+   uint8_t *pStatus = ( chain.size() >= 2 ) && ( status.flags & DESC_F_WRITE ) && ( status.length >= 1 ) ?
+      m_pEmulator->touchRAM( status.address + status.length - 1, 1 ) : 0;
+   const uint8_t *pHeader = header.length >= 16 ? m_pEmulator->getRAM( header.address, 16 ) : 0;
+   if( !pStatus )
+      return( S_IOERR );
+
+   uint8_t result = S_OK;
+   uint32_t type = pHeader ? util::loadLE32( pHeader ) : T_IN;
+   uint64_t position = pHeader ? ( util::loadLE32( pHeader + 8 ) | ( (uint64_t)util::loadLE32( pHeader + 12 ) << 32 ) ) : 0;
+   if( !pHeader )
+   {
+      result = S_IOERR;
+   } else
+   if( ( type == T_IN ) || ( type == T_OUT ) )
+   {
+      if( position >= m_Size / SECTOR_SIZE )
+      {
+         result = S_IOERR;
+      }
+      position *= SECTOR_SIZE;
+
+      // Copy every buffer directly between the mapping and the RAM
+      for( size_t i = 1; ( result == S_OK ) && ( i + 1 < chain.size() ); i++ )
+      {
+         const Descriptor &buffer = chain[i];
+         bool toRAM = ( buffer.flags & DESC_F_WRITE ) != 0;
+         if( ( toRAM != ( type == T_IN ) ) || ( buffer.length > m_Size - position ) ||
+             ( ( type == T_OUT ) && m_ReadOnly ) )
+         {
+            result = S_IOERR;
+            break;
+         }
+
+         if( toRAM )
+         {
+            uint8_t *p = m_pEmulator->touchRAM( buffer.address, buffer.length );
+            if( !p )
+            {
+               result = S_IOERR;
+               break;
+            }
+            memcpy( p, m_pData + position, buffer.length );
+            written += buffer.length;
+         } else
+         {
+            const uint8_t *p = m_pEmulator->getRAM( buffer.address, buffer.length );
+            if( !p )
+            {
+               result = S_IOERR;
+               break;
+            }
+            memcpy( m_pData + position, p, buffer.length );
+         }
+         position += buffer.length;
+      }
+   } else
+   if( type == T_FLUSH )
+   {
+#ifdef BLOCKDEVICE_MMAP
+      if( !m_ReadOnly && ( msync( m_pData, m_Size, MS_SYNC ) != 0 ) )
+      {
+         result = S_IOERR;
+      }
+#endif
+   } else
+   if( type == T_GET_ID )
+   {
+      static const char id[20] = "RISC-V-Emulator";
+      if( chain.size() >= 3 )
+      {
+         const Descriptor &buffer = chain[1];
+         uint32_t n = buffer.length < sizeof( id ) ? buffer.length : sizeof( id );
+         uint8_t *p = ( buffer.flags & DESC_F_WRITE ) ? m_pEmulator->touchRAM( buffer.address, n ) : 0;
+         if( p )
+         {
+            memcpy( p, id, n );
+            written += n;
+         } else
+         {
+            result = S_IOERR;
+         }
+      }
+   } else
+   {
+      result = S_UNSUPP;
+   }
+
+   *pStatus = result;
+   written++;
+
+   return( result );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Store the registers and the position in the available ring, e.g. in a
+snapshot. The contents of the disk aren't part of the state.
+\param state Receives the state
+*/
+/*----------------------------------------------------------------------------*/
+void BlockDevice::saveState( std::vector<uint8_t> &state )
+{
+   std::lock_guard<std::mutex> lock( m_Mutex );
+
+   const uint32_t registers[STATE_SIZE / 4] =
+   {
+      m_DeviceFeaturesSel, m_DriverFeaturesSel, m_QueueNum, m_QueueReady, m_InterruptStatus,
+      m_Status, m_QueueDesc, m_QueueDriver, m_QueueDevice, m_LastAvail
+   };
+
+   state.resize( STATE_SIZE );
+   for( uint32_t i = 0; i < STATE_SIZE / 4; i++ )
+   {
+      util::storeLE32( &state[i * 4], registers[i] );
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Restore the state stored by saveState(). An empty state, e.g. of a snapshot
+written before the device existed, resets the device.
+\param state The state
+\return false if the state is invalid
+*/
+/*----------------------------------------------------------------------------*/
+bool BlockDevice::restoreState( const std::vector<uint8_t> &state )
+{
+   std::lock_guard<std::mutex> lock( m_Mutex );
+
+   if( state.empty() )
+   {
+      reset();
+      return( true );
+   }
+
+   if( state.size() != STATE_SIZE )
+      return( false );
+
+   uint32_t queueNum = util::loadLE32( &state[8] );
+   if( ( queueNum > QUEUE_NUM_MAX ) || ( queueNum & ( queueNum - 1 ) ) )
+      return( false );
+
+   m_DeviceFeaturesSel = util::loadLE32( &state[0] );
+   m_DriverFeaturesSel = util::loadLE32( &state[4] );
+   m_QueueNum = queueNum;
+   m_QueueReady = util::loadLE32( &state[12] );
+   m_InterruptStatus = util::loadLE32( &state[16] );
+   m_Status = util::loadLE32( &state[20] );
+   m_QueueDesc = util::loadLE32( &state[24] );
+   m_QueueDriver = util::loadLE32( &state[28] );
+   m_QueueDevice = util::loadLE32( &state[32] );
+   m_LastAvail = (uint16_t)util::loadLE32( &state[36] );
+
+   return( true );
+}
@@ -0,0 +1,144 @@
+/*******************************************************************************
+ *  Copyright (c) 2024 Christian Nowak <chnowak@web.de>                        *
+ *   This file is part of chn's RISC-V-Emulator.                               *
+ *                                                                             *
+ *  RISC-V-Emulator is free software: you can redistribute it and/or modify it *
+ *  under the terms of the GNU General Public License as published by the Free *
+ *  Software Foundation, either version 3 of the License, or (at your option)  *
+ *  any later version.                                                         *
+ *                                                                             *          
+ *  RISC-V-Emulator is distributed in the hope that it will be useful, but     * 
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY *
+ *  or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License    *
+ *  for more details.                                                          *
+ *                                                                             *
+ *  You should have received a copy of the GNU General Public License along    *
+ *  with RISC-V-Emulator. If not, see <https://www.gnu.org/licenses/>.         *
+ *******************************************************************************/
+
+/*----------------------------------------------------------------------------*/
+/*!
+\file BlockDevice.h
+\author Christian Nowak <chnowak@web.de>
+\brief Headerfile for class BlockDevice.
+*/
+/*----------------------------------------------------------------------------*/
+#ifndef __BLOCKDEVICE_H__
+#define __BLOCKDEVICE_H__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <mutex>
+
+#include "MemoryBus.h"
+
+class Emulator;
+
+/*----------------------------------------------------------------------------*/
+/*!
+\class BlockDevice
+\date  2026-10-16
+A disk modelled on a virtio-blk device with the registers of virtio-mmio
+(version 2). The program puts requests into a single virtqueue, i.e. a
+descriptor table, an available ring and a used ring in the RAM, and notifies
+the device by writing to QUEUE_NOTIFY. The requests are then completed before
+the write returns: the data is copied directly between the RAM and a host
+file mapped into the host memory, the status byte of every request is written
+and the request is put into the used ring. There are no interrupts, instead
+bit 0 of INTERRUPT_STATUS is set, which is cleared by writing to
+INTERRUPT_ACK. Without a file, the device id is 0, i.e. there is no device.
+*/
+/*----------------------------------------------------------------------------*/
+class BlockDevice : public MemoryBus::Device
+{
+   public:
+      static const uint32_t REG_MAGIC = 0x000;
+      static const uint32_t REG_VERSION = 0x004;
+      static const uint32_t REG_DEVICE_ID = 0x008;
+      static const uint32_t REG_VENDOR_ID = 0x00c;
+      static const uint32_t REG_DEVICE_FEATURES = 0x010;
+      static const uint32_t REG_DEVICE_FEATURES_SEL = 0x014;
+      static const uint32_t REG_DRIVER_FEATURES = 0x020;
+      static const uint32_t REG_DRIVER_FEATURES_SEL = 0x024;
+      static const uint32_t REG_QUEUE_SEL = 0x030;
+      static const uint32_t REG_QUEUE_NUM_MAX = 0x034;
+      static const uint32_t REG_QUEUE_NUM = 0x038;
+      static const uint32_t REG_QUEUE_READY = 0x044;
+      static const uint32_t REG_QUEUE_NOTIFY = 0x050;
+      static const uint32_t REG_INTERRUPT_STATUS = 0x060;
+      static const uint32_t REG_INTERRUPT_ACK = 0x064;
+      static const uint32_t REG_STATUS = 0x070;
+      static const uint32_t REG_QUEUE_DESC = 0x080;
+      static const uint32_t REG_QUEUE_DRIVER = 0x090;
+      static const uint32_t REG_QUEUE_DEVICE = 0x0a0;
+      static const uint32_t REG_CAPACITY = 0x100;
+
+      static const uint32_t SECTOR_SIZE = 512;
+      static const uint32_t QUEUE_NUM_MAX = 256;
+
+      BlockDevice( Emulator *pEmulator );
+      virtual ~BlockDevice();
+
+      bool attach( std::string fileName );
+      void detach();
+      uint64_t getSize() const;
+
+      virtual uint8_t readMem8( uint32_t offset );
+      virtual uint32_t readMem32( uint32_t offset );
+      virtual void writeMem8( uint32_t offset, uint8_t d );
+      virtual void writeMem32( uint32_t offset, uint32_t d );
+
+      virtual void saveState( std::vector<uint8_t> &state );
+      virtual bool restoreState( const std::vector<uint8_t> &state );
+
+   private:
+      static const uint32_t MAGIC = 0x74726976; // "virt"
+      static const uint32_t DEVICE_ID = 2;
+      static const uint32_t F_RO = 1 << 5;
+      static const uint32_t F_FLUSH = 1 << 9;
+      static const uint32_t F_VERSION_1 = 1 << 0; // Bit 32, in the second word
+      static const uint16_t DESC_F_NEXT = 1;
+      static const uint16_t DESC_F_WRITE = 2;
+      static const uint32_t T_IN = 0;
+      static const uint32_t T_OUT = 1;
+      static const uint32_t T_FLUSH = 4;
+      static const uint32_t T_GET_ID = 8;
+      static const uint8_t S_OK = 0;
+      static const uint8_t S_IOERR = 1;
+      static const uint8_t S_UNSUPP = 2;
+      static const uint32_t STATE_SIZE = 10 * 4;
+
+      // A descriptor of the descriptor table
+      struct Descriptor
+      {
+         uint32_t address;
+         uint32_t length;
+         uint16_t flags;
+         uint16_t next;
+      };
+
+      void reset();
+      void processQueue();
+      bool readDescriptor( uint32_t index, Descriptor &d ) const;
+      uint8_t processRequest( const std::vector<Descriptor> &chain, uint32_t &written );
+
+      Emulator *m_pEmulator;
+      std::mutex m_Mutex;
+      int m_File;
+      uint8_t *m_pData;
+      uint64_t m_Size;
+      bool m_ReadOnly;
+      uint32_t m_DeviceFeaturesSel;
+      uint32_t m_DriverFeaturesSel;
+      uint32_t m_QueueNum;
+      uint32_t m_QueueReady;
+      uint32_t m_InterruptStatus;
+      uint32_t m_Status;
+      uint32_t m_QueueDesc;
+      uint32_t m_QueueDriver;
+      uint32_t m_QueueDevice;
+      uint16_t m_LastAvail;
+};
+
+#endif
@@ -0,0 +1,346 @@
+/*******************************************************************************
+ *  Copyright (c) 2024 Christian Nowak <chnowak@web.de>                        *
+ *   This file is part of chn's RISC-V-Emulator.                               *
+ *                                                                             *
+ *  RISC-V-Emulator is free software: you can redistribute it and/or modify it *
+ *  under the terms of the GNU General Public License as published by the Free *
+ *  Software Foundation, either version 3 of the License, or (at your option)  *
+ *  any later version.                                                         *
+ *                                                                             *          
+ *  RISC-V-Emulator is distributed in the hope that it will be useful, but     * 
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY *
+ *  or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License    *
+ *  for more details.                                                          *
+ *                                                                             *
+ *  You should have received a copy of the GNU General Public License along    *
+ *  with RISC-V-Emulator. If not, see <https://www.gnu.org/licenses/>.         *
+ *******************************************************************************/
+
+/*----------------------------------------------------------------------------*/
+/*!
+\file ConsoleDevice.cpp
+\author Christian Nowak <chnowak@web.de>
+\brief This implements the console device
+*/
+/*----------------------------------------------------------------------------*/
+#include <stdio.h>
+#include <string.h>
+
+#include "ConsoleDevice.h"
+#include "Emulator.h"
+#include "util.h"
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Constructor for class ConsoleDevice
+\param pEmulator The Emulator to be halted by a write to the halt register
+*/
+/*----------------------------------------------------------------------------*/
+ConsoleDevice::ConsoleDevice( Emulator *pEmulator ) :
+   m_pEmulator( pEmulator ),
+   m_pCapture( 0 ),
+   m_Address( 0 )
+{
+   m_Buffer.reserve( BUFFER_SIZE );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Destructor for class ConsoleDevice
+*/
+/*----------------------------------------------------------------------------*/
+ConsoleDevice::~ConsoleDevice()
+{
+   flush();
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+The registers of the console are write-only.
+\return Always 0xff
+*/
+/*----------------------------------------------------------------------------*/
+uint8_t ConsoleDevice::readMem8( uint32_t )
+{
+   return( 0xff );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Write to a register of the console.
+\param offset The address relative to the start of the device
+\param d The value to write
+*/
+/*----------------------------------------------------------------------------*/
+void ConsoleDevice::writeMem8( uint32_t offset, uint8_t d )
+{
+   if( offset == REG_DATA )
+   {
+      char c = (char)d;
+      output( &c, 1 );
+   } else
+   if( offset == REG_HALT )
+   {
+      m_pEmulator->halt();
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Write a half-word to a register of the console. A write to DATA outputs the
+lowest byte instead of being split into two bytes.
+\param offset The address relative to the start of the device
+\param d The value to write
+*/
+/*----------------------------------------------------------------------------*/
+void ConsoleDevice::writeMem16( uint32_t offset, uint16_t d )
+{
+   writeMem8( offset, d & 0xff );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Write a word to a register of the console. A write to WRITE outputs the given
+number of bytes from the buffer at ADDRESS, see writeBuffer().
+\param offset The address relative to the start of the device
+\param d The value to write
+*/
+/*----------------------------------------------------------------------------*/
+void ConsoleDevice::writeMem32( uint32_t offset, uint32_t d )
+{
+   if( offset == REG_ADDRESS )
+   {
+      m_Address = d;
+   } else
+   if( offset == REG_WRITE )
+   {
+      writeBuffer( m_Address, d );
+   } else
+   {
+      writeMem8( offset, d & 0xff );
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Output a buffer of the guest program page by page. Pages within the RAM are
+output directly from there, and a buffer running past the end of the RAM is
+cut off there. A buffer outside of the RAM, e.g. in a file window, is read
+through the memory bus, up to MAX_BUS_WRITE bytes.
+\param address The address of the buffer
+\param size The size of the buffer in bytes
+*/
+/*----------------------------------------------------------------------------*/
+void ConsoleDevice::writeBuffer( uint32_t address, uint32_t size )
+{
+   bool inRAM = m_pEmulator->getRAM( address, 1 ) != 0;
+   if( !inRAM && ( size > MAX_BUS_WRITE ) )
+   {
+      size = MAX_BUS_WRITE;
+   }
+
+   while( size > 0 )
+   {
+      uint32_t n = MemoryBus::PAGE_SIZE - ( address & ( MemoryBus::PAGE_SIZE - 1 ) );
+      if( n > size )
+         n = size;
+
+      const uint8_t *pData = m_pEmulator->getRAM( address, n );
+      if( pData )
+      {
+         output( (const char *)pData, n );
+      } else
+      {
+         if( inRAM )
+            break;
+
+         char page[MemoryBus::PAGE_SIZE];
+         for( uint32_t i = 0; i < n; i++ )
+         {
+            page[i] = (char)m_pEmulator->readMem8( address + i );
+         }
+         output( page, n );
+      }
+
+      address += n;
+      size -= n;
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Store the address of the buffer in a snapshot. The output is flushed when the
+emulation stops, so there is nothing else to store.
+\param state Receives the state
+*/
+/*----------------------------------------------------------------------------*/
+void ConsoleDevice::saveState( std::vector<uint8_t> &state )
+{
+   state.resize( 4 );
+   util::storeLE32( &state[0], m_Address );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Restore the address of the buffer from a snapshot. Snapshots written before
+the console had any state contain an empty state.
+\param state The state written by saveState()
+\return false if the state is invalid
+*/
+/*----------------------------------------------------------------------------*/
+bool ConsoleDevice::restoreState( const std::vector<uint8_t> &state )
+{
+   if( state.empty() )
+   {
+      m_Address = 0;
+      return( true );
+   }
+
+   if( state.size() != 4 )
+      return( false );
+
+   m_Address = util::loadLE32( &state[0] );
+
+   return( true );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Output a text, e.g. a message of the Emulator, along with the output of the
+guest program.
+\param text The text
+*/
+/*----------------------------------------------------------------------------*/
+void ConsoleDevice::write( const std::string &text )
+{
+   output( text.data(), text.size() );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Output data of the guest program, e.g. written to stdout by a system call.
+\param pData The data
+\param size The number of bytes
+*/
+/*----------------------------------------------------------------------------*/
+void ConsoleDevice::write( const char *pData, size_t size )
+{
+   output( pData, size );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Output data written to stderr by the guest program. It isn't buffered, but the
+buffered output is written first, so both appear in the order of writing. When
+capturing, it is appended to the captured output.
+\param pData The data
+\param size The number of bytes
+*/
+/*----------------------------------------------------------------------------*/
+void ConsoleDevice::writeError( const char *pData, size_t size )
+{
+   std::lock_guard<std::mutex> lock( m_Mutex );
+
+   if( m_pCapture )
+   {
+      m_pCapture->append( pData, size );
+      return;
+   }
+
+   flushBuffer();
+   fflush( stdout );
+   fwrite( pData, 1, size, stderr );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Append output to the capture string or to the buffer. The buffer is written to
+stdout as soon as it contains a newline or is full. The harts may output
+concurrently.
+\param pData The output
+\param size The number of bytes
+*/
+/*----------------------------------------------------------------------------*/
+void ConsoleDevice::output( const char *pData, size_t size )
+{
+   std::lock_guard<std::mutex> lock( m_Mutex );
+
+   if( m_pCapture )
+   {
+      m_pCapture->append( pData, size );
+      return;
+   }
+
+   if( m_Buffer.size() + size > BUFFER_SIZE )
+   {
+      flushBuffer();
+   }
+
+   if( size >= BUFFER_SIZE )
+   {
+      fwrite( pData, 1, size, stdout );
+   } else
+   {
+      m_Buffer.append( pData, size );
+   }
+
+   if( memchr( pData, '\n', size ) )
+   {
+      flushBuffer();
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Write the buffered output to stdout, e.g. when the emulation stops.
+*/
+/*----------------------------------------------------------------------------*/
+void ConsoleDevice::flush()
+{
+   std::lock_guard<std::mutex> lock( m_Mutex );
+   flushBuffer();
+   fflush( stdout );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Write the buffer to stdout. The caller has to hold the lock.
+*/
+/*----------------------------------------------------------------------------*/
+void ConsoleDevice::flushBuffer()
+{
+   if( !m_Buffer.empty() )
+   {
+      fwrite( m_Buffer.data(), 1, m_Buffer.size(), stdout );
+      m_Buffer.clear();
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Collect the output in a string instead of writing it to stdout. The harts may
+write to the console concurrently, so the string must not be accessed while
+the Emulator is running.
+\param pCapture The string to append the output to, or nullptr for stdout
+*/
+/*----------------------------------------------------------------------------*/
+void ConsoleDevice::setCapture( std::string *pCapture )
+{
+   m_pCapture = pCapture;
+}
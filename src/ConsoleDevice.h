@@ -0,0 +1,94 @@
+/*******************************************************************************
+ *  Copyright (c) 2024 Christian Nowak <chnowak@web.de>                        *
+ *   This file is part of chn's RISC-V-Emulator.                               *
+ *                                                                             *
+ *  RISC-V-Emulator is free software: you can redistribute it and/or modify it *
+ *  under the terms of the GNU General Public License as published by the Free *
+ *  Software Foundation, either version 3 of the License, or (at your option)  *
+ *  any later version.                                                         *
+ *                                                                             *          
+ *  RISC-V-Emulator is distributed in the hope that it will be useful, but     * 
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY *
+ *  or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License    *
+ *  for more details.                                                          *
+ *                                                                             *
+ *  You should have received a copy of the GNU General Public License along    *
+ *  with RISC-V-Emulator. If not, see <https://www.gnu.org/licenses/>.         *
+ *******************************************************************************/
+
+/*----------------------------------------------------------------------------*/
+/*!
+\file ConsoleDevice.h
+\author Christian Nowak <chnowak@web.de>
+\brief Headerfile for class ConsoleDevice.
+*/
+/*----------------------------------------------------------------------------*/
+#ifndef __CONSOLEDEVICE_H__
+#define __CONSOLEDEVICE_H__
+
+#include <string>
+#include <mutex>
+
+#include "MemoryBus.h"
+
+class Emulator;
+
+/*----------------------------------------------------------------------------*/
+/*!
+\class ConsoleDevice
+\date  2026-10-16
+The console of the Emulator, which lets a guest program run without an
+operating system. It has four write-only registers:
+ - DATA (offset 0x0): the lowest byte of a value written to it is output
+ - HALT (offset 0x4): any write to it halts the Emulator, i.e. all of its harts
+ - ADDRESS (offset 0x8): the address of a buffer in the RAM
+ - WRITE (offset 0xc): writing a length to it outputs that many bytes from the
+   buffer at ADDRESS, so a whole string is output by a single store
+ADDRESS and WRITE only accept words. A buffer outside of the RAM is output
+up to MAX_BUS_WRITE bytes. The output is collected in a buffer,
+which is written to stdout when a line is complete, when it is full and when
+the emulation stops. Instead of stdout, the output can be collected in a
+string.
+*/
+/*----------------------------------------------------------------------------*/
+class ConsoleDevice : public MemoryBus::Device
+{
+   public:
+      static const uint32_t REG_DATA = 0x0;
+      static const uint32_t REG_HALT = 0x4;
+      static const uint32_t REG_ADDRESS = 0x8;
+      static const uint32_t REG_WRITE = 0xc;
+
+      ConsoleDevice( Emulator *pEmulator );
+      virtual ~ConsoleDevice();
+
+      virtual uint8_t readMem8( uint32_t offset );
+      virtual void writeMem8( uint32_t offset, uint8_t d );
+      virtual void writeMem16( uint32_t offset, uint16_t d );
+      virtual void writeMem32( uint32_t offset, uint32_t d );
+
+      virtual void saveState( std::vector<uint8_t> &state );
+      virtual bool restoreState( const std::vector<uint8_t> &state );
+
+      void write( const std::string &text );
+      void write( const char *pData, size_t size );
+      void writeError( const char *pData, size_t size );
+      void flush();
+      void setCapture( std::string *pCapture );
+
+   private:
+      static const size_t BUFFER_SIZE = 4096;
+      static const uint32_t MAX_BUS_WRITE = 0x100000;
+
+      void writeBuffer( uint32_t address, uint32_t size );
+      void output( const char *pData, size_t size );
+      void flushBuffer();
+
+      Emulator *m_pEmulator;
+      std::string *m_pCapture;
+      std::mutex m_Mutex;
+      std::string m_Buffer;
+      uint32_t m_Address;
+};
+
+#endif
@@ -0,0 +1,245 @@
+/*******************************************************************************
+ *  Copyright (c) 2024 Christian Nowak <chnowak@web.de>                        *
+ *   This file is part of chn's RISC-V-Emulator.                               *
+ *                                                                             *
+ *  RISC-V-Emulator is free software: you can redistribute it and/or modify it *
+ *  under the terms of the GNU General Public License as published by the Free *
+ *  Software Foundation, either version 3 of the License, or (at your option)  *
+ *  any later version.                                                         *
+ *                                                                             *          
+ *  RISC-V-Emulator is distributed in the hope that it will be useful, but     * 
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY *
+ *  or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License    *
+ *  for more details.                                                          *
+ *                                                                             *
+ *  You should have received a copy of the GNU General Public License along    *
+ *  with RISC-V-Emulator. If not, see <https://www.gnu.org/licenses/>.         *
+ *******************************************************************************/
+
+/*----------------------------------------------------------------------------*/
+/*!
+\file DMADevice.cpp
+\author Christian Nowak <chnowak@web.de>
+\brief This implements a DMA engine copying and filling the RAM
+*/
+/*----------------------------------------------------------------------------*/
+#include <string.h>
+
+#include "DMADevice.h"
+#include "Emulator.h"
+#include "util.h"
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Constructor for class DMADevice
+\param pEmulator The Emulator whose RAM is transferred
+*/
+/*----------------------------------------------------------------------------*/
+DMADevice::DMADevice( Emulator *pEmulator ) :
+   m_pEmulator( pEmulator )
+{
+   reset();
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Destructor for class DMADevice
+*/
+/*----------------------------------------------------------------------------*/
+DMADevice::~DMADevice()
+{
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Clear all registers.
+*/
+/*----------------------------------------------------------------------------*/
+void DMADevice::reset()
+{
+   m_Source = 0;
+   m_Destination = 0;
+   m_Length = 0;
+   m_Fill = 0;
+   m_Status = STATUS_IDLE;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Read a byte of a register.
+\param offset The address relative to the start of the device
+\return The value
+*/
+/*----------------------------------------------------------------------------*/
+uint8_t DMADevice::readMem8( uint32_t offset )
+{
+   return( (uint8_t)( readMem32( offset & ~3 ) >> ( ( offset & 3 ) * 8 ) ) );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Read a register. CONTROL reads as 0, as a transfer is always complete.
+\param offset The address relative to the start of the device
+\return The value
+*/
+/*----------------------------------------------------------------------------*/
+uint32_t DMADevice::readMem32( uint32_t offset )
+{
+   std::lock_guard<std::mutex> lock( m_Mutex );
+
+   switch( offset )
+   {
+      case REG_SOURCE:
+         return( m_Source );
+      case REG_DESTINATION:
+         return( m_Destination );
+      case REG_LENGTH:
+         return( m_Length );
+      case REG_FILL:
+         return( m_Fill );
+      case REG_STATUS:
+         return( m_Status );
+      default:
+         return( 0 );
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Byte writes to the registers are ignored.
+*/
+/*----------------------------------------------------------------------------*/
+void DMADevice::writeMem8( uint32_t, uint8_t )
+{
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Write a register. Writing COPY or FILL to CONTROL carries out the transfer,
+other values are ignored.
+\param offset The address relative to the start of the device
+\param d The value to write
+*/
+/*----------------------------------------------------------------------------*/
+void DMADevice::writeMem32( uint32_t offset, uint32_t d )
+{
+   std::lock_guard<std::mutex> lock( m_Mutex );
+
+   switch( offset )
+   {
+      case REG_SOURCE:
+         m_Source = d;
+         break;
+      case REG_DESTINATION:
+         m_Destination = d;
+         break;
+      case REG_LENGTH:
+         m_Length = d;
+         break;
+      case REG_FILL:
+         m_Fill = d;
+         break;
+      case REG_CONTROL:
+         if( ( d == CONTROL_COPY ) || ( d == CONTROL_FILL ) )
+            m_Status = transfer( d );
+         break;
+      default:
+         break;
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Copy LENGTH bytes from SOURCE to DESTINATION or fill them with the FILL byte.
+The pages of the destination are prepared for being written first, so the
+transfer is part of the dirty pages and the baseline like any store.
+\param control COPY or FILL
+\return The new status
+*/
+/*----------------------------------------------------------------------------*/
+uint32_t DMADevice::transfer( uint32_t control )
+{
+   const uint8_t *pSource = 0;
+   if( control == CONTROL_COPY )
+   {
+      pSource = m_pEmulator->getRAM( m_Source, m_Length );
+      if( !pSource )
+         return( STATUS_ERROR );
+   }
+
+   uint8_t *pDestination = m_pEmulator->touchRAM( m_Destination, m_Length );
+   if( !pDestination )
+      return( STATUS_ERROR );
+
+   if( pSource )
+   {
+      memmove( pDestination, pSource, m_Length );
+   } else
+   {
+      memset( pDestination, (int)( m_Fill & 0xff ), m_Length );
+   }
+   m_pEmulator->invalidateWritten( m_Destination, m_Length );
+
+   return( STATUS_DONE );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Store the registers in a snapshot.
+\param state Receives the state
+*/
+/*----------------------------------------------------------------------------*/
+void DMADevice::saveState( std::vector<uint8_t> &state )
+{
+   std::lock_guard<std::mutex> lock( m_Mutex );
+
+   const uint32_t registers[STATE_SIZE / 4] =
+   {
+      m_Source, m_Destination, m_Length, m_Fill, m_Status
+   };
+
+   state.resize( STATE_SIZE );
+   for( uint32_t i = 0; i < STATE_SIZE / 4; i++ )
+   {
+      util::storeLE32( &state[i * 4], registers[i] );
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Restore the registers from a snapshot. An empty state resets them.
+\param state The state written by saveState()
+\return false if the state is invalid
+*/
+/*----------------------------------------------------------------------------*/
+bool DMADevice::restoreState( const std::vector<uint8_t> &state )
+{
+   std::lock_guard<std::mutex> lock( m_Mutex );
+
+   if( state.empty() )
+   {
+      reset();
+      return( true );
+   }
+
+   if( state.size() != STATE_SIZE )
+      return( false );
+
+   m_Source = util::loadLE32( &state[0] );
+   m_Destination = util::loadLE32( &state[4] );
+   m_Length = util::loadLE32( &state[8] );
+   m_Fill = util::loadLE32( &state[12] );
+   m_Status = util::loadLE32( &state[16] );
+
+   return( true );
+}
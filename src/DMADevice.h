@@ -0,0 +1,100 @@
+/*******************************************************************************
+ *  Copyright (c) 2024 Christian Nowak <chnowak@web.de>                        *
+ *   This file is part of chn's RISC-V-Emulator.                               *
+ *                                                                             *
+ *  RISC-V-Emulator is free software: you can redistribute it and/or modify it *
+ *  under the terms of the GNU General Public License as published by the Free *
+ *  Software Foundation, either version 3 of the License, or (at your option)  *
+ *  any later version.                                                         *
+ *                                                                             *          
+ *  RISC-V-Emulator is distributed in the hope that it will be useful, but     * 
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY *
+ *  or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License    *
+ *  for more details.                                                          *
+ *                                                                             *
+ *  You should have received a copy of the GNU General Public License along    *
+ *  with RISC-V-Emulator. If not, see <https://www.gnu.org/licenses/>.         *
+ *******************************************************************************/
+
+/*----------------------------------------------------------------------------*/
+/*!
+\file DMADevice.h
+\author Christian Nowak <chnowak@web.de>
+\brief Headerfile for class DMADevice.
+*/
+/*----------------------------------------------------------------------------*/
+#ifndef __DMADEVICE_H__
+#define __DMADEVICE_H__
+
+#include <cstdint>
+#include <vector>
+#include <mutex>
+
+#include "MemoryBus.h"
+
+class Emulator;
+
+/*----------------------------------------------------------------------------*/
+/*!
+\class DMADevice
+\date  2026-10-16
+A DMA engine, which copies or fills a range of the RAM on behalf of the guest
+program. It has six word registers:
+ - SOURCE (offset 0x00): the address to copy from
+ - DESTINATION (offset 0x04): the address to copy to or to fill
+ - LENGTH (offset 0x08): the number of bytes
+ - FILL (offset 0x0c): the lowest byte is the value to fill with
+ - CONTROL (offset 0x10): writing COPY or FILL starts the transfer
+ - STATUS (offset 0x14): IDLE before the first transfer, DONE or ERROR after
+   the last one
+The transfer is completed before the write to CONTROL returns, by memmove()
+or memset() of the host directly in the RAM. Source and destination may
+overlap. If a range isn't completely within the RAM, nothing is transferred
+and STATUS becomes ERROR. The destination is written like by stores of the
+hart which has started the transfer, so it sees any code written immediately.
+*/
+/*----------------------------------------------------------------------------*/
+class DMADevice : public MemoryBus::Device
+{
+   public:
+      static const uint32_t REG_SOURCE = 0x00;
+      static const uint32_t REG_DESTINATION = 0x04;
+      static const uint32_t REG_LENGTH = 0x08;
+      static const uint32_t REG_FILL = 0x0c;
+      static const uint32_t REG_CONTROL = 0x10;
+      static const uint32_t REG_STATUS = 0x14;
+
+      static const uint32_t CONTROL_COPY = 1;
+      static const uint32_t CONTROL_FILL = 2;
+
+      static const uint32_t STATUS_IDLE = 0;
+      static const uint32_t STATUS_DONE = 1;
+      static const uint32_t STATUS_ERROR = 2;
+
+      DMADevice( Emulator *pEmulator );
+      virtual ~DMADevice();
+
+      virtual uint8_t readMem8( uint32_t offset );
+      virtual uint32_t readMem32( uint32_t offset );
+      virtual void writeMem8( uint32_t offset, uint8_t d );
+      virtual void writeMem32( uint32_t offset, uint32_t d );
+
+      virtual void saveState( std::vector<uint8_t> &state );
+      virtual bool restoreState( const std::vector<uint8_t> &state );
+
+   private:
+      static const uint32_t STATE_SIZE = 5 * 4;
+
+      void reset();
+      uint32_t transfer( uint32_t control );
+
+      Emulator *m_pEmulator;
+      std::mutex m_Mutex;
+      uint32_t m_Source;
+      uint32_t m_Destination;
+      uint32_t m_Length;
+      uint32_t m_Fill;
+      uint32_t m_Status;
+};
+
+#endif
@@ -0,0 +1,264 @@
+/*******************************************************************************
+ *  Copyright (c) 2024 Christian Nowak <chnowak@web.de>                        *
+ *   This file is part of chn's RISC-V-Emulator.                               *
+ *                                                                             *
+ *  RISC-V-Emulator is free software: you can redistribute it and/or modify it *
+ *  under the terms of the GNU General Public License as published by the Free *
+ *  Software Foundation, either version 3 of the License, or (at your option)  *
+ *  any later version.                                                         *
+ *                                                                             *          
+ *  RISC-V-Emulator is distributed in the hope that it will be useful, but     * 
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY *
+ *  or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License    *
+ *  for more details.                                                          *
+ *                                                                             *
+ *  You should have received a copy of the GNU General Public License along    *
+ *  with RISC-V-Emulator. If not, see <https://www.gnu.org/licenses/>.         *
+ *******************************************************************************/
+
+
+/*----------------------------------------------------------------------------*/
+/*!
+\file Disassembler.cpp
+\author Christian Nowak <chnowak@web.de>
+\brief This implements the disassembly of RISC-V instructions
+*/
+/*----------------------------------------------------------------------------*/
+#include <stdio.h>
+
+#include "Disassembler.h"
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Disassemble a machine code instruction.
+\param address Memory address of the instruction
+\param instr The full binary instruction code
+\param instruction Receives the disassembly
+*/
+/*----------------------------------------------------------------------------*/
+void Disassembler::disassemble( uint32_t address, uint32_t instr, RISCV::Instruction &instruction )
+{
+   RISCV::DecodedInstruction d;
+   RISCV::decode( address, instr, d );
+   disassemble( d, instr, instruction );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Disassemble an instruction which has already been decoded. Illegal
+instructions result in an empty disassembly.
+\param d The decoded instruction
+\param instr The full binary instruction code
+\param instruction Receives the disassembly
+*/
+/*----------------------------------------------------------------------------*/
+void Disassembler::disassemble( const RISCV::DecodedInstruction &d, uint32_t instr, RISCV::Instruction &instruction )
+{
+   std::string rd = RISCV::registerName( d.rd );
+   std::string rs1 = RISCV::registerName( d.rs1 );
+   std::string rs2 = RISCV::registerName( d.rs2 );
+   util::strvec parameters;
+   std::string comment;
+   std::string suffix;
+
+   switch( d.op )
+   {
+      case RISCV::OP_LB:
+      case RISCV::OP_LH:
+      case RISCV::OP_LW:
+      case RISCV::OP_LBU:
+      case RISCV::OP_LHU:
+         parameters = util::strvec { rd, stdformat( "{}({})", d.imm, rs1 ) };
+         break;
+
+      case RISCV::OP_ADDI:
+      case RISCV::OP_SLTI:
+      case RISCV::OP_SLLI:
+      case RISCV::OP_SRLI:
+      case RISCV::OP_SRAI:
+         parameters = util::strvec { rd, rs1, stdformat( "{}", d.imm ) };
+         break;
+
+      case RISCV::OP_SLTIU:
+      case RISCV::OP_XORI:
+      case RISCV::OP_ORI:
+      case RISCV::OP_ANDI:
+         parameters = util::strvec { rd, rs1, stdformat( "{}", (uint32_t)d.imm ) };
+         break;
+
+      case RISCV::OP_AUIPC:
+      case RISCV::OP_LUI:
+         parameters = util::strvec { rd, stdformat( "0x{:x}", d.imm >> 12 ) };
+         break;
+
+      case RISCV::OP_SB:
+      case RISCV::OP_SH:
+      case RISCV::OP_SW:
+         parameters = util::strvec { rs2, stdformat( "{}({})", d.imm, rs1 ) };
+         break;
+
+      case RISCV::OP_LR_W:
+         parameters = util::strvec { rd, stdformat( "({})", rs1 ) };
+         suffix = orderSuffix( d.imm );
+         break;
+
+      case RISCV::OP_AMOADD_W:
+      case RISCV::OP_AMOSWAP_W:
+      case RISCV::OP_SC_W:
+      case RISCV::OP_AMOXOR_W:
+      case RISCV::OP_AMOOR_W:
+      case RISCV::OP_AMOAND_W:
+      case RISCV::OP_AMOMIN_W:
+      case RISCV::OP_AMOMAX_W:
+      case RISCV::OP_AMOMINU_W:
+      case RISCV::OP_AMOMAXU_W:
+         parameters = util::strvec { rd, rs2, stdformat( "({})", rs1 ) };
+         suffix = orderSuffix( d.imm );
+         break;
+
+      case RISCV::OP_FENCE:
+         parameters = util::strvec { fenceSet( d.imm >> 4 ), fenceSet( d.imm ) };
+         break;
+
+      case RISCV::OP_BEQ:
+      case RISCV::OP_BNE:
+      case RISCV::OP_BLT:
+      case RISCV::OP_BGE:
+      case RISCV::OP_BLTU:
+      case RISCV::OP_BGEU:
+         parameters = util::strvec { rs1, rs2, stdformat( "{}", d.imm ) };
+         comment = stdformat( "{:x}", d.address + d.imm );
+         break;
+
+      case RISCV::OP_JALR:
+         parameters = util::strvec { rd, stdformat( "{}({})", d.imm, rs1 ) };
+         if( ( d.rd == 0 ) && ( d.imm == 0 ) && ( d.rs1 == 1 ) )
+         {
+            comment = "ret";
+         }
+         break;
+
+      case RISCV::OP_JAL:
+         parameters = util::strvec { rd, stdformat( "{}", d.imm ) };
+         comment = stdformat( "{:8x}", d.address + d.imm );
+         break;
+
+      case RISCV::OP_FENCE_I:
+      case RISCV::OP_ECALL:
+      case RISCV::OP_EBREAK:
+      case RISCV::OP_HOST_ROUTINE:
+      case RISCV::OP_ILLEGAL:
+      case RISCV::OP_EXIT:
+         break;
+
+      default: // The register-register operations
+         parameters = util::strvec { rd, rs1, rs2 };
+         break;
+   }
+
+   instruction.set( d.address, instr, mnemonic( d.op ) + suffix, parameters, comment );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Print a disassembled instruction together with its address as one line of a
+trace to stdout.
+\param instruction The disassembled instruction
+*/
+/*----------------------------------------------------------------------------*/
+void Disassembler::print( const RISCV::Instruction &instruction )
+{
+   std::string disass = instruction.toString();
+   if( disass.size() > 1 )
+   {
+      printf( "%08x\t%s\n", instruction.getAddress(), disass.c_str() );
+   } else
+   {
+      printf( "%08x\n", instruction.getAddress() );
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\param op An operation
+\return The assembler mnemonic of the operation or an empty string for an
+illegal instruction
+*/
+/*----------------------------------------------------------------------------*/
+const char *Disassembler::mnemonic( uint8_t op )
+{
+   // Must be in the same order as enum Operation
+   static const char *const mnemonics[] =
+   {
+      "",
+      "lb", "lh", "lw", "lbu", "lhu",
+      "addi", "slli", "slti", "sltiu", "xori", "srli", "srai", "ori", "andi",
+      "auipc",
+      "sb", "sh", "sw",
+      "amoadd.w", "amoswap.w", "lr.w", "sc.w", "amoxor.w", "amoor.w",
+      "amoand.w", "amomin.w", "amomax.w", "amominu.w", "amomaxu.w",
+      "add", "mul", "sub", "sll", "mulh", "slt", "mulhsu", "sltu", "mulhu",
+      "xor", "div", "srl", "divu", "sra", "or", "rem", "and", "remu",
+      "lui",
+      "fence",
+      "beq", "bne", "blt", "bge", "bltu", "bgeu",
+      "jalr",
+      "jal",
+      "fence.i",
+      "ecall",
+      "ebreak",
+      "",
+      ""
+   };
+   static_assert( sizeof( mnemonics ) / sizeof( mnemonics[0] ) == RISCV::OP_EXIT + 1, "Mnemonic table doesn't match enum Operation" );
+
+   return( mnemonics[op] );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\param aqrl The aq and rl flags of an atomic instruction
+\return The suffix of the mnemonic for the flags, e.g. ".aqrl"
+*/
+/*----------------------------------------------------------------------------*/
+std::string Disassembler::orderSuffix( int32_t aqrl )
+{
+   std::string suffix;
+   if( aqrl & ( RISCV::AQ | RISCV::RL ) )
+   {
+      suffix = ".";
+      if( aqrl & RISCV::AQ )
+         suffix += "aq";
+      if( aqrl & RISCV::RL )
+         suffix += "rl";
+   }
+
+   return( suffix );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\param bits The predecessor or successor set of a FENCE in the lower 4 bits
+\return The set as an operand, e.g. "rw"
+*/
+/*----------------------------------------------------------------------------*/
+std::string Disassembler::fenceSet( int32_t bits )
+{
+   std::string set;
+   if( bits & RISCV::FENCE_SI )
+      set += "i";
+   if( bits & RISCV::FENCE_SO )
+      set += "o";
+   if( bits & RISCV::FENCE_SR )
+      set += "r";
+   if( bits & RISCV::FENCE_SW )
+      set += "w";
+
+   return( set );
+}
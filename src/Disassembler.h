@@ -0,0 +1,57 @@
+/*******************************************************************************
+ *  Copyright (c) 2024 Christian Nowak <chnowak@web.de>                        *
+ *   This file is part of chn's RISC-V-Emulator.                               *
+ *                                                                             *
+ *  RISC-V-Emulator is free software: you can redistribute it and/or modify it *
+ *  under the terms of the GNU General Public License as published by the Free *
+ *  Software Foundation, either version 3 of the License, or (at your option)  *
+ *  any later version.                                                         *
+ *                                                                             *          
+ *  RISC-V-Emulator is distributed in the hope that it will be useful, but     * 
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY *
+ *  or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License    *
+ *  for more details.                                                          *
+ *                                                                             *
+ *  You should have received a copy of the GNU General Public License along    *
+ *  with RISC-V-Emulator. If not, see <https://www.gnu.org/licenses/>.         *
+ *******************************************************************************/
+
+
+/*----------------------------------------------------------------------------*/
+/*!
+\file Disassembler.h
+\author Christian Nowak <chnowak@web.de>
+\brief Headerfile for class Disassembler.
+*/
+/*----------------------------------------------------------------------------*/
+#ifndef __DISASSEMBLER_H__
+#define __DISASSEMBLER_H__
+
+#include <cstdint>
+#include <string>
+
+#include "RISCV.h"
+
+/*----------------------------------------------------------------------------*/
+/*!
+\class Disassembler
+\date  2026-10-16
+Converts machine code instructions into assembly code. This is independent of
+the execution of the instructions, so RISCV::decode() doesn't contain any
+formatting code.
+*/
+/*----------------------------------------------------------------------------*/
+class Disassembler
+{
+   public:
+      static void disassemble( uint32_t address, uint32_t instr, RISCV::Instruction &instruction );
+      static void disassemble( const RISCV::DecodedInstruction &d, uint32_t instr, RISCV::Instruction &instruction );
+      static void print( const RISCV::Instruction &instruction );
+
+   private:
+      static const char *mnemonic( uint8_t op );
+      static std::string orderSuffix( int32_t aqrl );
+      static std::string fenceSet( int32_t bits );
+};
+
+#endif
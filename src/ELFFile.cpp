@@ -0,0 +1,265 @@
+/*******************************************************************************
+ *  Copyright (c) 2024 Christian Nowak <chnowak@web.de>                        *
+ *   This file is part of chn's RISC-V-Emulator.                               *
+ *                                                                             *
+ *  RISC-V-Emulator is free software: you can redistribute it and/or modify it *
+ *  under the terms of the GNU General Public License as published by the Free *
+ *  Software Foundation, either version 3 of the License, or (at your option)  *
+ *  any later version.                                                         *
+ *                                                                             *          
+ *  RISC-V-Emulator is distributed in the hope that it will be useful, but     * 
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY *
+ *  or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License    *
+ *  for more details.                                                          *
+ *                                                                             *
+ *  You should have received a copy of the GNU General Public License along    *
+ *  with RISC-V-Emulator. If not, see <https://www.gnu.org/licenses/>.         *
+ *******************************************************************************/
+
+/*----------------------------------------------------------------------------*/
+/*!
+\file ELFFile.cpp
+\author Christian Nowak <chnowak@web.de>
+\brief This implements the reader of ELF executables
+*/
+/*----------------------------------------------------------------------------*/
+#include "ELFFile.h"
+#include "util.h"
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Constructor for class ELFFile
+*/
+/*----------------------------------------------------------------------------*/
+ELFFile::ELFFile() :
+   m_EntryPoint( 0 )
+{
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Destructor for class ELFFile
+*/
+/*----------------------------------------------------------------------------*/
+ELFFile::~ELFFile()
+{
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Check whether a file starts with the magic number of an ELF file.
+\param fileName The file
+\return true if the file is an ELF file of any kind
+*/
+/*----------------------------------------------------------------------------*/
+bool ELFFile::isELF( std::string fileName )
+{
+   std::ifstream file( fileName, std::ios::binary );
+   std::vector<uint8_t> ident;
+   if( !read( file, 0, 4, ident ) )
+      return( false );
+
+   return( ( ident[0] == 0x7f ) && ( ident[1] == 'E' ) && ( ident[2] == 'L' ) && ( ident[3] == 'F' ) );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Read the headers and the symbol table of an ELF file.
+\param fileName The file
+\return A pointer to the new ELFFile instance or nullptr if the file isn't a
+32bit little endian RISC-V executable
+*/
+/*----------------------------------------------------------------------------*/
+ELFFile *ELFFile::create( std::string fileName )
+{
+   std::ifstream file( fileName, std::ios::binary );
+   std::vector<uint8_t> ehdr;
+   if( !read( file, 0, EHDR_SIZE, ehdr ) )
+      return( 0 );
+
+   // ELFCLASS32, ELFDATA2LSB
+   if( ( ehdr[0] != 0x7f ) || ( ehdr[1] != 'E' ) || ( ehdr[2] != 'L' ) || ( ehdr[3] != 'F' ) ||
+       ( ehdr[4] != 1 ) || ( ehdr[5] != 1 ) )
+      return( 0 );
+
+   if( ( util::loadLE16( &ehdr[16] ) != ET_EXEC ) || ( util::loadLE16( &ehdr[18] ) != EM_RISCV ) )
+      return( 0 );
+
+   uint32_t phOffset = util::loadLE32( &ehdr[28] );
+   uint32_t shOffset = util::loadLE32( &ehdr[32] );
+   uint32_t phEntSize = util::loadLE16( &ehdr[42] );
+   uint32_t phNum = util::loadLE16( &ehdr[44] );
+   uint32_t shEntSize = util::loadLE16( &ehdr[46] );
+   uint32_t shNum = util::loadLE16( &ehdr[48] );
+
+   if( ( phEntSize < PHDR_SIZE ) || ( ( shNum > 0 ) && ( shEntSize < SHDR_SIZE ) ) )
+      return( 0 );
+
+   ELFFile *pELF = new ELFFile();
+   pELF->m_EntryPoint = util::loadLE32( &ehdr[24] );
+
+   std::vector<uint8_t> phdrs;
+   if( !read( file, phOffset, phEntSize * phNum, phdrs ) )
+   {
+      delete pELF;
+      return( 0 );
+   }
+
+   for( uint32_t i = 0; i < phNum; i++ )
+   {
+      const uint8_t *pPhdr = &phdrs[i * phEntSize];
+      if( util::loadLE32( &pPhdr[0] ) != PT_LOAD )
+         continue;
+
+      Segment segment;
+      segment.offset = util::loadLE32( &pPhdr[4] );
+      segment.address = util::loadLE32( &pPhdr[8] );
+      segment.fileSize = util::loadLE32( &pPhdr[16] );
+      segment.memSize = util::loadLE32( &pPhdr[20] );
+      if( segment.fileSize > segment.memSize )
+      {
+         delete pELF;
+         return( 0 );
+      }
+      pELF->m_Segments.push_back( segment );
+   }
+
+   // Section headers of the same size as the ELF32 ones are expected from
+   // here on, the symbols are optional
+   std::vector<uint8_t> shdrs;
+   if( ( shNum > 0 ) && ( shEntSize == SHDR_SIZE ) && read( file, shOffset, SHDR_SIZE * shNum, shdrs ) )
+   {
+      pELF->readSymbols( file, shdrs, shNum );
+   }
+
+   return( pELF );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Read a part of a file.
+\param file The file
+\param offset The offset of the part in the file
+\param size The size of the part in bytes
+\param data Receives the contents of the part
+\return false if the part isn't within the file
+*/
+/*----------------------------------------------------------------------------*/
+bool ELFFile::read( std::ifstream &file, uint32_t offset, uint32_t size, std::vector<uint8_t> &data )
+{
+   file.clear();
+   file.seekg( 0, std::ios::end );
+   uint64_t fileSize = file.tellg();
+   if( !file || ( (uint64_t)offset + size > fileSize ) )
+      return( false );
+
+   data.resize( size );
+   if( size == 0 )
+      return( true );
+
+   file.seekg( offset, std::ios::beg );
+   file.read( (char *)data.data(), size );
+
+   return( file.good() && ( (uint32_t)file.gcount() == size ) );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Read the functions, variables and labels from the symbol table of the file.
+Section and file names, undefined symbols and the symbols of the assembler,
+i.e. local labels (.L) and mapping symbols ($x), are left out.
+\param file The file
+\param sectionHeaders The section headers
+\param numSections The number of section headers
+\return false if the symbol table is broken, in which case no symbols are
+kept, as the lookups need a sorted table
+*/
+/*----------------------------------------------------------------------------*/
+bool ELFFile::readSymbols( std::ifstream &file, const std::vector<uint8_t> &sectionHeaders, uint32_t numSections )
+{
+   for( uint32_t i = 0; i < numSections; i++ )
+   {
+      const uint8_t *pShdr = &sectionHeaders[i * SHDR_SIZE];
+      if( util::loadLE32( &pShdr[4] ) != SHT_SYMTAB )
+         continue;
+
+      // sh_link is the section of the names
+      uint32_t link = util::loadLE32( &pShdr[24] );
+      if( link >= numSections )
+      {
+         m_Symbols.clear();
+         return( false );
+      }
+
+      const uint8_t *pStrShdr = &sectionHeaders[link * SHDR_SIZE];
+      std::vector<uint8_t> syms;
+      std::vector<uint8_t> strs;
+      if( !read( file, util::loadLE32( &pShdr[16] ), util::loadLE32( &pShdr[20] ), syms ) ||
+          !read( file, util::loadLE32( &pStrShdr[16] ), util::loadLE32( &pStrShdr[20] ), strs ) )
+      {
+         m_Symbols.clear();
+         return( false );
+      }
+
+      for( size_t j = 0; j + SYM_SIZE <= syms.size(); j += SYM_SIZE )
+      {
+         const uint8_t *pSym = &syms[j];
+         uint32_t name = util::loadLE32( &pSym[0] );
+         uint8_t type = pSym[12] & 0xf;
+         uint16_t section = util::loadLE16( &pSym[14] );
+
+         // STT_NOTYPE, STT_OBJECT, STT_FUNC; SHN_UNDEF
+         if( ( type > 2 ) || ( section == 0 ) || ( name >= strs.size() ) )
+            continue;
+
+         std::string symName( (const char *)&strs[name], strnlen( (const char *)&strs[name], strs.size() - name ) );
+         if( symName.empty() || ( symName[0] == '$' ) || ( symName.compare( 0, 2, ".L" ) == 0 ) )
+            continue;
+
+         m_Symbols.add( util::loadLE32( &pSym[4] ), util::loadLE32( &pSym[8] ), symName );
+      }
+   }
+
+   m_Symbols.sort();
+
+   return( true );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\return The address of the first instruction to be executed
+*/
+/*----------------------------------------------------------------------------*/
+uint32_t ELFFile::getEntryPoint() const
+{
+   return( m_EntryPoint );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\return The segments to be loaded into memory
+*/
+/*----------------------------------------------------------------------------*/
+const std::vector<ELFFile::Segment> &ELFFile::getSegments() const
+{
+   return( m_Segments );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\return The symbols, sorted by their address
+*/
+/*----------------------------------------------------------------------------*/
+const SymbolTable &ELFFile::getSymbols() const
+{
+   return( m_Symbols );
+}
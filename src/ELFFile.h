@@ -0,0 +1,85 @@
+/*******************************************************************************
+ *  Copyright (c) 2024 Christian Nowak <chnowak@web.de>                        *
+ *   This file is part of chn's RISC-V-Emulator.                               *
+ *                                                                             *
+ *  RISC-V-Emulator is free software: you can redistribute it and/or modify it *
+ *  under the terms of the GNU General Public License as published by the Free *
+ *  Software Foundation, either version 3 of the License, or (at your option)  *
+ *  any later version.                                                         *
+ *                                                                             *          
+ *  RISC-V-Emulator is distributed in the hope that it will be useful, but     * 
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY *
+ *  or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License    *
+ *  for more details.                                                          *
+ *                                                                             *
+ *  You should have received a copy of the GNU General Public License along    *
+ *  with RISC-V-Emulator. If not, see <https://www.gnu.org/licenses/>.         *
+ *******************************************************************************/
+
+/*----------------------------------------------------------------------------*/
+/*!
+\file ELFFile.h
+\author Christian Nowak <chnowak@web.de>
+\brief Headerfile for class ELFFile.
+*/
+/*----------------------------------------------------------------------------*/
+#ifndef __ELFFILE_H__
+#define __ELFFILE_H__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <fstream>
+
+#include "SymbolTable.h"
+
+/*----------------------------------------------------------------------------*/
+/*!
+\class ELFFile
+\date  2026-10-16
+The headers and the symbol table of a 32bit little endian RISC-V executable
+in ELF format. Only the headers are read, the contents of the segments are
+left in the file, so they can be mapped into the RAM.
+*/
+/*----------------------------------------------------------------------------*/
+class ELFFile
+{
+   public:
+      // A part of the file to be loaded into memory (PT_LOAD). The memory
+      // beyond fileSize up to memSize is cleared (e.g. .bss).
+      struct Segment
+      {
+         uint32_t offset;
+         uint32_t address;
+         uint32_t fileSize;
+         uint32_t memSize;
+      };
+
+      static bool isELF( std::string fileName );
+      static ELFFile *create( std::string fileName );
+      ~ELFFile();
+
+      uint32_t getEntryPoint() const;
+      const std::vector<Segment> &getSegments() const;
+      const SymbolTable &getSymbols() const;
+
+   private:
+      static const uint16_t ET_EXEC = 2;
+      static const uint16_t EM_RISCV = 243;
+      static const uint32_t PT_LOAD = 1;
+      static const uint32_t SHT_SYMTAB = 2;
+      static const uint32_t EHDR_SIZE = 52;
+      static const uint32_t PHDR_SIZE = 32;
+      static const uint32_t SHDR_SIZE = 40;
+      static const uint32_t SYM_SIZE = 16;
+
+      ELFFile();
+      static bool read( std::ifstream &file, uint32_t offset, uint32_t size, std::vector<uint8_t> &data );
+      bool readSymbols( std::ifstream &file, const std::vector<uint8_t> &sectionHeaders, uint32_t numSections );
+
+      uint32_t m_EntryPoint;
+      std::vector<Segment> m_Segments;
+      SymbolTable m_Symbols;
+};
+
+#endif
@@ -26,28 +26,64 @@
 /*----------------------------------------------------------------------------*/
 #include <iostream>
 #include <fstream>
+#include <algorithm>
 #include <string.h>
+#include <thread>
+#include <chrono>
+#include <stdio.h>
+#include <errno.h>
+
+#if !defined( _WIN32 )
+#define EMULATOR_POSIX
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 #include "Emulator.h"
+#include "ELFFile.h"
 
+// The hart running on the calling thread, which has caused any write of a
+// device to the RAM
+static thread_local RISCV *pRunningHart = 0;
 
 /*----------------------------------------------------------------------------*/
 /*! 2024-08-15
 Constructor for class Emulator
-\param pProgramData Pointer to the machine code to be executed
-\param programDataSize Size in bytes of the machine code
+\param numHarts The number of harts, which all share the RAM
+\param pRAM The RAM holding the machine code to be executed, which is owned
+by the Emulator from now on
 */
 /*----------------------------------------------------------------------------*/
-Emulator::Emulator( uint8_t *pProgramData, size_t programDataSize ) :
-   m_pProgramData( pProgramData ),
-   m_ProgramDataSize( programDataSize ),
+Emulator::Emulator( int numHarts, GuestRAM *pRAM ) :
    m_RAMStart( 0x80000000 ),
-   m_RAMSize(  0x08000000 ),
-   m_StopEmulation( false )
+   m_pRAM( pRAM ),
+   m_EntryPoint( 0x80000000 ),
+   m_StopEmulation( false ),
+   m_DynamicBinding( false ),
+   m_Quantum( 0 ),
+   m_Quanta( 0 ),
+   m_SchedulingOverhead( 0.0 )
 {
-   m_pCPU = new RISCV( this );
-   m_pRAM = new uint8_t[m_RAMSize];
-   memcpy( m_pRAM, pProgramData, programDataSize > m_RAMSize ? m_RAMSize : programDataSize );
+   static_assert( GuestRAM::PAGE_SIZE == 4096, "The CPU expects a dirty flag per 4KB page" );
+   m_Bus.mapRAM( m_RAMStart, m_pRAM->getSize(), m_pRAM->getData() );
+
+   for( int i = 0; i < numHarts; i++ )
+   {
+      m_Harts.push_back( new RISCV( this, i ) );
+   }
+   mapRAM( false );
+
+   m_pConsole = new ConsoleDevice( this );
+   m_Bus.mapDevice( CONSOLE_ADDRESS, MemoryBus::PAGE_SIZE, m_pConsole );
+
+   m_pDisk = new BlockDevice( this );
+   m_Bus.mapDevice( DISK_ADDRESS, MemoryBus::PAGE_SIZE, m_pDisk );
+
+   m_pDMA = new DMADevice( this );
+   m_Bus.mapDevice( DMA_ADDRESS, MemoryBus::PAGE_SIZE, m_pDMA );
+
+   m_pSyscalls = new SyscallHandler( this, m_pConsole );
+   m_pHostRoutines = new HostRoutines( this, m_pConsole, numHarts );
 }
 
 
@@ -58,20 +94,273 @@ Destructor for class RISCV
 /*----------------------------------------------------------------------------*/
 Emulator::~Emulator()
 {
-   delete m_pProgramData;
-   delete m_pCPU;
+   for( size_t i = 0; i < m_Harts.size(); i++ )
+   {
+      delete m_Harts[i];
+   }
+   for( size_t i = 0; i < m_FileWindows.size(); i++ )
+   {
+      delete m_FileWindows[i];
+   }
+   delete m_pHostRoutines;
+   delete m_pSyscalls;
+   delete m_pDMA;
+   delete m_pDisk;
+   delete m_pConsole;
    delete m_pRAM;
 }
 
 
 /*----------------------------------------------------------------------------*/
 /*! 2024-08-15
-Execute a single machine code instruction
+Execute a single machine code instruction on the first hart.
 */
 /*----------------------------------------------------------------------------*/
 void Emulator::step()
 {
-   m_pCPU->step();
+   RISCV::RunResult result;
+   runHart( 0, 1, &result );
+   report( 0, result );
+   m_pConsole->flush();
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Execute machine code instructions using the selected execution engine until
+either a given number of instructions has been executed or a stop event
+occurs. With more than one hart, every hart executes up to maxInstructions,
+either on its own host thread or, if a quantum has been set, interleaved with
+the others on the calling thread. The emulation is stopped after an illegal
+opcode or a write to the halt register.
+\param maxInstructions The maximum number of instructions to be executed by
+each hart
+\return The reason for returning and the number of instructions executed by
+all harts. A stop event of any hart takes precedence over reaching the limit,
+and the event of the hart with the lowest id over those of the others.
+*/
+/*----------------------------------------------------------------------------*/
+RISCV::RunResult Emulator::run( uint64_t maxInstructions )
+{
+   std::vector<RISCV::RunResult> results( m_Harts.size() );
+   if( m_Harts.size() == 1 )
+   {
+      runHart( 0, maxInstructions, &results[0] );
+   } else
+   if( m_Quantum > 0 )
+   {
+      runScheduled( maxInstructions, results );
+   } else
+   {
+      std::vector<std::thread> threads;
+      for( size_t i = 0; i < m_Harts.size(); i++ )
+      {
+         threads.push_back( std::thread( &Emulator::runHart, this, (int)i, maxInstructions, &results[i] ) );
+      }
+
+      for( size_t i = 0; i < threads.size(); i++ )
+      {
+         threads[i].join();
+      }
+   }
+
+   RISCV::RunResult result = results[0];
+   report( 0, results[0] );
+   for( size_t i = 1; i < results.size(); i++ )
+   {
+      report( i, results[i] );
+      if( ( result.reason == RISCV::STOP_BUDGET ) || ( result.reason == RISCV::STOP_DEADLINE ) )
+      {
+         result.reason = results[i].reason;
+      }
+      result.instructions += results[i].instructions;
+   }
+   m_pConsole->flush();
+
+   return( result );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Run one hart. With more than one hart, this is the thread function of the hart.
+\param hart The index of the hart
+\param maxInstructions The maximum number of instructions to be executed
+\param pResult Receives the result of RISCV::run()
+*/
+/*----------------------------------------------------------------------------*/
+void Emulator::runHart( int hart, uint64_t maxInstructions, RISCV::RunResult *pResult )
+{
+   // Emulator is final, so the CPU can inline its memory accesses
+   RISCV *pCPU = m_Harts[hart];
+   pRunningHart = pCPU;
+   *pResult = m_DynamicBinding ? pCPU->run( maxInstructions ) :
+                                 pCPU->run<Emulator>( maxInstructions );
+   pRunningHart = 0;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Run all harts on the calling thread, switching between them in round-robin
+order after every quantum. As the CPU stops exactly after the given number of
+instructions with every engine, the interleaving of the harts only depends on
+the quantum, so the results are identical in every run. A hart is switched
+out when it has used up its quantum or stopped, and takes no further part
+once it has executed maxInstructions or stopped.
+\param maxInstructions The maximum number of instructions to be executed by
+each hart
+\param results Receives the result of every hart
+*/
+/*----------------------------------------------------------------------------*/
+void Emulator::runScheduled( uint64_t maxInstructions, std::vector<RISCV::RunResult> &results )
+{
+   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+   std::chrono::steady_clock::duration executing( 0 );
+
+   std::vector<bool> active( m_Harts.size(), true );
+   size_t numActive = m_Harts.size();
+   for( size_t i = 0; i < results.size(); i++ )
+   {
+      results[i].reason = RISCV::STOP_BUDGET;
+      results[i].instructions = 0;
+   }
+
+   while( numActive > 0 )
+   {
+      for( size_t i = 0; i < m_Harts.size(); i++ )
+      {
+         if( !active[i] )
+            continue;
+
+         uint64_t remaining = maxInstructions - results[i].instructions;
+         RISCV::RunResult result;
+         std::chrono::steady_clock::time_point t = std::chrono::steady_clock::now();
+         runHart( i, remaining < m_Quantum ? remaining : m_Quantum, &result );
+         executing += std::chrono::steady_clock::now() - t;
+         m_Quanta++;
+
+         results[i].instructions += result.instructions;
+         if( ( result.reason != RISCV::STOP_BUDGET ) || ( results[i].instructions >= maxInstructions ) )
+         {
+            results[i].reason = result.reason;
+            active[i] = false;
+            numActive--;
+         }
+      }
+   }
+
+   m_SchedulingOverhead += std::chrono::duration<double>( std::chrono::steady_clock::now() - start - executing ).count();
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Output the events which have stopped a hart on the console and stop the emulation after an
+illegal opcode or a write to the halt register. With more than one hart, the
+messages are prefixed by the hart.
+\param hart The index of the hart
+\param result The result of running the hart
+*/
+/*----------------------------------------------------------------------------*/
+void Emulator::report( int hart, const RISCV::RunResult &result )
+{
+   std::string prefix = m_Harts.size() > 1 ? stdformat( "Hart {}: ", hart ) : std::string();
+
+   if( result.reason == RISCV::STOP_ILLEGAL_INSTRUCTION )
+   {
+      m_pConsole->write( stdformat( "{}Unknown opcode found at 0x{:x}.\n", prefix, m_Harts[hart]->getPC() ) );
+   } else
+   if( result.reason == RISCV::STOP_BREAKPOINT )
+   {
+      m_pConsole->write( stdformat( "{}Breakpoint at 0x{:x}.\n", prefix, m_Harts[hart]->getPC() ) );
+   }
+
+   if( ( result.reason == RISCV::STOP_ILLEGAL_INSTRUCTION ) || ( result.reason == RISCV::STOP_HALT ) )
+   {
+      m_StopEmulation = true;
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Stop the emulation, i.e. make all harts return from run() after their current
+instruction. This may be called from any hart's thread, e.g. by a device.
+*/
+/*----------------------------------------------------------------------------*/
+void Emulator::halt()
+{
+   m_StopEmulation = true;
+   for( size_t i = 0; i < m_Harts.size(); i++ )
+   {
+      m_Harts[i]->requestStop( RISCV::STOP_HALT );
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Select whether run() binds the memory accesses of the CPU at compile time
+(the default) or calls them through the virtual methods of
+RISCV::MemoryInterface, e.g. to compare the performance of both.
+\param dynamicBinding true for virtual calls
+*/
+/*----------------------------------------------------------------------------*/
+void Emulator::setDynamicBinding( bool dynamicBinding )
+{
+   m_DynamicBinding = dynamicBinding;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Select how multiple harts are run: either each on its own host thread (the
+default), or deterministically on the calling thread, switching between them
+after a fixed number of instructions.
+\param quantum The number of instructions executed by a hart before switching
+to the next one, or 0 to run every hart on its own thread
+*/
+/*----------------------------------------------------------------------------*/
+void Emulator::setQuantum( uint64_t quantum )
+{
+   m_Quantum = quantum;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Select whether memcpy, memset, strlen and memcmp of the program are carried
+out by the host, see class HostRoutines. The routines are looked up in the
+symbols of the current program and of every program loaded later, so they
+are only found in ELF files. Must not be called while the emulation is
+running.
+\param mode The mode
+*/
+/*----------------------------------------------------------------------------*/
+void Emulator::setHostRoutines( HostRoutines::Mode mode )
+{
+   m_pHostRoutines->setMode( mode );
+   installHostRoutines();
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Select the execution engine of the CPU.
+\param engine The execution engine
+\return false if the engine isn't supported on the host platform
+*/
+/*----------------------------------------------------------------------------*/
+bool Emulator::setEngine( RISCV::Engine engine )
+{
+   for( size_t i = 0; i < m_Harts.size(); i++ )
+   {
+      if( !m_Harts[i]->setEngine( engine ) )
+         return( false );
+   }
+
+   return( true );
 }
 
 
@@ -79,153 +368,875 @@ void Emulator::step()
 /*! 2024-08-15
 Create an instance of the Emulator and load a binary file into its virtual
 memory for execution.
-\param fileName The file to be loaded as machine code
+\param fileName The file to be loaded as machine code, or a snapshot whose
+number of harts and size of RAM are taken instead of the following parameters
+and have to meet the same constraints
+\param numHarts The number of harts, from 1 to MAX_HARTS
+\param ramSize The size of the RAM in bytes, a multiple of
+MemoryBus::PAGE_SIZE up to MAX_RAM_SIZE
+\param hugePages true to back the RAM by transparent huge pages of the host
 \return A pointer to the new Emulator instance or nullptr on failure
 */
 /*----------------------------------------------------------------------------*/
-Emulator *Emulator::create( std::string fileName )
+Emulator *Emulator::create( std::string fileName, int numHarts, uint32_t ramSize, bool hugePages )
 {
-   std::ifstream binFile( fileName, std::ios::binary );
-   if( !binFile )
+   // A snapshot determines the number of harts and the size of the RAM
+   if( isSnapshot( fileName ) )
+   {
+      std::vector<uint8_t> header;
+      if( !readSnapshotHeader( fileName, header ) )
+         return( 0 );
+
+      numHarts = util::loadLE32( &header[12] );
+      ramSize = util::loadLE32( &header[20] );
+
+      // The RAM must not wrap around the end of the address space
+      if( (uint64_t)util::loadLE32( &header[16] ) + ramSize > 0x100000000ULL )
+         return( 0 );
+   }
+
+   if( ( numHarts < 1 ) || ( numHarts > MAX_HARTS ) )
       return( 0 );
 
-   binFile.seekg( 0, std::ios::end );
-   size_t binSize = binFile.tellg();
-   binFile.seekg( 0, std::ios::beg );
+   if( ( ramSize == 0 ) || ( ramSize > MAX_RAM_SIZE ) || ( ( ramSize & ( MemoryBus::PAGE_SIZE - 1 ) ) != 0 ) )
+      return( 0 );
 
-   uint8_t *pBinData = new uint8_t[binSize];
-   binFile.read( (char*)pBinData, binSize );
-   binFile.close();
+   GuestRAM *pRAM = GuestRAM::create( ramSize, hugePages );
+   if( !pRAM )
+      return( 0 );
 
-   Emulator *pEmu = new Emulator( pBinData, binSize );
+   Emulator *pEmu = new Emulator( numHarts, pRAM );
+   if( !pEmu->load( fileName ) )
+   {
+      delete pEmu;
+      return( 0 );
+   }
 
    return( pEmu );
 }
 
 
 /*----------------------------------------------------------------------------*/
-/*! 2024-08-15
-This method is invoked when the CPU reads a byte.
-\param address The memory address to read from
-\return The value
+/*! 2026-10-16
+Replace the program of an existing Emulator, so the instance can be reused
+for running another binary file. The program is loaded into cleared RAM, then
+all harts are reset and start at the entry point of the program. The engine,
+binding and quantum stay as they were. A snapshot is restored instead, see
+restoreSnapshot().
+\param fileName The file to be loaded as machine code
+\return false if the file couldn't be read
 */
 /*----------------------------------------------------------------------------*/
-uint8_t Emulator::readMem8( uint32_t address )
+bool Emulator::load( std::string fileName )
 {
-   if( address >= m_RAMStart && address < m_RAMStart + m_RAMSize )
+   if( isSnapshot( fileName ) )
+      return( restoreSnapshot( fileName ) );
+
+   // The pages used by the previous program are returned to the host
+   mapRAM( false );
+   if( !m_pRAM->clear() || !loadProgram( fileName ) )
+      return( false );
+
+   for( size_t i = 0; i < m_Harts.size(); i++ )
    {
-      uint32_t a = address - m_RAMStart;
-      uint8_t d = m_pRAM[a];
-      return( m_pRAM[a] );
-   } else
+      m_Harts[i]->reset();
+      m_Harts[i]->setPC( m_EntryPoint );
+   }
+   installHostRoutines();
+   m_StopEmulation = false;
+
+   return( true );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Use a host file as the disk of the block device at DISK_ADDRESS, see
+BlockDevice::attach(). Must not be called while the Emulator is running.
+\param fileName The file
+\return false if the file couldn't be used as a disk
+*/
+/*----------------------------------------------------------------------------*/
+bool Emulator::attachDisk( std::string fileName )
+{
+   return( m_pDisk->attach( fileName ) );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Map a host file read-only into the address space, see FileWindow. The harts
+read it through the memory bus like RAM, without a copy and without calling a
+device. Writes to it are ignored. The file isn't part of snapshots. Must not
+be called while the Emulator is running.
+\param address The start of the window, a multiple of MemoryBus::PAGE_SIZE
+\param fileName The file
+\return false if the file couldn't be mapped or the window would overlap the
+RAM, a device or another window
+*/
+/*----------------------------------------------------------------------------*/
+bool Emulator::mapFile( uint32_t address, std::string fileName )
+{
+   if( address & ( MemoryBus::PAGE_SIZE - 1 ) )
+      return( false );
+
+   FileWindow *pWindow = FileWindow::create( fileName );
+   if( !pWindow )
+      return( false );
+
+   if( !m_Bus.isUnmapped( address, pWindow->getSize() ) )
    {
-      return( 0xff );
+      delete pWindow;
+      return( false );
    }
+
+   m_Bus.mapRAM( address, pWindow->getSize(), pWindow->getData(), false );
+   m_FileWindows.push_back( pWindow );
+
+   return( true );
 }
 
 
 /*----------------------------------------------------------------------------*/
-/*! 2024-08-15
-This method is invoked when the CPU reads a half-word.
-\param address The memory address to read from
-\return The value
+/*! 2026-10-16
+Load a program into the cleared RAM. An ELF executable is loaded segment by
+segment to the addresses given in its program headers, which have to be
+within the RAM unless they are empty. The part of a segment beyond the contents in the file (e.g.
+.bss) needs no loading, as the RAM is cleared. The entry point and the symbol
+table are taken from the file. Any other file is loaded as a flat binary to
+the start of the RAM, which is also its entry point. The heap of the program
+starts at the next page after the end of the program.
+\param fileName The file to be loaded
+\return false if the file couldn't be read or doesn't fit into the RAM
+*/
+/*----------------------------------------------------------------------------*/
+bool Emulator::loadProgram( std::string fileName )
+{
+   m_EntryPoint = m_RAMStart;
+   m_Symbols.clear();
+
+   if( !ELFFile::isELF( fileName ) )
+   {
+      std::ifstream file( fileName, std::ios::binary | std::ios::ate );
+      uint64_t size = file ? (uint64_t)file.tellg() : 0;
+      uint32_t end = size < m_pRAM->getSize() ? (uint32_t)size : m_pRAM->getSize();
+      m_pSyscalls->reset( m_RAMStart + ( ( end + GuestRAM::PAGE_SIZE - 1 ) & ~( GuestRAM::PAGE_SIZE - 1 ) ) );
+
+      return( m_pRAM->load( fileName ) );
+   }
+
+   ELFFile *pELF = ELFFile::create( fileName );
+   if( !pELF )
+      return( false );
+
+   bool ok = true;
+   uint32_t ramSize = m_pRAM->getSize();
+   uint32_t end = 0;
+   const std::vector<ELFFile::Segment> &segments = pELF->getSegments();
+   for( size_t i = 0; ok && ( i < segments.size() ); i++ )
+   {
+      const ELFFile::Segment &segment = segments[i];
+      uint32_t offset = segment.address - m_RAMStart;
+      if( segment.memSize == 0 )
+      {
+         continue;
+      } else
+      if( ( segment.address < m_RAMStart ) || ( offset > ramSize ) || ( segment.memSize > ramSize - offset ) )
+      {
+         ok = false;
+      } else
+      if( segment.fileSize > 0 )
+      {
+         ok = m_pRAM->load( fileName, offset, segment.offset, segment.fileSize );
+      }
+
+      if( ok && ( offset + segment.memSize > end ) )
+      {
+         end = offset + segment.memSize;
+      }
+   }
+
+   if( ok )
+   {
+      m_EntryPoint = pELF->getEntryPoint();
+      m_Symbols = pELF->getSymbols();
+      m_pSyscalls->reset( m_RAMStart + (uint32_t)( ( (uint64_t)end + GuestRAM::PAGE_SIZE - 1 ) & ~(uint64_t)( GuestRAM::PAGE_SIZE - 1 ) ) );
+   }
+   delete pELF;
+
+   return( ok );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Save the complete state of the Emulator, i.e. the states of all harts and
+devices and the contents of the RAM, to a snapshot file. Running the snapshot
+continues exactly where the emulation has stopped. The RAM is stored at an
+offset aligned to the page size of the host, so restoreSnapshot() can map it
+into the RAM instead of reading it. All-zero pages of the RAM are left out.
+The snapshot is written to a temporary file next to the file, which then
+replaces it. So the file may be the snapshot or the program the RAM has been
+loaded from, whose pages are still mapped into the RAM, and a failed save
+leaves an existing file intact.
+Must not be called while the Emulator is running.
+\param fileName The file to be written
+\return false on failure
+*/
+/*----------------------------------------------------------------------------*/
+bool Emulator::saveSnapshot( std::string fileName ) const
+{
+   std::vector<MemoryBus::Device *> devices;
+   std::vector<uint32_t> starts;
+   m_Bus.getDevices( devices, starts );
+
+   std::vector<uint8_t> header( SNAPSHOT_HEADER_SIZE + m_Harts.size() * SNAPSHOT_HART_SIZE );
+   memcpy( &header[0], "RV32SNAP", 8 );
+   util::storeLE32( &header[8], SNAPSHOT_VERSION );
+   util::storeLE32( &header[12], m_Harts.size() );
+   util::storeLE32( &header[16], m_RAMStart );
+   util::storeLE32( &header[20], m_pRAM->getSize() );
+   util::storeLE32( &header[28], devices.size() );
+
+   for( size_t i = 0; i < m_Harts.size(); i++ )
+   {
+      RISCV::State state;
+      m_Harts[i]->getState( state );
+
+      uint8_t *p = &header[SNAPSHOT_HEADER_SIZE + i * SNAPSHOT_HART_SIZE];
+      util::storeLE32( p, state.pc );
+      for( int r = 0; r < 32; r++ )
+      {
+         util::storeLE32( p + 4 + r * 4, state.registers[r] );
+      }
+      util::storeLE32( p + 132, state.reservationAddress );
+      util::storeLE32( p + 136, state.reservedWord );
+      util::storeLE32( p + 140, state.reservedValue );
+   }
+
+   // Every device: its start address, the size of its state and the state,
+   // padded to a multiple of 4 bytes
+   for( size_t i = 0; i < devices.size(); i++ )
+   {
+      std::vector<uint8_t> state;
+      devices[i]->saveState( state );
+
+      size_t offset = header.size();
+      header.resize( offset + 8 + ( ( state.size() + 3 ) & ~(size_t)3 ) );
+      util::storeLE32( &header[offset], starts[i] );
+      util::storeLE32( &header[offset + 4], state.size() );
+      if( !state.empty() )
+      {
+         memcpy( &header[offset + 8], state.data(), state.size() );
+      }
+   }
+
+   // The state of the system calls: its size and the state, padded as well
+   std::vector<uint8_t> syscalls;
+   m_pSyscalls->saveState( syscalls );
+   size_t offset = header.size();
+   header.resize( offset + 4 + ( ( syscalls.size() + 3 ) & ~(size_t)3 ) );
+   util::storeLE32( &header[offset], syscalls.size() );
+   memcpy( &header[offset + 4], syscalls.data(), syscalls.size() );
+
+   if( header.size() > SNAPSHOT_MAX_HEADER )
+      return( false );
+
+   uint32_t ramOffset = ( header.size() + SNAPSHOT_ALIGNMENT - 1 ) & ~( SNAPSHOT_ALIGNMENT - 1 );
+   util::storeLE32( &header[24], ramOffset );
+
+#ifdef EMULATOR_POSIX
+   std::string tempName = stdformat( "{}.{}.tmp", fileName, (long)getpid() );
+#else
+   std::string tempName = fileName + ".tmp";
+#endif
+   std::ofstream file( tempName, std::ios::binary | std::ios::trunc );
+   if( !file )
+      return( false );
+
+   file.write( (const char *)header.data(), header.size() );
+   bool ok = m_pRAM->save( file, ramOffset );
+   file.close();
+   ok = ok && !file.fail();
+
+#ifdef EMULATOR_POSIX
+   // The data has to be on the disk before the file replaces the old one
+   int fd = ok ? ::open( tempName.c_str(), O_RDONLY ) : -1;
+   ok = ok && ( fd >= 0 ) && ( fsync( fd ) == 0 );
+   if( fd >= 0 )
+   {
+      ::close( fd );
+   }
+#else
+   // rename() doesn't replace an existing file
+   ok = ok && ( ( remove( fileName.c_str() ) == 0 ) || ( errno == ENOENT ) );
+#endif
+
+   if( !ok || ( rename( tempName.c_str(), fileName.c_str() ) != 0 ) )
+   {
+      remove( tempName.c_str() );
+      return( false );
+   }
+
+   return( true );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\param fileName The file
+\return true if the file starts like a snapshot
 */
 /*----------------------------------------------------------------------------*/
-uint16_t Emulator::readMem16( uint32_t address )
+bool Emulator::isSnapshot( std::string fileName )
 {
-   return(   ( readMem8( address ) & 0xff ) |
-           ( ( readMem8( address + 1 ) & 0xff ) << 8 ) );
+   std::ifstream file( fileName, std::ios::binary );
+   char magic[8];
+   file.read( magic, sizeof( magic ) );
+
+   return( file.good() && ( memcmp( magic, "RV32SNAP", 8 ) == 0 ) );
 }
 
 
 /*----------------------------------------------------------------------------*/
-/*! 2024-08-15
-This method is invoked when the CPU reads a word.
-\param address The memory address to read from
-\return The value
+/*! 2026-10-16
+Read everything in a snapshot before the RAM.
+\param fileName The snapshot file
+\param header Receives the header and the states of the harts and devices
+\return false if the file isn't a valid snapshot
 */
 /*----------------------------------------------------------------------------*/
-uint32_t Emulator::readMem32( uint32_t address )
+bool Emulator::readSnapshotHeader( std::string fileName, std::vector<uint8_t> &header )
 {
-   return(   ( (uint32_t)readMem8( address )     & 0xff ) |
-           ( ( (uint32_t)readMem8( address + 1 ) & 0xff ) << 8 ) |
-           ( ( (uint32_t)readMem8( address + 2 ) & 0xff ) << 16 ) |
-           ( ( (uint32_t)readMem8( address + 3 ) & 0xff ) << 24 ) );
+   std::ifstream file( fileName, std::ios::binary );
+   header.resize( SNAPSHOT_HEADER_SIZE );
+   file.read( (char *)header.data(), header.size() );
+   if( !file.good() || ( memcmp( &header[0], "RV32SNAP", 8 ) != 0 ) ||
+       ( util::loadLE32( &header[8] ) < 1 ) || ( util::loadLE32( &header[8] ) > SNAPSHOT_VERSION ) )
+      return( false );
+
+   uint32_t numHarts = util::loadLE32( &header[12] );
+   uint32_t ramOffset = util::loadLE32( &header[24] );
+   if( ( ramOffset > SNAPSHOT_MAX_HEADER ) || ( numHarts > MAX_HARTS ) ||
+       ( ramOffset < SNAPSHOT_HEADER_SIZE + numHarts * SNAPSHOT_HART_SIZE ) ||
+       ( ramOffset & ( SNAPSHOT_ALIGNMENT - 1 ) ) )
+      return( false );
+
+   header.resize( ramOffset );
+   file.read( (char *)&header[SNAPSHOT_HEADER_SIZE], ramOffset - SNAPSHOT_HEADER_SIZE );
+
+   return( file.good() );
 }
 
 
 /*----------------------------------------------------------------------------*/
-/*! 2024-08-15
-This method is invoked when the CPU writes a byte.
-\param address The memory address to write to
-\param d The value to write
+/*! 2026-10-16
+Restore the complete state of the Emulator from a snapshot file written by
+saveSnapshot(). The number of harts and the size of the RAM have to be the
+same as in the snapshot. Instead of reading the RAM, the snapshot is mapped
+privately into it, so restoring takes about the same time for any size of
+RAM, and the pages of the snapshot are shared by all Emulators restored from
+it until they are written to.
+\param fileName The snapshot file
+\return false if the snapshot doesn't fit the Emulator, is truncated or
+couldn't be read
 */
 /*----------------------------------------------------------------------------*/
-void Emulator::writeMem8( uint32_t address, uint8_t d )
+bool Emulator::restoreSnapshot( std::string fileName )
 {
-   if( address >= m_RAMStart && address < m_RAMStart + m_RAMSize )
+   std::vector<uint8_t> header;
+   if( !readSnapshotHeader( fileName, header ) )
+      return( false );
+
+   if( ( util::loadLE32( &header[12] ) != m_Harts.size() ) ||
+       ( util::loadLE32( &header[16] ) != m_RAMStart ) ||
+       ( util::loadLE32( &header[20] ) != m_pRAM->getSize() ) )
+      return( false );
+
+   // A truncated snapshot must not be restored with zeros in place of the RAM
+   uint32_t ramOffset = util::loadLE32( &header[24] );
+   std::ifstream file( fileName, std::ios::binary | std::ios::ate );
+   if( !file || ( (uint64_t)file.tellg() < (uint64_t)ramOffset + m_pRAM->getSize() ) )
+      return( false );
+   file.close();
+
+   mapRAM( false );
+   if( !m_pRAM->clear() || !m_pRAM->load( fileName, 0, ramOffset, m_pRAM->getSize() ) )
+      return( false );
+
+   for( size_t i = 0; i < m_Harts.size(); i++ )
    {
-      // RAM access
-      uint32_t a = address - m_RAMStart;
-      m_pRAM[a] = d;
+      const uint8_t *p = &header[SNAPSHOT_HEADER_SIZE + i * SNAPSHOT_HART_SIZE];
+      RISCV::State state;
+      state.pc = util::loadLE32( p );
+      for( int r = 0; r < 32; r++ )
+      {
+         state.registers[r] = util::loadLE32( p + 4 + r * 4 );
+      }
+      state.reservationAddress = util::loadLE32( p + 132 );
+      state.reservedWord = util::loadLE32( p + 136 );
+      state.reservedValue = util::loadLE32( p + 140 );
+
+      m_Harts[i]->reset();
+      m_Harts[i]->setState( state );
+   }
+
+   std::vector<MemoryBus::Device *> devices;
+   std::vector<uint32_t> starts;
+   m_Bus.getDevices( devices, starts );
+
+   size_t offset = SNAPSHOT_HEADER_SIZE + m_Harts.size() * SNAPSHOT_HART_SIZE;
+   uint32_t numDevices = util::loadLE32( &header[28] );
+   for( uint32_t i = 0; i < numDevices; i++ )
+   {
+      if( offset + 8 > header.size() )
+         return( false );
+
+      uint32_t start = util::loadLE32( &header[offset] );
+      uint32_t size = util::loadLE32( &header[offset + 4] );
+      offset += 8;
+      if( size > header.size() - offset )
+         return( false );
+
+      std::vector<uint8_t> state( header.begin() + offset, header.begin() + offset + size );
+      offset += ( size + 3 ) & ~3;
+
+      std::vector<uint32_t>::iterator device = std::find( starts.begin(), starts.end(), start );
+      if( ( device == starts.end() ) || !devices[device - starts.begin()]->restoreState( state ) )
+         return( false );
+   }
+
+   // Snapshots of version 1 predate the system calls, so the heap may take
+   // all of the RAM
+   if( util::loadLE32( &header[8] ) < 2 )
+   {
+      m_pSyscalls->reset( m_RAMStart + m_pRAM->getSize() );
    } else
    {
-      // When writing to address 0x0, output the byte to the console
-      if( address == 0 )
-         printf( "%c", d );
+      if( offset + 4 > header.size() )
+         return( false );
+
+      uint32_t size = util::loadLE32( &header[offset] );
+      if( size > header.size() - offset - 4 )
+         return( false );
+
+      std::vector<uint8_t> state( header.begin() + offset + 4, header.begin() + offset + 4 + size );
+      if( !m_pSyscalls->restoreState( state ) )
+         return( false );
    }
+
+   m_EntryPoint = m_RAMStart;
+   m_Symbols.clear();
+   installHostRoutines();
+   m_StopEmulation = false;
+
+   return( true );
 }
 
 
 /*----------------------------------------------------------------------------*/
-/*! 2024-08-15
-This method is invoked when the CPU writes a half-word.
-\param address The memory address to write to
-\param d The value to write
+/*! 2026-10-16
+Make the current state of the Emulator, i.e. the states of all harts and
+devices and the contents of the RAM, its baseline, which resetToBaseline()
+returns to. From then on, every page of the RAM is saved before it is
+written to for the first time. The baseline is dropped by load(). Must not be
+called while the Emulator is running.
+*/
+/*----------------------------------------------------------------------------*/
+void Emulator::setBaseline()
+{
+   m_BaselineHarts.resize( m_Harts.size() );
+   for( size_t i = 0; i < m_Harts.size(); i++ )
+   {
+      m_Harts[i]->getState( m_BaselineHarts[i] );
+   }
+
+   std::vector<MemoryBus::Device *> devices;
+   std::vector<uint32_t> starts;
+   m_Bus.getDevices( devices, starts );
+   m_BaselineDevices.resize( devices.size() );
+   for( size_t i = 0; i < devices.size(); i++ )
+   {
+      devices[i]->saveState( m_BaselineDevices[i] );
+   }
+   m_pSyscalls->saveState( m_BaselineSyscalls );
+
+   m_pRAM->setBaseline();
+   mapRAM( true );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Return to the baseline taken by setBaseline(), e.g. to run the same program
+once more with a reused Emulator. Only the pages of the RAM written to since
+then are restored, and only the code translated from them is dropped, so this
+takes time in proportion to the memory the program has written to, and code
+which hasn't been modified stays translated. Must not be called while the
+Emulator is running.
+\return false if there is no baseline, e.g. as another program has been
+loaded
 */
 /*----------------------------------------------------------------------------*/
-void Emulator::writeMem16( uint32_t address, uint16_t d )
+bool Emulator::resetToBaseline()
 {
-   writeMem8( address,       d        & 0xff );
-   writeMem8( address + 1, ( d >> 8 ) & 0xff );
+   if( !m_pRAM->resetToBaseline( m_RestoredPages ) )
+      return( false );
+
+   for( size_t i = 0; i < m_Harts.size(); i++ )
+   {
+      for( size_t p = 0; p < m_RestoredPages.size(); p++ )
+      {
+         m_Harts[i]->invalidateCode( m_RAMStart + m_RestoredPages[p], GuestRAM::PAGE_SIZE );
+      }
+      m_Harts[i]->setState( m_BaselineHarts[i] );
+   }
+
+   std::vector<MemoryBus::Device *> devices;
+   std::vector<uint32_t> starts;
+   m_Bus.getDevices( devices, starts );
+   for( size_t i = 0; i < devices.size() && i < m_BaselineDevices.size(); i++ )
+   {
+      devices[i]->restoreState( m_BaselineDevices[i] );
+   }
+   m_pSyscalls->restoreState( m_BaselineSyscalls );
+   m_StopEmulation = false;
+
+   return( true );
 }
 
 
 /*----------------------------------------------------------------------------*/
-/*! 2024-08-15
-This method is invoked when the CPU writes a word.
-\param address The memory address to write to
-\param d The value to write
+/*! 2026-10-16
+Share the pages of the RAM which haven't changed since the previous call with
+all other Emulators using the same deduplicator, see GuestRAM::deduplicate().
+A shared page is copied again when it is written to. Loading a program stops
+sharing all pages. Must not be called while the Emulator is running.
+Only Linux can replace a shared page without the other harts seeing it empty
+for a moment, so elsewhere, only an Emulator with a single hart shares pages.
+\param pDeduplicator The deduplicator, which has to be the same in every call
+and has to live longer than the Emulator
+\return The number of pages shared by this call
+*/
+/*----------------------------------------------------------------------------*/
+size_t Emulator::deduplicate( PageDeduplicator *pDeduplicator )
+{
+#if !defined( __linux__ )
+   if( m_Harts.size() > 1 )
+      return( 0 );
+#endif
+
+   size_t numShared = m_pRAM->deduplicate( pDeduplicator );
+   mapRAM( m_pRAM->tracksWrites() );
+
+   return( numShared );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\return The number of bytes of the RAM shared with other Emulators
+*/
+/*----------------------------------------------------------------------------*/
+size_t Emulator::getSharedRAM() const
+{
+   return( m_pRAM->getSharedSize() );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Let the harts call the host instead of the routines of the current program
+which are carried out by the host.
+*/
+/*----------------------------------------------------------------------------*/
+void Emulator::installHostRoutines()
+{
+   std::vector<uint32_t> addresses = m_pHostRoutines->find( m_Symbols );
+   for( size_t i = 0; i < m_Harts.size(); i++ )
+   {
+      m_Harts[i]->setHostRoutines( addresses );
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Give all harts direct access to the RAM.
+\param trackWrites true if the harts have to check the dirty flag of every
+page they write to, which is only necessary while there is a baseline or
+pages are shared
+*/
+/*----------------------------------------------------------------------------*/
+void Emulator::mapRAM( bool trackWrites )
+{
+   for( size_t i = 0; i < m_Harts.size(); i++ )
+   {
+      m_Harts[i]->mapRAM( m_RAMStart, m_pRAM->getSize(), m_pRAM->getData(),
+                          trackWrites ? m_pRAM->getDirtyPages() : 0 );
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\return The number of bytes of the RAM written to since the baseline has been
+taken
+*/
+/*----------------------------------------------------------------------------*/
+size_t Emulator::getDirtyRAM() const
+{
+   return( m_pRAM->getNumDirtyPages() * GuestRAM::PAGE_SIZE );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\return The symbols of the program, which are only available for ELF files
+*/
+/*----------------------------------------------------------------------------*/
+const SymbolTable &Emulator::getSymbols() const
+{
+   return( m_Symbols );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\return The routines carried out by the host, e.g. for their statistics
+*/
+/*----------------------------------------------------------------------------*/
+const HostRoutines &Emulator::getHostRoutines() const
+{
+   return( *m_pHostRoutines );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\return The size of the RAM in bytes
+*/
+/*----------------------------------------------------------------------------*/
+uint32_t Emulator::getRAMSize() const
+{
+   return( m_pRAM->getSize() );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\return The number of bytes of the RAM which are backed by physical memory of
+the host, i.e. the pages which have been touched by the program
+*/
+/*----------------------------------------------------------------------------*/
+size_t Emulator::getResidentRAM() const
+{
+   return( m_pRAM->getResidentSize() );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Look up a range of guest addresses in the RAM, e.g. for a device reading a
+buffer of the guest program at once.
+\param address The guest address of the range
+\param size The size of the range in bytes
+\return The host address of the range, or nullptr if the range isn't
+completely within the RAM
+*/
+/*----------------------------------------------------------------------------*/
+const uint8_t *Emulator::getRAM( uint32_t address, uint32_t size ) const
+{
+   uint32_t offset = address - m_RAMStart;
+   if( ( offset >= m_pRAM->getSize() ) || ( size > m_pRAM->getSize() - offset ) )
+      return( 0 );
+
+   return( m_pRAM->getData() + offset );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Look up a range of guest addresses in the RAM for being written by the host,
+e.g. by a system call. The pages of the range are prepared like for a store of
+the CPU, see GuestRAM::touch(). The caller has to drop the code translated
+from the range after writing to it.
+\param address The guest address of the range
+\param size The size of the range in bytes
+\return The host address of the range, or nullptr if the range isn't
+completely within the RAM
+*/
+/*----------------------------------------------------------------------------*/
+uint8_t *Emulator::touchRAM( uint32_t address, uint32_t size )
+{
+   uint32_t offset = address - m_RAMStart;
+   if( ( offset >= m_pRAM->getSize() ) || ( size > m_pRAM->getSize() - offset ) )
+      return( 0 );
+
+   if( size > 0 )
+   {
+      m_pRAM->touch( offset, size );
+   }
+
+   return( m_pRAM->getData() + offset );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Drop the code translated from a range of the RAM and the reservations
+overlapping it after a device has written to it, like for a store of the hart
+whose access to the device has caused the write. Outside of the emulation,
+this is done for all harts.
+\param address The guest address of the range
+\param size The size of the range in bytes
 */
 /*----------------------------------------------------------------------------*/
-void Emulator::writeMem32( uint32_t address, uint32_t d )
+void Emulator::invalidateWritten( uint32_t address, uint32_t size )
 {
-   writeMem8( address,       d         & 0xff );
-   writeMem8( address + 1, ( d >> 8  ) & 0xff );
-   writeMem8( address + 2, ( d >> 16 ) & 0xff );
-   writeMem8( address + 3, ( d >> 24 ) & 0xff );
+   if( pRunningHart )
+   {
+      pRunningHart->invalidateWritten( address, size );
+      return;
+   }
+
+   for( size_t i = 0; i < m_Harts.size(); i++ )
+   {
+      m_Harts[i]->invalidateWritten( address, size );
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Collect the output of the guest program and the messages about stopped harts
+in a string instead of printing them to stdout, e.g. when running several
+Emulators at once.
+\param pOutput The string to append the output to, or nullptr for stdout
+*/
+/*----------------------------------------------------------------------------*/
+void Emulator::captureOutput( std::string *pOutput )
+{
+   m_pConsole->setCapture( pOutput );
 }
 
 
 /*----------------------------------------------------------------------------*/
 /*! 2024-08-15
-This method is invoked when the CPU encounters an unknown/illegal optode.
+This method is invoked when the CPU encounters an unknown/illegal optode. The
+other harts are stopped as well, the message is printed when the hart returns
+from run().
 */
 /*----------------------------------------------------------------------------*/
 void Emulator::unknownOpcode()
 {
-   printf( "Unknown opcode found at 0x%x.\n", m_pCPU->getPC() );
-   m_StopEmulation = true;
+   halt();
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+This method is invoked when a hart executes an ECALL instruction, i.e. makes a
+system call.
+\param pHart The hart
+*/
+/*----------------------------------------------------------------------------*/
+void Emulator::environmentCall( RISCV *pHart )
+{
+   m_pSyscalls->handle( pHart );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+This method is invoked when a hart calls a routine which is carried out by the
+host, see setHostRoutines().
+\param pHart The hart
+\param address The start address of the routine
+*/
+/*----------------------------------------------------------------------------*/
+void Emulator::hostRoutine( RISCV *pHart, uint32_t address )
+{
+   m_pHostRoutines->call( pHart, address );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\return The exit status of the program, see SyscallHandler::getExitStatus()
+*/
+/*----------------------------------------------------------------------------*/
+int Emulator::getExitStatus() const
+{
+   return( m_pSyscalls->getExitStatus() );
 }
 
 
 /*----------------------------------------------------------------------------*/
 /*! 2024-08-15
 \return true if the emulation has been stopped, i.e. the CPU has encountered
-an illegal opcode.
+an illegal opcode or the program has written to the halt register.
 */
 /*----------------------------------------------------------------------------*/
 bool Emulator::emulationStopped() const
 {
    return( m_StopEmulation );
 }
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\return The number of harts
+*/
+/*----------------------------------------------------------------------------*/
+int Emulator::getNumHarts() const
+{
+   return( (int)m_Harts.size() );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\param hart The index of the hart, which is also its hart id
+\return The emulated CPU of the hart
+*/
+/*----------------------------------------------------------------------------*/
+const RISCV *Emulator::getCPU( int hart ) const
+{
+   return( m_Harts[hart] );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\return The memory bus, e.g. for mapping additional devices into the address
+space
+*/
+/*----------------------------------------------------------------------------*/
+MemoryBus *Emulator::getBus()
+{
+   return( &m_Bus );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\return The number of quanta the harts have been run for with a quantum set
+*/
+/*----------------------------------------------------------------------------*/
+uint64_t Emulator::getQuanta() const
+{
+   return( m_Quanta );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\return The time in seconds spent on switching between the harts with a
+quantum set, i.e. outside of the harts' execution
+*/
+/*----------------------------------------------------------------------------*/
+double Emulator::getSchedulingOverhead() const
+{
+   return( m_SchedulingOverhead );
+}
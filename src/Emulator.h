@@ -28,18 +28,63 @@
 #define __EMULATOR_H__
 
 #include <string>
+#include <vector>
+#include <atomic>
+#include <stdio.h>
 
 #include "RISCV.h"
+#include "MemoryBus.h"
+#include "ConsoleDevice.h"
+#include "BlockDevice.h"
+#include "DMADevice.h"
+#include "FileWindow.h"
+#include "GuestRAM.h"
+#include "SymbolTable.h"
+#include "SyscallHandler.h"
+#include "HostRoutines.h"
 
-class Emulator : public RISCV::MemoryInterface
+class Emulator final : public RISCV::MemoryInterface
 {
    public:
-      static Emulator *create( std::string fileName );
+      static const int MAX_HARTS = 64;
+      static const uint32_t DEFAULT_RAM_SIZE = 0x08000000;
+      static const uint32_t MAX_RAM_SIZE = 0x80000000;
+
+      static Emulator *create( std::string fileName, int numHarts = 1, uint32_t ramSize = DEFAULT_RAM_SIZE, bool hugePages = false );
       ~Emulator();
 
+      bool load( std::string fileName );
+      bool attachDisk( std::string fileName );
+      bool mapFile( uint32_t address, std::string fileName );
+      bool saveSnapshot( std::string fileName ) const;
+      void setBaseline();
+      bool resetToBaseline();
+      size_t deduplicate( PageDeduplicator *pDeduplicator );
+      void captureOutput( std::string *pOutput );
       void step();
+      RISCV::RunResult run( uint64_t maxInstructions );
+      bool setEngine( RISCV::Engine engine );
+      void setDynamicBinding( bool dynamicBinding );
+      void setQuantum( uint64_t quantum );
+      void setHostRoutines( HostRoutines::Mode mode );
+      void halt();
 
       bool emulationStopped() const;
+      int getNumHarts() const;
+      const RISCV *getCPU( int hart = 0 ) const;
+      uint64_t getQuanta() const;
+      double getSchedulingOverhead() const;
+      uint32_t getRAMSize() const;
+      size_t getResidentRAM() const;
+      const uint8_t *getRAM( uint32_t address, uint32_t size ) const;
+      uint8_t *touchRAM( uint32_t address, uint32_t size );
+      void invalidateWritten( uint32_t address, uint32_t size );
+      int getExitStatus() const;
+      size_t getDirtyRAM() const;
+      size_t getSharedRAM() const;
+      const SymbolTable &getSymbols() const;
+      const HostRoutines &getHostRoutines() const;
+      MemoryBus *getBus();
 
       virtual uint8_t readMem8( uint32_t address );
       virtual uint16_t readMem16( uint32_t address );
@@ -47,18 +92,155 @@ class Emulator : public RISCV::MemoryInterface
       virtual void writeMem8( uint32_t address, uint8_t d );
       virtual void writeMem16( uint32_t address, uint16_t d );
       virtual void writeMem32( uint32_t address, uint32_t d );
+      virtual void markDirty( uint32_t address );
       virtual void unknownOpcode();
+      virtual void environmentCall( RISCV *pHart );
+      virtual void hostRoutine( RISCV *pHart, uint32_t address );
 
    private:
-      Emulator( uint8_t *pProgramData, size_t programDataSize );
+      static const uint32_t CONSOLE_ADDRESS = 0x00000000;
+      static const uint32_t DISK_ADDRESS = 0x10001000;
+      static const uint32_t DMA_ADDRESS = 0x10002000;
+
+      // Layout of snapshot files: a header, the state of every hart, the
+      // state of every device, the state of the system calls (since version
+      // 2) and the RAM at the next multiple of SNAPSHOT_ALIGNMENT, which is
+      // at least the page size of any host
+      static const uint32_t SNAPSHOT_VERSION = 2;
+      static const uint32_t SNAPSHOT_HEADER_SIZE = 32;
+      static const uint32_t SNAPSHOT_HART_SIZE = 36 * 4;
+      static const uint32_t SNAPSHOT_ALIGNMENT = 0x10000;
+      static const uint32_t SNAPSHOT_MAX_HEADER = 0x01000000;
+
+      Emulator( int numHarts, GuestRAM *pRAM );
+      bool loadProgram( std::string fileName );
+      static bool isSnapshot( std::string fileName );
+      static bool readSnapshotHeader( std::string fileName, std::vector<uint8_t> &header );
+      bool restoreSnapshot( std::string fileName );
+      void mapRAM( bool trackWrites );
+      void installHostRoutines();
+      void runHart( int hart, uint64_t maxInstructions, RISCV::RunResult *pResult );
+      void runScheduled( uint64_t maxInstructions, std::vector<RISCV::RunResult> &results );
+      void report( int hart, const RISCV::RunResult &result );
 
-      RISCV *m_pCPU;
-      uint8_t *m_pProgramData;
-      size_t m_ProgramDataSize;
+      std::vector<RISCV *> m_Harts;
+      MemoryBus m_Bus;
+      ConsoleDevice *m_pConsole;
+      BlockDevice *m_pDisk;
+      DMADevice *m_pDMA;
+      SyscallHandler *m_pSyscalls;
+      HostRoutines *m_pHostRoutines;
+      std::vector<FileWindow *> m_FileWindows;
       uint32_t m_RAMStart;
-      uint32_t m_RAMSize;
-      uint8_t *m_pRAM;
-      bool m_StopEmulation;
+      GuestRAM *m_pRAM;
+      uint32_t m_EntryPoint;
+      SymbolTable m_Symbols;
+      std::vector<RISCV::State> m_BaselineHarts;
+      std::vector<std::vector<uint8_t> > m_BaselineDevices;
+      std::vector<uint8_t> m_BaselineSyscalls;
+      std::vector<uint32_t> m_RestoredPages;
+      std::atomic<bool> m_StopEmulation;
+      bool m_DynamicBinding;
+      uint64_t m_Quantum;
+      uint64_t m_Quanta;
+      double m_SchedulingOverhead;
 };
 
+
+/*----------------------------------------------------------------------------*/
+/*! 2024-08-15
+This method is invoked when the CPU reads a byte.
+\param address The memory address to read from
+\return The value
+*/
+/*----------------------------------------------------------------------------*/
+inline uint8_t Emulator::readMem8( uint32_t address )
+{
+   return( m_Bus.readMem8( address ) );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2024-08-15
+This method is invoked when the CPU reads a half-word.
+\param address The memory address to read from
+\return The value
+*/
+/*----------------------------------------------------------------------------*/
+inline uint16_t Emulator::readMem16( uint32_t address )
+{
+   return( m_Bus.readMem16( address ) );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2024-08-15
+This method is invoked when the CPU reads a word.
+\param address The memory address to read from
+\return The value
+*/
+/*----------------------------------------------------------------------------*/
+inline uint32_t Emulator::readMem32( uint32_t address )
+{
+   return( m_Bus.readMem32( address ) );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2024-08-15
+This method is invoked when the CPU writes a byte.
+\param address The memory address to write to
+\param d The value to write
+*/
+/*----------------------------------------------------------------------------*/
+inline void Emulator::writeMem8( uint32_t address, uint8_t d )
+{
+   if( address - m_RAMStart < m_pRAM->getSize() )
+      m_pRAM->touch( address - m_RAMStart );
+   m_Bus.writeMem8( address, d );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2024-08-15
+This method is invoked when the CPU writes a half-word.
+\param address The memory address to write to
+\param d The value to write
+*/
+/*----------------------------------------------------------------------------*/
+inline void Emulator::writeMem16( uint32_t address, uint16_t d )
+{
+   if( address - m_RAMStart < m_pRAM->getSize() )
+      m_pRAM->touch( address - m_RAMStart, 2 );
+   m_Bus.writeMem16( address, d );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2024-08-15
+This method is invoked when the CPU writes a word.
+\param address The memory address to write to
+\param d The value to write
+*/
+/*----------------------------------------------------------------------------*/
+inline void Emulator::writeMem32( uint32_t address, uint32_t d )
+{
+   if( address - m_RAMStart < m_pRAM->getSize() )
+      m_pRAM->touch( address - m_RAMStart, 4 );
+   m_Bus.writeMem32( address, d );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+This method is invoked before the CPU writes to a page of the RAM for the
+first time since the baseline has been taken.
+\param address A memory address within the page
+*/
+/*----------------------------------------------------------------------------*/
+inline void Emulator::markDirty( uint32_t address )
+{
+   m_pRAM->touch( address - m_RAMStart );
+}
+
 #endif
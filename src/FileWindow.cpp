@@ -0,0 +1,134 @@
+/*******************************************************************************
+ *  Copyright (c) 2024 Christian Nowak <chnowak@web.de>                        *
+ *   This file is part of chn's RISC-V-Emulator.                               *
+ *                                                                             *
+ *  RISC-V-Emulator is free software: you can redistribute it and/or modify it *
+ *  under the terms of the GNU General Public License as published by the Free *
+ *  Software Foundation, either version 3 of the License, or (at your option)  *
+ *  any later version.                                                         *
+ *                                                                             *          
+ *  RISC-V-Emulator is distributed in the hope that it will be useful, but     * 
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY *
+ *  or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License    *
+ *  for more details.                                                          *
+ *                                                                             *
+ *  You should have received a copy of the GNU General Public License along    *
+ *  with RISC-V-Emulator. If not, see <https://www.gnu.org/licenses/>.         *
+ *******************************************************************************/
+
+/*----------------------------------------------------------------------------*/
+/*!
+\file FileWindow.cpp
+\author Christian Nowak <chnowak@web.de>
+\brief This implements host files mapped into the address space of the guest
+*/
+/*----------------------------------------------------------------------------*/
+#if !defined( _WIN32 )
+#define FILEWINDOW_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "FileWindow.h"
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Constructor for class FileWindow
+\param pData The mapped file
+\param size The size of the mapping in bytes
+*/
+/*----------------------------------------------------------------------------*/
+FileWindow::FileWindow( uint8_t *pData, uint32_t size ) :
+   m_pData( pData ),
+   m_Size( size )
+{
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Destructor for class FileWindow. The file is unmapped.
+*/
+/*----------------------------------------------------------------------------*/
+FileWindow::~FileWindow()
+{
+#ifdef FILEWINDOW_MMAP
+   munmap( m_pData, m_Size );
+#endif
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Map a file. The mapping is rounded up to a multiple of PAGE_SIZE, where the
+bytes beyond the end of the file read as 0.
+\param fileName The file
+\return A pointer to the new FileWindow instance or nullptr if the file
+couldn't be mapped, is empty or is larger than 4GB minus a page
+*/
+/*----------------------------------------------------------------------------*/
+FileWindow *FileWindow::create( std::string fileName )
+{
+#ifdef FILEWINDOW_MMAP
+   int fd = open( fileName.c_str(), O_RDONLY );
+   if( fd < 0 )
+      return( 0 );
+
+   struct stat st;
+   if( ( fstat( fd, &st ) != 0 ) || !S_ISREG( st.st_mode ) || ( st.st_size == 0 ) )
+   {
+      close( fd );
+      return( 0 );
+   }
+
+   // Beyond the end of the file, mmap() only provides the rest of its last
+   // host page. Any further pages are mapped anonymously.
+   uint64_t pageSize = sysconf( _SC_PAGESIZE ) > (long)PAGE_SIZE ? (uint64_t)sysconf( _SC_PAGESIZE ) : PAGE_SIZE;
+   uint64_t size = ( st.st_size + pageSize - 1 ) & ~( pageSize - 1 );
+   if( size > 0x100000000ULL - PAGE_SIZE )
+   {
+      close( fd );
+      return( 0 );
+   }
+   void *p = mmap( 0, size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+   if( ( p != MAP_FAILED ) &&
+       ( mmap( p, (size_t)st.st_size, PROT_READ, MAP_SHARED | MAP_FIXED, fd, 0 ) == MAP_FAILED ) )
+   {
+      munmap( p, size );
+      p = MAP_FAILED;
+   }
+   close( fd );
+
+   if( p == MAP_FAILED )
+      return( 0 );
+
+   return( new FileWindow( (uint8_t *)p, (uint32_t)size ) );
+#else
+   return( 0 );
+#endif
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\return The mapped file. The memory must not be written to.
+*/
+/*----------------------------------------------------------------------------*/
+uint8_t *FileWindow::getData() const
+{
+   return( m_pData );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\return The size of the mapping in bytes, a multiple of PAGE_SIZE
+*/
+/*----------------------------------------------------------------------------*/
+uint32_t FileWindow::getSize() const
+{
+   return( m_Size );
+}
@@ -0,0 +1,61 @@
+/*******************************************************************************
+ *  Copyright (c) 2024 Christian Nowak <chnowak@web.de>                        *
+ *   This file is part of chn's RISC-V-Emulator.                               *
+ *                                                                             *
+ *  RISC-V-Emulator is free software: you can redistribute it and/or modify it *
+ *  under the terms of the GNU General Public License as published by the Free *
+ *  Software Foundation, either version 3 of the License, or (at your option)  *
+ *  any later version.                                                         *
+ *                                                                             *          
+ *  RISC-V-Emulator is distributed in the hope that it will be useful, but     * 
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY *
+ *  or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License    *
+ *  for more details.                                                          *
+ *                                                                             *
+ *  You should have received a copy of the GNU General Public License along    *
+ *  with RISC-V-Emulator. If not, see <https://www.gnu.org/licenses/>.         *
+ *******************************************************************************/
+
+/*----------------------------------------------------------------------------*/
+/*!
+\file FileWindow.h
+\author Christian Nowak <chnowak@web.de>
+\brief Headerfile for class FileWindow.
+*/
+/*----------------------------------------------------------------------------*/
+#ifndef __FILEWINDOW_H__
+#define __FILEWINDOW_H__
+
+#include <cstdint>
+#include <string>
+
+/*----------------------------------------------------------------------------*/
+/*!
+\class FileWindow
+\date  2026-10-16
+A host file mapped read-only and shared into the host memory, so it can be
+mapped as read-only RAM into the address space of the guest. The guest reads
+the pages of the page cache of the host, which are shared by all Emulators
+and processes mapping the same file, without any copy. Only available on
+POSIX hosts.
+*/
+/*----------------------------------------------------------------------------*/
+class FileWindow
+{
+   public:
+      static const uint32_t PAGE_SIZE = 4096;
+
+      static FileWindow *create( std::string fileName );
+      ~FileWindow();
+
+      uint8_t *getData() const;
+      uint32_t getSize() const;
+
+   private:
+      FileWindow( uint8_t *pData, uint32_t size );
+
+      uint8_t *m_pData;
+      uint32_t m_Size;
+};
+
+#endif
@@ -0,0 +1,693 @@
+/*******************************************************************************
+ *  Copyright (c) 2024 Christian Nowak <chnowak@web.de>                        *
+ *   This file is part of chn's RISC-V-Emulator.                               *
+ *                                                                             *
+ *  RISC-V-Emulator is free software: you can redistribute it and/or modify it *
+ *  under the terms of the GNU General Public License as published by the Free *
+ *  Software Foundation, either version 3 of the License, or (at your option)  *
+ *  any later version.                                                         *
+ *                                                                             *          
+ *  RISC-V-Emulator is distributed in the hope that it will be useful, but     * 
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY *
+ *  or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License    *
+ *  for more details.                                                          *
+ *                                                                             *
+ *  You should have received a copy of the GNU General Public License along    *
+ *  with RISC-V-Emulator. If not, see <https://www.gnu.org/licenses/>.         *
+ *******************************************************************************/
+
+/*----------------------------------------------------------------------------*/
+/*!
+\file GuestRAM.cpp
+\author Christian Nowak <chnowak@web.de>
+\brief This implements the host memory of the guest RAM
+*/
+/*----------------------------------------------------------------------------*/
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <fstream>
+
+#if !defined( _WIN32 )
+#define GUESTRAM_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "GuestRAM.h"
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Constructor for class GuestRAM
+\param pData The host memory
+\param size The size of the host memory in bytes
+\param hugePages true if transparent huge pages have been requested
+*/
+/*----------------------------------------------------------------------------*/
+GuestRAM::GuestRAM( uint8_t *pData, uint32_t size, bool hugePages ) :
+   m_pData( pData ),
+   m_Size( size ),
+   m_HugePages( hugePages ),
+   m_pDirtyPages( new std::atomic<uint8_t>[( size + PAGE_SIZE - 1 ) >> PAGE_BITS] ),
+   m_Baseline( true ),
+   m_SavedPages( ( size + PAGE_SIZE - 1 ) >> PAGE_BITS, false ),
+   m_pDeduplicator( 0 ),
+   m_NumSharedPages( 0 )
+{
+   dropBaseline();
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Destructor for class GuestRAM
+*/
+/*----------------------------------------------------------------------------*/
+GuestRAM::~GuestRAM()
+{
+   releaseSharedPages();
+#ifdef GUESTRAM_MMAP
+   munmap( m_pData, m_Size );
+#else
+   free( m_pData );
+#endif
+   delete[] m_pDirtyPages;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Reserve cleared host memory for the guest RAM.
+\param size The size in bytes
+\param hugePages true to request transparent huge pages, which is ignored if
+the host doesn't support them
+\return A pointer to the new GuestRAM instance or nullptr on failure
+*/
+/*----------------------------------------------------------------------------*/
+GuestRAM *GuestRAM::create( uint32_t size, bool hugePages )
+{
+   if( size == 0 )
+      return( 0 );
+
+   uint8_t *pData = allocate( 0, size, hugePages );
+   if( !pData )
+      return( 0 );
+
+   return( new GuestRAM( pData, size, hugePages ) );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Map cleared memory, which is committed page by page on demand.
+\param pAddress nullptr for a new mapping or the address of an existing
+mapping to be replaced
+\param size The size in bytes
+\param hugePages true to request transparent huge pages
+\return The address of the mapping or nullptr on failure
+*/
+/*----------------------------------------------------------------------------*/
+uint8_t *GuestRAM::allocate( uint8_t *pAddress, uint32_t size, bool hugePages )
+{
+#ifdef GUESTRAM_MMAP
+   // MAP_NORESERVE: the RAM of idle instances doesn't count against the
+   // overcommit limit of the host
+   int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+   if( pAddress )
+      flags |= MAP_FIXED;
+
+   void *p = mmap( pAddress, size, PROT_READ | PROT_WRITE, flags, -1, 0 );
+   if( p == MAP_FAILED )
+      return( 0 );
+
+#ifdef MADV_HUGEPAGE
+   if( hugePages )
+   {
+      madvise( p, size, MADV_HUGEPAGE );
+   }
+#endif
+
+   return( (uint8_t *)p );
+#else
+   if( pAddress )
+   {
+      memset( pAddress, 0, size );
+      return( pAddress );
+   }
+
+   return( (uint8_t *)calloc( size, 1 ) );
+#endif
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\return The host memory of the guest RAM
+*/
+/*----------------------------------------------------------------------------*/
+uint8_t *GuestRAM::getData() const
+{
+   return( m_pData );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\return The size of the guest RAM in bytes
+*/
+/*----------------------------------------------------------------------------*/
+uint32_t GuestRAM::getSize() const
+{
+   return( m_Size );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Determine how much of the guest RAM is backed by physical memory of the host.
+Unwritten pages of a loaded file count as soon as they are in the page cache
+of the host, although they are shared with other instances.
+\return The resident size in bytes
+*/
+/*----------------------------------------------------------------------------*/
+size_t GuestRAM::getResidentSize() const
+{
+#ifdef GUESTRAM_MMAP
+   size_t pageSize = sysconf( _SC_PAGESIZE );
+   size_t numPages = ( m_Size + pageSize - 1 ) / pageSize;
+#if defined( __APPLE__ )
+   std::vector<char> resident( numPages );
+#else
+   std::vector<unsigned char> resident( numPages );
+#endif
+   if( mincore( m_pData, m_Size, resident.data() ) != 0 )
+      return( m_Size );
+
+   size_t numResident = 0;
+   for( size_t i = 0; i < numPages; i++ )
+   {
+      numResident += resident[i] & 1;
+   }
+
+   return( numResident * pageSize );
+#else
+   return( m_Size );
+#endif
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Clear the guest RAM by returning its pages to the host and mapping new ones,
+which are committed on demand again. The address of the RAM doesn't change.
+The baseline is dropped and no pages are shared anymore.
+\return false on failure
+*/
+/*----------------------------------------------------------------------------*/
+bool GuestRAM::clear()
+{
+   dropBaseline();
+   releaseSharedPages();
+   return( allocate( m_pData, m_Size, m_HugePages ) != 0 );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Load a part of a binary file into the cleared RAM. Instead of reading it, the
+file is mapped privately into the RAM where possible, which takes the same
+time for any size of file. This requires the offset in the RAM and the offset
+in the file to be equal modulo the page size of the host, which is the case
+for the segments of ELF files and for flat binary files. Partial pages at both
+ends of the part are read, so the RAM before and after the part stays as it
+is. As long as the RAM hasn't been written to, changes of the file may become
+visible in it. The baseline is dropped.
+\param fileName The file to be loaded
+\param offset The offset in the RAM to load the part to
+\param fileOffset The offset of the part in the file
+\param size The size of the part in bytes. It is truncated at the end of the
+file and at the end of the RAM.
+\return false if the file couldn't be read
+*/
+/*----------------------------------------------------------------------------*/
+bool GuestRAM::load( std::string fileName, uint32_t offset, uint32_t fileOffset, uint32_t size )
+{
+   if( offset > m_Size )
+      return( false );
+
+   dropBaseline();
+
+#ifdef GUESTRAM_MMAP
+   int fd = open( fileName.c_str(), O_RDONLY );
+   if( fd < 0 )
+      return( false );
+
+   struct stat st;
+   if( ( fstat( fd, &st ) != 0 ) || !S_ISREG( st.st_mode ) )
+   {
+      close( fd );
+      return( false );
+   }
+
+   uint64_t available = (uint64_t)st.st_size > fileOffset ? st.st_size - fileOffset : 0;
+   if( size > available )
+      size = (uint32_t)available;
+   if( size > m_Size - offset )
+      size = m_Size - offset;
+
+   // Shared pages are mapped read-only
+   if( size > 0 )
+   {
+      touch( offset, size );
+   }
+
+   size_t pageSize = sysconf( _SC_PAGESIZE );
+   uint32_t head = size;
+   uint32_t body = 0;
+   if( ( offset - fileOffset ) % pageSize == 0 )
+   {
+      head = ( pageSize - offset % pageSize ) % pageSize;
+      if( head > size )
+         head = size;
+      body = ( size - head ) / pageSize * pageSize;
+   }
+
+   bool ok = true;
+   if( body > 0 )
+   {
+      ok = mmap( m_pData + offset + head, body, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, fileOffset + head ) != MAP_FAILED;
+   }
+
+   ok = ok && readFile( fd, m_pData + offset, fileOffset, head ) &&
+      readFile( fd, m_pData + offset + head + body, fileOffset + head + body, size - head - body );
+   close( fd );
+
+   return( ok );
+#else
+   std::ifstream binFile( fileName, std::ios::binary );
+   if( !binFile )
+      return( false );
+
+   binFile.seekg( fileOffset, std::ios::beg );
+   binFile.read( (char *)m_pData + offset, size > m_Size - offset ? m_Size - offset : size );
+
+   return( true );
+#endif
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Write the contents of the RAM to a file. Pages which only contain zeros are
+skipped, which leaves holes in the file on most file systems, so the file only
+takes as much space as the RAM which is in use. The file is extended to the
+full size of the RAM, so it can be loaded by load().
+\param file The file
+\param fileOffset The offset in the file to write the RAM to. To map the RAM
+back by load(), it has to be a multiple of the page size of the host.
+\return false on failure
+*/
+/*----------------------------------------------------------------------------*/
+bool GuestRAM::save( std::ofstream &file, uint64_t fileOffset ) const
+{
+   bool lastWritten = false;
+   for( uint32_t offset = 0; offset < m_Size; offset += PAGE_SIZE )
+   {
+      uint32_t size = m_Size - offset < PAGE_SIZE ? m_Size - offset : PAGE_SIZE;
+      const uint8_t *p = m_pData + offset;
+      lastWritten = ( p[0] != 0 ) || ( memcmp( p, p + 1, size - 1 ) != 0 );
+      if( lastWritten )
+      {
+         file.seekp( fileOffset + offset, std::ios::beg );
+         file.write( (const char *)p, size );
+      }
+   }
+
+   if( !lastWritten )
+   {
+      file.seekp( fileOffset + m_Size - 1, std::ios::beg );
+      file.put( 0 );
+   }
+
+   return( file.good() );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\return A flag per page of the RAM which is set if the page has been written to
+since the baseline has been taken. Writing to a page whose flag isn't set
+requires calling touch() first. Without a baseline, all flags are set.
+*/
+/*----------------------------------------------------------------------------*/
+const std::atomic<uint8_t> *GuestRAM::getDirtyPages() const
+{
+   return( m_pDirtyPages );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Make the current contents of the RAM its baseline, which resetToBaseline()
+returns to. Must not be called while the RAM is written to.
+*/
+/*----------------------------------------------------------------------------*/
+void GuestRAM::setBaseline()
+{
+   for( uint32_t page = 0; page < ( m_Size + PAGE_SIZE - 1 ) >> PAGE_BITS; page++ )
+   {
+      m_pDirtyPages[page].store( 0, std::memory_order_relaxed );
+   }
+   m_SavedPages.assign( m_SavedPages.size(), false );
+   m_DirtyPageList.clear();
+   m_BaselineData.clear();
+   m_Baseline = true;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Restore the contents of the RAM at the time the baseline has been taken by
+copying back the pages written to since then. The baseline stays, so the RAM
+can be reset again. Must not be called while the RAM is written to.
+\param pages Receives the offsets of the restored pages in the RAM, e.g. for
+invalidating the code translated from them
+\return false if no baseline has been taken
+*/
+/*----------------------------------------------------------------------------*/
+bool GuestRAM::resetToBaseline( std::vector<uint32_t> &pages )
+{
+   pages.clear();
+   if( !m_Baseline )
+      return( false );
+
+   for( size_t i = 0; i < m_DirtyPageList.size(); i++ )
+   {
+      uint32_t page = m_DirtyPageList[i];
+      uint32_t offset = page << PAGE_BITS;
+      if( !m_SharedSlots.empty() && ( m_SharedSlots[page] != PageDeduplicator::NO_SLOT ) )
+      {
+         unshare( page, false );
+      }
+      memcpy( m_pData + offset, &m_BaselineData[i << PAGE_BITS],
+              m_Size - offset < PAGE_SIZE ? m_Size - offset : PAGE_SIZE );
+      m_pDirtyPages[page].store( 0, std::memory_order_relaxed );
+      m_SavedPages[page] = false;
+      pages.push_back( offset );
+   }
+   m_DirtyPageList.clear();
+   m_BaselineData.clear();
+
+   return( true );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\return The number of pages written to since the baseline has been taken
+*/
+/*----------------------------------------------------------------------------*/
+size_t GuestRAM::getNumDirtyPages() const
+{
+   return( m_Baseline ? m_DirtyPageList.size() : 0 );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Prepare a page of the RAM whose dirty flag isn't set for being written to:
+save it if it hasn't been written to since the baseline has been taken, and
+copy it into a private page if it is shared. The flag of the page is only set
+afterwards, so other harts writing to it at the same time wait for the lock
+until it is ready.
+\param page The index of the page
+*/
+/*----------------------------------------------------------------------------*/
+void GuestRAM::savePage( uint32_t page )
+{
+   std::lock_guard<std::mutex> lock( m_BaselineMutex );
+   if( m_pDirtyPages[page].load( std::memory_order_relaxed ) )
+      return;
+
+   uint32_t offset = page << PAGE_BITS;
+   if( m_Baseline && !m_SavedPages[page] )
+   {
+      size_t i = m_BaselineData.size();
+      m_BaselineData.resize( i + PAGE_SIZE );
+      memcpy( &m_BaselineData[i], m_pData + offset, m_Size - offset < PAGE_SIZE ? m_Size - offset : PAGE_SIZE );
+      m_DirtyPageList.push_back( page );
+      m_SavedPages[page] = true;
+   }
+
+   // If the host has run out of mappings, the page stays read-only
+   if( !m_SharedSlots.empty() && ( m_SharedSlots[page] != PageDeduplicator::NO_SLOT ) &&
+       !unshare( page, true ) )
+      return;
+
+   m_pDirtyPages[page].store( 1, std::memory_order_release );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Drop the baseline, e.g. as the RAM is replaced, and stop saving pages.
+*/
+/*----------------------------------------------------------------------------*/
+void GuestRAM::dropBaseline()
+{
+   if( !m_Baseline )
+      return;
+
+   for( uint32_t page = 0; page < ( m_Size + PAGE_SIZE - 1 ) >> PAGE_BITS; page++ )
+   {
+      bool shared = !m_SharedSlots.empty() && ( m_SharedSlots[page] != PageDeduplicator::NO_SLOT );
+      m_pDirtyPages[page].store( shared ? 0 : 1, std::memory_order_relaxed );
+   }
+   m_DirtyPageList.clear();
+   m_BaselineData.clear();
+   m_Baseline = false;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Share the pages of the RAM with other RAMs using the same deduplicator. Every
+resident page whose contents haven't changed since the previous call is
+looked up in the deduplicator by its contents and mapped read-only from
+there, so pages with the same contents in several RAMs take host memory only
+once. Pages which only contain zeros are returned to the host instead. As
+pages are only shared if they haven't changed between two calls, pages which
+are written to frequently stay private. This takes time in proportion to the
+resident size of the RAM. Must not be called while the RAM is written to.
+\param pDeduplicator The deduplicator, which has to be the same in every call
+\return The number of pages shared by this call
+*/
+/*----------------------------------------------------------------------------*/
+size_t GuestRAM::deduplicate( PageDeduplicator *pDeduplicator )
+{
+#ifdef GUESTRAM_MMAP
+   static const uint8_t zeroPage[PAGE_SIZE] = { 0 };
+
+   if( !pDeduplicator || ( m_pDeduplicator && ( m_pDeduplicator != pDeduplicator ) ) )
+      return( 0 );
+
+   uint32_t numPages = ( m_Size + PAGE_SIZE - 1 ) >> PAGE_BITS;
+   if( !m_pDeduplicator )
+   {
+      m_pDeduplicator = pDeduplicator;
+      m_SharedSlots.assign( numPages, (uint32_t)PageDeduplicator::NO_SLOT );
+      m_PageHashes.assign( numPages, 0 );
+   }
+
+   // The deduplicator only exists if the pages of the host have 4KB, so
+   // every page of the host is a page of the RAM
+#if defined( __APPLE__ )
+   std::vector<char> resident( numPages );
+#else
+   std::vector<unsigned char> resident( numPages );
+#endif
+   if( !pDeduplicator->canMap() || ( mincore( m_pData, m_Size, resident.data() ) != 0 ) )
+      return( 0 );
+
+   uint64_t zeroHash = PageDeduplicator::hash( zeroPage );
+   size_t numShared = 0;
+   for( uint32_t page = 0; page < numPages; page++ )
+   {
+      if( ( m_SharedSlots[page] != PageDeduplicator::NO_SLOT ) || !( resident[page] & 1 ) )
+         continue;
+
+      uint8_t *p = m_pData + ( page << PAGE_BITS );
+      if( memcmp( p, zeroPage, PAGE_SIZE ) == 0 )
+      {
+         // A page which has only been read may be the zero page of the host
+         if( ( m_PageHashes[page] != zeroHash ) &&
+             ( mmap( p, PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0 ) != MAP_FAILED ) )
+         {
+            m_PageHashes[page] = zeroHash;
+         }
+         continue;
+      }
+
+      uint64_t hash = PageDeduplicator::hash( p );
+      if( hash != m_PageHashes[page] )
+      {
+         m_PageHashes[page] = hash;
+         continue;
+      }
+
+      uint32_t slot = pDeduplicator->acquire( p, hash );
+      if( slot == PageDeduplicator::NO_SLOT )
+         break;
+
+      if( mmap( p, PAGE_SIZE, PROT_READ, MAP_SHARED | MAP_FIXED, pDeduplicator->getFile(), PageDeduplicator::getFileOffset( slot ) ) == MAP_FAILED )
+      {
+         pDeduplicator->release( slot );
+         break;
+      }
+
+      m_SharedSlots[page] = slot;
+      m_NumSharedPages++;
+      m_pDirtyPages[page].store( 0, std::memory_order_relaxed );
+      numShared++;
+   }
+
+   return( numShared );
+#else
+   return( 0 );
+#endif
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\return The number of bytes of the RAM shared by the deduplicator
+*/
+/*----------------------------------------------------------------------------*/
+size_t GuestRAM::getSharedSize() const
+{
+   return( m_NumSharedPages * PAGE_SIZE );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\return true if there are pages whose dirty flag isn't set, i.e. writes to the
+RAM have to check the dirty flags and call touch()
+*/
+/*----------------------------------------------------------------------------*/
+bool GuestRAM::tracksWrites() const
+{
+   return( m_Baseline || ( m_NumSharedPages > 0 ) );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Stop sharing a page by mapping a private page in its place. On Linux, the
+private page is filled first and then moved into place, so other harts reading
+the page never see it empty. Elsewhere, the page reads as zeros until its
+contents have been copied back, see Emulator::deduplicate().
+\param page The index of the page
+\param keepContents true to copy the contents of the shared page
+\return false if the host has run out of mappings
+*/
+/*----------------------------------------------------------------------------*/
+bool GuestRAM::unshare( uint32_t page, bool keepContents )
+{
+#ifdef GUESTRAM_MMAP
+   uint8_t *p = m_pData + ( page << PAGE_BITS );
+#if defined( __linux__ )
+   void *pPrivate = mmap( 0, PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+   if( pPrivate == MAP_FAILED )
+      return( false );
+
+   if( keepContents )
+   {
+      memcpy( pPrivate, p, PAGE_SIZE );
+   }
+
+   if( mremap( pPrivate, PAGE_SIZE, PAGE_SIZE, MREMAP_MAYMOVE | MREMAP_FIXED, p ) == MAP_FAILED )
+   {
+      munmap( pPrivate, PAGE_SIZE );
+      return( false );
+   }
+#else
+   uint8_t contents[PAGE_SIZE];
+   if( keepContents )
+   {
+      memcpy( contents, p, PAGE_SIZE );
+   }
+
+   if( mmap( p, PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0 ) == MAP_FAILED )
+      return( false );
+
+   if( keepContents )
+   {
+      memcpy( p, contents, PAGE_SIZE );
+   }
+#endif
+
+   m_pDeduplicator->release( m_SharedSlots[page] );
+   m_SharedSlots[page] = PageDeduplicator::NO_SLOT;
+   m_PageHashes[page] = 0;
+   m_NumSharedPages--;
+#endif
+
+   return( true );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Release all shared pages in the deduplicator before the RAM is mapped anew.
+*/
+/*----------------------------------------------------------------------------*/
+void GuestRAM::releaseSharedPages()
+{
+   for( size_t page = 0; ( m_NumSharedPages > 0 ) && ( page < m_SharedSlots.size() ); page++ )
+   {
+      if( m_SharedSlots[page] != PageDeduplicator::NO_SLOT )
+      {
+         m_pDeduplicator->release( m_SharedSlots[page] );
+         m_SharedSlots[page] = PageDeduplicator::NO_SLOT;
+         m_NumSharedPages--;
+         if( !m_Baseline )
+         {
+            m_pDirtyPages[page].store( 1, std::memory_order_relaxed );
+         }
+      }
+   }
+   m_PageHashes.assign( m_PageHashes.size(), 0 );
+}
+
+
+#ifdef GUESTRAM_MMAP
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Read a part of a file into the RAM.
+\param fd The file
+\param pDest The destination in the RAM
+\param fileOffset The offset of the part in the file
+\param size The size of the part in bytes
+\return false on failure
+*/
+/*----------------------------------------------------------------------------*/
+bool GuestRAM::readFile( int fd, uint8_t *pDest, uint32_t fileOffset, uint32_t size )
+{
+   while( size > 0 )
+   {
+      ssize_t n = pread( fd, pDest, size, fileOffset );
+      if( n <= 0 )
+         return( false );
+
+      pDest += n;
+      fileOffset += n;
+      size -= n;
+   }
+
+   return( true );
+}
+#endif
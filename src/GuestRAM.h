@@ -0,0 +1,143 @@
+/*******************************************************************************
+ *  Copyright (c) 2024 Christian Nowak <chnowak@web.de>                        *
+ *   This file is part of chn's RISC-V-Emulator.                               *
+ *                                                                             *
+ *  RISC-V-Emulator is free software: you can redistribute it and/or modify it *
+ *  under the terms of the GNU General Public License as published by the Free *
+ *  Software Foundation, either version 3 of the License, or (at your option)  *
+ *  any later version.                                                         *
+ *                                                                             *          
+ *  RISC-V-Emulator is distributed in the hope that it will be useful, but     * 
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY *
+ *  or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License    *
+ *  for more details.                                                          *
+ *                                                                             *
+ *  You should have received a copy of the GNU General Public License along    *
+ *  with RISC-V-Emulator. If not, see <https://www.gnu.org/licenses/>.         *
+ *******************************************************************************/
+
+/*----------------------------------------------------------------------------*/
+/*!
+\file GuestRAM.h
+\author Christian Nowak <chnowak@web.de>
+\brief Headerfile for class GuestRAM.
+*/
+/*----------------------------------------------------------------------------*/
+#ifndef __GUESTRAM_H__
+#define __GUESTRAM_H__
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <fstream>
+#include <vector>
+#include <atomic>
+#include <mutex>
+
+#include "PageDeduplicator.h"
+
+/*----------------------------------------------------------------------------*/
+/*!
+\class GuestRAM
+\date  2026-10-16
+The host memory holding the RAM of the Emulator. On POSIX hosts, the whole
+size is only reserved as an anonymous mapping and the host commits a page
+when it is touched for the first time, so a guest only costs the memory it
+actually uses. Optionally, the host is asked to back the RAM by transparent
+huge pages, which reduces the TLB misses of guests using a lot of memory.
+Binary files are loaded by mapping them privately into the RAM: their pages
+are read from the file on demand, shared with all other instances which have
+loaded the same file, and only copied when they are written to. On other
+hosts, the RAM is allocated by calloc() and files are read into it.
+
+For reusing an instance for many runs of the same program, the current
+contents of the RAM can be made its baseline. From then on, every page is
+copied before it is written to for the first time, which is tracked by a
+dirty flag per page, and resetting to the baseline only copies those pages
+back, so it takes time in proportion to the memory written since then.
+
+The pages can also be shared with the RAMs of other instances holding the same
+contents by a PageDeduplicator. A shared page is mapped read-only and its
+dirty flag is cleared, so it is copied into a private page again before it is
+written to.
+*/
+/*----------------------------------------------------------------------------*/
+class GuestRAM
+{
+   public:
+      static const uint32_t PAGE_BITS = 12;
+      static const uint32_t PAGE_SIZE = 1 << PAGE_BITS;
+
+      static GuestRAM *create( uint32_t size, bool hugePages = false );
+      ~GuestRAM();
+
+      uint8_t *getData() const;
+      uint32_t getSize() const;
+      size_t getResidentSize() const;
+      bool clear();
+      bool load( std::string fileName, uint32_t offset = 0, uint32_t fileOffset = 0, uint32_t size = 0xffffffff );
+      bool save( std::ofstream &file, uint64_t fileOffset ) const;
+
+      const std::atomic<uint8_t> *getDirtyPages() const;
+      void touch( uint32_t offset, uint32_t n = 1 );
+      void setBaseline();
+      bool resetToBaseline( std::vector<uint32_t> &pages );
+      size_t getNumDirtyPages() const;
+      size_t deduplicate( PageDeduplicator *pDeduplicator );
+      size_t getSharedSize() const;
+      bool tracksWrites() const;
+
+   private:
+      GuestRAM( uint8_t *pData, uint32_t size, bool hugePages );
+      static uint8_t *allocate( uint8_t *pAddress, uint32_t size, bool hugePages );
+      static bool readFile( int fd, uint8_t *pDest, uint32_t fileOffset, uint32_t size );
+      void savePage( uint32_t page );
+      void dropBaseline();
+      bool unshare( uint32_t page, bool keepContents );
+      void releaseSharedPages();
+
+      uint8_t *m_pData;
+      uint32_t m_Size;
+      bool m_HugePages;
+
+      // A flag per page which is set once the page has been written to since
+      // the baseline has been taken. Without a baseline, all flags are set
+      // except for the shared pages.
+      std::atomic<uint8_t> *m_pDirtyPages;
+      bool m_Baseline;
+      std::mutex m_BaselineMutex;
+      std::vector<uint32_t> m_DirtyPageList;
+      std::vector<bool> m_SavedPages;
+      std::vector<uint8_t> m_BaselineData;
+
+      // The slot of every shared page in the deduplicator, and the hash of
+      // every other page when it was last scanned
+      PageDeduplicator *m_pDeduplicator;
+      std::vector<uint32_t> m_SharedSlots;
+      std::vector<uint64_t> m_PageHashes;
+      size_t m_NumSharedPages;
+};
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Must be called before a part of the RAM is written to. If a baseline has been
+taken, the pages of the part which haven't been written to since then are
+saved. This may be called by several harts at once.
+\param offset The offset of the part in the RAM, which has to be within the RAM
+\param n The size of the part in bytes
+*/
+/*----------------------------------------------------------------------------*/
+inline void GuestRAM::touch( uint32_t offset, uint32_t n )
+{
+   uint32_t last = offset + n - 1 < m_Size ? offset + n - 1 : m_Size - 1;
+   for( uint32_t page = offset >> PAGE_BITS; page <= last >> PAGE_BITS; page++ )
+   {
+      if( !m_pDirtyPages[page].load( std::memory_order_acquire ) )
+      {
+         savePage( page );
+      }
+   }
+}
+
+#endif
@@ -0,0 +1,514 @@
+/*******************************************************************************
+ *  Copyright (c) 2024 Christian Nowak <chnowak@web.de>                        *
+ *   This file is part of chn's RISC-V-Emulator.                               *
+ *                                                                             *
+ *  RISC-V-Emulator is free software: you can redistribute it and/or modify it *
+ *  under the terms of the GNU General Public License as published by the Free *
+ *  Software Foundation, either version 3 of the License, or (at your option)  *
+ *  any later version.                                                         *
+ *                                                                             *          
+ *  RISC-V-Emulator is distributed in the hope that it will be useful, but     * 
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY *
+ *  or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License    *
+ *  for more details.                                                          *
+ *                                                                             *
+ *  You should have received a copy of the GNU General Public License along    *
+ *  with RISC-V-Emulator. If not, see <https://www.gnu.org/licenses/>.         *
+ *******************************************************************************/
+
+/*----------------------------------------------------------------------------*/
+/*!
+\file HostRoutines.cpp
+\author Christian Nowak <chnowak@web.de>
+\brief This implements routines of the program carried out by the host
+*/
+/*----------------------------------------------------------------------------*/
+#include <string.h>
+#include <string>
+
+#include "HostRoutines.h"
+#include "Emulator.h"
+#include "util.h"
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Constructor for class HostRoutines. The routines are executed by the harts
+until a mode is set.
+\param pEmulator The Emulator whose RAM is accessed
+\param pConsole The console for reporting differences
+\param numHarts The number of harts which may call the routines
+*/
+/*----------------------------------------------------------------------------*/
+HostRoutines::HostRoutines( Emulator *pEmulator, ConsoleDevice *pConsole, int numHarts ) :
+   m_pEmulator( pEmulator ),
+   m_pConsole( pConsole ),
+   m_Mode( MODE_OFF ),
+   m_Checkers( numHarts, (RISCV *)0 ),
+   m_Calls( 0 ),
+   m_Mismatches( 0 )
+{
+   for( int i = 0; i < NUM_ROUTINES; i++ )
+   {
+      m_Addresses[i] = 0;
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Destructor for class HostRoutines
+*/
+/*----------------------------------------------------------------------------*/
+HostRoutines::~HostRoutines()
+{
+   for( size_t i = 0; i < m_Checkers.size(); i++ )
+   {
+      delete m_Checkers[i];
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Select whether the routines are carried out by the host or checked. This only
+takes effect with the next call of find().
+\param mode The mode
+*/
+/*----------------------------------------------------------------------------*/
+void HostRoutines::setMode( Mode mode )
+{
+   m_Mode = mode;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\return The mode
+*/
+/*----------------------------------------------------------------------------*/
+HostRoutines::Mode HostRoutines::getMode() const
+{
+   return( m_Mode );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Look up the routines in the symbol table of a program.
+\param symbols The symbols of the program
+\return The start addresses of the routines found, which are to be passed to
+RISCV::setHostRoutines(). Empty if the mode is MODE_OFF.
+*/
+/*----------------------------------------------------------------------------*/
+std::vector<uint32_t> HostRoutines::find( const SymbolTable &symbols )
+{
+   std::vector<uint32_t> addresses;
+   for( int i = 0; i < NUM_ROUTINES; i++ )
+   {
+      const SymbolTable::Symbol *pSymbol = m_Mode != MODE_OFF ? symbols.find( name( i ) ) : 0;
+      m_Addresses[i] = pSymbol ? pSymbol->address : 0;
+      if( m_Addresses[i] != 0 )
+      {
+         addresses.push_back( m_Addresses[i] );
+      }
+   }
+
+   return( addresses );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Carry out or check the routine called by a hart. The hart returns to ra
+afterwards. This is called by the hart itself, so the harts may call routines
+concurrently.
+\param pHart The hart calling the routine
+\param address The start address of the routine
+*/
+/*----------------------------------------------------------------------------*/
+void HostRoutines::call( RISCV *pHart, uint32_t address )
+{
+   int routine = 0;
+   while( ( routine < NUM_ROUTINES ) && ( m_Addresses[routine] != address ) )
+   {
+      routine++;
+   }
+   if( routine == NUM_ROUTINES )
+      return;
+
+   m_Calls++;
+   if( m_Mode == MODE_CHECK )
+   {
+      check( routine, pHart, address );
+   } else
+   {
+      pHart->setRegister( 10, carryOut( routine, pHart ) );
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\return The number of routines called
+*/
+/*----------------------------------------------------------------------------*/
+uint64_t HostRoutines::getCalls() const
+{
+   return( m_Calls );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\return The number of routines of the program whose result has differed from
+the result of the host in the checking mode
+*/
+/*----------------------------------------------------------------------------*/
+uint64_t HostRoutines::getMismatches() const
+{
+   return( m_Mismatches );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\param routine A routine
+\return The name of the routine in the symbol table
+*/
+/*----------------------------------------------------------------------------*/
+const char *HostRoutines::name( int routine )
+{
+   static const char *const names[NUM_ROUTINES] =
+   {
+      "memcpy", "memset", "strlen", "memcmp"
+   };
+
+   return( names[routine] );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\param v A value
+\return -1, 0 or 1 for a negative, zero or positive value
+*/
+/*----------------------------------------------------------------------------*/
+int32_t HostRoutines::sign( int32_t v )
+{
+   return( ( v > 0 ) - ( v < 0 ) );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Carry out a routine with the arguments in a0 to a2 of a hart. The memory
+written is treated like stores of the hart.
+\param routine The routine
+\param pHart The hart calling the routine
+\return The result of the routine
+*/
+/*----------------------------------------------------------------------------*/
+uint32_t HostRoutines::carryOut( int routine, RISCV *pHart )
+{
+   uint32_t a0 = pHart->getRegister( 10 );
+   uint32_t a1 = pHart->getRegister( 11 );
+   uint32_t a2 = pHart->getRegister( 12 );
+
+   switch( routine )
+   {
+      case ROUTINE_MEMCPY:
+         copy( a0, a1, a2 );
+         pHart->invalidateWritten( a0, a2 );
+         return( a0 );
+      case ROUTINE_MEMSET:
+         fill( a0, (uint8_t)a1, a2 );
+         pHart->invalidateWritten( a0, a2 );
+         return( a0 );
+      case ROUTINE_STRLEN:
+         return( length( a0 ) );
+      default:
+         return( (uint32_t)compare( a0, a1, a2 ) );
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Execute the routine of the program and compare its result with the result of
+the host, which is determined beforehand without writing to the memory. The
+result of memcmp is only compared by its sign, which is all the C standard
+defines. If the routine of the program doesn't return, it is carried out by
+the host instead, as are copies and fills which aren't fully within the RAM.
+\param routine The routine
+\param pHart The hart calling the routine
+\param address The start address of the routine
+*/
+/*----------------------------------------------------------------------------*/
+void HostRoutines::check( int routine, RISCV *pHart, uint32_t address )
+{
+   uint32_t a0 = pHart->getRegister( 10 );
+   uint32_t a1 = pHart->getRegister( 11 );
+   uint32_t a2 = pHart->getRegister( 12 );
+   uint32_t ra = pHart->getRegister( 1 );
+
+   // The expected data is kept on the host, so its size is limited to the
+   // RAM, and a copy or fill which isn't fully within the RAM isn't checked
+   if( ( ( routine == ROUTINE_MEMCPY ) || ( routine == ROUTINE_MEMSET ) ) &&
+       ( ( a2 > m_pEmulator->getRAMSize() ) || !m_pEmulator->getRAM( a0, a2 ) ||
+         ( ( routine == ROUTINE_MEMCPY ) && !m_pEmulator->getRAM( a1, a2 ) ) ) )
+   {
+      pHart->setRegister( 10, carryOut( routine, pHart ) );
+      return;
+   }
+
+   std::vector<uint8_t> expectedData;
+   uint32_t expected;
+   switch( routine )
+   {
+      case ROUTINE_MEMCPY:
+         expectedData.resize( a2 );
+         read( a1, expectedData.data(), a2 );
+         expected = a0;
+         break;
+      case ROUTINE_MEMSET:
+         expectedData.assign( a2, (uint8_t)a1 );
+         expected = a0;
+         break;
+      case ROUTINE_STRLEN:
+         expected = length( a0 );
+         break;
+      default:
+         expected = (uint32_t)sign( compare( a0, a1, a2 ) );
+         break;
+   }
+
+   bool same = runProgram( pHart, address );
+   if( same )
+   {
+      uint32_t result = pHart->getRegister( 10 );
+      if( routine == ROUTINE_MEMCMP )
+      {
+         result = (uint32_t)sign( (int32_t)result );
+      }
+
+      std::vector<uint8_t> data( expectedData.size() );
+      read( a0, data.data(), (uint32_t)data.size() );
+      same = ( result == expected ) && ( data == expectedData );
+      if( !expectedData.empty() )
+      {
+         pHart->invalidateWritten( a0, a2 );
+      }
+   } else
+   {
+      pHart->setRegister( 10, carryOut( routine, pHart ) );
+   }
+
+   if( !same )
+   {
+      m_Mismatches++;
+      std::string arguments = routine == ROUTINE_STRLEN ? stdformat( "0x{:x}", a0 ) :
+                              stdformat( "0x{:x}, 0x{:x}, 0x{:x}", a0, a1, a2 );
+      m_pConsole->write( stdformat( "{}( {} ) called from 0x{:x} differs from the host.\n",
+         name( routine ), arguments, ra - 4 ) );
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Execute a routine of the program for a hart, on an interpreter with the
+registers of the hart, until it returns to ra with the stack pointer of the
+call. The interpreter accesses the memory through the Emulator. Then the
+registers of the interpreter become those of the hart.
+\param pHart The hart calling the routine
+\param address The start address of the routine
+\return false if the routine stopped or didn't return within CHECK_LIMIT
+instructions, in which case the registers of the hart are left unchanged
+*/
+/*----------------------------------------------------------------------------*/
+bool HostRoutines::runProgram( RISCV *pHart, uint32_t address )
+{
+   // Only the hart itself uses its checker, so no locking is needed
+   RISCV *&pChecker = m_Checkers[pHart->getHartId()];
+   if( !pChecker )
+   {
+      pChecker = new RISCV( m_pEmulator, pHart->getHartId() );
+   }
+
+   RISCV::State state;
+   pHart->getState( state );
+   state.pc = address;
+   pChecker->setState( state );
+   pChecker->flushDecodeCache();
+
+   uint32_t returnAddress = state.registers[1] & ~1;
+   uint32_t sp = state.registers[2];
+   for( uint64_t i = 0; i < CHECK_LIMIT; i++ )
+   {
+      if( pChecker->run( 1 ).reason != RISCV::STOP_BUDGET )
+         return( false );
+
+      if( ( pChecker->getPC() == returnAddress ) && ( pChecker->getRegister( 2 ) == sp ) )
+      {
+         pChecker->getState( state );
+         pHart->setState( state );
+         return( true );
+      }
+   }
+
+   return( false );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Copy a range of memory like memmove(), directly in the RAM if both ranges are
+within it and through the memory bus otherwise.
+\param dst The destination address
+\param src The source address
+\param size The number of bytes
+*/
+/*----------------------------------------------------------------------------*/
+void HostRoutines::copy( uint32_t dst, uint32_t src, uint32_t size )
+{
+   const uint8_t *pSrc = m_pEmulator->getRAM( src, size );
+   uint8_t *pDst = pSrc ? m_pEmulator->touchRAM( dst, size ) : 0;
+   if( pDst )
+   {
+      memmove( pDst, pSrc, size );
+      return;
+   }
+
+   for( uint32_t i = 0; i < size; i++ )
+   {
+      m_pEmulator->writeMem8( dst + i, m_pEmulator->readMem8( src + i ) );
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Fill a range of memory like memset().
+\param dst The destination address
+\param value The value of every byte
+\param size The number of bytes
+*/
+/*----------------------------------------------------------------------------*/
+void HostRoutines::fill( uint32_t dst, uint8_t value, uint32_t size )
+{
+   uint8_t *pDst = m_pEmulator->touchRAM( dst, size );
+   if( pDst )
+   {
+      memset( pDst, value, size );
+      return;
+   }
+
+   for( uint32_t i = 0; i < size; i++ )
+   {
+      m_pEmulator->writeMem8( dst + i, value );
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Read a range of memory into the host.
+\param src The source address
+\param pData Receives the data
+\param size The number of bytes
+*/
+/*----------------------------------------------------------------------------*/
+void HostRoutines::read( uint32_t src, uint8_t *pData, uint32_t size )
+{
+   const uint8_t *pSrc = m_pEmulator->getRAM( src, size );
+   if( pSrc )
+   {
+      memcpy( pData, pSrc, size );
+      return;
+   }
+
+   for( uint32_t i = 0; i < size; i++ )
+   {
+      pData[i] = m_pEmulator->readMem8( src + i );
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Determine the length of a string like strlen(). The string is searched page by
+page, as its end isn't known beforehand.
+\param s The address of the string
+\return The number of bytes before the terminating 0
+*/
+/*----------------------------------------------------------------------------*/
+uint32_t HostRoutines::length( uint32_t s )
+{
+   uint32_t n = 0;
+   while( n < UINT32_MAX )
+   {
+      uint32_t size = GuestRAM::PAGE_SIZE - ( ( s + n ) & ( GuestRAM::PAGE_SIZE - 1 ) );
+      const uint8_t *p = m_pEmulator->getRAM( s + n, size );
+      if( p )
+      {
+         const uint8_t *pEnd = (const uint8_t *)memchr( p, 0, size );
+         if( pEnd )
+            return( n + (uint32_t)( pEnd - p ) );
+         n += size;
+      } else
+      {
+         if( m_pEmulator->readMem8( s + n ) == 0 )
+            return( n );
+         n++;
+      }
+   }
+
+   return( n );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Compare two ranges of memory like memcmp().
+\param s1 The address of the first range
+\param s2 The address of the second range
+\param size The number of bytes
+\return The difference of the first differing bytes as unsigned values, or 0
+if the ranges are equal
+*/
+/*----------------------------------------------------------------------------*/
+int32_t HostRoutines::compare( uint32_t s1, uint32_t s2, uint32_t size )
+{
+   const uint8_t *p1 = m_pEmulator->getRAM( s1, size );
+   const uint8_t *p2 = m_pEmulator->getRAM( s2, size );
+   if( p1 && p2 )
+   {
+      // memcmp() finds the first chunk which differs, which is then compared
+      // byte by byte
+      const uint32_t CHUNK_SIZE = 64;
+      for( uint32_t i = 0; i < size; i += CHUNK_SIZE )
+      {
+         uint32_t n = size - i < CHUNK_SIZE ? size - i : CHUNK_SIZE;
+         if( memcmp( p1 + i, p2 + i, n ) != 0 )
+         {
+            while( p1[i] == p2[i] )
+            {
+               i++;
+            }
+            return( (int32_t)p1[i] - (int32_t)p2[i] );
+         }
+      }
+      return( 0 );
+   }
+
+   for( uint32_t i = 0; i < size; i++ )
+   {
+      uint8_t b1 = m_pEmulator->readMem8( s1 + i );
+      uint8_t b2 = m_pEmulator->readMem8( s2 + i );
+      if( b1 != b2 )
+         return( (int32_t)b1 - (int32_t)b2 );
+   }
+
+   return( 0 );
+}
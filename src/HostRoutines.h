@@ -0,0 +1,107 @@
+/*******************************************************************************
+ *  Copyright (c) 2024 Christian Nowak <chnowak@web.de>                        *
+ *   This file is part of chn's RISC-V-Emulator.                               *
+ *                                                                             *
+ *  RISC-V-Emulator is free software: you can redistribute it and/or modify it *
+ *  under the terms of the GNU General Public License as published by the Free *
+ *  Software Foundation, either version 3 of the License, or (at your option)  *
+ *  any later version.                                                         *
+ *                                                                             *          
+ *  RISC-V-Emulator is distributed in the hope that it will be useful, but     * 
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY *
+ *  or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License    *
+ *  for more details.                                                          *
+ *                                                                             *
+ *  You should have received a copy of the GNU General Public License along    *
+ *  with RISC-V-Emulator. If not, see <https://www.gnu.org/licenses/>.         *
+ *******************************************************************************/
+
+/*----------------------------------------------------------------------------*/
+/*!
+\file HostRoutines.h
+\author Christian Nowak <chnowak@web.de>
+\brief Headerfile for class HostRoutines.
+*/
+/*----------------------------------------------------------------------------*/
+#ifndef __HOSTROUTINES_H__
+#define __HOSTROUTINES_H__
+
+#include <cstdint>
+#include <vector>
+#include <atomic>
+
+class Emulator;
+class ConsoleDevice;
+class SymbolTable;
+class RISCV;
+
+/*----------------------------------------------------------------------------*/
+/*!
+\class HostRoutines
+\date  2026-10-16
+Well-known routines of the C library, i.e. memcpy, memset, strlen and memcmp,
+which are carried out by the host instead of the harts. They are found by
+their names in the symbol table of the program. When a hart calls one of
+them, the host takes the arguments from a0 to a2, works directly on the RAM,
+puts the result into a0 and returns to ra, like the routine of the program
+would. In the checking mode, the routine of the program is executed instead,
+by an interpreter of its own, and its result and the memory it has written
+are compared with the result of the host. Any difference is reported on the
+console.
+*/
+/*----------------------------------------------------------------------------*/
+class HostRoutines
+{
+   public:
+      enum Mode
+      {
+         MODE_OFF,   // All routines are executed by the harts
+         MODE_ON,    // The routines are carried out by the host
+         MODE_CHECK  // The routines of the program are checked against the host
+      };
+
+      HostRoutines( Emulator *pEmulator, ConsoleDevice *pConsole, int numHarts );
+      ~HostRoutines();
+
+      void setMode( Mode mode );
+      Mode getMode() const;
+      std::vector<uint32_t> find( const SymbolTable &symbols );
+      void call( RISCV *pHart, uint32_t address );
+      uint64_t getCalls() const;
+      uint64_t getMismatches() const;
+
+   private:
+      enum Routine
+      {
+         ROUTINE_MEMCPY,
+         ROUTINE_MEMSET,
+         ROUTINE_STRLEN,
+         ROUTINE_MEMCMP,
+         NUM_ROUTINES
+      };
+
+      // The maximum number of instructions a routine of the program may
+      // execute when being checked
+      static const uint64_t CHECK_LIMIT = 0x100000000ULL;
+
+      static const char *name( int routine );
+      static int32_t sign( int32_t v );
+      uint32_t carryOut( int routine, RISCV *pHart );
+      void check( int routine, RISCV *pHart, uint32_t address );
+      bool runProgram( RISCV *pHart, uint32_t address );
+      void copy( uint32_t dst, uint32_t src, uint32_t size );
+      void fill( uint32_t dst, uint8_t value, uint32_t size );
+      void read( uint32_t src, uint8_t *pData, uint32_t size );
+      uint32_t length( uint32_t s );
+      int32_t compare( uint32_t s1, uint32_t s2, uint32_t size );
+
+      Emulator *m_pEmulator;
+      ConsoleDevice *m_pConsole;
+      Mode m_Mode;
+      uint32_t m_Addresses[NUM_ROUTINES];
+      std::vector<RISCV *> m_Checkers;
+      std::atomic<uint64_t> m_Calls;
+      std::atomic<uint64_t> m_Mismatches;
+};
+
+#endif
@@ -0,0 +1,1117 @@
+/*******************************************************************************
+ *  Copyright (c) 2024 Christian Nowak <chnowak@web.de>                        *
+ *   This file is part of chn's RISC-V-Emulator.                               *
+ *                                                                             *
+ *  RISC-V-Emulator is free software: you can redistribute it and/or modify it *
+ *  under the terms of the GNU General Public License as published by the Free *
+ *  Software Foundation, either version 3 of the License, or (at your option)  *
+ *  any later version.                                                         *
+ *                                                                             *          
+ *  RISC-V-Emulator is distributed in the hope that it will be useful, but     * 
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY *
+ *  or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License    *
+ *  for more details.                                                          *
+ *                                                                             *
+ *  You should have received a copy of the GNU General Public License along    *
+ *  with RISC-V-Emulator. If not, see <https://www.gnu.org/licenses/>.         *
+ *******************************************************************************/
+
+
+/*----------------------------------------------------------------------------*/
+/*!
+\file JIT.cpp
+\author Christian Nowak <chnowak@web.de>
+\brief This implements the x86-64 backend for translated basic blocks
+*/
+/*----------------------------------------------------------------------------*/
+#if defined( __x86_64__ ) && !defined( _WIN32 )
+#define JIT_X86_64
+#include <sys/mman.h>
+#endif
+
+#include "JIT.h"
+
+// x86-64 register numbers
+#define EAX 0
+#define ECX 1
+#define EDX 2
+#define ESI 6
+#define EDI 7
+
+static_assert( offsetof( JIT::Context, indirectBranchCache ) + sizeof( JIT::IndirectBranchTarget ) < 128, "Context members must be reachable with an 8 bit displacement" );
+static_assert( sizeof( JIT::IndirectBranchTarget ) == 16, "The generated code scales the cache index by 16" );
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Constructor for class JIT
+*/
+/*----------------------------------------------------------------------------*/
+JIT::JIT() :
+   m_pArena( 0 ),
+   m_ArenaUsed( 0 ),
+   m_CodeStart( 0 ),
+   m_pEnter( 0 ),
+   m_pExit( 0 ),
+   m_pExitUnlinked( 0 ),
+   m_Full( false )
+{
+   m_Context.pCPU = 0;
+   m_Context.instructions = 0;
+   m_Context.limit = 0;
+   m_Context.pExit = 0;
+   m_Context.pRAM = 0;
+   m_Context.pDirtyPages = 0;
+   m_Context.pDecodeCacheTags = 0;
+   m_Context.pCodePageBits = 0;
+   m_Context.ramStart = 0;
+   m_Context.ramSize = 0;
+   m_Context.reservationAddress = RISCV::NO_RESERVATION;
+   m_Context.reservationGranule = 4;
+   for( int i = 0; i < INDIRECT_BRANCH_CACHE_SIZE; i++ )
+   {
+      m_Context.indirectBranchCache[i].address = RISCV::INVALID_ADDRESS;
+      m_Context.indirectBranchCache[i].pCode = 0;
+   }
+
+#ifdef JIT_X86_64
+   // The arena is never writable and executable at the same time
+   void *p = mmap( 0, ARENA_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+   if( p != MAP_FAILED )
+   {
+      m_pArena = (uint8_t *)p;
+      emitPrologueAndEpilogue();
+      m_CodeStart = m_ArenaUsed;
+      setWritable( m_pArena, ARENA_SIZE, false );
+   }
+#endif
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Destructor for class JIT
+*/
+/*----------------------------------------------------------------------------*/
+JIT::~JIT()
+{
+#ifdef JIT_X86_64
+   if( m_pArena )
+   {
+      munmap( m_pArena, ARENA_SIZE );
+   }
+#endif
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\return true if the JIT can generate code for the host platform
+*/
+/*----------------------------------------------------------------------------*/
+bool JIT::isSupported()
+{
+#ifdef JIT_X86_64
+   return( true );
+#else
+   return( false );
+#endif
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Translate a basic block into machine code. Translation stops at the first
+instruction which can't be translated, so the generated code returns to the
+caller at that instruction, which then has to be executed by the interpreter.
+The jumps of the static exits of the block are stored in its exits, so they
+can be patched later.
+\param pBlock The block
+\return A pointer to the generated code or nullptr if not even the first
+instruction could be translated or if the code arena is full
+*/
+/*----------------------------------------------------------------------------*/
+void *JIT::translate( RISCV::Block *pBlock )
+{
+   const RISCV::DecodedInstruction *pOps = pBlock->ops.data();
+   size_t n = pBlock->ops.size();
+
+   if( !m_pArena || ( n == 0 ) || !canTranslate( pOps[0].op ) )
+      return( 0 );
+
+   // One extra instruction for the entry and the exit stubs
+   if( m_ArenaUsed + ( n + 2 ) * MAX_BYTES_PER_INSTRUCTION > ARENA_SIZE )
+   {
+      m_Full = true;
+      return( 0 );
+   }
+
+   void *pCode = m_pArena + m_ArenaUsed;
+   setWritable( (uint8_t *)pCode, ( n + 2 ) * MAX_BYTES_PER_INSTRUCTION, true );
+   emitEntry( pBlock->address, n );
+
+   for( size_t i = 0; i < n; i++ )
+   {
+      if( !canTranslate( pOps[i].op ) )
+      {
+         emitExit( i, pOps[i].address );
+         break;
+      }
+
+      if( !translateInstruction( pOps[i], i, pBlock ) )
+         break;
+   }
+
+   emitExitStubs();
+   setWritable( (uint8_t *)pCode, ( n + 2 ) * MAX_BYTES_PER_INSTRUCTION, false );
+
+   return( pCode );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Execute generated code. The context has to be set up by the caller.
+\param pCode The code as returned by translate()
+\param pRegisters The guest register file
+\return The address of the next guest instruction to be executed
+*/
+/*----------------------------------------------------------------------------*/
+uint32_t JIT::execute( void *pCode, uint32_t *pRegisters )
+{
+   typedef uint32_t ( *EnterFunction )( uint32_t *pRegisters, Context *pContext, void *pCode );
+
+   return( ( (EnterFunction)m_pEnter )( pRegisters, &m_Context, pCode ) );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\return The context which is passed to the generated code
+*/
+/*----------------------------------------------------------------------------*/
+JIT::Context &JIT::getContext()
+{
+   return( m_Context );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Redirect a jump of the generated code.
+\param pJump The 32 bit displacement of the jump instruction
+\param pTarget The new target of the jump
+*/
+/*----------------------------------------------------------------------------*/
+void JIT::patch( uint8_t *pJump, const void *pTarget )
+{
+   setWritable( pJump, 4, true );
+   setJumpTarget( pJump, pTarget );
+   setWritable( pJump, 4, false );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Write the displacement of a jump. The code has to be writable.
+\param pJump The 32 bit displacement of the jump instruction
+\param pTarget The target of the jump
+*/
+/*----------------------------------------------------------------------------*/
+void JIT::setJumpTarget( uint8_t *pJump, const void *pTarget )
+{
+   uint32_t rel = (uint32_t)( (const uint8_t *)pTarget - ( pJump + 4 ) );
+   for( int i = 0; i < 4; i++ )
+   {
+      pJump[i] = ( rel >> ( i * 8 ) ) & 0xff;
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Enter a native entry point into the cache used by the code generated for JALR.
+\param address The guest address
+\param pCode The generated code for the block starting at address
+*/
+/*----------------------------------------------------------------------------*/
+void JIT::setIndirectBranchTarget( uint32_t address, void *pCode )
+{
+   IndirectBranchTarget &t = m_Context.indirectBranchCache[( address >> 2 ) & ( INDIRECT_BRANCH_CACHE_SIZE - 1 )];
+   t.address = address;
+   t.pCode = pCode;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Remove a guest address from the cache used by the code generated for JALR.
+\param address The guest address
+*/
+/*----------------------------------------------------------------------------*/
+void JIT::removeIndirectBranchTarget( uint32_t address )
+{
+   IndirectBranchTarget &t = m_Context.indirectBranchCache[( address >> 2 ) & ( INDIRECT_BRANCH_CACHE_SIZE - 1 )];
+   if( t.address == address )
+   {
+      t.address = RISCV::INVALID_ADDRESS;
+      t.pCode = 0;
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\return true if the code arena is full. All translations have to be dropped
+using flush() before new code can be generated.
+*/
+/*----------------------------------------------------------------------------*/
+bool JIT::isFull() const
+{
+   return( m_Full );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Drop all generated code.
+*/
+/*----------------------------------------------------------------------------*/
+void JIT::flush()
+{
+   m_ArenaUsed = m_CodeStart;
+   m_Full = false;
+   for( int i = 0; i < INDIRECT_BRANCH_CACHE_SIZE; i++ )
+   {
+      m_Context.indirectBranchCache[i].address = RISCV::INVALID_ADDRESS;
+      m_Context.indirectBranchCache[i].pCode = 0;
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\param op An operation
+\return true if the operation can be translated into machine code
+*/
+/*----------------------------------------------------------------------------*/
+bool JIT::canTranslate( uint8_t op )
+{
+   switch( op )
+   {
+      case RISCV::OP_ILLEGAL:
+      case RISCV::OP_EBREAK:
+      case RISCV::OP_FENCE_I:
+      case RISCV::OP_ECALL:
+      case RISCV::OP_HOST_ROUTINE:
+      case RISCV::OP_AMOADD_W:
+      case RISCV::OP_AMOSWAP_W:
+      case RISCV::OP_LR_W:
+      case RISCV::OP_SC_W:
+      case RISCV::OP_AMOXOR_W:
+      case RISCV::OP_AMOOR_W:
+      case RISCV::OP_AMOAND_W:
+      case RISCV::OP_AMOMIN_W:
+      case RISCV::OP_AMOMAX_W:
+      case RISCV::OP_AMOMINU_W:
+      case RISCV::OP_AMOMAXU_W:
+         return( false );
+
+      default:
+         return( true );
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Generate the code for entering and leaving the generated code. Entering saves
+the callee-saved registers which are used by the generated code, loads rbx
+with the register file and rbp with the context and jumps to the code of the
+block. Every block ends with a jump to the exit code with the address of the
+next guest instruction in eax. Unlinked static exits enter the exit code
+through m_pExitUnlinked with the exit in rdx.
+*/
+/*----------------------------------------------------------------------------*/
+void JIT::emitPrologueAndEpilogue()
+{
+   m_pEnter = m_pArena + m_ArenaUsed;
+   emitBytes( { 0x53 } );                   // push rbx
+   emitBytes( { 0x55 } );                   // push rbp
+   emitBytes( { 0x48, 0x83, 0xec, 0x08 } ); // sub rsp, 8 (keeps the stack 16 byte aligned)
+   emitBytes( { 0x48, 0x89, 0xfb } );       // mov rbx, rdi
+   emitBytes( { 0x48, 0x89, 0xf5 } );       // mov rbp, rsi
+   emitBytes( { 0xff, 0xe2 } );             // jmp rdx
+
+   m_pExitUnlinked = m_pArena + m_ArenaUsed;
+   emitBytes( { 0x48, 0x89, 0x55, (uint8_t)offsetof( Context, pExit ) } ); // mov [rbp+pExit], rdx
+
+   m_pExit = m_pArena + m_ArenaUsed;
+   emitBytes( { 0x48, 0x83, 0xc4, 0x08 } ); // add rsp, 8
+   emitBytes( { 0x5d } );                   // pop rbp
+   emitBytes( { 0x5b } );                   // pop rbx
+   emitBytes( { 0xc3 } );                   // ret
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Generate the code for entering a block. As linked blocks jump directly into
+each other, every block first checks whether it would exceed the instruction
+limit and returns to the caller in this case. A stop requested by another
+thread sets the limit to 0, so it is seen by the next block entered.
+\param address The address of the first guest instruction of the block
+\param n The maximum number of instructions executed by the block
+*/
+/*----------------------------------------------------------------------------*/
+void JIT::emitEntry( uint32_t address, size_t n )
+{
+   static_assert( RISCV::MAX_BLOCK_LENGTH + 1 < 128, "The length of a block must fit into an 8 bit immediate" );
+   static_assert( sizeof( std::atomic<uint64_t> ) == 8, "The generated code reads the limit as a plain qword" );
+
+   emitBytes( { 0x48, 0x8b, 0x45, (uint8_t)offsetof( Context, instructions ) } ); // mov rax, [rbp+instructions]
+   emitBytes( { 0x48, 0x83, 0xc0, (uint8_t)n } );                                 // add rax, n
+   emitBytes( { 0x48, 0x3b, 0x45, (uint8_t)offsetof( Context, limit ) } );        // cmp rax, [rbp+limit]
+   emitBytes( { 0x76, 10 } ); // jbe over the exit
+   emit8( 0xb8 );             // mov eax, address
+   emit32( address );
+   emitJump( m_pExit );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Generate the code for leaving the block. For a static exit of the block, the
+jump leads to a stub which passes the exit to the caller, and it's redirected
+to the following block when the exit gets linked.
+\param n The number of guest instructions executed up to this point
+\param address The address of the next guest instruction
+\param pExit The static exit or nullptr
+*/
+/*----------------------------------------------------------------------------*/
+void JIT::emitExit( int n, uint32_t address, RISCV::Exit *pExit )
+{
+   if( n > 0 )
+   {
+      emitBytes( { 0x48, 0x81, 0x45, (uint8_t)offsetof( Context, instructions ) } ); // add qword [rbp+instructions], n
+      emit32( n );
+   }
+   emit8( 0xb8 ); // mov eax, address
+   emit32( address );
+   if( pExit )
+   {
+      pExit->pNativePatch = m_pArena + m_ArenaUsed + 1;
+      m_PendingExits.push_back( pExit );
+   }
+   emitJump( m_pExit );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Generate the stubs for the static exits of the block which has just been
+translated, and point the jumps of the exits to them.
+*/
+/*----------------------------------------------------------------------------*/
+void JIT::emitExitStubs()
+{
+   for( size_t i = 0; i < m_PendingExits.size(); i++ )
+   {
+      RISCV::Exit *pExit = m_PendingExits[i];
+      pExit->pNativeStub = m_pArena + m_ArenaUsed;
+      setJumpTarget( pExit->pNativePatch, pExit->pNativeStub );
+      emitBytes( { 0x48, 0xba } ); // mov rdx, pExit
+      emit64( (uint64_t)pExit );
+      emitJump( m_pExitUnlinked );
+   }
+   m_PendingExits.clear();
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Generate a jump with a 32 bit displacement.
+\param pTarget The target of the jump
+*/
+/*----------------------------------------------------------------------------*/
+void JIT::emitJump( const uint8_t *pTarget )
+{
+   emit8( 0xe9 ); // jmp pTarget
+   emit32( (uint32_t)( pTarget - ( m_pArena + m_ArenaUsed + 4 ) ) );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Generate a forward jump with a 32 bit displacement, which is set by
+bindForward().
+\return The position of the displacement
+*/
+/*----------------------------------------------------------------------------*/
+size_t JIT::emitForwardJump()
+{
+   emit8( 0xe9 ); // jmp
+   emit32( 0 );
+   return( m_ArenaUsed - 4 );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Generate a conditional forward jump with a 32 bit displacement, which is set by
+bindForward().
+\param condition The second opcode byte of the jump, e.g. 0x84 for je
+\return The position of the displacement
+*/
+/*----------------------------------------------------------------------------*/
+size_t JIT::emitForwardBranch( uint8_t condition )
+{
+   emitBytes( { 0x0f, condition } ); // jcc
+   emit32( 0 );
+   return( m_ArenaUsed - 4 );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Let a forward jump lead to the code which is generated next.
+\param at The position of the displacement as returned by emitForwardJump() or
+emitForwardBranch()
+*/
+/*----------------------------------------------------------------------------*/
+void JIT::bindForward( size_t at )
+{
+   setJumpTarget( m_pArena + at, m_pArena + m_ArenaUsed );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Generate a call of a helper function with the arguments in edi, esi and edx.
+\param pFunction The function
+*/
+/*----------------------------------------------------------------------------*/
+void JIT::emitCall( const void *pFunction )
+{
+   emitBytes( { 0x48, 0xb8 } ); // mov rax, pFunction
+   emit64( (uint64_t)pFunction );
+   emitBytes( { 0xff, 0xd0 } ); // call rax
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Generate code for loading a guest register into a host register.
+\param hostReg The host register
+\param r The guest register
+*/
+/*----------------------------------------------------------------------------*/
+void JIT::emitLoadRegister( int hostReg, int r )
+{
+   if( r == 0 )
+   {
+      emitBytes( { 0x31, (uint8_t)( 0xc0 | ( hostReg << 3 ) | hostReg ) } ); // xor hostReg, hostReg
+   } else
+   {
+      emitBytes( { 0x8b, (uint8_t)( 0x43 | ( hostReg << 3 ) ), (uint8_t)( r * 4 ) } ); // mov hostReg, [rbx+r*4]
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Generate code for storing a host register into a guest register. Writes to x0
+are dropped.
+\param r The guest register
+\param hostReg The host register
+*/
+/*----------------------------------------------------------------------------*/
+void JIT::emitStoreRegister( int r, int hostReg )
+{
+   if( r != 0 )
+   {
+      emitBytes( { 0x89, (uint8_t)( 0x43 | ( hostReg << 3 ) ), (uint8_t)( r * 4 ) } ); // mov [rbx+r*4], hostReg
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Generate code for a load. Aligned loads from the RAM window are done directly
+in host memory, everything else calls a helper which goes through the memory
+interface of the CPU.
+\param d The decoded instruction
+*/
+/*----------------------------------------------------------------------------*/
+void JIT::emitLoad( const RISCV::DecodedInstruction &d )
+{
+   int n = ( d.op == RISCV::OP_LW ) ? 4 : ( ( d.op == RISCV::OP_LH ) || ( d.op == RISCV::OP_LHU ) ) ? 2 : 1;
+
+   emitLoadRegister( EAX, d.rs1 );
+   emit8( 0x05 ); // add eax, imm
+   emit32( d.imm );
+
+   // offset = address - ramStart, which has to be below ramSize
+   emitBytes( { 0x89, 0xc1 } );                                          // mov ecx, eax
+   emitBytes( { 0x2b, 0x4d, (uint8_t)offsetof( Context, ramStart ) } ); // sub ecx, [rbp+ramStart]
+   emitBytes( { 0x3b, 0x4d, (uint8_t)offsetof( Context, ramSize ) } );  // cmp ecx, [rbp+ramSize]
+   size_t outside = emitForwardBranch( 0x83 );                           // jae
+   size_t misaligned = 0;
+   if( n > 1 )
+   {
+      emitBytes( { 0xa8, (uint8_t)( n - 1 ) } ); // test al, n - 1
+      misaligned = emitForwardBranch( 0x85 );    // jnz
+   }
+
+   emitBytes( { 0x48, 0x8b, 0x55, (uint8_t)offsetof( Context, pRAM ) } ); // mov rdx, [rbp+pRAM]
+   switch( d.op )
+   {
+      case RISCV::OP_LB:  emitBytes( { 0x0f, 0xbe, 0x04, 0x0a } ); break; // movsx eax, byte [rdx+rcx]
+      case RISCV::OP_LH:  emitBytes( { 0x0f, 0xbf, 0x04, 0x0a } ); break; // movsx eax, word [rdx+rcx]
+      case RISCV::OP_LW:  emitBytes( { 0x8b, 0x04, 0x0a } );       break; // mov eax, [rdx+rcx]
+      case RISCV::OP_LBU: emitBytes( { 0x0f, 0xb6, 0x04, 0x0a } ); break; // movzx eax, byte [rdx+rcx]
+      default:            emitBytes( { 0x0f, 0xb7, 0x04, 0x0a } ); break; // movzx eax, word [rdx+rcx]
+   }
+   size_t done = emitForwardJump();
+
+   bindForward( outside );
+   if( n > 1 )
+   {
+      bindForward( misaligned );
+   }
+   emitBytes( { 0x89, 0xc6 } );             // mov esi, eax
+   emitBytes( { 0x48, 0x8b, 0x7d, 0x00 } ); // mov rdi, [rbp+pCPU]
+   switch( d.op )
+   {
+      case RISCV::OP_LB:
+         emitCall( (const void *)&readMem8 );
+         emitBytes( { 0x0f, 0xbe, 0xc0 } ); // movsx eax, al
+         break;
+
+      case RISCV::OP_LH:
+         emitCall( (const void *)&readMem16 );
+         emitBytes( { 0x0f, 0xbf, 0xc0 } ); // movsx eax, ax
+         break;
+
+      case RISCV::OP_LW:
+         emitCall( (const void *)&readMem32 );
+         break;
+
+      case RISCV::OP_LBU:
+         emitCall( (const void *)&readMem8 );
+         break;
+
+      default:
+         emitCall( (const void *)&readMem16 );
+         break;
+   }
+
+   bindForward( done );
+   emitStoreRegister( d.rd, EAX );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Generate code for a store. An aligned store to the RAM window is done directly
+in host memory if it needs none of the bookkeeping of RISCV::writeMem32(), i.e.
+if it doesn't hit the reservation, a cached decoded instruction or a page with
+translated code and if its page is already marked as dirty. Everything else
+calls a helper, and the block is left if the store has modified translated
+code.
+\param d The decoded instruction
+\param i The index of the instruction within its block
+*/
+/*----------------------------------------------------------------------------*/
+void JIT::emitStore( const RISCV::DecodedInstruction &d, int i )
+{
+   static_assert( ( RISCV::DECODE_CACHE_SIZE - 1 ) * 4 <= 0x7fffffff, "The decode cache index must fit into an immediate" );
+
+   int n = ( d.op == RISCV::OP_SW ) ? 4 : ( d.op == RISCV::OP_SH ) ? 2 : 1;
+   std::vector<size_t> slow;
+
+   emitLoadRegister( EAX, d.rs1 );
+   emit8( 0x05 ); // add eax, imm
+   emit32( d.imm );
+
+   // Overlaps the reservation if address + n - 1 - reservationAddress < reservationGranule + n - 1
+   emitBytes( { 0x8d, 0x48, (uint8_t)( n - 1 ) } );                                   // lea ecx, [rax+n-1]
+   emitBytes( { 0x2b, 0x4d, (uint8_t)offsetof( Context, reservationAddress ) } );     // sub ecx, [rbp+reservationAddress]
+   emitBytes( { 0x8b, 0x55, (uint8_t)offsetof( Context, reservationGranule ) } );     // mov edx, [rbp+reservationGranule]
+   emitBytes( { 0x83, 0xc2, (uint8_t)( n - 1 ) } );                                   // add edx, n-1
+   emitBytes( { 0x39, 0xd1 } );                                                       // cmp ecx, edx
+   slow.push_back( emitForwardBranch( 0x82 ) );                                       // jb
+
+   // offset = address - ramStart, which has to be below ramSize
+   emitBytes( { 0x89, 0xc1 } );                                          // mov ecx, eax
+   emitBytes( { 0x2b, 0x4d, (uint8_t)offsetof( Context, ramStart ) } ); // sub ecx, [rbp+ramStart]
+   emitBytes( { 0x3b, 0x4d, (uint8_t)offsetof( Context, ramSize ) } );  // cmp ecx, [rbp+ramSize]
+   slow.push_back( emitForwardBranch( 0x83 ) );                          // jae
+   if( n > 1 )
+   {
+      emitBytes( { 0xa8, (uint8_t)( n - 1 ) } );   // test al, n - 1
+      slow.push_back( emitForwardBranch( 0x85 ) ); // jnz
+   }
+
+   // An aligned store hits a single entry of the decode cache and a single page
+   emitBytes( { 0x89, 0xc2 } ); // mov edx, eax
+   emitBytes( { 0x81, 0xe2 } ); // and edx, ( DECODE_CACHE_SIZE - 1 ) * 4
+   emit32( ( RISCV::DECODE_CACHE_SIZE - 1 ) * 4 );
+   emitBytes( { 0x48, 0x8b, 0x75, (uint8_t)offsetof( Context, pDecodeCacheTags ) } ); // mov rsi, [rbp+pDecodeCacheTags]
+   emitBytes( { 0x89, 0xc7 } );                                                       // mov edi, eax
+   emitBytes( { 0x83, 0xe7, 0xfc } );                                                 // and edi, ~3
+   emitBytes( { 0x39, 0x3c, 0x16 } );                                                 // cmp [rsi+rdx], edi
+   slow.push_back( emitForwardBranch( 0x84 ) );                                       // je
+
+   emitBytes( { 0x48, 0x8b, 0x75, (uint8_t)offsetof( Context, pCodePageBits ) } ); // mov rsi, [rbp+pCodePageBits]
+   emitBytes( { 0x89, 0xc2 } );                                                    // mov edx, eax
+   emitBytes( { 0xc1, 0xea, RISCV::CODE_PAGE_BITS } );                             // shr edx, CODE_PAGE_BITS
+   emitBytes( { 0x89, 0xd7 } );                                                    // mov edi, edx
+   emitBytes( { 0xc1, 0xef, 0x05 } );                                              // shr edi, 5
+   emitBytes( { 0x8b, 0x3c, 0xbe } );                                              // mov edi, [rsi+rdi*4]
+   emitBytes( { 0x0f, 0xa3, 0xd7 } );                                              // bt edi, edx
+   slow.push_back( emitForwardBranch( 0x82 ) );                                    // jc
+
+   // The dirty flag of the page, if the pages are tracked
+   emitBytes( { 0x48, 0x8b, 0x75, (uint8_t)offsetof( Context, pDirtyPages ) } ); // mov rsi, [rbp+pDirtyPages]
+   emitBytes( { 0x48, 0x85, 0xf6 } );                                            // test rsi, rsi
+   size_t untracked = emitForwardBranch( 0x84 );                                 // jz
+   emitBytes( { 0x89, 0xca } );                                                  // mov edx, ecx
+   emitBytes( { 0xc1, 0xea, RISCV::DIRTY_PAGE_BITS } );                          // shr edx, DIRTY_PAGE_BITS
+   emitBytes( { 0x80, 0x3c, 0x16, 0x00 } );                                      // cmp byte [rsi+rdx], 0
+   slow.push_back( emitForwardBranch( 0x84 ) );                                  // je
+   bindForward( untracked );
+
+   emitLoadRegister( EDX, d.rs2 );
+   emitBytes( { 0x48, 0x8b, 0x75, (uint8_t)offsetof( Context, pRAM ) } ); // mov rsi, [rbp+pRAM]
+   switch( d.op )
+   {
+      case RISCV::OP_SB: emitBytes( { 0x88, 0x14, 0x0e } );       break; // mov [rsi+rcx], dl
+      case RISCV::OP_SH: emitBytes( { 0x66, 0x89, 0x14, 0x0e } ); break; // mov [rsi+rcx], dx
+      default:           emitBytes( { 0x89, 0x14, 0x0e } );       break; // mov [rsi+rcx], edx
+   }
+   size_t done = emitForwardJump();
+
+   for( size_t j = 0; j < slow.size(); j++ )
+   {
+      bindForward( slow[j] );
+   }
+   emitBytes( { 0x89, 0xc6 } ); // mov esi, eax
+   emitLoadRegister( EDX, d.rs2 );
+   emitBytes( { 0x48, 0x8b, 0x7d, 0x00 } ); // mov rdi, [rbp+pCPU]
+   emitCall( d.op == RISCV::OP_SB ? (const void *)&writeMem8 :
+             d.op == RISCV::OP_SH ? (const void *)&writeMem16 :
+                                    (const void *)&writeMem32 );
+
+   // Leave the block if the store has modified translated code
+   emitBytes( { 0x85, 0xc0 } ); // test eax, eax
+   emitBytes( { 0x74, 18 } );   // jz over the exit
+   emitExit( i + 1, d.address + 4 );
+
+   bindForward( done );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Translate a single instruction.
+\param d The decoded instruction
+\param i The index of the instruction within its block
+\param pBlock The block
+\return false if the instruction ends the block
+*/
+/*----------------------------------------------------------------------------*/
+bool JIT::translateInstruction( const RISCV::DecodedInstruction &d, int i, RISCV::Block *pBlock )
+{
+   switch( d.op )
+   {
+      case RISCV::OP_LB:
+      case RISCV::OP_LH:
+      case RISCV::OP_LW:
+      case RISCV::OP_LBU:
+      case RISCV::OP_LHU:
+         emitLoad( d );
+         return( true );
+
+      case RISCV::OP_SB:
+      case RISCV::OP_SH:
+      case RISCV::OP_SW:
+         emitStore( d, i );
+         return( true );
+
+      case RISCV::OP_ADDI:
+      case RISCV::OP_XORI:
+      case RISCV::OP_ORI:
+      case RISCV::OP_ANDI:
+      case RISCV::OP_SLTI:
+      case RISCV::OP_SLTIU:
+      {
+         if( d.rd == 0 )
+            return( true );
+
+         emitLoadRegister( EAX, d.rs1 );
+         switch( d.op )
+         {
+            case RISCV::OP_ADDI:  emit8( 0x05 ); break; // add eax, imm
+            case RISCV::OP_XORI:  emit8( 0x35 ); break; // xor eax, imm
+            case RISCV::OP_ORI:   emit8( 0x0d ); break; // or eax, imm
+            case RISCV::OP_ANDI:  emit8( 0x25 ); break; // and eax, imm
+            default:              emit8( 0x3d ); break; // cmp eax, imm
+         }
+         emit32( d.imm );
+         if( d.op == RISCV::OP_SLTI )
+         {
+            emitBytes( { 0x0f, 0x9c, 0xc0 } ); // setl al
+            emitBytes( { 0x0f, 0xb6, 0xc0 } ); // movzx eax, al
+         } else
+         if( d.op == RISCV::OP_SLTIU )
+         {
+            emitBytes( { 0x0f, 0x92, 0xc0 } ); // setb al
+            emitBytes( { 0x0f, 0xb6, 0xc0 } ); // movzx eax, al
+         }
+         emitStoreRegister( d.rd, EAX );
+         return( true );
+      }
+
+      case RISCV::OP_SLLI:
+      case RISCV::OP_SRLI:
+      case RISCV::OP_SRAI:
+      {
+         if( d.rd == 0 )
+            return( true );
+
+         emitLoadRegister( EAX, d.rs1 );
+         emitBytes( { 0xc1, (uint8_t)( d.op == RISCV::OP_SLLI ? 0xe0 : d.op == RISCV::OP_SRLI ? 0xe8 : 0xf8 ), (uint8_t)d.imm } ); // shl/shr/sar eax, imm
+         emitStoreRegister( d.rd, EAX );
+         return( true );
+      }
+
+      case RISCV::OP_FENCE:
+      {
+         // x86-64 only reorders stores with later loads
+         if( ( d.imm & ( RISCV::FENCE_PW | RISCV::FENCE_PO ) ) && ( d.imm & ( RISCV::FENCE_SR | RISCV::FENCE_SI ) ) )
+         {
+            emitBytes( { 0x0f, 0xae, 0xf0 } ); // mfence
+         }
+         return( true );
+      }
+
+      case RISCV::OP_LUI:
+      case RISCV::OP_AUIPC:
+      {
+         if( d.rd != 0 )
+         {
+            emitBytes( { 0xc7, 0x43, (uint8_t)( d.rd * 4 ) } ); // mov dword [rbx+rd*4], imm
+            emit32( d.op == RISCV::OP_LUI ? d.imm : d.address + d.imm );
+         }
+         return( true );
+      }
+
+      case RISCV::OP_ADD:
+      case RISCV::OP_SUB:
+      case RISCV::OP_SLL:
+      case RISCV::OP_SLT:
+      case RISCV::OP_SLTU:
+      case RISCV::OP_XOR:
+      case RISCV::OP_SRL:
+      case RISCV::OP_SRA:
+      case RISCV::OP_OR:
+      case RISCV::OP_AND:
+      case RISCV::OP_MUL:
+      case RISCV::OP_MULH:
+      case RISCV::OP_MULHSU:
+      case RISCV::OP_MULHU:
+      case RISCV::OP_DIV:
+      case RISCV::OP_DIVU:
+      case RISCV::OP_REM:
+      case RISCV::OP_REMU:
+      {
+         if( d.rd == 0 )
+            return( true );
+
+         emitLoadRegister( EAX, d.rs1 );
+         emitLoadRegister( ECX, d.rs2 );
+         switch( d.op )
+         {
+            case RISCV::OP_ADD: emitBytes( { 0x01, 0xc8 } ); break; // add eax, ecx
+            case RISCV::OP_SUB: emitBytes( { 0x29, 0xc8 } ); break; // sub eax, ecx
+            case RISCV::OP_SLL: emitBytes( { 0xd3, 0xe0 } ); break; // shl eax, cl
+            case RISCV::OP_XOR: emitBytes( { 0x31, 0xc8 } ); break; // xor eax, ecx
+            case RISCV::OP_SRL: emitBytes( { 0xd3, 0xe8 } ); break; // shr eax, cl
+            case RISCV::OP_SRA: emitBytes( { 0xd3, 0xf8 } ); break; // sar eax, cl
+            case RISCV::OP_OR:  emitBytes( { 0x09, 0xc8 } ); break; // or eax, ecx
+            case RISCV::OP_AND: emitBytes( { 0x21, 0xc8 } ); break; // and eax, ecx
+            case RISCV::OP_MUL: emitBytes( { 0x0f, 0xaf, 0xc1 } ); break; // imul eax, ecx
+
+            case RISCV::OP_SLT:
+               emitBytes( { 0x39, 0xc8 } );       // cmp eax, ecx
+               emitBytes( { 0x0f, 0x9c, 0xc0 } ); // setl al
+               emitBytes( { 0x0f, 0xb6, 0xc0 } ); // movzx eax, al
+               break;
+
+            case RISCV::OP_SLTU:
+               emitBytes( { 0x39, 0xc8 } );       // cmp eax, ecx
+               emitBytes( { 0x0f, 0x92, 0xc0 } ); // setb al
+               emitBytes( { 0x0f, 0xb6, 0xc0 } ); // movzx eax, al
+               break;
+
+            case RISCV::OP_MULH:
+               emitBytes( { 0x48, 0x63, 0xc0 } ); // movsxd rax, eax
+               emitBytes( { 0x48, 0x63, 0xc9 } ); // movsxd rcx, ecx
+               emitBytes( { 0x48, 0x0f, 0xaf, 0xc1 } ); // imul rax, rcx
+               emitBytes( { 0x48, 0xc1, 0xe8, 0x20 } ); // shr rax, 32
+               break;
+
+            case RISCV::OP_MULHSU:
+               emitBytes( { 0x48, 0x63, 0xc0 } ); // movsxd rax, eax
+               emitBytes( { 0x48, 0x0f, 0xaf, 0xc1 } ); // imul rax, rcx
+               emitBytes( { 0x48, 0xc1, 0xe8, 0x20 } ); // shr rax, 32
+               break;
+
+            case RISCV::OP_MULHU:
+               emitBytes( { 0x48, 0x0f, 0xaf, 0xc1 } ); // imul rax, rcx
+               emitBytes( { 0x48, 0xc1, 0xe8, 0x20 } ); // shr rax, 32
+               break;
+
+            default:
+               emitBytes( { 0x89, 0xc7 } ); // mov edi, eax
+               emitBytes( { 0x89, 0xce } ); // mov esi, ecx
+               emitCall( d.op == RISCV::OP_DIV  ? (const void *)&div :
+                         d.op == RISCV::OP_DIVU ? (const void *)&divu :
+                         d.op == RISCV::OP_REM  ? (const void *)&rem :
+                                                  (const void *)&remu );
+               break;
+         }
+         emitStoreRegister( d.rd, EAX );
+         return( true );
+      }
+
+      case RISCV::OP_BEQ:
+      case RISCV::OP_BNE:
+      case RISCV::OP_BLT:
+      case RISCV::OP_BGE:
+      case RISCV::OP_BLTU:
+      case RISCV::OP_BGEU:
+      {
+         uint8_t jcc;
+         switch( d.op )
+         {
+            case RISCV::OP_BEQ:  jcc = 0x74; break; // je
+            case RISCV::OP_BNE:  jcc = 0x75; break; // jne
+            case RISCV::OP_BLT:  jcc = 0x7c; break; // jl
+            case RISCV::OP_BGE:  jcc = 0x7d; break; // jge
+            case RISCV::OP_BLTU: jcc = 0x72; break; // jb
+            default:             jcc = 0x73; break; // jae
+         }
+
+         emitLoadRegister( EAX, d.rs1 );
+         emitLoadRegister( ECX, d.rs2 );
+         emitBytes( { 0x39, 0xc8 } ); // cmp eax, ecx
+         emitBytes( { jcc, 18 } );    // jcc over the not-taken exit
+         emitExit( i + 1, d.address + 4, &pBlock->exits[0] );
+         emitExit( i + 1, d.address + d.imm, &pBlock->exits[1] );
+         return( false );
+      }
+
+      case RISCV::OP_JAL:
+      {
+         if( d.rd != 0 )
+         {
+            emitBytes( { 0xc7, 0x43, (uint8_t)( d.rd * 4 ) } ); // mov dword [rbx+rd*4], address + 4
+            emit32( d.address + 4 );
+         }
+         emitExit( i + 1, d.address + d.imm, &pBlock->exits[0] );
+         return( false );
+      }
+
+      case RISCV::OP_JALR:
+      {
+         // The target is computed before writing rd as both may be the same register
+         emitLoadRegister( EAX, d.rs1 );
+         emit8( 0x05 ); // add eax, imm
+         emit32( d.imm );
+         emit8( 0x25 ); // and eax, 0xfffffffe
+         emit32( 0xfffffffe );
+         if( d.rd != 0 )
+         {
+            emitBytes( { 0xc7, 0x43, (uint8_t)( d.rd * 4 ) } ); // mov dword [rbx+rd*4], address + 4
+            emit32( d.address + 4 );
+         }
+         emitBytes( { 0x48, 0x81, 0x45, (uint8_t)offsetof( Context, instructions ) } ); // add qword [rbp+instructions], i + 1
+         emit32( i + 1 );
+
+         // Jump to the native code of the target if it's in the indirect branch cache
+         emitBytes( { 0x89, 0xc1 } );       // mov ecx, eax
+         emitBytes( { 0xc1, 0xe9, 0x02 } ); // shr ecx, 2
+         emitBytes( { 0x81, 0xe1 } );       // and ecx, INDIRECT_BRANCH_CACHE_SIZE - 1
+         emit32( INDIRECT_BRANCH_CACHE_SIZE - 1 );
+         emitBytes( { 0xc1, 0xe1, 0x04 } ); // shl ecx, 4
+         emitBytes( { 0x3b, 0x44, 0x0d, (uint8_t)( offsetof( Context, indirectBranchCache ) + offsetof( IndirectBranchTarget, address ) ) } ); // cmp eax, [rbp+rcx+address]
+         emitBytes( { 0x0f, 0x85 } ); // jne exit
+         emit32( (uint32_t)( m_pExit - ( m_pArena + m_ArenaUsed + 4 ) ) );
+         emitBytes( { 0xff, 0x64, 0x0d, (uint8_t)( offsetof( Context, indirectBranchCache ) + offsetof( IndirectBranchTarget, pCode ) ) } ); // jmp [rbp+rcx+pCode]
+         return( false );
+      }
+
+      case RISCV::OP_EXIT:
+      {
+         emitExit( i, d.address, &pBlock->exits[0] );
+         return( false );
+      }
+
+      default:
+      {
+         emitExit( i, d.address );
+         return( false );
+      }
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Append a byte to the generated code.
+*/
+/*----------------------------------------------------------------------------*/
+void JIT::emit8( uint8_t b )
+{
+   m_pArena[m_ArenaUsed++] = b;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Append a 32 bit little endian value to the generated code.
+*/
+/*----------------------------------------------------------------------------*/
+void JIT::emit32( uint32_t d )
+{
+   for( int i = 0; i < 4; i++ )
+   {
+      emit8( ( d >> ( i * 8 ) ) & 0xff );
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Append a 64 bit little endian value to the generated code.
+*/
+/*----------------------------------------------------------------------------*/
+void JIT::emit64( uint64_t d )
+{
+   emit32( d & 0xffffffff );
+   emit32( d >> 32 );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Append a sequence of bytes to the generated code.
+*/
+/*----------------------------------------------------------------------------*/
+void JIT::emitBytes( std::initializer_list<uint8_t> bytes )
+{
+   for( std::initializer_list<uint8_t>::const_iterator i = bytes.begin(); i != bytes.end(); i++ )
+   {
+      emit8( *i );
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Switch a part of the arena between writable and executable.
+\param p The start of the part
+\param size The size of the part in bytes
+\param writable true to make the part writable, false to make it executable
+*/
+/*----------------------------------------------------------------------------*/
+void JIT::setWritable( uint8_t *p, size_t size, bool writable )
+{
+#ifdef JIT_X86_64
+   size_t start = ( p - m_pArena ) & ~( HOST_PAGE_SIZE - 1 );
+   size_t end = ( p - m_pArena + size + HOST_PAGE_SIZE - 1 ) & ~( HOST_PAGE_SIZE - 1 );
+   if( end > ARENA_SIZE )
+   {
+      end = ARENA_SIZE;
+   }
+   mprotect( m_pArena + start, end - start, writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC );
+#endif
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Helper functions called by the generated code. The loads return the value
+zero-extended to 32 bits, the stores return true if translated code has been
+modified or if a stop has been requested, so the block has to be left.
+*/
+/*----------------------------------------------------------------------------*/
+uint32_t JIT::readMem8( RISCV *pCPU, uint32_t address )
+{
+   return( pCPU->readMem8( address ) );
+}
+
+uint32_t JIT::readMem16( RISCV *pCPU, uint32_t address )
+{
+   return( pCPU->readMem16( address ) );
+}
+
+uint32_t JIT::readMem32( RISCV *pCPU, uint32_t address )
+{
+   return( pCPU->readMem32( address ) );
+}
+
+uint32_t JIT::writeMem8( RISCV *pCPU, uint32_t address, uint32_t d )
+{
+   pCPU->writeMem8( address, d & 0xff );
+   return( pCPU->m_CodeModified || ( pCPU->m_StopReason != RISCV::STOP_NONE ) );
+}
+
+uint32_t JIT::writeMem16( RISCV *pCPU, uint32_t address, uint32_t d )
+{
+   pCPU->writeMem16( address, d & 0xffff );
+   return( pCPU->m_CodeModified || ( pCPU->m_StopReason != RISCV::STOP_NONE ) );
+}
+
+uint32_t JIT::writeMem32( RISCV *pCPU, uint32_t address, uint32_t d )
+{
+   pCPU->writeMem32( address, d );
+   return( pCPU->m_CodeModified || ( pCPU->m_StopReason != RISCV::STOP_NONE ) );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Division helper functions called by the generated code, following the RISC-V
+rules for division by zero and overflow.
+*/
+/*----------------------------------------------------------------------------*/
+uint32_t JIT::div( uint32_t a, uint32_t b )
+{
+   if( b == 0 )
+      return( 0xffffffff );
+   if( ( a == 0x80000000 ) && ( b == 0xffffffff ) ) // -2^LEN-1 / -1 -> overflow
+      return( 0x80000000 );
+   return( (uint32_t)( (int32_t)a / (int32_t)b ) );
+}
+
+uint32_t JIT::divu( uint32_t a, uint32_t b )
+{
+   return( b == 0 ? 0xffffffff : a / b );
+}
+
+uint32_t JIT::rem( uint32_t a, uint32_t b )
+{
+   if( b == 0 )
+      return( a );
+   if( ( a == 0x80000000 ) && ( b == 0xffffffff ) ) // -2^LEN-1 / -1 -> overflow
+      return( 0 );
+   return( (uint32_t)( (int32_t)a % (int32_t)b ) );
+}
+
+uint32_t JIT::remu( uint32_t a, uint32_t b )
+{
+   return( b == 0 ? a : a % b );
+}
@@ -0,0 +1,146 @@
+/*******************************************************************************
+ *  Copyright (c) 2024 Christian Nowak <chnowak@web.de>                        *
+ *   This file is part of chn's RISC-V-Emulator.                               *
+ *                                                                             *
+ *  RISC-V-Emulator is free software: you can redistribute it and/or modify it *
+ *  under the terms of the GNU General Public License as published by the Free *
+ *  Software Foundation, either version 3 of the License, or (at your option)  *
+ *  any later version.                                                         *
+ *                                                                             *          
+ *  RISC-V-Emulator is distributed in the hope that it will be useful, but     * 
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY *
+ *  or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License    *
+ *  for more details.                                                          *
+ *                                                                             *
+ *  You should have received a copy of the GNU General Public License along    *
+ *  with RISC-V-Emulator. If not, see <https://www.gnu.org/licenses/>.         *
+ *******************************************************************************/
+
+
+/*----------------------------------------------------------------------------*/
+/*!
+\file JIT.h
+\author Christian Nowak <chnowak@web.de>
+\brief Headerfile for class JIT.
+*/
+/*----------------------------------------------------------------------------*/
+#ifndef __JIT_H__
+#define __JIT_H__
+
+#include <cstdint>
+#include <cstddef>
+#include <initializer_list>
+#include <vector>
+#include <atomic>
+
+#include "RISCV.h"
+
+/*----------------------------------------------------------------------------*/
+/*!
+\class JIT
+\date  2026-10-16
+Translates basic blocks of decoded RISC-V instructions into x86-64 machine
+code. The generated code accesses the guest registers through rbx, which
+points to the register file of the RISCV instance, and the Context through
+rbp. Every block returns the address of the next guest instruction.
+Exits with a static target can be patched to jump directly to the code of the
+following block, and JALR looks up its target in a small cache of native entry
+points, so execution only returns to the caller when a target hasn't been
+translated yet or when the instruction limit has been reached.
+*/
+/*----------------------------------------------------------------------------*/
+class JIT
+{
+   public:
+      static const int INDIRECT_BRANCH_CACHE_SIZE = 256;
+
+      struct IndirectBranchTarget
+      {
+         uint32_t address;
+         uint32_t unused;
+         void *pCode;
+      };
+
+      struct Context
+      {
+         RISCV *pCPU;
+         uint64_t instructions; // Number of instructions executed natively
+         std::atomic<uint64_t> limit; // No block is entered which could make instructions exceed limit,
+                                      // set to 0 by other threads to stop the code
+         RISCV::Exit *pExit;    // The unlinked exit through which the code has been left, if any
+         uint8_t *pRAM;         // The RAM window of the CPU, accessed directly by loads and stores
+         const std::atomic<uint8_t> *pDirtyPages;
+         const uint32_t *pDecodeCacheTags;
+         const uint32_t *pCodePageBits;
+         uint32_t ramStart;
+         uint32_t ramSize;
+         uint32_t reservationAddress; // Can only be cleared while the code runs, so a stale copy
+         uint32_t reservationGranule; // just sends a few more stores through the helpers
+         IndirectBranchTarget indirectBranchCache[INDIRECT_BRANCH_CACHE_SIZE];
+      };
+
+      JIT();
+      ~JIT();
+
+      static bool isSupported();
+
+      void *translate( RISCV::Block *pBlock );
+      uint32_t execute( void *pCode, uint32_t *pRegisters );
+      Context &getContext();
+      void patch( uint8_t *pJump, const void *pTarget );
+      void setIndirectBranchTarget( uint32_t address, void *pCode );
+      void removeIndirectBranchTarget( uint32_t address );
+      bool isFull() const;
+      void flush();
+
+   private:
+      static const size_t ARENA_SIZE = 16 * 1024 * 1024;
+      static const size_t MAX_BYTES_PER_INSTRUCTION = 256;
+      static const size_t HOST_PAGE_SIZE = 4096;
+
+      static bool canTranslate( uint8_t op );
+      bool translateInstruction( const RISCV::DecodedInstruction &d, int n, RISCV::Block *pBlock );
+      void emitPrologueAndEpilogue();
+      void emitEntry( uint32_t address, size_t n );
+      void emitExit( int n, uint32_t address, RISCV::Exit *pExit = 0 );
+      void emitExitStubs();
+      void emitJump( const uint8_t *pTarget );
+      size_t emitForwardJump();
+      size_t emitForwardBranch( uint8_t condition );
+      void bindForward( size_t at );
+      void emitLoad( const RISCV::DecodedInstruction &d );
+      void emitStore( const RISCV::DecodedInstruction &d, int i );
+      void emitCall( const void *pFunction );
+      void emitLoadRegister( int hostReg, int r );
+      void emitStoreRegister( int r, int hostReg );
+
+      void emit8( uint8_t b );
+      void emit32( uint32_t d );
+      void emit64( uint64_t d );
+      void emitBytes( std::initializer_list<uint8_t> bytes );
+      void setWritable( uint8_t *p, size_t size, bool writable );
+      static void setJumpTarget( uint8_t *pJump, const void *pTarget );
+
+      static uint32_t readMem8( RISCV *pCPU, uint32_t address );
+      static uint32_t readMem16( RISCV *pCPU, uint32_t address );
+      static uint32_t readMem32( RISCV *pCPU, uint32_t address );
+      static uint32_t writeMem8( RISCV *pCPU, uint32_t address, uint32_t d );
+      static uint32_t writeMem16( RISCV *pCPU, uint32_t address, uint32_t d );
+      static uint32_t writeMem32( RISCV *pCPU, uint32_t address, uint32_t d );
+      static uint32_t div( uint32_t a, uint32_t b );
+      static uint32_t divu( uint32_t a, uint32_t b );
+      static uint32_t rem( uint32_t a, uint32_t b );
+      static uint32_t remu( uint32_t a, uint32_t b );
+
+      uint8_t *m_pArena;
+      size_t m_ArenaUsed;
+      size_t m_CodeStart;
+      uint8_t *m_pEnter;
+      uint8_t *m_pExit;
+      uint8_t *m_pExitUnlinked;
+      std::vector<RISCV::Exit *> m_PendingExits;
+      bool m_Full;
+      Context m_Context;
+};
+
+#endif
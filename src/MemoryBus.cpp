@@ -0,0 +1,309 @@
+/*******************************************************************************
+ *  Copyright (c) 2024 Christian Nowak <chnowak@web.de>                        *
+ *   This file is part of chn's RISC-V-Emulator.                               *
+ *                                                                             *
+ *  RISC-V-Emulator is free software: you can redistribute it and/or modify it *
+ *  under the terms of the GNU General Public License as published by the Free *
+ *  Software Foundation, either version 3 of the License, or (at your option)  *
+ *  any later version.                                                         *
+ *                                                                             *          
+ *  RISC-V-Emulator is distributed in the hope that it will be useful, but     * 
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY *
+ *  or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License    *
+ *  for more details.                                                          *
+ *                                                                             *
+ *  You should have received a copy of the GNU General Public License along    *
+ *  with RISC-V-Emulator. If not, see <https://www.gnu.org/licenses/>.         *
+ *******************************************************************************/
+
+/*----------------------------------------------------------------------------*/
+/*!
+\file MemoryBus.cpp
+\author Christian Nowak <chnowak@web.de>
+\brief This implements the memory bus
+*/
+/*----------------------------------------------------------------------------*/
+#include <stdlib.h>
+
+#include "MemoryBus.h"
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Destructor for class MemoryBus::Device
+*/
+/*----------------------------------------------------------------------------*/
+MemoryBus::Device::~Device()
+{
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Read a half-word from the device as two bytes.
+\param offset The address relative to the start of the device
+\return The value
+*/
+/*----------------------------------------------------------------------------*/
+uint16_t MemoryBus::Device::readMem16( uint32_t offset )
+{
+   return(   (uint16_t)readMem8( offset ) |
+           ( (uint16_t)readMem8( offset + 1 ) << 8 ) );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Read a word from the device as four bytes.
+\param offset The address relative to the start of the device
+\return The value
+*/
+/*----------------------------------------------------------------------------*/
+uint32_t MemoryBus::Device::readMem32( uint32_t offset )
+{
+   return(   (uint32_t)readMem8( offset ) |
+           ( (uint32_t)readMem8( offset + 1 ) << 8 ) |
+           ( (uint32_t)readMem8( offset + 2 ) << 16 ) |
+           ( (uint32_t)readMem8( offset + 3 ) << 24 ) );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Write a half-word to the device as two bytes.
+\param offset The address relative to the start of the device
+\param d The value to write
+*/
+/*----------------------------------------------------------------------------*/
+void MemoryBus::Device::writeMem16( uint32_t offset, uint16_t d )
+{
+   writeMem8( offset,       d        & 0xff );
+   writeMem8( offset + 1, ( d >> 8 ) & 0xff );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Write a word to the device as four bytes.
+\param offset The address relative to the start of the device
+\param d The value to write
+*/
+/*----------------------------------------------------------------------------*/
+void MemoryBus::Device::writeMem32( uint32_t offset, uint32_t d )
+{
+   writeMem8( offset,       d         & 0xff );
+   writeMem8( offset + 1, ( d >> 8  ) & 0xff );
+   writeMem8( offset + 2, ( d >> 16 ) & 0xff );
+   writeMem8( offset + 3, ( d >> 24 ) & 0xff );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Save the state of the device, e.g. for a snapshot. By default, a device has no
+state.
+\param state Receives the state in a format of the device's choice
+*/
+/*----------------------------------------------------------------------------*/
+void MemoryBus::Device::saveState( std::vector<uint8_t> &state )
+{
+   state.clear();
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Restore the state of the device, e.g. from a snapshot.
+\param state The state as saved by saveState()
+\return false if the state is invalid
+*/
+/*----------------------------------------------------------------------------*/
+bool MemoryBus::Device::restoreState( const std::vector<uint8_t> &state )
+{
+   return( state.empty() );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Constructor for class MemoryBus. Initially, the whole address space is
+unmapped.
+*/
+/*----------------------------------------------------------------------------*/
+MemoryBus::MemoryBus()
+{
+   // The page table covers the whole address space. calloc() leaves the parts
+   // of it which are never written to without physical memory.
+   m_pPages = (Page *)calloc( NUM_PAGES, sizeof( Page ) );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Destructor for class MemoryBus. Neither the host memory nor the devices which
+have been mapped are deleted.
+*/
+/*----------------------------------------------------------------------------*/
+MemoryBus::~MemoryBus()
+{
+   free( m_pPages );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\return true if start and size describe a non-empty range of whole pages
+within the address space
+*/
+/*----------------------------------------------------------------------------*/
+bool MemoryBus::isPageRange( uint32_t start, uint32_t size ) const
+{
+   return( ( size > 0 ) &&
+           !( start & PAGE_MASK ) &&
+           !( size & PAGE_MASK ) &&
+           ( (uint64_t)start + size <= 0x100000000ULL ) );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Map host memory as RAM into the address space, replacing whatever has been
+mapped there before. The host memory has to stay valid as long as it is
+mapped.
+\param start Address of the first byte, a multiple of the page size
+\param size Size in bytes, a multiple of the page size
+\param pHostMemory The contents in host memory, in little endian byte order
+\param writable false to ignore writes, e.g. for ROM
+\return false if the range isn't made up of whole pages
+*/
+/*----------------------------------------------------------------------------*/
+bool MemoryBus::mapRAM( uint32_t start, uint32_t size, uint8_t *pHostMemory, bool writable )
+{
+   if( !isPageRange( start, size ) )
+      return( false );
+
+   removeDevices( start, size );
+   for( uint32_t i = 0; i < ( size >> PAGE_BITS ); i++ )
+   {
+      Page &page = m_pPages[( start >> PAGE_BITS ) + i];
+      page.pRead = pHostMemory + ( i << PAGE_BITS );
+      page.pWrite = writable ? page.pRead : 0;
+      page.pDevice = 0;
+      page.deviceStart = 0;
+   }
+
+   return( true );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Map a device into the address space, replacing whatever has been mapped there
+before. The device has to stay valid as long as it is mapped.
+\param start Address of the first byte, a multiple of the page size
+\param size Size in bytes, a multiple of the page size
+\param pDevice The device
+\return false if the range isn't made up of whole pages
+*/
+/*----------------------------------------------------------------------------*/
+bool MemoryBus::mapDevice( uint32_t start, uint32_t size, Device *pDevice )
+{
+   if( !isPageRange( start, size ) )
+      return( false );
+
+   removeDevices( start, size );
+   m_Devices[start] = pDevice;
+   for( uint32_t i = 0; i < ( size >> PAGE_BITS ); i++ )
+   {
+      Page &page = m_pPages[( start >> PAGE_BITS ) + i];
+      page.pRead = 0;
+      page.pWrite = 0;
+      page.pDevice = pDevice;
+      page.deviceStart = start;
+   }
+
+   return( true );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Remove RAM or devices from the address space.
+\param start Address of the first byte, a multiple of the page size
+\param size Size in bytes, a multiple of the page size
+\return false if the range isn't made up of whole pages
+*/
+/*----------------------------------------------------------------------------*/
+bool MemoryBus::unmap( uint32_t start, uint32_t size )
+{
+   if( !isPageRange( start, size ) )
+      return( false );
+
+   removeDevices( start, size );
+   for( uint32_t i = 0; i < ( size >> PAGE_BITS ); i++ )
+   {
+      Page &page = m_pPages[( start >> PAGE_BITS ) + i];
+      page.pRead = 0;
+      page.pWrite = 0;
+      page.pDevice = 0;
+      page.deviceStart = 0;
+   }
+
+   return( true );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\param start Address of the first byte, a multiple of the page size
+\param size Size in bytes, a multiple of the page size
+\return true if the range is made up of whole pages and neither RAM nor a
+device is mapped to any of them
+*/
+/*----------------------------------------------------------------------------*/
+bool MemoryBus::isUnmapped( uint32_t start, uint32_t size ) const
+{
+   if( !isPageRange( start, size ) )
+      return( false );
+
+   for( uint32_t i = 0; i < ( size >> PAGE_BITS ); i++ )
+   {
+      const Page &page = m_pPages[( start >> PAGE_BITS ) + i];
+      if( page.pRead || page.pDevice )
+         return( false );
+   }
+
+   return( true );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Forget the devices whose mappings start within a range of addresses.
+\param start Address of the first byte
+\param size Size in bytes
+*/
+/*----------------------------------------------------------------------------*/
+void MemoryBus::removeDevices( uint32_t start, uint32_t size )
+{
+   m_Devices.erase( m_Devices.lower_bound( start ), m_Devices.upper_bound( start + ( size - 1 ) ) );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Get all mapped devices, e.g. to save their states.
+\param devices Receives the devices, ordered by their addresses
+\param starts Receives the start address of the mapping of every device
+*/
+/*----------------------------------------------------------------------------*/
+void MemoryBus::getDevices( std::vector<Device *> &devices, std::vector<uint32_t> &starts ) const
+{
+   devices.clear();
+   starts.clear();
+   for( std::map<uint32_t, Device *>::const_iterator i = m_Devices.begin(); i != m_Devices.end(); i++ )
+   {
+      starts.push_back( i->first );
+      devices.push_back( i->second );
+   }
+}
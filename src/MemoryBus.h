@@ -0,0 +1,269 @@
+/*******************************************************************************
+ *  Copyright (c) 2024 Christian Nowak <chnowak@web.de>                        *
+ *   This file is part of chn's RISC-V-Emulator.                               *
+ *                                                                             *
+ *  RISC-V-Emulator is free software: you can redistribute it and/or modify it *
+ *  under the terms of the GNU General Public License as published by the Free *
+ *  Software Foundation, either version 3 of the License, or (at your option)  *
+ *  any later version.                                                         *
+ *                                                                             *          
+ *  RISC-V-Emulator is distributed in the hope that it will be useful, but     * 
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY *
+ *  or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License    *
+ *  for more details.                                                          *
+ *                                                                             *
+ *  You should have received a copy of the GNU General Public License along    *
+ *  with RISC-V-Emulator. If not, see <https://www.gnu.org/licenses/>.         *
+ *******************************************************************************/
+
+/*----------------------------------------------------------------------------*/
+/*!
+\file MemoryBus.h
+\author Christian Nowak <chnowak@web.de>
+\brief Headerfile for class MemoryBus.
+*/
+/*----------------------------------------------------------------------------*/
+#ifndef __MEMORYBUS_H__
+#define __MEMORYBUS_H__
+
+#include <cstdint>
+#include <vector>
+#include <map>
+
+#include "util.h"
+
+/*----------------------------------------------------------------------------*/
+/*!
+\class MemoryBus
+\date  2026-10-16
+Maps the 32bit address space in pages of 4KB either to RAM in host memory or
+to devices. Every access is dispatched by a single lookup in the page table,
+no matter how many devices are mapped. Reads from unmapped addresses return
+all ones, writes to them are ignored.
+*/
+/*----------------------------------------------------------------------------*/
+class MemoryBus
+{
+   public:
+      /*----------------------------------------------------------------------*/
+      /*!
+      \class Device
+      \date  2026-10-16
+      Base class for devices which can be mapped into the address space. The
+      addresses passed to the methods are relative to the start of the
+      mapping. By default, half-word and word accesses are split up into
+      byte accesses. A device with a state, e.g. buffered data, stores it in
+      snapshots by overriding saveState() and restoreState().
+      */
+      /*----------------------------------------------------------------------*/
+      class Device
+      {
+         public:
+            virtual ~Device();
+
+            virtual uint8_t readMem8( uint32_t offset ) = 0;
+            virtual uint16_t readMem16( uint32_t offset );
+            virtual uint32_t readMem32( uint32_t offset );
+            virtual void writeMem8( uint32_t offset, uint8_t d ) = 0;
+            virtual void writeMem16( uint32_t offset, uint16_t d );
+            virtual void writeMem32( uint32_t offset, uint32_t d );
+
+            virtual void saveState( std::vector<uint8_t> &state );
+            virtual bool restoreState( const std::vector<uint8_t> &state );
+      };
+
+      static const uint32_t PAGE_BITS = 12;
+      static const uint32_t PAGE_SIZE = 1 << PAGE_BITS;
+
+      MemoryBus();
+      ~MemoryBus();
+
+      bool mapRAM( uint32_t start, uint32_t size, uint8_t *pHostMemory, bool writable = true );
+      bool mapDevice( uint32_t start, uint32_t size, Device *pDevice );
+      bool unmap( uint32_t start, uint32_t size );
+      bool isUnmapped( uint32_t start, uint32_t size ) const;
+      void getDevices( std::vector<Device *> &devices, std::vector<uint32_t> &starts ) const;
+
+      uint8_t readMem8( uint32_t address );
+      uint16_t readMem16( uint32_t address );
+      uint32_t readMem32( uint32_t address );
+      void writeMem8( uint32_t address, uint8_t d );
+      void writeMem16( uint32_t address, uint16_t d );
+      void writeMem32( uint32_t address, uint32_t d );
+
+   private:
+      static const uint32_t NUM_PAGES = 1 << ( 32 - PAGE_BITS );
+      static const uint32_t PAGE_MASK = PAGE_SIZE - 1;
+
+      // A page is either RAM (pRead set, pWrite set unless it's read-only) or
+      // a device or unmapped (everything 0)
+      struct Page
+      {
+         uint8_t *pRead;
+         uint8_t *pWrite;
+         Device *pDevice;
+         uint32_t deviceStart;
+      };
+
+      bool isPageRange( uint32_t start, uint32_t size ) const;
+      void removeDevices( uint32_t start, uint32_t size );
+
+      Page *m_pPages;
+      std::map<uint32_t, Device *> m_Devices;
+};
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Read a byte.
+\param address The memory address to read from
+\return The value
+*/
+/*----------------------------------------------------------------------------*/
+inline uint8_t MemoryBus::readMem8( uint32_t address )
+{
+   const Page &page = m_pPages[address >> PAGE_BITS];
+   if( page.pRead )
+      return( page.pRead[address & PAGE_MASK] );
+   if( page.pDevice )
+      return( page.pDevice->readMem8( address - page.deviceStart ) );
+
+   return( 0xff );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Read a half-word. Misaligned accesses are split up into byte accesses, as they
+may cross a page boundary.
+\param address The memory address to read from
+\return The value
+*/
+/*----------------------------------------------------------------------------*/
+inline uint16_t MemoryBus::readMem16( uint32_t address )
+{
+   if( address & 1 )
+   {
+      return(   (uint16_t)readMem8( address ) |
+              ( (uint16_t)readMem8( address + 1 ) << 8 ) );
+   }
+
+   const Page &page = m_pPages[address >> PAGE_BITS];
+   if( page.pRead )
+      return( util::loadLE16( page.pRead + ( address & PAGE_MASK ) ) );
+   if( page.pDevice )
+      return( page.pDevice->readMem16( address - page.deviceStart ) );
+
+   return( 0xffff );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Read a word. Misaligned accesses are split up into byte accesses, as they may
+cross a page boundary.
+\param address The memory address to read from
+\return The value
+*/
+/*----------------------------------------------------------------------------*/
+inline uint32_t MemoryBus::readMem32( uint32_t address )
+{
+   if( address & 3 )
+   {
+      return(   (uint32_t)readMem8( address ) |
+              ( (uint32_t)readMem8( address + 1 ) << 8 ) |
+              ( (uint32_t)readMem8( address + 2 ) << 16 ) |
+              ( (uint32_t)readMem8( address + 3 ) << 24 ) );
+   }
+
+   const Page &page = m_pPages[address >> PAGE_BITS];
+   if( page.pRead )
+      return( util::loadLE32( page.pRead + ( address & PAGE_MASK ) ) );
+   if( page.pDevice )
+      return( page.pDevice->readMem32( address - page.deviceStart ) );
+
+   return( 0xffffffff );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Write a byte.
+\param address The memory address to write to
+\param d The value to write
+*/
+/*----------------------------------------------------------------------------*/
+inline void MemoryBus::writeMem8( uint32_t address, uint8_t d )
+{
+   const Page &page = m_pPages[address >> PAGE_BITS];
+   if( page.pWrite )
+   {
+      page.pWrite[address & PAGE_MASK] = d;
+   } else
+   if( page.pDevice )
+   {
+      page.pDevice->writeMem8( address - page.deviceStart, d );
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Write a half-word. Misaligned accesses are split up into byte accesses, as
+they may cross a page boundary.
+\param address The memory address to write to
+\param d The value to write
+*/
+/*----------------------------------------------------------------------------*/
+inline void MemoryBus::writeMem16( uint32_t address, uint16_t d )
+{
+   if( address & 1 )
+   {
+      writeMem8( address,       d        & 0xff );
+      writeMem8( address + 1, ( d >> 8 ) & 0xff );
+      return;
+   }
+
+   const Page &page = m_pPages[address >> PAGE_BITS];
+   if( page.pWrite )
+   {
+      util::storeLE16( page.pWrite + ( address & PAGE_MASK ), d );
+   } else
+   if( page.pDevice )
+   {
+      page.pDevice->writeMem16( address - page.deviceStart, d );
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Write a word. Misaligned accesses are split up into byte accesses, as they may
+cross a page boundary.
+\param address The memory address to write to
+\param d The value to write
+*/
+/*----------------------------------------------------------------------------*/
+inline void MemoryBus::writeMem32( uint32_t address, uint32_t d )
+{
+   if( address & 3 )
+   {
+      writeMem8( address,       d         & 0xff );
+      writeMem8( address + 1, ( d >> 8  ) & 0xff );
+      writeMem8( address + 2, ( d >> 16 ) & 0xff );
+      writeMem8( address + 3, ( d >> 24 ) & 0xff );
+      return;
+   }
+
+   const Page &page = m_pPages[address >> PAGE_BITS];
+   if( page.pWrite )
+   {
+      util::storeLE32( page.pWrite + ( address & PAGE_MASK ), d );
+   } else
+   if( page.pDevice )
+   {
+      page.pDevice->writeMem32( address - page.deviceStart, d );
+   }
+}
+
+#endif
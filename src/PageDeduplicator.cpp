@@ -0,0 +1,376 @@
+/*******************************************************************************
+ *  Copyright (c) 2024 Christian Nowak <chnowak@web.de>                        *
+ *   This file is part of chn's RISC-V-Emulator.                               *
+ *                                                                             *
+ *  RISC-V-Emulator is free software: you can redistribute it and/or modify it *
+ *  under the terms of the GNU General Public License as published by the Free *
+ *  Software Foundation, either version 3 of the License, or (at your option)  *
+ *  any later version.                                                         *
+ *                                                                             *          
+ *  RISC-V-Emulator is distributed in the hope that it will be useful, but     * 
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY *
+ *  or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License    *
+ *  for more details.                                                          *
+ *                                                                             *
+ *  You should have received a copy of the GNU General Public License along    *
+ *  with RISC-V-Emulator. If not, see <https://www.gnu.org/licenses/>.         *
+ *******************************************************************************/
+
+/*----------------------------------------------------------------------------*/
+/*!
+\file PageDeduplicator.cpp
+\author Christian Nowak <chnowak@web.de>
+\brief This implements the sharing of identical pages between Emulators
+*/
+/*----------------------------------------------------------------------------*/
+#include <string.h>
+#include <stdio.h>
+
+#if !defined( _WIN32 )
+#define PAGEDEDUPLICATOR_SHM
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "PageDeduplicator.h"
+#include "util.h"
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Constructor for class PageDeduplicator
+\param fd The shared memory object holding the pages
+\param pPages The shared memory object mapped into the host memory
+\param maxPages The number of pages the shared memory object can hold
+*/
+/*----------------------------------------------------------------------------*/
+PageDeduplicator::PageDeduplicator( int fd, uint8_t *pPages, uint32_t maxPages ) :
+   m_File( fd ),
+   m_pPages( pPages ),
+   m_MaxPages( maxPages ),
+   m_NumPages( 0 ),
+   m_NumReferences( 0 ),
+   m_PeakSavedBytes( 0 ),
+   m_MaxMappings( 65530 ),
+   m_NumMappings( 0 ),
+   m_CountedReferences( 0 )
+{
+#if defined( __linux__ )
+   // Every shared page may be a mapping of its own, and the number of
+   // mappings of a process is limited
+   FILE *pFile = fopen( "/proc/sys/vm/max_map_count", "r" );
+   if( pFile )
+   {
+      unsigned long maxMappings;
+      if( fscanf( pFile, "%lu", &maxMappings ) == 1 )
+      {
+         m_MaxMappings = maxMappings;
+      }
+      fclose( pFile );
+   }
+#endif
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Destructor for class PageDeduplicator
+*/
+/*----------------------------------------------------------------------------*/
+PageDeduplicator::~PageDeduplicator()
+{
+#ifdef PAGEDEDUPLICATOR_SHM
+   munmap( m_pPages, (size_t)m_MaxPages * PAGE_SIZE );
+   close( m_File );
+#endif
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Create a deduplicator. Its shared memory object only takes host memory for
+the pages actually stored in it.
+\param maxPages The maximum number of distinct pages
+\return A pointer to the new PageDeduplicator instance or nullptr if the host
+doesn't support sharing pages
+*/
+/*----------------------------------------------------------------------------*/
+PageDeduplicator *PageDeduplicator::create( uint32_t maxPages )
+{
+#ifdef PAGEDEDUPLICATOR_SHM
+   if( ( maxPages == 0 ) || ( sysconf( _SC_PAGESIZE ) != PAGE_SIZE ) )
+      return( 0 );
+
+#if defined( __linux__ )
+   int fd = memfd_create( "RISC-V-Emulator pages", 0 );
+#else
+   std::string name = stdformat( "/RISC-V-Emulator-{}-{}", getpid(), (const void *)&maxPages );
+   int fd = shm_open( name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600 );
+   if( fd >= 0 )
+   {
+      shm_unlink( name.c_str() );
+   }
+#endif
+   if( fd < 0 )
+      return( 0 );
+
+   size_t size = (size_t)maxPages * PAGE_SIZE;
+   void *p = ftruncate( fd, size ) == 0 ? mmap( 0, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_NORESERVE, fd, 0 ) : MAP_FAILED;
+   if( p == MAP_FAILED )
+   {
+      close( fd );
+      return( 0 );
+   }
+
+   return( new PageDeduplicator( fd, (uint8_t *)p, maxPages ) );
+#else
+   return( 0 );
+#endif
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Calculate the hash of the contents of a page, which is never 0.
+\param pPage The page
+\return The hash
+*/
+/*----------------------------------------------------------------------------*/
+uint64_t PageDeduplicator::hash( const uint8_t *pPage )
+{
+   // FNV-1a over 64 bit words
+   uint64_t h = 0xcbf29ce484222325ULL;
+   for( uint32_t i = 0; i < PAGE_SIZE; i += 8 )
+   {
+      uint64_t w;
+      memcpy( &w, pPage + i, sizeof( w ) );
+      h = ( h ^ w ) * 0x100000001b3ULL;
+   }
+
+   return( h ? h : 1 );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Look up a page with the given contents, storing it if there is none yet, and
+add a reference to it.
+\param pPage The contents of the page
+\param hash The hash of the contents, see hash()
+\return The slot of the page in the shared memory object or NO_SLOT if it is
+full
+*/
+/*----------------------------------------------------------------------------*/
+uint32_t PageDeduplicator::acquire( const uint8_t *pPage, uint64_t hash )
+{
+   std::lock_guard<std::mutex> lock( m_Mutex );
+
+   uint32_t slot = NO_SLOT;
+   typedef std::unordered_multimap<uint64_t, uint32_t>::const_iterator Iterator;
+   std::pair<Iterator, Iterator> range = m_Slots.equal_range( hash );
+   for( Iterator i = range.first; i != range.second; i++ )
+   {
+      if( memcmp( m_pPages + (size_t)i->second * PAGE_SIZE, pPage, PAGE_SIZE ) == 0 )
+      {
+         slot = i->second;
+         break;
+      }
+   }
+
+   if( slot == NO_SLOT )
+   {
+      if( !m_FreeSlots.empty() )
+      {
+         slot = m_FreeSlots.back();
+         m_FreeSlots.pop_back();
+      } else
+      if( m_Hashes.size() < m_MaxPages )
+      {
+         slot = m_Hashes.size();
+         m_Hashes.push_back( 0 );
+         m_References.push_back( 0 );
+      } else
+      {
+         return( NO_SLOT );
+      }
+
+      memcpy( m_pPages + (size_t)slot * PAGE_SIZE, pPage, PAGE_SIZE );
+      m_Hashes[slot] = hash;
+      m_Slots.insert( std::make_pair( hash, slot ) );
+      m_NumPages++;
+   }
+
+   m_References[slot]++;
+   m_NumReferences++;
+   if( ( m_NumReferences - m_NumPages ) * PAGE_SIZE > m_PeakSavedBytes )
+   {
+      m_PeakSavedBytes = ( m_NumReferences - m_NumPages ) * PAGE_SIZE;
+   }
+
+   return( slot );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Remove a reference to a page. The host memory of a page without references
+is freed.
+\param slot The slot of the page returned by acquire()
+*/
+/*----------------------------------------------------------------------------*/
+void PageDeduplicator::release( uint32_t slot )
+{
+   std::lock_guard<std::mutex> lock( m_Mutex );
+
+   m_NumReferences--;
+   if( --m_References[slot] > 0 )
+      return;
+
+   typedef std::unordered_multimap<uint64_t, uint32_t>::iterator Iterator;
+   std::pair<Iterator, Iterator> range = m_Slots.equal_range( m_Hashes[slot] );
+   for( Iterator i = range.first; i != range.second; i++ )
+   {
+      if( i->second == slot )
+      {
+         m_Slots.erase( i );
+         break;
+      }
+   }
+
+#if defined( MADV_REMOVE )
+   madvise( m_pPages + (size_t)slot * PAGE_SIZE, PAGE_SIZE, MADV_REMOVE );
+#endif
+   m_FreeSlots.push_back( slot );
+   m_NumPages--;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\return The shared memory object holding the pages, to be mapped with
+MAP_SHARED at getFileOffset()
+*/
+/*----------------------------------------------------------------------------*/
+int PageDeduplicator::getFile() const
+{
+   return( m_File );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\param slot The slot of a page
+\return The offset of the page in the shared memory object
+*/
+/*----------------------------------------------------------------------------*/
+uint64_t PageDeduplicator::getFileOffset( uint32_t slot )
+{
+   return( (uint64_t)slot * PAGE_SIZE );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Check whether the process may map more shared pages. Every shared page may
+need a mapping of its own, which is limited by the host, so sharing stops
+when half of the limit has been reached. The rest is left for giving up the
+sharing again, which may split mappings. Counting the mappings takes time in
+proportion to their number, so they are only counted again if the mappings
+added by the pages shared since they were last counted might exceed the
+limit.
+\return true if more pages may be shared
+*/
+/*----------------------------------------------------------------------------*/
+bool PageDeduplicator::canMap()
+{
+   std::lock_guard<std::mutex> lock( m_Mutex );
+
+   size_t added = m_NumReferences > m_CountedReferences ? m_NumReferences - m_CountedReferences : 0;
+   if( ( m_CountedReferences == 0 ) || ( m_NumMappings + 2 * added >= m_MaxMappings / 2 ) )
+   {
+      m_NumMappings = countMappings();
+      m_CountedReferences = m_NumReferences;
+      added = 0;
+   }
+
+   return( m_NumMappings + 2 * added < m_MaxMappings / 2 );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\return The number of mappings of the process, or 0 if it isn't known
+*/
+/*----------------------------------------------------------------------------*/
+size_t PageDeduplicator::countMappings()
+{
+   size_t n = 0;
+#if defined( __linux__ )
+   FILE *pFile = fopen( "/proc/self/maps", "r" );
+   if( !pFile )
+      return( 0 );
+
+   char buf[65536];
+   size_t size;
+   while( ( size = fread( buf, 1, sizeof( buf ), pFile ) ) > 0 )
+   {
+      for( size_t i = 0; i < size; i++ )
+      {
+         n += buf[i] == '\n';
+      }
+   }
+   fclose( pFile );
+#endif
+
+   return( n );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\return The number of distinct pages stored
+*/
+/*----------------------------------------------------------------------------*/
+size_t PageDeduplicator::getNumPages() const
+{
+   std::lock_guard<std::mutex> lock( m_Mutex );
+   return( m_NumPages );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\return The number of pages of all RAMs which are shared
+*/
+/*----------------------------------------------------------------------------*/
+size_t PageDeduplicator::getNumReferences() const
+{
+   std::lock_guard<std::mutex> lock( m_Mutex );
+   return( m_NumReferences );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\return The host memory saved by sharing pages, i.e. the size of all shared
+pages of all RAMs minus the size of the distinct pages stored
+*/
+/*----------------------------------------------------------------------------*/
+size_t PageDeduplicator::getSavedBytes() const
+{
+   std::lock_guard<std::mutex> lock( m_Mutex );
+   return( ( m_NumReferences - m_NumPages ) * PAGE_SIZE );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\return The maximum of getSavedBytes() so far
+*/
+/*----------------------------------------------------------------------------*/
+size_t PageDeduplicator::getPeakSavedBytes() const
+{
+   std::lock_guard<std::mutex> lock( m_Mutex );
+   return( m_PeakSavedBytes );
+}
@@ -0,0 +1,89 @@
+/*******************************************************************************
+ *  Copyright (c) 2024 Christian Nowak <chnowak@web.de>                        *
+ *   This file is part of chn's RISC-V-Emulator.                               *
+ *                                                                             *
+ *  RISC-V-Emulator is free software: you can redistribute it and/or modify it *
+ *  under the terms of the GNU General Public License as published by the Free *
+ *  Software Foundation, either version 3 of the License, or (at your option)  *
+ *  any later version.                                                         *
+ *                                                                             *          
+ *  RISC-V-Emulator is distributed in the hope that it will be useful, but     * 
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY *
+ *  or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License    *
+ *  for more details.                                                          *
+ *                                                                             *
+ *  You should have received a copy of the GNU General Public License along    *
+ *  with RISC-V-Emulator. If not, see <https://www.gnu.org/licenses/>.         *
+ *******************************************************************************/
+
+/*----------------------------------------------------------------------------*/
+/*!
+\file PageDeduplicator.h
+\author Christian Nowak <chnowak@web.de>
+\brief Headerfile for class PageDeduplicator.
+*/
+/*----------------------------------------------------------------------------*/
+#ifndef __PAGEDEDUPLICATOR_H__
+#define __PAGEDEDUPLICATOR_H__
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+
+/*----------------------------------------------------------------------------*/
+/*!
+\class PageDeduplicator
+\date  2026-10-16
+Shares pages with identical contents between the RAMs of several Emulators
+within one process. Every distinct page is stored once in a shared memory
+object of the host, from which it is mapped read-only into all RAMs holding
+that page. The pages are found by a hash of their contents. A RAM gives up
+sharing a page when the page is written to, see GuestRAM::deduplicate(). The
+deduplicator may be used by several threads at once and has to live longer
+than the RAMs using it. Only available on POSIX hosts.
+*/
+/*----------------------------------------------------------------------------*/
+class PageDeduplicator
+{
+   public:
+      static const uint32_t PAGE_SIZE = 4096;
+      static const uint32_t NO_SLOT = 0xffffffff;
+
+      static PageDeduplicator *create( uint32_t maxPages = 0x00100000 );
+      ~PageDeduplicator();
+
+      static uint64_t hash( const uint8_t *pPage );
+      uint32_t acquire( const uint8_t *pPage, uint64_t hash );
+      void release( uint32_t slot );
+      int getFile() const;
+      static uint64_t getFileOffset( uint32_t slot );
+      bool canMap();
+
+      size_t getNumPages() const;
+      size_t getNumReferences() const;
+      size_t getSavedBytes() const;
+      size_t getPeakSavedBytes() const;
+
+   private:
+      PageDeduplicator( int fd, uint8_t *pPages, uint32_t maxPages );
+      static size_t countMappings();
+
+      int m_File;
+      uint8_t *m_pPages;
+      uint32_t m_MaxPages;
+      mutable std::mutex m_Mutex;
+      std::unordered_multimap<uint64_t, uint32_t> m_Slots;
+      std::vector<uint64_t> m_Hashes;
+      std::vector<uint32_t> m_References;
+      std::vector<uint32_t> m_FreeSlots;
+      size_t m_NumPages;
+      size_t m_NumReferences;
+      size_t m_PeakSavedBytes;
+      size_t m_MaxMappings;
+      size_t m_NumMappings;
+      size_t m_CountedReferences;
+};
+
+#endif
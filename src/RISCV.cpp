@@ -25,18 +25,44 @@
 */
 /*----------------------------------------------------------------------------*/
 #include <stdio.h>
+#include <string.h>
 #include <string>
+#include <algorithm>
 
 #include "RISCV.h"
+#include "JIT.h"
+#include "Disassembler.h"
 
 
 /*----------------------------------------------------------------------------*/
 /*! 2024-08-14
 Constructor for class RISCV
+\param pMem The memory interface
+\param hartId The id of the hart, which is passed to the program in a0
 */
 /*----------------------------------------------------------------------------*/
-RISCV::RISCV( MemoryInterface *pMem ) :
-   m_pMemory( pMem )
+RISCV::RISCV( MemoryInterface *pMem, uint32_t hartId ) :
+   m_pMemory( pMem ),
+   m_HartId( hartId ),
+   m_pRAM( 0 ),
+   m_RAMStart( 0 ),
+   m_RAMSize( 0 ),
+   m_pDirtyPages( 0 ),
+   m_ReservationAddress( NO_RESERVATION ),
+   m_ReservationGranule( 4 ),
+   m_ReservedWord( 0 ),
+   m_ReservedValue( 0 ),
+   m_DecodeCacheHits( 0 ),
+   m_DecodeCacheMisses( 0 ),
+   m_Engine( ENGINE_INTERPRETER ),
+   m_CodePageBits( 1 << ( 32 - CODE_PAGE_BITS - 5 ), 0 ),
+   m_CodeModified( false ),
+   m_StopReason( STOP_NONE ),
+   m_Deadline( NO_DEADLINE ),
+   m_InstructionsRetired( 0 ),
+   m_BlocksTranslated( 0 ),
+   m_BlocksInvalidated( 0 ),
+   m_pJIT( 0 )
 {
    reset();
 }
@@ -49,6 +75,8 @@ Destructor for class RISCV
 /*----------------------------------------------------------------------------*/
 RISCV::~RISCV()
 {
+   flushBlocks();
+   delete m_pJIT;
 }
 
 
@@ -75,7 +103,9 @@ std::string RISCV::registerName( int n )
 
 /*----------------------------------------------------------------------------*/
 /*! 2024-08-14
-Set the PC to 0x80000000 and all registers to 0.
+Set the PC to 0x80000000, a0 to the hart id and all other registers to 0. The
+decode cache and the block cache are flushed as the memory contents may have
+changed, and a pending stop request is dropped.
 */
 /*----------------------------------------------------------------------------*/
 void RISCV::reset()
@@ -85,81 +115,824 @@ void RISCV::reset()
    {
       m_Registers[i] = 0;
    }
+   m_Registers[10] = m_HartId;
+
+   m_StopReason = STOP_NONE;
+   clearReservation();
+   flushDecodeCache();
+   flushBlocks();
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Give the CPU direct access to a window of RAM in host memory. Aligned loads,
+stores and instruction fetches within the window are done directly in host
+memory instead of calling the MemoryInterface, which only sees misaligned
+accesses and accesses outside of the window, e.g. to devices. The host memory
+has to stay valid as long as it is mapped.
+\param start Guest address of the window
+\param size Size of the window in bytes, a multiple of 4. Pass 0 to unmap the
+window.
+\param pHostMemory The RAM contents in host memory, in little endian byte order
+\param pDirtyPages Optionally a flag per 4KB page of the window. Before the CPU
+writes directly to a page whose flag isn't set, it calls
+MemoryInterface::markDirty(), which has to set the flag, e.g. after saving the
+page.
+*/
+/*----------------------------------------------------------------------------*/
+void RISCV::mapRAM( uint32_t start, uint32_t size, uint8_t *pHostMemory, const std::atomic<uint8_t> *pDirtyPages )
+{
+   m_RAMStart = start;
+   m_RAMSize = size;
+   m_pRAM = pHostMemory;
+   m_pDirtyPages = pDirtyPages;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2024-08-14
+\return The current value of the PC (program counter)
+*/
+/*----------------------------------------------------------------------------*/
+uint32_t RISCV::getPC() const
+{
+   return( m_PC );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Set the PC, e.g. to the entry point of a program after reset().
+\param pc The address of the next instruction to be executed
+*/
+/*----------------------------------------------------------------------------*/
+void RISCV::setPC( uint32_t pc )
+{
+   m_PC = pc;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Get the state of the hart, i.e. everything a program could observe apart
+from the memory.
+\param state Receives the state
+*/
+/*----------------------------------------------------------------------------*/
+void RISCV::getState( State &state ) const
+{
+   state.pc = m_PC;
+   for( int i = 0; i < 32; i++ )
+   {
+      state.registers[i] = m_Registers[i];
+   }
+   state.reservationAddress = m_ReservationAddress;
+   state.reservedWord = m_ReservedWord;
+   state.reservedValue = m_ReservedValue;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Set the state of the hart, e.g. from a snapshot. The decode cache and the
+block cache are kept, so if the memory has changed as well, they have to be
+flushed by reset() before or invalidated by invalidateCode().
+\param state The state
+*/
+/*----------------------------------------------------------------------------*/
+void RISCV::setState( const State &state )
+{
+   m_PC = state.pc;
+   for( int i = 0; i < 32; i++ )
+   {
+      m_Registers[i] = state.registers[i];
+   }
+   m_Registers[0] = 0;
+   m_ReservationAddress = state.reservationAddress;
+   m_ReservedWord = state.reservedWord;
+   m_ReservedValue = state.reservedValue;
+   m_StopReason = STOP_NONE;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\return The id of the hart
+*/
+/*----------------------------------------------------------------------------*/
+uint32_t RISCV::getHartId() const
+{
+   return( m_HartId );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2024-08-14
+This method is called when the emulation encounters an unknown opcode.
+*/
+/*----------------------------------------------------------------------------*/
+void RISCV::unknownOpcode()
+{
+   m_StopReason = STOP_ILLEGAL_INSTRUCTION;
+   m_pMemory->unknownOpcode();
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2024-08-14
+Execute a single machine code instruction.
+\param pInstruction Pointer to an Instruction object for a disassembly, which
+is also printed to stdout as a line of the trace. Pass nullptr if no
+disassembly is required.
+*/
+/*----------------------------------------------------------------------------*/
+void RISCV::step( Instruction *pInstruction )
+{
+   if( pInstruction )
+   {
+      // Tracing: the disassembly needs the instruction code, so bypass the cache
+      uint32_t instr = readMem32( m_PC );
+      DecodedInstruction d;
+      decode( m_PC, instr, d );
+      Disassembler::disassemble( d, instr, *pInstruction );
+      executeOps<true, MemoryInterface>( &d );
+      Disassembler::print( *pInstruction );
+   } else
+   {
+      executeOps<true, MemoryInterface>( &fetchDecoded( m_PC ) );
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Drop the complete decode cache.
+*/
+/*----------------------------------------------------------------------------*/
+void RISCV::flushDecodeCache()
+{
+   for( int i = 0; i < DECODE_CACHE_SIZE; i++ )
+   {
+      m_DecodeCacheTags[i] = INVALID_ADDRESS;
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\return The number of instructions which have been taken from the decode cache
+*/
+/*----------------------------------------------------------------------------*/
+uint64_t RISCV::getDecodeCacheHits() const
+{
+   return( m_DecodeCacheHits );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\return The number of instructions which had to be fetched and decoded
+*/
+/*----------------------------------------------------------------------------*/
+uint64_t RISCV::getDecodeCacheMisses() const
+{
+   return( m_DecodeCacheMisses );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Execute instructions with all memory accesses going through the virtual
+methods of MemoryInterface. See run<Bus>().
+\param maxInstructions The maximum number of instructions to be retired
+\return The reason for returning and the number of instructions retired
+*/
+/*----------------------------------------------------------------------------*/
+RISCV::RunResult RISCV::run( uint64_t maxInstructions )
+{
+   return( run<MemoryInterface>( maxInstructions ) );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Execute the native code of a block. Linked native blocks jump directly into
+each other, so this may execute several blocks up to the limit.
+\param pBlock The block
+\param limit The number of retired instructions at which to stop
+\return The unlinked static exit through which the native code has been left
+or nullptr
+*/
+/*----------------------------------------------------------------------------*/
+RISCV::Exit *RISCV::executeNative( Block *pBlock, uint64_t limit )
+{
+   JIT::Context &context = m_pJIT->getContext();
+   context.pCPU = this;
+   context.instructions = 0;
+   context.limit = limit - m_InstructionsRetired;
+   context.pExit = 0;
+   context.pRAM = m_pRAM;
+   context.pDirtyPages = m_pDirtyPages;
+   context.pDecodeCacheTags = m_DecodeCacheTags;
+   context.pCodePageBits = m_CodePageBits.data();
+   context.ramStart = m_RAMStart;
+   context.ramSize = m_RAMSize;
+   context.reservationAddress = m_ReservationAddress;
+   context.reservationGranule = m_ReservationGranule;
+
+   // A stop requested by another thread while setting the limit must not get
+   // lost, see requestStop()
+   if( m_StopReason != STOP_NONE )
+   {
+      context.limit = 0;
+   }
+
+   m_PC = m_pJIT->execute( pBlock->pNativeCode, m_Registers );
+   m_InstructionsRetired += context.instructions;
+
+   return( context.pExit );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Look up the block at the current PC after a block has been left through an
+exit which hasn't been linked yet, and link the exit to it. If the block has
+been left through a JALR instead, the target is entered into the indirect
+branch cache of the JIT.
+\param pExit The static exit through which the block has been left or nullptr
+\return The block at the current PC
+*/
+/*----------------------------------------------------------------------------*/
+RISCV::Block *RISCV::nextBlock( Exit *pExit )
+{
+   Block *pBlock = lookupBlock( m_PC );
+   if( ( m_Engine == ENGINE_JIT ) && !pBlock->nativeTranslated )
+   {
+      translateNative( pBlock );
+   }
+
+   if( pExit && !pExit->pBlock->removed )
+   {
+      linkExit( pExit, pBlock );
+   } else
+   if( ( m_Engine == ENGINE_JIT ) && pBlock->pNativeCode )
+   {
+      m_pJIT->setIndirectBranchTarget( m_PC, pBlock->pNativeCode );
+   }
+
+   return( pBlock );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Make run() return as soon as possible, i.e. after the current instruction.
+Called by devices, e.g. when the guest writes to a halt register. This may be
+called from any thread, e.g. to stop the other harts of a multi-hart system.
+If a stop is already pending, its reason is kept.
+\param reason The stop reason to be returned by run()
+*/
+/*----------------------------------------------------------------------------*/
+void RISCV::requestStop( StopReason reason )
+{
+   StopReason none = STOP_NONE;
+   m_StopReason.compare_exchange_strong( none, reason );
+
+   // Native code only checks its instruction limit when entering a block
+   if( m_pJIT )
+   {
+      m_pJIT->getContext().limit = 0;
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Make run() return with STOP_DEADLINE once the total number of retired
+instructions reaches a given value.
+\param instructionsRetired The deadline or NO_DEADLINE
+*/
+/*----------------------------------------------------------------------------*/
+void RISCV::setDeadline( uint64_t instructionsRetired )
+{
+   m_Deadline = instructionsRetired;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Find the block starting at a given address, translating it if necessary. A
+small direct-mapped cache in front of the block cache speeds up the lookups
+for the targets of JALR, which can't be linked.
+\param address Memory address of the first instruction
+\return The block
+*/
+/*----------------------------------------------------------------------------*/
+RISCV::Block *RISCV::lookupBlock( uint32_t address )
+{
+   BlockLookup &l = m_BlockLookupCache[( address >> 2 ) & ( BLOCK_LOOKUP_CACHE_SIZE - 1 )];
+   if( l.address == address )
+      return( l.pBlock );
+
+   Block *pBlock;
+   std::unordered_map<uint32_t, Block *>::const_iterator i = m_Blocks.find( address );
+   if( i != m_Blocks.end() )
+   {
+      pBlock = i->second;
+   } else
+   {
+      pBlock = translateBlock( address );
+   }
+
+   l.address = address;
+   l.pBlock = pBlock;
+
+   return( pBlock );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Link an exit of a block to the block at its target. If both blocks have been
+translated by the JIT, the native code of the exit is patched to jump to the
+native code of the target block.
+\param pExit The exit
+\param pBlock The block at the target of the exit
+*/
+/*----------------------------------------------------------------------------*/
+void RISCV::linkExit( Exit *pExit, Block *pBlock )
+{
+   pExit->pLinked = pBlock;
+   pBlock->incoming.push_back( pExit );
+
+   if( pExit->pNativePatch && pBlock->pNativeCode )
+   {
+      m_pJIT->patch( pExit->pNativePatch, pBlock->pNativeCode );
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Translate a block into machine code. If the code arena of the JIT is full, all
+native code is dropped and the translation is retried. Blocks which can't be
+translated are executed by executeOps() instead.
+\param pBlock The block
+*/
+/*----------------------------------------------------------------------------*/
+void RISCV::translateNative( Block *pBlock )
+{
+   pBlock->pNativeCode = m_pJIT->translate( pBlock );
+   if( !pBlock->pNativeCode && m_pJIT->isFull() )
+   {
+      for( std::unordered_map<uint32_t, Block *>::iterator i = m_Blocks.begin(); i != m_Blocks.end(); i++ )
+      {
+         Block *p = i->second;
+         p->nativeTranslated = false;
+         p->pNativeCode = 0;
+         for( int e = 0; e < p->numExits; e++ )
+         {
+            p->exits[e].pNativePatch = 0;
+            p->exits[e].pNativeStub = 0;
+         }
+      }
+      m_pJIT->flush();
+      pBlock->pNativeCode = m_pJIT->translate( pBlock );
+   }
+
+   pBlock->nativeTranslated = true;
+
+   // Restore the native links of the existing links from and to the block
+   if( pBlock->pNativeCode )
+   {
+      for( int e = 0; e < pBlock->numExits; e++ )
+      {
+         const Exit &exit = pBlock->exits[e];
+         if( exit.pLinked && exit.pLinked->pNativeCode && exit.pNativePatch )
+         {
+            m_pJIT->patch( exit.pNativePatch, exit.pLinked->pNativeCode );
+         }
+      }
+
+      for( size_t i = 0; i < pBlock->incoming.size(); i++ )
+      {
+         if( pBlock->incoming[i]->pNativePatch )
+         {
+            m_pJIT->patch( pBlock->incoming[i]->pNativePatch, pBlock->pNativeCode );
+         }
+      }
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\param op An operation
+\return true if the operation ends a basic block, i.e. it may change the
+control flow or stop the execution
+*/
+/*----------------------------------------------------------------------------*/
+bool RISCV::endsBlock( uint8_t op )
+{
+   return( ( op == OP_ILLEGAL ) ||
+           ( ( op >= OP_BEQ ) && ( op <= OP_HOST_ROUTINE ) ) );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Translate the basic block starting at a given address into an array of decoded
+instructions and add it to the block cache. A block ends with a jump, a branch
+or an illegal instruction. Blocks which would get longer than MAX_BLOCK_LENGTH
+are terminated by an OP_EXIT.
+\param address Memory address of the first instruction
+\return The new block
+*/
+/*----------------------------------------------------------------------------*/
+RISCV::Block *RISCV::translateBlock( uint32_t address )
+{
+   Block *pBlock = new Block;
+   pBlock->address = address;
+   pBlock->nativeTranslated = false;
+   pBlock->pNativeCode = 0;
+   pBlock->removed = false;
+   pBlock->numExits = 0;
+
+   uint32_t a = address;
+   for( ;; )
+   {
+      DecodedInstruction d;
+      decode( a, readMem32( a ), d );
+      if( isHostRoutine( a ) )
+         d.op = OP_HOST_ROUTINE;
+      pBlock->ops.push_back( d );
+      a += 4;
+
+      if( endsBlock( d.op ) )
+         break;
+
+      if( pBlock->ops.size() >= MAX_BLOCK_LENGTH )
+      {
+         d.address = a;
+         d.op = OP_EXIT;
+         pBlock->ops.push_back( d );
+         break;
+      }
+   }
+   pBlock->endAddress = a;
+
+   // The static exits of the block, depending on its last instruction
+   const DecodedInstruction &last = pBlock->ops.back();
+   if( ( last.op >= OP_BEQ ) && ( last.op <= OP_BGEU ) )
+   {
+      pBlock->exits[pBlock->numExits++].target = last.address + 4;
+      pBlock->exits[pBlock->numExits++].target = last.address + last.imm;
+   } else
+   if( last.op == OP_JAL )
+   {
+      pBlock->exits[pBlock->numExits++].target = last.address + last.imm;
+   } else
+   if( last.op == OP_ECALL )
+   {
+      pBlock->exits[pBlock->numExits++].target = last.address + 4;
+   } else
+   if( last.op == OP_EXIT )
+   {
+      pBlock->exits[pBlock->numExits++].target = last.address;
+   }
+   for( int e = 0; e < pBlock->numExits; e++ )
+   {
+      pBlock->exits[e].pBlock = pBlock;
+      pBlock->exits[e].pLinked = 0;
+      pBlock->exits[e].pNativePatch = 0;
+      pBlock->exits[e].pNativeStub = 0;
+   }
+
+   for( uint32_t page = address >> CODE_PAGE_BITS; page <= ( a - 1 ) >> CODE_PAGE_BITS; page++ )
+   {
+      m_CodePageBits[page >> 5] |= 1 << ( page & 31 );
+      m_CodePages[page].blocks.push_back( pBlock );
+      updateCodePage( page );
+   }
+
+   m_Blocks[address] = pBlock;
+   m_BlocksTranslated++;
+
+   return( pBlock );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Recompute which words of a code page are covered by translated blocks. The
+page is dropped from the set of code pages when it doesn't contain any blocks
+anymore.
+\param page The page number
+*/
+/*----------------------------------------------------------------------------*/
+void RISCV::updateCodePage( uint32_t page )
+{
+   CodePage &p = m_CodePages[page];
+   if( p.blocks.empty() )
+   {
+      m_CodePages.erase( page );
+      m_CodePageBits[page >> 5] &= ~( 1 << ( page & 31 ) );
+      return;
+   }
+
+   uint32_t pageStart = page << CODE_PAGE_BITS;
+   uint32_t pageEnd = pageStart + ( 1 << CODE_PAGE_BITS );
+   memset( p.codeWords, 0, sizeof( p.codeWords ) );
+   for( size_t i = 0; i < p.blocks.size(); i++ )
+   {
+      const Block *pBlock = p.blocks[i];
+      uint32_t start = pBlock->address > pageStart ? pBlock->address : pageStart;
+      uint32_t end = pBlock->endAddress - 1 < pageEnd - 1 ? pBlock->endAddress : pageEnd;
+      for( uint32_t a = start; a < end; a += 4 )
+      {
+         uint32_t w = ( a - pageStart ) >> 2;
+         p.codeWords[w >> 5] |= 1 << ( w & 31 );
+      }
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Remove all translated blocks overlapping a range of memory that has been
+written to. The blocks themselves are only deleted by freeRetiredBlocks() as
+one of them may still be executing.
+\param address Start address
+\param n Number of bytes
+*/
+/*----------------------------------------------------------------------------*/
+void RISCV::invalidateBlocks( uint32_t address, int n )
+{
+   uint32_t last = address + n - 1;
+   for( uint32_t page = address >> CODE_PAGE_BITS; page <= last >> CODE_PAGE_BITS; page++ )
+   {
+      if( !( m_CodePageBits[page >> 5] & ( 1 << ( page & 31 ) ) ) )
+         continue;
+
+      CodePage &p = m_CodePages[page];
+      bool hit = false;
+      for( uint32_t a = address & ~3; a <= last; a += 4 )
+      {
+         if( ( a >> CODE_PAGE_BITS ) == page )
+         {
+            uint32_t w = ( a & ( ( 1 << CODE_PAGE_BITS ) - 1 ) ) >> 2;
+            hit = hit || ( p.codeWords[w >> 5] & ( 1 << ( w & 31 ) ) );
+         }
+      }
+
+      if( !hit )
+         continue;
+
+      std::vector<Block *> blocks = p.blocks;
+      for( size_t i = 0; i < blocks.size(); i++ )
+      {
+         if( ( blocks[i]->address <= last ) && ( blocks[i]->endAddress > address ) )
+         {
+            removeBlock( blocks[i] );
+         }
+      }
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Remove a block from the block cache and from all code pages it covers. All
+links from and to the block are removed, so it can't be entered anymore.
+\param pBlock The block
+*/
+/*----------------------------------------------------------------------------*/
+void RISCV::removeBlock( Block *pBlock )
+{
+   for( size_t i = 0; i < pBlock->incoming.size(); i++ )
+   {
+      Exit *pExit = pBlock->incoming[i];
+      pExit->pLinked = 0;
+      if( pExit->pNativePatch )
+      {
+         m_pJIT->patch( pExit->pNativePatch, pExit->pNativeStub );
+      }
+   }
+   pBlock->incoming.clear();
+
+   for( int e = 0; e < pBlock->numExits; e++ )
+   {
+      Block *pLinked = pBlock->exits[e].pLinked;
+      if( pLinked )
+      {
+         std::vector<Exit *> &incoming = pLinked->incoming;
+         incoming.erase( std::remove( incoming.begin(), incoming.end(), &pBlock->exits[e] ), incoming.end() );
+         pBlock->exits[e].pLinked = 0;
+      }
+   }
+
+   BlockLookup &l = m_BlockLookupCache[( pBlock->address >> 2 ) & ( BLOCK_LOOKUP_CACHE_SIZE - 1 )];
+   if( l.pBlock == pBlock )
+   {
+      l.address = INVALID_ADDRESS;
+      l.pBlock = 0;
+   }
+
+   if( m_pJIT )
+   {
+      m_pJIT->removeIndirectBranchTarget( pBlock->address );
+   }
+
+   for( uint32_t page = pBlock->address >> CODE_PAGE_BITS; page <= ( pBlock->endAddress - 1 ) >> CODE_PAGE_BITS; page++ )
+   {
+      std::vector<Block *> &blocks = m_CodePages[page].blocks;
+      blocks.erase( std::remove( blocks.begin(), blocks.end(), pBlock ), blocks.end() );
+      updateCodePage( page );
+   }
+
+   m_Blocks.erase( pBlock->address );
+   pBlock->removed = true;
+   m_RetiredBlocks.push_back( pBlock );
+   m_BlocksInvalidated++;
+   m_CodeModified = true;
 }
 
 
 /*----------------------------------------------------------------------------*/
-/*! 2024-08-14
-\param r A register number
-\return The current contents of the register
+/*! 2026-10-16
+Delete the blocks which have been removed from the block cache.
 */
 /*----------------------------------------------------------------------------*/
-uint32_t RISCV::getRegister( int r ) const
+void RISCV::freeRetiredBlocks()
 {
-   r &= 0x1f;
-
-   if( r == 0 )
+   for( size_t i = 0; i < m_RetiredBlocks.size(); i++ )
    {
-      return( 0 );
-   } else
+      delete m_RetiredBlocks[i];
+   }
+   m_RetiredBlocks.clear();
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Treat a range of memory written by the host on behalf of the hart, e.g. by a
+system call or a device it has started, like a store of the hart: the code
+translated from the range is dropped and a reservation overlapping it is
+cleared. As for stores, other harts see new code after a fence.i.
+\param address The start of the range
+\param size The size of the range in bytes
+*/
+/*----------------------------------------------------------------------------*/
+void RISCV::invalidateWritten( uint32_t address, uint32_t size )
+{
+   // Page by page, so the time stays linear in the size
+   while( size > 0 )
    {
-      return( m_Registers[r & 0x1f] );
+      uint32_t n = ( 1 << CODE_PAGE_BITS ) - ( address & ( ( 1 << CODE_PAGE_BITS ) - 1 ) );
+      if( n > size )
+         n = size;
+
+      invalidateCode( address, (int)n );
+      invalidateReservation( address, (int)n );
+      address += n;
+      size -= n;
    }
 }
 
 
 /*----------------------------------------------------------------------------*/
-/*! 2024-08-14
-\return The current value of the PC (program counter)
+/*! 2026-10-16
+Set the routines carried out by the host instead of the hart: when the hart
+calls one of them, MemoryInterface::hostRoutine() is called instead of
+executing its first instruction, and the hart returns to ra. All decoded and
+translated instructions are dropped, so this must not be called while the
+hart is running.
+\param addresses The start addresses of the routines, or none to execute all
+routines on the hart
 */
 /*----------------------------------------------------------------------------*/
-uint32_t RISCV::getPC() const
+void RISCV::setHostRoutines( const std::vector<uint32_t> &addresses )
 {
-   return( m_PC );
+   m_HostRoutines = addresses;
+   std::sort( m_HostRoutines.begin(), m_HostRoutines.end() );
+   flushDecodeCache();
+   flushBlocks();
 }
 
 
 /*----------------------------------------------------------------------------*/
-/*! 2024-08-14
-Set a register to a given value.
-\param r The register number
-\param v The value to set the register to
+/*! 2026-10-16
+Drop the complete block cache. Must not be called while a block is executing.
 */
 /*----------------------------------------------------------------------------*/
-void RISCV::setRegister( int r, uint32_t v )
+void RISCV::flushBlocks()
 {
-   r &= 0x1f;
+   for( std::unordered_map<uint32_t, Block *>::iterator i = m_Blocks.begin(); i != m_Blocks.end(); i++ )
+   {
+      delete i->second;
+   }
+   m_Blocks.clear();
+   m_CodePages.clear();
+   std::fill( m_CodePageBits.begin(), m_CodePageBits.end(), 0 );
+   for( int i = 0; i < BLOCK_LOOKUP_CACHE_SIZE; i++ )
+   {
+      m_BlockLookupCache[i].address = INVALID_ADDRESS;
+      m_BlockLookupCache[i].pBlock = 0;
+   }
 
-   if( r != 0 )
+   if( m_pJIT )
    {
-      m_Registers[r] = v;
+      m_pJIT->flush();
    }
+
+   freeRetiredBlocks();
 }
 
 
 /*----------------------------------------------------------------------------*/
-/*! 2024-08-14
-This method is called when the emulation encounters an unknown opcode.
+/*! 2026-10-16
+Select the execution engine.
+\param engine ENGINE_INTERPRETER to execute one instruction after another,
+ENGINE_BLOCKS to execute translated basic blocks, ENGINE_JIT to execute basic
+blocks translated into host machine code
+\return false if the engine isn't supported on the host platform
 */
 /*----------------------------------------------------------------------------*/
-void RISCV::unknownOpcode()
+bool RISCV::setEngine( Engine engine )
 {
-   m_pMemory->unknownOpcode();
+   if( engine == ENGINE_JIT )
+   {
+      if( !JIT::isSupported() )
+         return( false );
+
+      if( !m_pJIT )
+      {
+         m_pJIT = new JIT();
+      }
+   }
+
+   m_Engine = engine;
+   return( true );
 }
 
 
 /*----------------------------------------------------------------------------*/
-/*! 2024-08-14
-Execute a single machine code instruction.
-\param pInstruction Pointer to an Instruction object for a disassembly.
-Pass nullptr if no disassembly is required.
+/*! 2026-10-16
+\return The selected execution engine
 */
 /*----------------------------------------------------------------------------*/
-void RISCV::step( Instruction *pInstruction )
+RISCV::Engine RISCV::getEngine() const
+{
+   return( m_Engine );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\return The number of instructions which have been executed
+*/
+/*----------------------------------------------------------------------------*/
+uint64_t RISCV::getInstructionsRetired() const
+{
+   return( m_InstructionsRetired );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\return The number of basic blocks which have been translated
+*/
+/*----------------------------------------------------------------------------*/
+uint64_t RISCV::getBlocksTranslated() const
+{
+   return( m_BlocksTranslated );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\return The number of translated blocks which have been invalidated by stores
+*/
+/*----------------------------------------------------------------------------*/
+uint64_t RISCV::getBlocksInvalidated() const
 {
-   uint32_t instr = readMem32( m_PC );
-   uint32_t oldPC = getPC();
+   return( m_BlocksInvalidated );
+}
 
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Decode a machine code instruction into its operation, register indices and
+the one immediate value that is relevant for that operation.
+\param address Memory address of the instruction
+\param instr The full binary instruction code
+\param d Receives the decoded instruction
+*/
+/*----------------------------------------------------------------------------*/
+void RISCV::decode( uint32_t address, uint32_t instr, DecodedInstruction &d )
+{
    uint8_t opcode = instr & 0x7f;
 
    uint8_t rd = ( instr >> 7 ) & 0x1f;
@@ -190,7 +963,12 @@ void RISCV::step( Instruction *pInstruction )
    if( instr & 0x80000000 )
       bTypeImm |= 0b11111111111111111111 << 12;
 
-   uint32_t newPC = oldPC;
+   d.address = address;
+   d.op = OP_ILLEGAL;
+   d.rd = rd;
+   d.rs1 = rs1;
+   d.rs2 = rs2;
+   d.imm = 0;
 
    switch( opcode )
    {
@@ -200,129 +978,70 @@ void RISCV::step( Instruction *pInstruction )
          {
             case 0: // LB
             {
-               uint32_t d = readMem8( getRegister( rs1 ) + iTypeImm );
-               if( d & 0x80 )
-                  d |= 0xffffff00;
-               setRegister( rd, d );
-               newPC = oldPC + 4;
-
-               if( pInstruction )
-               {
-                  pInstruction->set( oldPC, instr, "lb",
-                     util::strvec
-                     {
-                        registerName( rd ),
-                        stdformat( "{}({})", iTypeImm, registerName( rs1 ) )
-                     }
-                  );
-               }
+               d.op = OP_LB;
+               d.imm = iTypeImm;
                break;
             }
 
             case 1: // LH
             {
-               uint32_t d = readMem16( getRegister( rs1 ) + iTypeImm );
-               if( d & 0x8000 )
-                  d |= 0xffff0000;
-               setRegister( rd, d );
-               newPC = oldPC + 4;
-
-               if( pInstruction )
-               {
-                  pInstruction->set( oldPC, instr, "lh",
-                     util::strvec
-                     {
-                        registerName( rd ),
-                        stdformat( "{}({})", iTypeImm, registerName( rs1 ) )
-                     }
-                  );
-               }
+               d.op = OP_LH;
+               d.imm = iTypeImm;
                break;
             }
 
             case 2: // LW
             {
-               setRegister( rd, readMem32( getRegister( rs1 ) + iTypeImm ) );
-               newPC = oldPC + 4;
-
-               if( pInstruction )
-               {
-                  pInstruction->set( oldPC, instr, "lw",
-                     util::strvec
-                     {
-                        registerName( rd ),
-                        stdformat( "{}({})", iTypeImm, registerName( rs1 ) )
-                     }
-                  );
-               }
+               d.op = OP_LW;
+               d.imm = iTypeImm;
                break;
             }
 
             case 4: // LBU
             {
-               setRegister( rd, readMem8( getRegister( rs1 ) + iTypeImm ) );
-               newPC = oldPC + 4;
-
-               if( pInstruction )
-               {
-                  pInstruction->set( oldPC, instr, "lbu",
-                     util::strvec
-                     {
-                        registerName( rd ),
-                        stdformat( "{}({})", iTypeImm, registerName( rs1 ) )
-                     }
-                  );
-               }
+               d.op = OP_LBU;
+               d.imm = iTypeImm;
                break;
             }
 
             case 5: // LHU
             {
-               setRegister( rd, readMem16( getRegister( rs1 ) + iTypeImm ) );
-               newPC = oldPC + 4;
-
-               if( pInstruction )
-               {
-                  pInstruction->set( oldPC, instr, "lhu",
-                     util::strvec
-                     {
-                        registerName( rd ),
-                        stdformat( "{}({})", iTypeImm, registerName( rs1 ) )
-                     }
-                  );
-               }
+               d.op = OP_LHU;
+               d.imm = iTypeImm;
                break;
             }
 
             default:
             {
-               unknownOpcode();
+               d.op = OP_ILLEGAL;
                break;
             }
          }
          break;
       }
 
+      case 0x0f: // MISC-MEM
+      {
+         if( funct3 == 0 ) // FENCE
+         {
+            d.op = OP_FENCE;
+            d.imm = ( instr >> 20 ) & 0xff;
+         } else
+         if( funct3 == 1 ) // FENCE.I
+         {
+            d.op = OP_FENCE_I;
+         }
+         break;
+      }
+
       case 0x13:
       {
          switch( funct3 )
          {
             case 0: // ADDI
             {
-               setRegister( rd, getRegister( rs1 ) + iTypeImm );
-               newPC = oldPC + 4;
-
-               if( pInstruction )
-               {
-                  pInstruction->set( oldPC, instr, "addi",
-                     util::strvec
-                     {
-                        registerName( rd ),
-                        registerName( rs1 ),
-                        stdformat( "{}", iTypeImm )
-                     }
-                  );
-               }
+               d.op = OP_ADDI;
+               d.imm = iTypeImm;
                break;
             }
 
@@ -332,27 +1051,15 @@ void RISCV::step( Instruction *pInstruction )
                {
                   case 0:
                   {
+                     d.op = OP_SLLI;
                      uint32_t shamt = ( instr >> 20 ) & 0x1f;
-                     setRegister( rd, getRegister( rs1 ) << shamt );
-                     newPC = oldPC + 4;
-
-                     if( pInstruction )
-                     {
-                        pInstruction->set( oldPC, instr, "slli",
-                           util::strvec
-                           {
-                              registerName( rd ),
-                              registerName( rs1 ),
-                              stdformat( "{}", shamt )
-                           }
-                        );
-                     }
+                     d.imm = shamt;
                      break;
                   }
 
                   default:
                   {
-                     unknownOpcode();
+                     d.op = OP_ILLEGAL;
                      break;
                   }
                }
@@ -361,70 +1068,22 @@ void RISCV::step( Instruction *pInstruction )
 
             case 2: // SLTI
             {
-               if( (int32_t)getRegister( rs1 ) < iTypeImm )
-               {
-                  setRegister( rd, 1 );
-               } else
-               {
-                  setRegister( rd, 0 );
-               }
-               newPC = oldPC + 4;
-
-               if( pInstruction )
-               {
-                  pInstruction->set( oldPC, instr, "slti",
-                     util::strvec
-                     {
-                        registerName( rd ),
-                        registerName( rs1 ),
-                        stdformat( "{}", iTypeImm )
-                     }
-                  );
-               }
+               d.op = OP_SLTI;
+               d.imm = iTypeImm;
                break;
             }
 
             case 3: // SLTIU
             {
-               if( getRegister( rs1 ) < (uint32_t)iTypeImm )
-               {
-                  setRegister( rd, 1 );
-               } else
-               {
-                  setRegister( rd, 0 );
-               }
-               newPC = oldPC + 4;
-
-               if( pInstruction )
-               {
-                  pInstruction->set( oldPC, instr, "sltiu",
-                     util::strvec
-                     {
-                        registerName( rd ),
-                        registerName( rs1 ),
-                        stdformat( "{}", (uint32_t)iTypeImm )
-                     }
-                  );
-               }
+               d.op = OP_SLTIU;
+               d.imm = iTypeImm;
                break;
             }
 
             case 4: // XORI
             {
-               setRegister( rd, getRegister( rs1 ) ^ (uint32_t)iTypeImm );
-               newPC = oldPC + 4;
-
-               if( pInstruction )
-               {
-                  pInstruction->set( oldPC, instr, "xori",
-                     util::strvec
-                     {
-                        registerName( rd ),
-                        registerName( rs1 ),
-                        stdformat( "{}", (uint32_t)iTypeImm )
-                     }
-                  );
-               }
+               d.op = OP_XORI;
+               d.imm = iTypeImm;
                break;
             }
 
@@ -434,47 +1093,23 @@ void RISCV::step( Instruction *pInstruction )
                {
                   case 0: // SRLI
                   {
+                     d.op = OP_SRLI;
                      uint32_t shamt = ( instr >> 20 ) & 0x1f;
-                     setRegister( rd, getRegister( rs1 ) >> shamt );
-                     newPC = oldPC + 4;
-
-                     if( pInstruction )
-                     {
-                        pInstruction->set( oldPC, instr, "srli",
-                           util::strvec
-                           {
-                              registerName( rd ),
-                              registerName( rs1 ),
-                              stdformat( "{}", shamt )
-                           }
-                        );
-                     }
+                     d.imm = shamt;
                      break;
                   }
 
                   case 0x20: // SRAI
                   {
+                     d.op = OP_SRAI;
                      uint32_t shamt = ( instr >> 20 ) & 0x1f;
-                     setRegister( rd, (int32_t)getRegister( rs1 ) >> shamt );
-                     newPC = oldPC + 4;
-
-                     if( pInstruction )
-                     {
-                        pInstruction->set( oldPC, instr, "srai",
-                           util::strvec
-                           {
-                              registerName( rd ),
-                              registerName ( rs1 ),
-                              stdformat( "{}", shamt )
-                           }
-                        );
-                     }
+                     d.imm = shamt;
                      break;
                   }
 
                   default:
                   {
-                     unknownOpcode();
+                     d.op = OP_ILLEGAL;
                      break;
                   }
                }
@@ -483,45 +1118,21 @@ void RISCV::step( Instruction *pInstruction )
 
             case 6: // ORI
             {
-               setRegister( rd, getRegister( rs1 ) | (uint32_t)iTypeImm );
-               newPC = oldPC + 4;
-
-               if( pInstruction )
-               {
-                  pInstruction->set( oldPC, instr, "ori",
-                     util::strvec
-                     {
-                        registerName( rd ),
-                        registerName( rs1 ),
-                        stdformat( "{}", (uint32_t)iTypeImm )
-                     }
-                  );
-               }
+               d.op = OP_ORI;
+               d.imm = iTypeImm;
                break;
             }
 
             case 7: // ANDI
             {
-               setRegister( rd, getRegister( rs1 ) & (uint32_t)iTypeImm );
-               newPC = oldPC + 4;
-
-               if( pInstruction )
-               {
-                  pInstruction->set( oldPC, instr, "andi",
-                     util::strvec
-                     {
-                        registerName( rd ),
-                        registerName( rs1 ),
-                        stdformat( "{}", (uint32_t)iTypeImm )
-                     }
-                  );
-               }
+               d.op = OP_ANDI;
+               d.imm = iTypeImm;
                break;
             }
 
             default:
             {
-               unknownOpcode();
+               d.op = OP_ILLEGAL;
                break;
             }
          }
@@ -530,19 +1141,8 @@ void RISCV::step( Instruction *pInstruction )
 
       case 0x17: // AUIPC
       {
-         setRegister( rd, oldPC + uTypeImm );
-         newPC = oldPC + 4;
-
-         if( pInstruction )
-         {
-            pInstruction->set( oldPC, instr, "auipc",
-               util::strvec
-               {
-                  registerName( rd ),
-                  stdformat( "0x{:x}", uTypeImm >> 12 )
-               }
-            );
-         }
+         d.op = OP_AUIPC;
+         d.imm = uTypeImm;
          break;
       }
 
@@ -552,61 +1152,28 @@ void RISCV::step( Instruction *pInstruction )
          {
             case 0: // SB
             {
-               writeMem8( getRegister( rs1 ) + sTypeImm, getRegister( rs2 ) & 0xff );
-               newPC = oldPC + 4;
-
-               if( pInstruction )
-               {
-                  pInstruction->set( oldPC, instr, "sb",
-                     util::strvec
-                     {
-                        registerName( rs2 ),
-                        stdformat( "{}({})", sTypeImm, registerName( rs1 ) )
-                     }
-                  );
-               }
+               d.op = OP_SB;
+               d.imm = sTypeImm;
                break;
             }
 
             case 1: // SH
             {
-               writeMem16( getRegister( rs1 ) + sTypeImm, getRegister( rs2 ) & 0xffff );
-               newPC = oldPC + 4;
-
-               if( pInstruction )
-               {
-                  pInstruction->set( oldPC, instr, "sh",
-                     util::strvec
-                     {
-                        registerName( rs2 ),
-                        stdformat( "{}({})", sTypeImm, registerName( rs1 ) )
-                     }
-                  );
-               }
+               d.op = OP_SH;
+               d.imm = sTypeImm;
                break;
             }
 
             case 2: // SW
             {
-               writeMem32( getRegister( rs1 ) + sTypeImm, getRegister( rs2 ) );
-               newPC = oldPC + 4;
-
-               if( pInstruction )
-               {
-                  pInstruction->set( oldPC, instr, "sw",
-                     util::strvec
-                     {
-                        registerName( rs2 ),
-                        stdformat( "{}({})", sTypeImm, registerName( rs1 ) )
-                     }
-                  );
-               }
+               d.op = OP_SW;
+               d.imm = sTypeImm;
                break;
             }
 
             default:
             {
-               unknownOpcode();
+               d.op = OP_ILLEGAL;
                break;
             }
          }
@@ -619,273 +1186,78 @@ void RISCV::step( Instruction *pInstruction )
          {
             case 2:
             {
-               switch( funct7 & ~3 ) // Ignore the aq and rl flags as we're emulating only a single hart
+               d.imm = funct7 & ( AQ | RL );
+               switch( funct7 & ~( AQ | RL ) )
                {
                   case 0: // amoadd.w
                   {
-                     uint32_t address = getRegister( rs1 );
-                     uint32_t v = readMem32( address );
-                     setRegister( rd, v );
-                     v = v + getRegister( rs2 );
-                     writeMem32( address, v );
-                     newPC = oldPC + 4;
-
-                     if( pInstruction )
-                     {
-                        pInstruction->set( oldPC, instr, "amoadd.w",
-                           util::strvec
-                           {
-                              registerName( rd ),
-                              registerName( rs2 ),
-                              stdformat( "({})", registerName( rs1 ) )
-                           }
-                        );
-                     }
+                     d.op = OP_AMOADD_W;
                      break;
                   }
 
                   case 4: // amoswap.w
                   {
-                     uint32_t address = getRegister( rs1 );
-                     uint32_t v = readMem32( address );
-                     setRegister( rd, v );
-                     v = getRegister( rs2 );
-                     writeMem32( address, v );
-                     newPC = oldPC + 4;
-
-                     if( pInstruction )
-                     {
-                        pInstruction->set( oldPC, instr, "amoswap.w",
-                           util::strvec
-                           {
-                              registerName( rd ),
-                              registerName( rs2 ),
-                              stdformat( "({})", registerName( rs1 ) )
-                           }
-                        );
-                     }
+                     d.op = OP_AMOSWAP_W;
                      break;
                   }
 
                   case 8: // lr.w (load&reserve word)
                   {
-                     uint32_t addr = getRegister( rs1 );
-                     reserveAddr( addr, 4 );
-                     setRegister( rd, readMem32( getRegister( rs1 ) ) );
-
-                     newPC = oldPC + 4;
-
-                     if( pInstruction )
-                     {
-                        pInstruction->set( oldPC, instr, "lr.w",
-                           util::strvec
-                           {
-                              registerName( rd ),
-                              stdformat( "({})", registerName( rs1 ) )
-                           }
-                        );
-                     }
+                     d.op = OP_LR_W;
                      break;
                   }
 
                   case 12: // sc.w (store conditional)
                   {
-                     if( numReservedAddresses( getRegister( rs1 ), 4 ) == 4 )
-                     {
-                        // All accessed addresses have been reserved -> success
-                        writeMem32( getRegister( rs1 ), getRegister( rs2 ) );
-                        setRegister( rd, 0 );
-                     } else
-                     {
-                        setRegister( rd, 1 );
-                     }
-
-                     clearAllReservations();
-
-                     newPC = oldPC + 4;
-
-                     if( pInstruction )
-                     {
-                        pInstruction->set( oldPC, instr, "sc.w",
-                           util::strvec
-                           {
-                              registerName( rd ),
-                              registerName( rs2 ),
-                              stdformat( "({})", registerName( rs1 ) )
-                           }
-                        );
-                     }
+                     d.op = OP_SC_W;
                      break;
                   }
 
                   case 16: // amoxor.w
                   {
-                     uint32_t address = getRegister( rs1 );
-                     uint32_t v = readMem32( address );
-                     setRegister( rd, v );
-                     v = v ^ getRegister( rs2 );
-                     writeMem32( address, v );
-                     newPC = oldPC + 4;
-
-                     if( pInstruction )
-                     {
-                        pInstruction->set( oldPC, instr, "amoxor.w",
-                           util::strvec
-                           {
-                              registerName( rd ),
-                              registerName( rs2 ),
-                              stdformat( "({})", registerName( rs1 ) )
-                           }
-                        );
-                     }
+                     d.op = OP_AMOXOR_W;
                      break;
                   }
 
                   case 32: // amoor.w
                   {
-                     uint32_t address = getRegister( rs1 );
-                     uint32_t v = readMem32( address );
-                     setRegister( rd, v );
-                     v = v | getRegister( rs2 );
-                     writeMem32( address, v );
-                     newPC = oldPC + 4;
-
-                     if( pInstruction )
-                     {
-                        pInstruction->set( oldPC, instr, "amoor.w",
-                           util::strvec
-                           {
-                              registerName( rd ),
-                              registerName( rs2 ),
-                              stdformat( "({})", registerName( rs1 ) )
-                           }
-                        );
-                     }
+                     d.op = OP_AMOOR_W;
                      break;
                   }
 
                   case 48: // amoand.w
                   {
-                     uint32_t address = getRegister( rs1 );
-                     uint32_t v = readMem32( address );
-                     setRegister( rd, v );
-                     v = v & getRegister( rs2 );
-                     writeMem32( address, v );
-                     newPC = oldPC + 4;
-
-                     if( pInstruction )
-                     {
-                        pInstruction->set( oldPC, instr, "amoand.w",
-                           util::strvec
-                           {
-                              registerName( rd ),
-                              registerName( rs2 ),
-                              stdformat( "({})", registerName( rs1 ) )
-                           }
-                        );
-                     }
+                     d.op = OP_AMOAND_W;
                      break;
                   }
 
                   case 64: // amomin.w
                   {
-                     uint32_t address = getRegister( rs1 );
-                     uint32_t v = readMem32( address );
-                     setRegister( rd, v );
-                     uint32_t vrs2 = getRegister( rs2 );
-                     v = (int32_t)v < (int32_t)vrs2 ? v : vrs2;
-                     writeMem32( address, v );
-                     newPC = oldPC + 4;
-
-                     if( pInstruction )
-                     {
-                        pInstruction->set( oldPC, instr, "amomin.w",
-                           util::strvec
-                           {
-                              registerName( rd ),
-                              registerName( rs2 ),
-                              stdformat( "({})", registerName( rs1 ) )
-                           }
-                        );
-                     }
+                     d.op = OP_AMOMIN_W;
                      break;
                   }
 
                   case 80: // amomax.w
                   {
-                     uint32_t address = getRegister( rs1 );
-                     uint32_t v = readMem32( address );
-                     setRegister( rd, v );
-                     uint32_t vrs2 = getRegister( rs2 );
-                     v = (int32_t)v > (int32_t)vrs2 ? v : vrs2;
-                     writeMem32( address, v );
-                     newPC = oldPC + 4;
-
-                     if( pInstruction )
-                     {
-                        pInstruction->set( oldPC, instr, "amomax.w",
-                           util::strvec
-                           {
-                              registerName( rd ),
-                              registerName( rs2 ),
-                              stdformat( "({})", registerName( rs1 ) )
-                           }
-                        );
-                     }
+                     d.op = OP_AMOMAX_W;
                      break;
                   }
 
                   case 96: // amominu.w
                   {
-                     uint32_t address = getRegister( rs1 );
-                     uint32_t v = readMem32( address );
-                     setRegister( rd, v );
-                     uint32_t vrs2 = getRegister( rs2 );
-                     v = v < vrs2 ? v : vrs2;
-                     writeMem32( address, v );
-                     newPC = oldPC + 4;
-
-                     if( pInstruction )
-                     {
-                        pInstruction->set( oldPC, instr, "amominu.w",
-                           util::strvec
-                           {
-                              registerName( rd ),
-                              registerName( rs2 ),
-                              stdformat( "({})", registerName( rs1 ) )
-                           }
-                        );
-                     }
+                     d.op = OP_AMOMINU_W;
                      break;
                   }
 
                   case 112: // amomaxu.w
                   {
-                     uint32_t address = getRegister( rs1 );
-                     uint32_t v = readMem32( address );
-                     setRegister( rd, v );
-                     uint32_t vrs2 = getRegister( rs2 );
-                     v = v > vrs2 ? v : vrs2;
-                     writeMem32( address, v );
-                     newPC = oldPC + 4;
-
-                     if( pInstruction )
-                     {
-                        pInstruction->set( oldPC, instr, "amomaxu.w",
-                           util::strvec
-                           {
-                              registerName( rd ),
-                              registerName( rs2 ),
-                              stdformat( "({})", registerName( rs1 ) )
-                           }
-                        );
-                     }
+                     d.op = OP_AMOMAXU_W;
                      break;
                   }
 
                   default:
                   {
-                     unknownOpcode();
+                     d.op = OP_ILLEGAL;
                      break;
                   }
                }
@@ -894,7 +1266,7 @@ void RISCV::step( Instruction *pInstruction )
 
             default:
             {
-               unknownOpcode();
+               d.op = OP_ILLEGAL;
                break;
             }
          }
@@ -912,64 +1284,25 @@ void RISCV::step( Instruction *pInstruction )
                {
                   case 0x00: // ADD
                   {
-                     setRegister( rd, (int32_t)getRegister( rs1 ) + (int32_t)getRegister( rs2 ) );
-                     newPC = oldPC + 4;
-
-                     if( pInstruction )
-                     {
-                        pInstruction->set( oldPC, instr, "add",
-                           util::strvec
-                           {
-                              registerName( rd ),
-                              registerName( rs1 ),
-                              registerName( rs2 )
-                           }
-                        );
-                     }
+                     d.op = OP_ADD;
                      break;
                   }
 
                   case 0x01: // MUL
                   {
-                     setRegister( rd, (uint32_t)( ( (int64_t)getRegister( rs1 ) * (int64_t)getRegister( rs2 ) ) & 0xffffffff ) );
-                     newPC = oldPC + 4;
-
-                     if( pInstruction )
-                     {
-                        pInstruction->set( oldPC, instr, "mul",
-                           util::strvec
-                           {
-                              registerName( rd ),
-                              registerName( rs1 ),
-                              registerName( rs2 )
-                           }
-                        );
-                     }
+                     d.op = OP_MUL;
                      break;
                   }
 
                   case 0x20: // SUB
                   {
-                     setRegister( rd, (int32_t)getRegister( rs1 ) - (int32_t)getRegister( rs2 ) );
-                     newPC = oldPC + 4;
-
-                     if( pInstruction )
-                     {
-                        pInstruction->set( oldPC, instr, "sub",
-                           util::strvec
-                           {
-                              registerName( rd ),
-                              registerName( rs1 ),
-                              registerName( rs2 )
-                           }
-                        );
-                     }
+                     d.op = OP_SUB;
                      break;
                   }
 
                   default:
                   {
-                     unknownOpcode();
+                     d.op = OP_ILLEGAL;
                      break;
                   }
                }
@@ -982,45 +1315,19 @@ void RISCV::step( Instruction *pInstruction )
                {
                   case 0: // SLL
                   {
-                     setRegister( rd, getRegister( rs1 ) << ( getRegister( rs2 ) & 0x1f ) );
-                     newPC = oldPC + 4;
-
-                     if( pInstruction )
-                     {
-                        pInstruction->set( oldPC, instr, "sll",
-                           util::strvec
-                           {
-                              registerName( rd ),
-                              registerName( rs1 ),
-                              registerName( rs2 )
-                           }
-                        );
-                     }
+                     d.op = OP_SLL;
                      break;
                   }
 
                   case 1: // MULH
                   {
-                     setRegister( rd, ( ( (int64_t)getRegister( rs1 ) * (int64_t)getRegister( rs2 ) ) >> 32 ) & 0xffffffff );
-                     newPC = oldPC + 4;
-
-                     if( pInstruction )
-                     {
-                        pInstruction->set( oldPC, instr, "mulh",
-                           util::strvec
-                           {
-                              registerName( rd ),
-                              registerName( rs1 ),
-                              registerName( rs2 )
-                           }
-                        );
-                     }
+                     d.op = OP_MULH;
                      break;
                   }
 
                   default:
                   {
-                     unknownOpcode();
+                     d.op = OP_ILLEGAL;
                      break;
                   }
                }
@@ -1033,51 +1340,19 @@ void RISCV::step( Instruction *pInstruction )
                {
                   case 0: // SLT
                   {
-                     if( (int32_t)getRegister( rs1 ) < (int32_t)getRegister( rs2 ) )
-                     {
-                        setRegister( rd, 1 );
-                     } else
-                     {
-                        setRegister( rd, 0 );
-                     }
-                     newPC = oldPC + 4;
-
-                     if( pInstruction )
-                     {
-                        pInstruction->set( oldPC, instr, "slt",
-                           util::strvec
-                           {
-                              registerName( rd ),
-                              registerName( rs1 ),
-                              registerName( rs2 )
-                           }
-                        );
-                     }
+                     d.op = OP_SLT;
                      break;
                   }
 
                   case 1: // MULHSU
                   {
-                     setRegister( rd, (uint32_t)( ( ( (int64_t)getRegister( rs1 ) * (uint64_t)getRegister( rs2 ) ) >> 32 ) & 0xffffffff ) );
-                     newPC = oldPC + 4;
-
-                     if( pInstruction )
-                     {
-                        pInstruction->set( oldPC, instr, "mulhsu",
-                           util::strvec
-                           {
-                              registerName( rd ),
-                              registerName( rs1 ),
-                              registerName( rs2 )
-                           }
-                        );
-                     }
+                     d.op = OP_MULHSU;
                      break;
                   }
 
                   default:
                   {
-                     unknownOpcode();
+                     d.op = OP_ILLEGAL;
                      break;
                   }
                }
@@ -1090,51 +1365,19 @@ void RISCV::step( Instruction *pInstruction )
                {
                   case 0: // SLTU
                   {
-                     if( getRegister( rs1 ) < getRegister( rs2 ) )
-                     {
-                        setRegister( rd, 1 );
-                     } else
-                     {
-                        setRegister( rd, 0 );
-                     }
-                     newPC = oldPC + 4;
-
-                     if( pInstruction )
-                     {
-                        pInstruction->set( oldPC, instr, "sltu",
-                           util::strvec
-                           {
-                              registerName( rd ),
-                              registerName( rs1 ),
-                              registerName( rs2 )
-                           }
-                        );
-                     }
+                     d.op = OP_SLTU;
                      break;
                   }
 
                   case 1: // MULHU
                   {
-                     setRegister( rd, (uint32_t)( ( ( (uint64_t)getRegister( rs1 ) * (uint64_t)getRegister( rs2 ) ) >> 32 ) & 0xffffffff ) );
-                     newPC = oldPC + 4;
-
-                     if( pInstruction )
-                     {
-                        pInstruction->set( oldPC, instr, "mulhu",
-                           util::strvec
-                           {
-                              registerName( rd ),
-                              registerName( rs1 ),
-                              registerName( rs2 )
-                           }
-                        );
-                     }
+                     d.op = OP_MULHU;
                      break;
                   }
 
                   default:
                   {
-                     unknownOpcode();
+                     d.op = OP_ILLEGAL;
                      break;
                   }
                }
@@ -1147,55 +1390,19 @@ void RISCV::step( Instruction *pInstruction )
                {
                   case 0: // XOR
                   {
-                     setRegister( rd, getRegister( rs1 ) ^ getRegister( rs2 ) );
-                     newPC = oldPC + 4;
-
-                     if( pInstruction )
-                     {
-                        pInstruction->set( oldPC, instr, "xor",
-                           util::strvec
-                           {
-                              registerName( rd ),
-                              registerName( rs1 ),
-                              registerName( rs2 )
-                           }
-                        );
-                     }
+                     d.op = OP_XOR;
                      break;
                   }
 
                   case 1: // DIV
                   {
-                     if( getRegister( rs2 ) == 0 )
-                     {
-                        setRegister( rd, 0xffffffff );
-                     } else
-                     if( ( getRegister( rs1 ) == 0x80000000 ) && ( getRegister( rs2 ) == 0xffffffff ) ) // -2^LEN-1 / -1 -> overflow
-                     {
-                        setRegister( rd, 0x80000000 );
-                     } else
-                     {
-                        setRegister( rd, (uint32_t)( (int32_t)getRegister( rs1 ) / (int32_t)getRegister( rs2 ) ) );
-                     }
-                     newPC = oldPC + 4;
-
-                     if( pInstruction )
-                     {
-                        pInstruction->set( oldPC, instr, "div",
-                           util::strvec
-                           {
-                              registerName( rd ),
-                              registerName( rs1 ),
-                              registerName( rs2 )
-                           }
-                        );
-                     }
+                     d.op = OP_DIV;
                      break;
                   }
 
                   default:
                   {
-                     unknownOpcode();
+                     d.op = OP_ILLEGAL;
                      break;
                   }
                }
@@ -1208,70 +1415,25 @@ void RISCV::step( Instruction *pInstruction )
                {
                   case 0: // SRL
                   {
-                     setRegister( rd, getRegister( rs1 ) >> ( getRegister( rs2 ) & 0x1f ) );
-                     newPC = oldPC + 4;
-
-                     if( pInstruction )
-                     {
-                        pInstruction->set( oldPC, instr, "srl",
-                           util::strvec
-                           {
-                              registerName( rd ),
-                              registerName( rs1 ),
-                              registerName( rs2 )
-                           }
-                        );
-                     }
+                     d.op = OP_SRL;
                      break;
                   }
 
                   case 1: // DIVU
                   {
-                     if( getRegister( rs2 ) == 0 )
-                     {
-                        setRegister( rd, 0xffffffff );
-                     } else
-                     {
-                        setRegister( rd, getRegister( rs1 ) / getRegister( rs2 ) );
-                     }
-                     newPC = oldPC + 4;
-
-                     if( pInstruction )
-                     {
-                        pInstruction->set( oldPC, instr, "divu",
-                           util::strvec
-                           {
-                              registerName( rd ),
-                              registerName( rs1 ),
-                              registerName( rs2 )
-                           }
-                        );
-                     }
+                     d.op = OP_DIVU;
                      break;
                   }
 
                   case 0x20: // SRA
                   {
-                     setRegister( rd, (int32_t)getRegister( rs1 ) >> ( getRegister( rs2 ) & 0x1f ) );
-                     newPC = oldPC + 4;
-
-                     if( pInstruction )
-                     {
-                        pInstruction->set( oldPC, instr, "sra",
-                           util::strvec
-                           {
-                              registerName( rd ),
-                              registerName( rs1 ),
-                              registerName( rs2 )
-                           }
-                        );
-                     }
+                     d.op = OP_SRA;
                      break;
                   }
 
                   default:
                   {
-                     unknownOpcode();
+                     d.op = OP_ILLEGAL;
                      break;
                   }
                }
@@ -1284,55 +1446,19 @@ void RISCV::step( Instruction *pInstruction )
                {
                   case 0: // OR
                   {
-                     setRegister( rd, getRegister( rs1 ) | getRegister( rs2 ) );
-                     newPC = oldPC + 4;
-
-                     if( pInstruction )
-                     {
-                        pInstruction->set( oldPC, instr, "or",
-                           util::strvec
-                           {
-                              registerName( rd ),
-                              registerName( rs1 ),
-                              registerName( rs2 )
-                           }
-                        );
-                     }
+                     d.op = OP_OR;
                      break;
                   }
 
                   case 1: // REM
                   {
-                     if( getRegister( rs2 ) == 0 )
-                     {
-                        setRegister( rd, getRegister( rs1 ) );
-                     } else
-                     if( ( getRegister( rs1 ) == 0x80000000 ) && ( getRegister( rs2 ) == 0xffffffff ) ) // -2^LEN-1 / -1 -> overflow
-                     {
-                        setRegister( rd, 0 );
-                     } else
-                     {
-                        setRegister( rd, (uint32_t)( (int32_t)getRegister( rs1 ) % (int32_t)getRegister( rs2 ) ) );
-                     }
-                     newPC = oldPC + 4;
-
-                     if( pInstruction )
-                     {
-                        pInstruction->set( oldPC, instr, "rem",
-                           util::strvec
-                           {
-                              registerName( rd ),
-                              registerName( rs1 ),
-                              registerName( rs2 )
-                           }
-                        );
-                     }
+                     d.op = OP_REM;
                      break;
                   }
 
                   default:
                   {
-                     unknownOpcode();
+                     d.op = OP_ILLEGAL;
                      break;
                   }
                }
@@ -1345,51 +1471,19 @@ void RISCV::step( Instruction *pInstruction )
                {
                   case 0: // AND
                   {
-                     setRegister( rd, getRegister( rs1 ) & getRegister( rs2 ) );
-                     newPC = oldPC + 4;
-
-                     if( pInstruction )
-                     {
-                        pInstruction->set( oldPC, instr, "and",
-                           util::strvec
-                           {
-                              registerName( rd ),
-                              registerName( rs1 ),
-                              registerName( rs2 )
-                           }
-                        );
-                     }
+                     d.op = OP_AND;
                      break;
                   }
 
                   case 1: // REMU
                   {
-                     if( getRegister( rs2 ) == 0 )
-                     {
-                        setRegister( rd, getRegister( rs1 ) );
-                     } else
-                     {
-                        setRegister( rd, getRegister( rs1 ) % getRegister( rs2 ) );
-                     }
-                     newPC = oldPC + 4;
-
-                     if( pInstruction )
-                     {
-                        pInstruction->set( oldPC, instr, "remu",
-                           util::strvec
-                           {
-                              registerName( rd ),
-                              registerName( rs1 ),
-                              registerName( rs2 )
-                           }
-                        );
-                     }
+                     d.op = OP_REMU;
                      break;
                   }
 
                   default:
                   {
-                     unknownOpcode();
+                     d.op = OP_ILLEGAL;
                      break;
                   }
                }
@@ -1398,7 +1492,7 @@ void RISCV::step( Instruction *pInstruction )
 
             default:
             {
-               unknownOpcode();
+               d.op = OP_ILLEGAL;
                break;
             }
          }
@@ -1407,19 +1501,8 @@ void RISCV::step( Instruction *pInstruction )
 
       case 0x37: // LUI
       {
-         setRegister( rd, uTypeImm );
-         newPC = oldPC + 4;
-
-         if( pInstruction )
-         {
-            pInstruction->set( oldPC, instr, "lui",
-               util::strvec
-               {
-                  registerName( rd ),
-                  stdformat( "0x{:x}", uTypeImm >> 12 )
-               }
-            );
-         }
+         d.op = OP_LUI;
+         d.imm = uTypeImm;
          break;
       }
 
@@ -1429,157 +1512,49 @@ void RISCV::step( Instruction *pInstruction )
          {
             case 0: // BEQ
             {
-               if( getRegister( rs1 ) == getRegister( rs2 ) )
-               {
-                  newPC = oldPC + bTypeImm;
-               } else
-               {
-                  newPC = oldPC + 4;
-               }
-
-               if( pInstruction )
-               {
-                  pInstruction->set( oldPC, instr, "beq",
-                     util::strvec
-                     {
-                        registerName( rs1 ),
-                        registerName( rs2 ),
-                        stdformat( "{}", bTypeImm )
-                     },
-                     stdformat( "{:x}", oldPC + bTypeImm )
-                  );
-               }
+               d.op = OP_BEQ;
+               d.imm = bTypeImm;
                break;
             }
 
             case 1: // BNE
             {
-               if( getRegister( rs1 ) != getRegister( rs2 ) )
-               {
-                  newPC = oldPC + bTypeImm;
-               } else
-               {
-                  newPC = oldPC + 4;
-               }
-
-               if( pInstruction )
-               {
-                  pInstruction->set( oldPC, instr, "bne",
-                     util::strvec
-                     {
-                        registerName( rs1 ),
-                        registerName( rs2 ),
-                        stdformat( "{}", bTypeImm )
-                     },
-                     stdformat( "{:x}", oldPC + bTypeImm )
-                  );
-               }
+               d.op = OP_BNE;
+               d.imm = bTypeImm;
                break;
             }
 
             case 4: // BLT
             {
-               if( (int32_t)getRegister( rs1 ) < (int32_t)getRegister( rs2 ) )
-               {
-                  newPC = oldPC + bTypeImm;
-               } else
-               {
-                  newPC = oldPC + 4;
-               }
-
-               if( pInstruction )
-               {
-                  pInstruction->set( oldPC, instr, "blt",
-                     util::strvec
-                     {
-                        registerName( rs1 ),
-                        registerName( rs2 ),
-                        stdformat( "{}", bTypeImm )
-                     },
-                     stdformat( "{:x}", oldPC + bTypeImm )
-                  );
-               }
+               d.op = OP_BLT;
+               d.imm = bTypeImm;
                break;
             }
 
             case 5: // BGE
             {
-               if( (int32_t)getRegister( rs1 ) >= (int32_t)getRegister( rs2 ) )
-               {
-                  newPC = oldPC + bTypeImm;
-               } else
-               {
-                  newPC = oldPC + 4;
-               }
-
-               if( pInstruction )
-               {
-                  pInstruction->set( oldPC, instr, "bge",
-                     util::strvec
-                     {
-                        registerName( rs1 ),
-                        registerName( rs2 ),
-                        stdformat( "{}", bTypeImm )
-                     },
-                     stdformat( "{:x}", oldPC + bTypeImm )
-                  );
-               }
+               d.op = OP_BGE;
+               d.imm = bTypeImm;
                break;
             }
 
             case 6: // BLTU
             {
-               if( getRegister( rs1 ) < getRegister( rs2 ) )
-               {
-                  newPC = oldPC + bTypeImm;
-               } else
-               {
-                  newPC = oldPC + 4;
-               }
-
-               if( pInstruction )
-               {
-                  pInstruction->set( oldPC, instr, "bltu",
-                     util::strvec
-                     {
-                        registerName( rs1 ),
-                        registerName( rs2 ),
-                        stdformat( "{}", bTypeImm )
-                     },
-                     stdformat( "{:x}", oldPC + bTypeImm )
-                  );
-               }
+               d.op = OP_BLTU;
+               d.imm = bTypeImm;
                break;
             }
 
             case 7: // BGEU
             {
-               if( getRegister( rs1 ) >= getRegister( rs2 ) )
-               {
-                  newPC = oldPC + bTypeImm;
-               } else
-               {
-                  newPC = oldPC + 4;
-               }
-
-               if( pInstruction )
-               {
-                  pInstruction->set( oldPC, instr, "bgeu",
-                     util::strvec
-                     {
-                        registerName( rs1 ),
-                        registerName( rs2 ),
-                        stdformat( "{}", bTypeImm )
-                     },
-                     stdformat( "{:x}", oldPC + bTypeImm )
-                  );
-               }
+               d.op = OP_BGEU;
+               d.imm = bTypeImm;
                break;
             }
 
             default:
             {
-               unknownOpcode();
+               d.op = OP_ILLEGAL;
                break;
             }
          }
@@ -1592,32 +1567,14 @@ void RISCV::step( Instruction *pInstruction )
          {
             case 0: // JALR
             {
-               setRegister( rd, oldPC + 4 );
-               newPC = ( (int32_t)getRegister( rs1 ) + iTypeImm ) & 0xfffffffe;
-
-               if( pInstruction )
-               {
-                  std::string comment;
-                  if( ( rd == 0 ) && ( iTypeImm == 0 ) && ( rs1 == 1 ) )
-                  {
-                     comment = "ret";
-                  }
-
-                  pInstruction->set( oldPC, instr, "jalr",
-                     util::strvec
-                     {
-                        registerName( rd ),
-                        stdformat( "{}({})", iTypeImm, registerName( rs1 ) )
-                     },
-                     comment
-                  );
-               }
+               d.op = OP_JALR;
+               d.imm = iTypeImm;
                break;
             }
 
             default:
             {
-               unknownOpcode();
+               d.op = OP_ILLEGAL;
                break;
             }
          }
@@ -1626,186 +1583,177 @@ void RISCV::step( Instruction *pInstruction )
 
       case 0x6f: // JAL
       {
-         setRegister( rd, oldPC + 4 );
-         newPC = oldPC + jTypeImm;
+         d.op = OP_JAL;
+         d.imm = jTypeImm;
+         break;
+      }
 
-         if( pInstruction )
+      case 0x73: // SYSTEM
+      {
+         if( instr == 0x00000073 ) // ECALL
          {
-            pInstruction->set( oldPC, instr, "jal",
-               util::strvec
-               {
-                  registerName( rd ),
-                  stdformat( "{}", jTypeImm )
-               },
-               stdformat( "{:8x}", oldPC + jTypeImm )
-            );
+            d.op = OP_ECALL;
+         } else
+         if( instr == 0x00100073 ) // EBREAK
+         {
+            d.op = OP_EBREAK;
          }
          break;
       }
 
       default:
       {
-         unknownOpcode();
+         d.op = OP_ILLEGAL;
          break;
       }
    }
-
-   m_PC = newPC;
-
-   if( pInstruction )
-   {
-      std::string disass = pInstruction->toString();
-      if( disass.size() > 1 )
-      {
-         printf( "%08x\t%s\n", pInstruction->getAddress(), disass.c_str() );
-      } else
-      {
-         printf( "%08x\n", pInstruction->getAddress() );
-      }
-   }
 }
 
 
 /*----------------------------------------------------------------------------*/
-/*! 2024-08-15
-Invalidate an address reservation.
-\param addr Start address
-\param n Number of bytes
+/*! 2026-10-16
+Compute the value which an AMO instruction stores back to memory.
+\param op The AMO operation
+\param v The value read from memory
+\param vrs2 The value of rs2
+\return The value to be written to memory
 */
 /*----------------------------------------------------------------------------*/
-void RISCV::invalidateReservation( uint32_t addr, int n )
+uint32_t RISCV::amo( uint8_t op, uint32_t v, uint32_t vrs2 )
 {
-   if( n < 1 )
-      return;
-
-   for( int i = 0; i < n; i++ )
+   switch( op )
    {
-      if( m_ReservedAddresses.find( addr ) != m_ReservedAddresses.end() )
-      {
-         m_ReservedAddresses.erase( addr );
-      }
-      addr++;
+      case OP_AMOADD_W:  return( v + vrs2 );
+      case OP_AMOSWAP_W: return( vrs2 );
+      case OP_AMOXOR_W:  return( v ^ vrs2 );
+      case OP_AMOOR_W:   return( v | vrs2 );
+      case OP_AMOAND_W:  return( v & vrs2 );
+      case OP_AMOMIN_W:  return( (int32_t)v < (int32_t)vrs2 ? v : vrs2 );
+      case OP_AMOMAX_W:  return( (int32_t)v > (int32_t)vrs2 ? v : vrs2 );
+      case OP_AMOMINU_W: return( v < vrs2 ? v : vrs2 );
+      case OP_AMOMAXU_W: return( v > vrs2 ? v : vrs2 );
+      default:           return( v );
    }
 }
 
 
 /*----------------------------------------------------------------------------*/
-/*! 2024-08-15
-Reserve some address(es)
-\param The first memory address to be reserved
-\param n The number of addresses
+/*! 2026-10-16
+Execute an AMO instruction as an atomic operation of the host, so it's atomic
+with respect to the other harts sharing the memory.
+\param p The memory word in host memory
+\param op The AMO operation
+\param vrs2 The value of rs2
+\param order The memory order as given by the aq and rl flags
+\return The value read from memory
 */
 /*----------------------------------------------------------------------------*/
-void RISCV::reserveAddr( uint32_t addr, int n )
+uint32_t RISCV::atomicAmo( std::atomic<uint32_t> *p, uint8_t op, uint32_t vrs2, std::memory_order order )
 {
-   if( n < 1 )
-      return;
-
-   clearAllReservations();
-   for( int i = 0; i < n; i++ )
+   switch( op )
    {
-      m_ReservedAddresses[addr++] = true;
+      case OP_AMOADD_W:  return( p->fetch_add( vrs2, order ) );
+      case OP_AMOSWAP_W: return( p->exchange( vrs2, order ) );
+      case OP_AMOXOR_W:  return( p->fetch_xor( vrs2, order ) );
+      case OP_AMOOR_W:   return( p->fetch_or( vrs2, order ) );
+      case OP_AMOAND_W:  return( p->fetch_and( vrs2, order ) );
+      default:
+      {
+         // There are no host operations for min and max
+         uint32_t v = p->load( std::memory_order_relaxed );
+         while( !p->compare_exchange_weak( v, amo( op, v, vrs2 ), order, std::memory_order_relaxed ) )
+         {
+         }
+         return( v );
+      }
    }
 }
 
 
 /*----------------------------------------------------------------------------*/
-/*! 2024-08-15
-Clear all address reservations.
-*/
-/*----------------------------------------------------------------------------*/
-void RISCV::clearAllReservations()
-{
-   m_ReservedAddresses.clear();
-}
-
-
-/*----------------------------------------------------------------------------*/
-/*! 2024-08-15
+/*! 2026-10-16
+\param aqrl The aq and rl flags of an atomic instruction
+\return The memory order of the host which corresponds to the flags
 */
 /*----------------------------------------------------------------------------*/
-int RISCV::numReservedAddresses( uint32_t addr, int n ) const
+std::memory_order RISCV::memoryOrder( int32_t aqrl )
 {
-   if( n < 1 )
-      return( 0 );
-
-   int numReserved = 0;
-   for( int i = 0; i < n; i++ )
+   switch( aqrl & ( AQ | RL ) )
    {
-      if( m_ReservedAddresses.find( addr ) != m_ReservedAddresses.end() )
-         numReserved++;
+      case AQ | RL: return( std::memory_order_seq_cst );
+      case AQ:      return( std::memory_order_acquire );
+      case RL:      return( std::memory_order_release );
+      default:      return( std::memory_order_relaxed );
    }
-
-   return( numReserved );
-}
-
-
-/*----------------------------------------------------------------------------*/
-/*! 2024-08-15
-Read a byte.
-*/
-/*----------------------------------------------------------------------------*/
-uint8_t RISCV::readMem8( uint32_t address )
-{
-   return( m_pMemory->readMem8( address ) );
 }
 
 
 /*----------------------------------------------------------------------------*/
-/*! 2024-08-15
-Read a half-word.
+/*! 2026-10-16
+Execute a FENCE instruction. Only ordering stores before loads requires a full
+fence of the host, all other combinations are covered by an acquire-release
+fence.
+\param sets The predecessor and successor sets of the instruction
 */
 /*----------------------------------------------------------------------------*/
-uint16_t RISCV::readMem16( uint32_t address )
+void RISCV::fence( int32_t sets )
 {
-   return( m_pMemory->readMem16( address ) );
+   if( ( sets & ( FENCE_PW | FENCE_PO ) ) && ( sets & ( FENCE_SR | FENCE_SI ) ) )
+   {
+      std::atomic_thread_fence( std::memory_order_seq_cst );
+   } else
+   {
+      std::atomic_thread_fence( std::memory_order_acq_rel );
+   }
 }
 
 
 /*----------------------------------------------------------------------------*/
-/*! 2024-08-15
-Read a word.
+/*! 2026-10-16
+Execute a FENCE.I instruction. The hart's own stores invalidate the decoded
+and translated instructions immediately, but those of other harts don't, so
+all of them are dropped. The blocks are retired rather than deleted, as this
+is called while a block is being executed.
 */
 /*----------------------------------------------------------------------------*/
-uint32_t RISCV::readMem32( uint32_t address )
+void RISCV::synchronizeInstructions()
 {
-   return( m_pMemory->readMem32( address ) );
-}
+   std::atomic_thread_fence( std::memory_order_acquire );
+   flushDecodeCache();
 
+   std::vector<Block *> blocks;
+   for( std::unordered_map<uint32_t, Block *>::iterator i = m_Blocks.begin(); i != m_Blocks.end(); i++ )
+   {
+      blocks.push_back( i->second );
+   }
 
-/*----------------------------------------------------------------------------*/
-/*! 2024-08-15
-Write a byte.
-*/
-/*----------------------------------------------------------------------------*/
-void RISCV::writeMem8( uint32_t address, uint8_t d )
-{
-   invalidateReservation( address );
-   m_pMemory->writeMem8( address, d );
+   for( size_t i = 0; i < blocks.size(); i++ )
+   {
+      removeBlock( blocks[i] );
+   }
+   m_CodeModified = true;
 }
 
 
 /*----------------------------------------------------------------------------*/
-/*! 2024-08-15
-Write a half-word.
+/*! 2026-10-16
+Set the size of the reservation granule, i.e. the naturally aligned block of
+memory which is reserved by lr.w. A store to any byte of the granule makes a
+following sc.w fail. The default is 4 bytes, i.e. only the loaded word is
+reserved. The current reservation is cleared.
+\param size Size in bytes, a power of 2 and at least 4
+\return false if the size is invalid
 */
 /*----------------------------------------------------------------------------*/
-void RISCV::writeMem16( uint32_t address, uint16_t d )
+bool RISCV::setReservationGranule( uint32_t size )
 {
-   invalidateReservation( address, 2 );
-   m_pMemory->writeMem16( address, d );
-}
+   if( ( size < 4 ) || ( size & ( size - 1 ) ) )
+      return( false );
 
+   m_ReservationGranule = size;
+   clearReservation();
 
-/*----------------------------------------------------------------------------*/
-/*! 2024-08-15
-Write a word.
-*/
-/*----------------------------------------------------------------------------*/
-void RISCV::writeMem32( uint32_t address, uint32_t d )
-{
-   invalidateReservation( address, 4 );
-   m_pMemory->writeMem32( address, d );
+   return( true );
 }
 
 
@@ -30,10 +30,14 @@
 #include <vector>
 #include <string>
 #include <cstdint>
-#include <map>
+#include <atomic>
+#include <unordered_map>
+#include <algorithm>
 
 #include "util.h"
 
+class JIT;
+
 /*----------------------------------------------------------------------------*/
 /*!
 \class RISCV
@@ -52,7 +56,10 @@ class RISCV
             virtual void writeMem8( uint32_t address, uint8_t d ) = 0;
             virtual void writeMem16( uint32_t address, uint16_t d ) = 0;
             virtual void writeMem32( uint32_t address, uint32_t d ) = 0;
+            virtual void markDirty( uint32_t address ) = 0;
             virtual void unknownOpcode() = 0;
+            virtual void environmentCall( RISCV *pHart ) = 0;
+            virtual void hostRoutine( RISCV *pHart, uint32_t address ) = 0;
       };
 
       class Instruction
@@ -80,35 +87,253 @@ class RISCV
             util::strvec m_Parameters;
             std::string m_Comment;
       };
-      RISCV( MemoryInterface *pMem );
+
+      enum Operation
+      {
+         OP_ILLEGAL = 0,
+         OP_LB, OP_LH, OP_LW, OP_LBU, OP_LHU,
+         OP_ADDI, OP_SLLI, OP_SLTI, OP_SLTIU, OP_XORI, OP_SRLI, OP_SRAI, OP_ORI, OP_ANDI,
+         OP_AUIPC,
+         OP_SB, OP_SH, OP_SW,
+         OP_AMOADD_W, OP_AMOSWAP_W, OP_LR_W, OP_SC_W, OP_AMOXOR_W, OP_AMOOR_W,
+         OP_AMOAND_W, OP_AMOMIN_W, OP_AMOMAX_W, OP_AMOMINU_W, OP_AMOMAXU_W,
+         OP_ADD, OP_MUL, OP_SUB, OP_SLL, OP_MULH, OP_SLT, OP_MULHSU, OP_SLTU, OP_MULHU,
+         OP_XOR, OP_DIV, OP_SRL, OP_DIVU, OP_SRA, OP_OR, OP_REM, OP_AND, OP_REMU,
+         OP_LUI,
+         OP_FENCE,
+         OP_BEQ, OP_BNE, OP_BLT, OP_BGE, OP_BLTU, OP_BGEU,
+         OP_JALR,
+         OP_JAL,
+         OP_FENCE_I,
+         OP_ECALL,
+         OP_EBREAK,
+         OP_HOST_ROUTINE, // Not an instruction: replaces the first instruction of a routine carried out by the host
+         OP_EXIT // Not an instruction: leaves a translated block, continuing at address
+      };
+
+      enum Engine
+      {
+         ENGINE_INTERPRETER,
+         ENGINE_BLOCKS,
+         ENGINE_JIT
+      };
+
+      enum StopReason
+      {
+         STOP_NONE,
+         STOP_BUDGET,              // The maximum number of instructions has been executed
+         STOP_ILLEGAL_INSTRUCTION, // PC points to the illegal instruction
+         STOP_BREAKPOINT,          // PC points to the EBREAK instruction
+         STOP_HALT,                // requestStop() has been called, e.g. by a device
+         STOP_DEADLINE             // The deadline set by setDeadline() has been reached
+      };
+
+      struct RunResult
+      {
+         StopReason reason;
+         uint64_t instructions; // The number of instructions retired by run()
+      };
+
+      static const uint64_t NO_DEADLINE = UINT64_MAX;
+
+      static const int32_t AQ = 0x2;
+      static const int32_t RL = 0x1;
+      static const int32_t FENCE_PI = 0x80;
+      static const int32_t FENCE_PO = 0x40;
+      static const int32_t FENCE_PR = 0x20;
+      static const int32_t FENCE_PW = 0x10;
+      static const int32_t FENCE_SI = 0x08;
+      static const int32_t FENCE_SO = 0x04;
+      static const int32_t FENCE_SR = 0x02;
+      static const int32_t FENCE_SW = 0x01;
+
+      // Compact form of an instruction as kept in the decode cache. imm holds
+      // the one immediate (or shift amount) which is relevant for op. For the
+      // atomic instructions, it holds the aq and rl flags (AQ, RL), for
+      // FENCE the predecessor and successor sets (FENCE_*).
+      struct DecodedInstruction
+      {
+         uint32_t address;
+         uint8_t op;
+         uint8_t rd;
+         uint8_t rs1;
+         uint8_t rs2;
+         int32_t imm;
+      };
+
+      // The state of a hart as seen by the program, including the
+      // reservation of lr.w, e.g. for snapshots
+      struct State
+      {
+         uint32_t pc;
+         uint32_t registers[32];
+         uint32_t reservationAddress;
+         uint32_t reservedWord;
+         uint32_t reservedValue;
+      };
+
+      RISCV( MemoryInterface *pMem, uint32_t hartId = 0 );
       ~RISCV();
 
       void step( Instruction *pInstruction = 0 );
+      RunResult run( uint64_t maxInstructions );
+      template<class Bus> RunResult run( uint64_t maxInstructions );
+      void requestStop( StopReason reason = STOP_HALT );
+      void setDeadline( uint64_t instructionsRetired );
 
       void reset();
+      void mapRAM( uint32_t start, uint32_t size, uint8_t *pHostMemory, const std::atomic<uint8_t> *pDirtyPages = 0 );
+      bool setReservationGranule( uint32_t size );
 
       static std::string registerName( int n );
       uint32_t getRegister( int r ) const;
+      void setRegister( int r, uint32_t v );
       uint32_t getPC() const;
+      void setPC( uint32_t pc );
+      void getState( State &state ) const;
+      void setState( const State &state );
+      uint32_t getHartId() const;
+
+      static void decode( uint32_t address, uint32_t instr, DecodedInstruction &d );
+      void invalidateDecodedInstructions( uint32_t address, int n );
+      void flushDecodeCache();
+      uint64_t getDecodeCacheHits() const;
+      uint64_t getDecodeCacheMisses() const;
+      void invalidateCode( uint32_t address, int n );
+      void invalidateWritten( uint32_t address, uint32_t size );
+      void setHostRoutines( const std::vector<uint32_t> &addresses );
+      void flushBlocks();
+
+      bool setEngine( Engine engine );
+      Engine getEngine() const;
+      uint64_t getInstructionsRetired() const;
+      uint64_t getBlocksTranslated() const;
+      uint64_t getBlocksInvalidated() const;
 
    private:
+      friend class JIT;
+
+      static const int DECODE_CACHE_SIZE = 16384;
+      static const uint32_t INVALID_ADDRESS = 0xffffffff;
+      static const size_t MAX_BLOCK_LENGTH = 64;
+      static const int CODE_PAGE_BITS = 12;
+      static const int BLOCK_LOOKUP_CACHE_SIZE = 256;
+      static const uint32_t NO_RESERVATION = 0x00000001;
+      static const int DIRTY_PAGE_BITS = 12;
+
+      struct Block;
+
+      // An exit of a block with a static target, i.e. the not taken and the
+      // taken path of a branch, a JAL or an OP_EXIT. Once the block at target
+      // has been looked up, the exit is linked to it, so the following block
+      // is entered directly. pNativePatch is the jump of the native code which
+      // is redirected from pNativeStub to the linked block.
+      struct Exit
+      {
+         Block *pBlock;
+         uint32_t target;
+         Block *pLinked;
+         uint8_t *pNativePatch;
+         uint8_t *pNativeStub;
+      };
+
+      // A translated basic block covering the addresses address..endAddress-1.
+      // pNativeCode is only set if the block has been translated by the JIT.
+      // incoming holds the exits of other blocks which are linked to this one.
+      struct Block
+      {
+         uint32_t address;
+         uint32_t endAddress;
+         std::vector<DecodedInstruction> ops;
+         bool nativeTranslated;
+         void *pNativeCode;
+         bool removed;
+         int numExits;
+         Exit exits[2];
+         std::vector<Exit *> incoming;
+      };
+
+      struct BlockLookup
+      {
+         uint32_t address;
+         Block *pBlock;
+      };
+
+      // The translated blocks overlapping a page, and a bit per word of the
+      // page telling whether it belongs to one of those blocks
+      struct CodePage
+      {
+         uint32_t codeWords[( 1 << CODE_PAGE_BITS ) / 4 / 32];
+         std::vector<Block *> blocks;
+      };
+
+      const DecodedInstruction &fetchDecoded( uint32_t address );
+      template<bool SINGLE_STEP, class Bus> void executeOps( const DecodedInstruction *pOps );
+      template<class Bus> void runInterpreter( uint64_t limit );
+      template<class Bus> void runBlocks( uint64_t limit );
+      Exit *executeNative( Block *pBlock, uint64_t limit );
+      Block *nextBlock( Exit *pExit );
+      static bool endsBlock( uint8_t op );
+      Block *lookupBlock( uint32_t address );
+      Block *translateBlock( uint32_t address );
+      void linkExit( Exit *pExit, Block *pBlock );
+      void updateCodePage( uint32_t page );
+      void invalidateBlocks( uint32_t address, int n );
+      void removeBlock( Block *pBlock );
+      void freeRetiredBlocks();
+      void translateNative( Block *pBlock );
+      static uint32_t amo( uint8_t op, uint32_t v, uint32_t vrs2 );
+      static uint32_t atomicAmo( std::atomic<uint32_t> *p, uint8_t op, uint32_t vrs2, std::memory_order order );
+      static std::memory_order memoryOrder( int32_t aqrl );
+      static void fence( int32_t sets );
+      void synchronizeInstructions();
+      std::atomic<uint32_t> *atomicRAM( uint32_t address );
       void unknownOpcode();
-      void reserveAddr( uint32_t addr, int n );
+      void reserve( uint32_t addr, uint32_t v );
+      bool isReserved( uint32_t addr ) const;
       void invalidateReservation( uint32_t addr, int n = 1 );
-      void setRegister( int r, uint32_t v );
-      uint8_t readMem8( uint32_t address );
-      uint16_t readMem16( uint32_t address );
-      uint32_t readMem32( uint32_t address );
-      void writeMem8( uint32_t address, uint8_t d );
-      void writeMem16( uint32_t address, uint16_t d );
-      void writeMem32( uint32_t address, uint32_t d );
-      int numReservedAddresses( uint32_t addr, int n = 1 ) const;
-      void clearAllReservations();
+      bool isHostRoutine( uint32_t address ) const;
+      void clearReservation();
+      template<class Bus = MemoryInterface> uint8_t readMem8( uint32_t address );
+      template<class Bus = MemoryInterface> uint16_t readMem16( uint32_t address );
+      template<class Bus = MemoryInterface> uint32_t readMem32( uint32_t address );
+      template<class Bus = MemoryInterface> void trackWrite( uint32_t offset );
+      template<class Bus = MemoryInterface> void writeMem8( uint32_t address, uint8_t d );
+      template<class Bus = MemoryInterface> void writeMem16( uint32_t address, uint16_t d );
+      template<class Bus = MemoryInterface> void writeMem32( uint32_t address, uint32_t d );
 
       MemoryInterface *m_pMemory;
+      uint32_t m_HartId;
+      uint8_t *m_pRAM;
+      uint32_t m_RAMStart;
+      uint32_t m_RAMSize;
+      const std::atomic<uint8_t> *m_pDirtyPages;
       uint32_t m_Registers[32];
       uint32_t m_PC;
-      std::map<uint32_t, bool> m_ReservedAddresses;
+      uint32_t m_ReservationAddress;
+      uint32_t m_ReservationGranule;
+      uint32_t m_ReservedWord;
+      uint32_t m_ReservedValue;
+      uint32_t m_DecodeCacheTags[DECODE_CACHE_SIZE];
+      DecodedInstruction m_DecodeCache[DECODE_CACHE_SIZE];
+      uint64_t m_DecodeCacheHits;
+      uint64_t m_DecodeCacheMisses;
+      Engine m_Engine;
+      std::unordered_map<uint32_t, Block *> m_Blocks;
+      std::unordered_map<uint32_t, CodePage> m_CodePages;
+      std::vector<uint32_t> m_CodePageBits;
+      std::vector<Block *> m_RetiredBlocks;
+      std::vector<uint32_t> m_HostRoutines;
+      BlockLookup m_BlockLookupCache[BLOCK_LOOKUP_CACHE_SIZE];
+      bool m_CodeModified;
+      std::atomic<StopReason> m_StopReason;
+      uint64_t m_Deadline;
+      uint64_t m_InstructionsRetired;
+      uint64_t m_BlocksTranslated;
+      uint64_t m_BlocksInvalidated;
+      JIT *m_pJIT;
 };
 
+#include "RISCVExecute.h"
+
 #endif
@@ -0,0 +1,1016 @@
+/*******************************************************************************
+ *  Copyright (c) 2024 Christian Nowak <chnowak@web.de>                        *
+ *   This file is part of chn's RISC-V-Emulator.                               *
+ *                                                                             *
+ *  RISC-V-Emulator is free software: you can redistribute it and/or modify it *
+ *  under the terms of the GNU General Public License as published by the Free *
+ *  Software Foundation, either version 3 of the License, or (at your option)  *
+ *  any later version.                                                         *
+ *                                                                             *          
+ *  RISC-V-Emulator is distributed in the hope that it will be useful, but     * 
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY *
+ *  or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License    *
+ *  for more details.                                                          *
+ *                                                                             *
+ *  You should have received a copy of the GNU General Public License along    *
+ *  with RISC-V-Emulator. If not, see <https://www.gnu.org/licenses/>.         *
+ *******************************************************************************/
+
+
+/*----------------------------------------------------------------------------*/
+/*!
+\file RISCVExecute.h
+\author Christian Nowak <chnowak@web.de>
+\brief Inline and template members of class RISCV.
+The execution of instructions is templated on the type of the memory interface,
+so the memory accesses can be bound at compile time. RISCV::run() uses the
+virtual RISCV::MemoryInterface, RISCV::run<Bus>() the given type.
+*/
+/*----------------------------------------------------------------------------*/
+#ifndef __RISCVEXECUTE_H__
+#define __RISCVEXECUTE_H__
+
+#include "RISCV.h"
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2024-08-14
+\param r A register number
+\return The current contents of the register
+*/
+/*----------------------------------------------------------------------------*/
+inline uint32_t RISCV::getRegister( int r ) const
+{
+   // setRegister() never writes to x0, so it always reads as 0
+   return( m_Registers[r & 0x1f] );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2024-08-14
+Set a register to a given value.
+\param r The register number
+\param v The value to set the register to
+*/
+/*----------------------------------------------------------------------------*/
+inline void RISCV::setRegister( int r, uint32_t v )
+{
+   r &= 0x1f;
+
+   if( r != 0 )
+   {
+      m_Registers[r] = v;
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Look up the instruction at a given address in the decode cache. On a miss, the
+instruction is fetched from memory, decoded and stored in the cache.
+\param address Memory address of the instruction
+\return The decoded instruction
+*/
+/*----------------------------------------------------------------------------*/
+inline const RISCV::DecodedInstruction &RISCV::fetchDecoded( uint32_t address )
+{
+   int i = ( address >> 2 ) & ( DECODE_CACHE_SIZE - 1 );
+   DecodedInstruction &d = m_DecodeCache[i];
+   if( m_DecodeCacheTags[i] == address )
+   {
+      m_DecodeCacheHits++;
+   } else
+   {
+      m_DecodeCacheMisses++;
+      decode( address, readMem32( address ), d );
+      if( isHostRoutine( address ) )
+         d.op = OP_HOST_ROUTINE;
+      m_DecodeCacheTags[i] = address;
+   }
+
+   return( d );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Drop all decode cache entries overlapping a range of memory that has been
+written to. Only the tags are invalidated, so an instruction that overwrites
+itself can still be completed.
+\param address Start address
+\param n Number of bytes
+*/
+/*----------------------------------------------------------------------------*/
+inline void RISCV::invalidateDecodedInstructions( uint32_t address, int n )
+{
+   for( uint32_t a = address & ~3; a - ( address & ~3 ) < (uint32_t)n; a += 4 )
+   {
+      uint32_t &tag = m_DecodeCacheTags[( a >> 2 ) & ( DECODE_CACHE_SIZE - 1 )];
+      if( tag == a )
+      {
+         tag = INVALID_ADDRESS;
+      }
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Reserve the granule containing an address, replacing any previous reservation.
+\param addr The address loaded by lr.w
+\param v The value loaded by lr.w
+*/
+/*----------------------------------------------------------------------------*/
+inline void RISCV::reserve( uint32_t addr, uint32_t v )
+{
+   m_ReservationAddress = addr & ~( m_ReservationGranule - 1 );
+   m_ReservedWord = addr;
+   m_ReservedValue = v;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\param addr The address stored to by sc.w
+\return true if the granule containing the address is reserved
+*/
+/*----------------------------------------------------------------------------*/
+inline bool RISCV::isReserved( uint32_t addr ) const
+{
+   return( ( addr & ~( m_ReservationGranule - 1 ) ) == m_ReservationAddress );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Clear the reservation. NO_RESERVATION isn't aligned to any granule, so it
+never matches a masked address.
+*/
+/*----------------------------------------------------------------------------*/
+inline void RISCV::clearReservation()
+{
+   m_ReservationAddress = NO_RESERVATION;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\param address A memory address
+\return The word at the address in host memory for atomic accesses, or nullptr
+if the address isn't aligned or not in the RAM window
+*/
+/*----------------------------------------------------------------------------*/
+inline std::atomic<uint32_t> *RISCV::atomicRAM( uint32_t address )
+{
+   static_assert( sizeof( std::atomic<uint32_t> ) == sizeof( uint32_t ), "Atomic words must have the size of words" );
+
+   uint32_t offset = address - m_RAMStart;
+   if( ( offset < m_RAMSize ) && !( address & 3 ) )
+      return( reinterpret_cast<std::atomic<uint32_t> *>( m_pRAM + offset ) );
+
+   return( 0 );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Clear the reservation if a store overlaps the reserved granule. This is called
+on every store, so the overlap test is a single unsigned comparison: the last
+byte of the store has to be at most granule + n - 2 bytes above the start of
+the granule. Without a reservation, it may match stores to the first bytes of
+the address space, which just clears the reservation once more.
+\param addr Start address
+\param n Number of bytes
+*/
+/*----------------------------------------------------------------------------*/
+inline void RISCV::invalidateReservation( uint32_t addr, int n )
+{
+   if( addr + ( n - 1 ) - m_ReservationAddress < m_ReservationGranule + ( n - 1 ) )
+   {
+      clearReservation();
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Invalidate all decoded and translated instructions overlapping a range of
+memory that has been written to.
+\param address Start address
+\param n Number of bytes
+*/
+/*----------------------------------------------------------------------------*/
+inline void RISCV::invalidateCode( uint32_t address, int n )
+{
+   invalidateDecodedInstructions( address, n );
+   if( ( m_CodePageBits[( address >> CODE_PAGE_BITS ) >> 5] & ( 1 << ( ( address >> CODE_PAGE_BITS ) & 31 ) ) ) ||
+       ( m_CodePageBits[( ( address + n - 1 ) >> CODE_PAGE_BITS ) >> 5] & ( 1 << ( ( ( address + n - 1 ) >> CODE_PAGE_BITS ) & 31 ) ) ) )
+   {
+      invalidateBlocks( address, n );
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\param address Memory address of an instruction
+\return true if the instruction is the start of a routine carried out by the
+host, see setHostRoutines()
+*/
+/*----------------------------------------------------------------------------*/
+inline bool RISCV::isHostRoutine( uint32_t address ) const
+{
+   return( !m_HostRoutines.empty() &&
+           std::binary_search( m_HostRoutines.begin(), m_HostRoutines.end(), address ) );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Execute instructions using the selected engine until either a given number of
+instructions has been retired or a stop event occurs: an illegal instruction,
+an EBREAK, a call of requestStop() or reaching the deadline. A stop which has
+been requested outside of run() makes it return immediately.
+All memory accesses of the instructions go through Bus, which has to be the
+type of the MemoryInterface passed to the constructor. If Bus is a final
+class, the compiler can inline its memory accesses into the instruction
+handlers.
+\param maxInstructions The maximum number of instructions to be retired
+\return The reason for returning and the number of instructions retired
+\tparam Bus The type of the memory interface
+*/
+/*----------------------------------------------------------------------------*/
+template<class Bus>
+RISCV::RunResult RISCV::run( uint64_t maxInstructions )
+{
+   uint64_t start = m_InstructionsRetired;
+   uint64_t limit = maxInstructions > UINT64_MAX - start ? UINT64_MAX : start + maxInstructions;
+   StopReason limitReason = STOP_BUDGET;
+   if( m_Deadline < limit )
+   {
+      limit = m_Deadline;
+      limitReason = STOP_DEADLINE;
+   }
+
+   if( ( m_StopReason == STOP_NONE ) && ( m_InstructionsRetired < limit ) )
+   {
+      if( m_Engine == ENGINE_INTERPRETER )
+      {
+         runInterpreter<Bus>( limit );
+      } else
+      {
+         runBlocks<Bus>( limit );
+      }
+   }
+
+   // Another thread may request a stop at any time, which must not get lost
+   StopReason reason = m_StopReason.exchange( STOP_NONE );
+
+   RunResult result;
+   result.reason = reason != STOP_NONE ? reason : limitReason;
+   result.instructions = m_InstructionsRetired - start;
+
+   return( result );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Execute one instruction after another until the limit or a stop event.
+\param limit The number of retired instructions at which to stop
+\tparam Bus The type of the memory interface
+*/
+/*----------------------------------------------------------------------------*/
+template<class Bus>
+void RISCV::runInterpreter( uint64_t limit )
+{
+   while( ( m_InstructionsRetired < limit ) && ( m_StopReason == STOP_NONE ) )
+   {
+      executeOps<true, Bus>( &fetchDecoded( m_PC ) );
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Execute translated basic blocks, starting at the current PC. Blocks which
+haven't been translated yet are translated first. When a block is left through
+an exit with a static target, the exit is linked to the following block, so
+it's entered directly the next time without looking it up. A block which
+would exceed the limit is executed by the interpreter up to the limit.
+\param limit The number of retired instructions at which to stop
+\tparam Bus The type of the memory interface
+*/
+/*----------------------------------------------------------------------------*/
+template<class Bus>
+void RISCV::runBlocks( uint64_t limit )
+{
+   freeRetiredBlocks();
+
+   Block *pBlock = lookupBlock( m_PC );
+   for( ;; )
+   {
+      if( m_InstructionsRetired + pBlock->ops.size() > limit )
+      {
+         runInterpreter<Bus>( limit );
+         break;
+      }
+
+      Exit *pExit = 0;
+      m_CodeModified = false;
+
+      if( ( m_Engine == ENGINE_JIT ) && !pBlock->nativeTranslated )
+      {
+         translateNative( pBlock );
+      }
+
+      if( ( m_Engine == ENGINE_JIT ) && pBlock->pNativeCode )
+      {
+         pExit = executeNative( pBlock, limit );
+      } else
+      {
+         executeOps<false, Bus>( pBlock->ops.data() );
+         if( !m_CodeModified )
+         {
+            for( int i = 0; i < pBlock->numExits; i++ )
+            {
+               if( pBlock->exits[i].target == m_PC )
+               {
+                  pExit = &pBlock->exits[i];
+                  break;
+               }
+            }
+         }
+      }
+
+      if( ( m_StopReason != STOP_NONE ) || ( m_InstructionsRetired >= limit ) )
+         break;
+
+      if( pExit && pExit->pLinked )
+      {
+         pBlock = pExit->pLinked;
+         continue;
+      }
+
+      pBlock = nextBlock( pExit );
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Execute a sequence of decoded instructions using threaded dispatch: every
+handler jumps directly to the handler of the following instruction instead of
+returning to a central switch statement. Execution ends after a jump, a branch,
+an illegal instruction, an ECALL, an EBREAK, a routine carried out by the host
+or an OP_EXIT, whichever comes first. A translated block is also left after a store which has modified
+translated code or which has requested a stop.
+\param pOps Pointer to the first decoded instruction
+\tparam SINGLE_STEP If true, only the first instruction is executed
+\tparam Bus The type of the memory interface
+*/
+/*----------------------------------------------------------------------------*/
+template<bool SINGLE_STEP, class Bus>
+void RISCV::executeOps( const DecodedInstruction *pOps )
+{
+   const DecodedInstruction *pOp = pOps;
+   uint32_t newPC;
+
+#ifdef __GNUC__
+   // Must be in the same order as enum Operation
+   static const void *const handlers[] =
+   {
+      &&op_ILLEGAL,
+      &&op_LB, &&op_LH, &&op_LW, &&op_LBU, &&op_LHU,
+      &&op_ADDI, &&op_SLLI, &&op_SLTI, &&op_SLTIU, &&op_XORI, &&op_SRLI, &&op_SRAI, &&op_ORI, &&op_ANDI,
+      &&op_AUIPC,
+      &&op_SB, &&op_SH, &&op_SW,
+      &&op_AMO, &&op_AMO, &&op_LR_W, &&op_SC_W, &&op_AMO, &&op_AMO,
+      &&op_AMO, &&op_AMO, &&op_AMO, &&op_AMO, &&op_AMO,
+      &&op_ADD, &&op_MUL, &&op_SUB, &&op_SLL, &&op_MULH, &&op_SLT, &&op_MULHSU, &&op_SLTU, &&op_MULHU,
+      &&op_XOR, &&op_DIV, &&op_SRL, &&op_DIVU, &&op_SRA, &&op_OR, &&op_REM, &&op_AND, &&op_REMU,
+      &&op_LUI,
+      &&op_FENCE,
+      &&op_BEQ, &&op_BNE, &&op_BLT, &&op_BGE, &&op_BLTU, &&op_BGEU,
+      &&op_JALR,
+      &&op_JAL,
+      &&op_FENCE_I,
+      &&op_ECALL,
+      &&op_EBREAK,
+      &&op_HOST_ROUTINE,
+      &&op_EXIT
+   };
+   static_assert( sizeof( handlers ) / sizeof( handlers[0] ) == OP_EXIT + 1, "Handler table doesn't match enum Operation" );
+
+#define HANDLER( name ) op_##name:
+#define DISPATCH() goto *handlers[pOp->op]
+   DISPATCH();
+#else
+#define HANDLER( name ) case OP_##name:
+#define DISPATCH() continue
+   for( ;; ) switch( pOp->op )
+   {
+#endif
+
+// Continue with the next instruction
+#define NEXT() \
+   if( SINGLE_STEP ) { newPC = pOp->address + 4; goto done; } \
+   pOp++; \
+   DISPATCH()
+
+// Leave the block after a store that has modified translated code or that has
+// requested a stop
+#define NEXT_AFTER_STORE() \
+   if( !SINGLE_STEP && ( m_CodeModified || ( m_StopReason != STOP_NONE ) ) ) { newPC = pOp->address + 4; goto done; } \
+   NEXT()
+
+// Leave the block at the end of a jump or branch
+#define JUMP( target ) \
+   newPC = ( target ); \
+   goto done
+
+#ifdef __GNUC__
+   op_AMO:
+#else
+   case OP_AMOADD_W: case OP_AMOSWAP_W: case OP_AMOXOR_W: case OP_AMOOR_W: case OP_AMOAND_W:
+   case OP_AMOMIN_W: case OP_AMOMAX_W: case OP_AMOMINU_W: case OP_AMOMAXU_W:
+#endif
+   {
+      // rs2 is read before rd is written as both may be the same register
+      uint32_t address = getRegister( pOp->rs1 );
+      uint32_t vrs2 = getRegister( pOp->rs2 );
+      uint32_t v;
+      std::atomic<uint32_t> *pAtomic = atomicRAM( address );
+      if( pAtomic )
+      {
+         // Other harts may access the word at the same time
+         trackWrite<Bus>( address - m_RAMStart );
+         v = atomicAmo( pAtomic, pOp->op, vrs2, memoryOrder( pOp->imm ) );
+         invalidateReservation( address, 4 );
+         invalidateCode( address, 4 );
+      } else
+      {
+         v = readMem32<Bus>( address );
+         writeMem32<Bus>( address, amo( pOp->op, v, vrs2 ) );
+      }
+      setRegister( pOp->rd, v );
+      NEXT_AFTER_STORE();
+   }
+
+   HANDLER( ILLEGAL )
+   {
+      unknownOpcode();
+      m_InstructionsRetired += pOp - pOps;
+      m_PC = pOp->address;
+      return;
+   }
+
+   HANDLER( LB )
+   {
+      uint32_t v = readMem8<Bus>( getRegister( pOp->rs1 ) + pOp->imm );
+      if( v & 0x80 )
+         v |= 0xffffff00;
+      setRegister( pOp->rd, v );
+      NEXT();
+   }
+
+   HANDLER( LH )
+   {
+      uint32_t v = readMem16<Bus>( getRegister( pOp->rs1 ) + pOp->imm );
+      if( v & 0x8000 )
+         v |= 0xffff0000;
+      setRegister( pOp->rd, v );
+      NEXT();
+   }
+
+   HANDLER( LW )
+   {
+      setRegister( pOp->rd, readMem32<Bus>( getRegister( pOp->rs1 ) + pOp->imm ) );
+      NEXT();
+   }
+
+   HANDLER( LBU )
+   {
+      setRegister( pOp->rd, readMem8<Bus>( getRegister( pOp->rs1 ) + pOp->imm ) );
+      NEXT();
+   }
+
+   HANDLER( LHU )
+   {
+      setRegister( pOp->rd, readMem16<Bus>( getRegister( pOp->rs1 ) + pOp->imm ) );
+      NEXT();
+   }
+
+   HANDLER( ADDI )
+   {
+      setRegister( pOp->rd, getRegister( pOp->rs1 ) + pOp->imm );
+      NEXT();
+   }
+
+   HANDLER( SLLI )
+   {
+      setRegister( pOp->rd, getRegister( pOp->rs1 ) << pOp->imm );
+      NEXT();
+   }
+
+   HANDLER( SLTI )
+   {
+      setRegister( pOp->rd, (int32_t)getRegister( pOp->rs1 ) < pOp->imm ? 1 : 0 );
+      NEXT();
+   }
+
+   HANDLER( SLTIU )
+   {
+      setRegister( pOp->rd, getRegister( pOp->rs1 ) < (uint32_t)pOp->imm ? 1 : 0 );
+      NEXT();
+   }
+
+   HANDLER( XORI )
+   {
+      setRegister( pOp->rd, getRegister( pOp->rs1 ) ^ (uint32_t)pOp->imm );
+      NEXT();
+   }
+
+   HANDLER( SRLI )
+   {
+      setRegister( pOp->rd, getRegister( pOp->rs1 ) >> pOp->imm );
+      NEXT();
+   }
+
+   HANDLER( SRAI )
+   {
+      setRegister( pOp->rd, (int32_t)getRegister( pOp->rs1 ) >> pOp->imm );
+      NEXT();
+   }
+
+   HANDLER( ORI )
+   {
+      setRegister( pOp->rd, getRegister( pOp->rs1 ) | (uint32_t)pOp->imm );
+      NEXT();
+   }
+
+   HANDLER( ANDI )
+   {
+      setRegister( pOp->rd, getRegister( pOp->rs1 ) & (uint32_t)pOp->imm );
+      NEXT();
+   }
+
+   HANDLER( AUIPC )
+   {
+      setRegister( pOp->rd, pOp->address + pOp->imm );
+      NEXT();
+   }
+
+   HANDLER( SB )
+   {
+      writeMem8<Bus>( getRegister( pOp->rs1 ) + pOp->imm, getRegister( pOp->rs2 ) & 0xff );
+      NEXT_AFTER_STORE();
+   }
+
+   HANDLER( SH )
+   {
+      writeMem16<Bus>( getRegister( pOp->rs1 ) + pOp->imm, getRegister( pOp->rs2 ) & 0xffff );
+      NEXT_AFTER_STORE();
+   }
+
+   HANDLER( SW )
+   {
+      writeMem32<Bus>( getRegister( pOp->rs1 ) + pOp->imm, getRegister( pOp->rs2 ) );
+      NEXT_AFTER_STORE();
+   }
+
+   HANDLER( LR_W ) // load&reserve word
+   {
+      uint32_t address = getRegister( pOp->rs1 );
+      std::atomic<uint32_t> *pAtomic = atomicRAM( address );
+      uint32_t v;
+      if( pAtomic )
+      {
+         // A load can't have release semantics, so rl makes it sequentially consistent
+         v = pAtomic->load( pOp->imm & RL ? std::memory_order_seq_cst :
+                            pOp->imm & AQ ? std::memory_order_acquire : std::memory_order_relaxed );
+      } else
+      {
+         v = readMem32<Bus>( address );
+      }
+      reserve( address, v );
+      setRegister( pOp->rd, v );
+      NEXT();
+   }
+
+   HANDLER( SC_W ) // store conditional
+   {
+      uint32_t address = getRegister( pOp->rs1 );
+      uint32_t vrs2 = getRegister( pOp->rs2 );
+      bool success = false;
+      if( isReserved( address ) )
+      {
+         // The reservation is still valid. Stores of other harts don't clear
+         // it, so the word loaded by lr.w is only replaced if it still holds
+         // the loaded value.
+         std::atomic<uint32_t> *pAtomic = atomicRAM( address );
+         if( pAtomic && ( address == m_ReservedWord ) )
+         {
+            uint32_t expected = m_ReservedValue;
+            trackWrite<Bus>( address - m_RAMStart );
+            success = pAtomic->compare_exchange_strong( expected, vrs2, memoryOrder( pOp->imm ), std::memory_order_relaxed );
+            if( success )
+            {
+               invalidateCode( address, 4 );
+            }
+         } else
+         {
+            writeMem32<Bus>( address, vrs2 );
+            success = true;
+         }
+      }
+
+      clearReservation();
+      setRegister( pOp->rd, success ? 0 : 1 );
+      NEXT_AFTER_STORE();
+   }
+
+   HANDLER( ADD )
+   {
+      setRegister( pOp->rd, getRegister( pOp->rs1 ) + getRegister( pOp->rs2 ) );
+      NEXT();
+   }
+
+   HANDLER( MUL )
+   {
+      setRegister( pOp->rd, getRegister( pOp->rs1 ) * getRegister( pOp->rs2 ) );
+      NEXT();
+   }
+
+   HANDLER( SUB )
+   {
+      setRegister( pOp->rd, getRegister( pOp->rs1 ) - getRegister( pOp->rs2 ) );
+      NEXT();
+   }
+
+   HANDLER( SLL )
+   {
+      setRegister( pOp->rd, getRegister( pOp->rs1 ) << ( getRegister( pOp->rs2 ) & 0x1f ) );
+      NEXT();
+   }
+
+   HANDLER( MULH )
+   {
+      setRegister( pOp->rd, (uint32_t)( ( (int64_t)(int32_t)getRegister( pOp->rs1 ) * (int64_t)(int32_t)getRegister( pOp->rs2 ) ) >> 32 ) );
+      NEXT();
+   }
+
+   HANDLER( SLT )
+   {
+      setRegister( pOp->rd, (int32_t)getRegister( pOp->rs1 ) < (int32_t)getRegister( pOp->rs2 ) ? 1 : 0 );
+      NEXT();
+   }
+
+   HANDLER( MULHSU )
+   {
+      setRegister( pOp->rd, (uint32_t)( ( (int64_t)(int32_t)getRegister( pOp->rs1 ) * (int64_t)getRegister( pOp->rs2 ) ) >> 32 ) );
+      NEXT();
+   }
+
+   HANDLER( SLTU )
+   {
+      setRegister( pOp->rd, getRegister( pOp->rs1 ) < getRegister( pOp->rs2 ) ? 1 : 0 );
+      NEXT();
+   }
+
+   HANDLER( MULHU )
+   {
+      setRegister( pOp->rd, (uint32_t)( ( (uint64_t)getRegister( pOp->rs1 ) * (uint64_t)getRegister( pOp->rs2 ) ) >> 32 ) );
+      NEXT();
+   }
+
+   HANDLER( XOR )
+   {
+      setRegister( pOp->rd, getRegister( pOp->rs1 ) ^ getRegister( pOp->rs2 ) );
+      NEXT();
+   }
+
+   HANDLER( DIV )
+   {
+      uint32_t vrs1 = getRegister( pOp->rs1 );
+      uint32_t vrs2 = getRegister( pOp->rs2 );
+      if( vrs2 == 0 )
+      {
+         setRegister( pOp->rd, 0xffffffff );
+      } else
+      if( ( vrs1 == 0x80000000 ) && ( vrs2 == 0xffffffff ) ) // -2^LEN-1 / -1 -> overflow
+      {
+         setRegister( pOp->rd, 0x80000000 );
+      } else
+      {
+         setRegister( pOp->rd, (uint32_t)( (int32_t)vrs1 / (int32_t)vrs2 ) );
+      }
+      NEXT();
+   }
+
+   HANDLER( SRL )
+   {
+      setRegister( pOp->rd, getRegister( pOp->rs1 ) >> ( getRegister( pOp->rs2 ) & 0x1f ) );
+      NEXT();
+   }
+
+   HANDLER( DIVU )
+   {
+      uint32_t vrs2 = getRegister( pOp->rs2 );
+      setRegister( pOp->rd, vrs2 == 0 ? 0xffffffff : getRegister( pOp->rs1 ) / vrs2 );
+      NEXT();
+   }
+
+   HANDLER( SRA )
+   {
+      setRegister( pOp->rd, (int32_t)getRegister( pOp->rs1 ) >> ( getRegister( pOp->rs2 ) & 0x1f ) );
+      NEXT();
+   }
+
+   HANDLER( OR )
+   {
+      setRegister( pOp->rd, getRegister( pOp->rs1 ) | getRegister( pOp->rs2 ) );
+      NEXT();
+   }
+
+   HANDLER( REM )
+   {
+      uint32_t vrs1 = getRegister( pOp->rs1 );
+      uint32_t vrs2 = getRegister( pOp->rs2 );
+      if( vrs2 == 0 )
+      {
+         setRegister( pOp->rd, vrs1 );
+      } else
+      if( ( vrs1 == 0x80000000 ) && ( vrs2 == 0xffffffff ) ) // -2^LEN-1 / -1 -> overflow
+      {
+         setRegister( pOp->rd, 0 );
+      } else
+      {
+         setRegister( pOp->rd, (uint32_t)( (int32_t)vrs1 % (int32_t)vrs2 ) );
+      }
+      NEXT();
+   }
+
+   HANDLER( AND )
+   {
+      setRegister( pOp->rd, getRegister( pOp->rs1 ) & getRegister( pOp->rs2 ) );
+      NEXT();
+   }
+
+   HANDLER( REMU )
+   {
+      uint32_t vrs2 = getRegister( pOp->rs2 );
+      setRegister( pOp->rd, vrs2 == 0 ? getRegister( pOp->rs1 ) : getRegister( pOp->rs1 ) % vrs2 );
+      NEXT();
+   }
+
+   HANDLER( LUI )
+   {
+      setRegister( pOp->rd, pOp->imm );
+      NEXT();
+   }
+
+   HANDLER( FENCE )
+   {
+      fence( pOp->imm );
+      NEXT();
+   }
+
+   HANDLER( BEQ )
+   {
+      JUMP( getRegister( pOp->rs1 ) == getRegister( pOp->rs2 ) ? pOp->address + pOp->imm : pOp->address + 4 );
+   }
+
+   HANDLER( BNE )
+   {
+      JUMP( getRegister( pOp->rs1 ) != getRegister( pOp->rs2 ) ? pOp->address + pOp->imm : pOp->address + 4 );
+   }
+
+   HANDLER( BLT )
+   {
+      JUMP( (int32_t)getRegister( pOp->rs1 ) < (int32_t)getRegister( pOp->rs2 ) ? pOp->address + pOp->imm : pOp->address + 4 );
+   }
+
+   HANDLER( BGE )
+   {
+      JUMP( (int32_t)getRegister( pOp->rs1 ) >= (int32_t)getRegister( pOp->rs2 ) ? pOp->address + pOp->imm : pOp->address + 4 );
+   }
+
+   HANDLER( BLTU )
+   {
+      JUMP( getRegister( pOp->rs1 ) < getRegister( pOp->rs2 ) ? pOp->address + pOp->imm : pOp->address + 4 );
+   }
+
+   HANDLER( BGEU )
+   {
+      JUMP( getRegister( pOp->rs1 ) >= getRegister( pOp->rs2 ) ? pOp->address + pOp->imm : pOp->address + 4 );
+   }
+
+   HANDLER( JALR )
+   {
+      // Compute the target before writing rd as both may be the same register
+      uint32_t target = ( getRegister( pOp->rs1 ) + pOp->imm ) & 0xfffffffe;
+      setRegister( pOp->rd, pOp->address + 4 );
+      JUMP( target );
+   }
+
+   HANDLER( JAL )
+   {
+      setRegister( pOp->rd, pOp->address + 4 );
+      JUMP( pOp->address + pOp->imm );
+   }
+
+   HANDLER( FENCE_I )
+   {
+      synchronizeInstructions();
+      JUMP( pOp->address + 4 );
+   }
+
+   HANDLER( ECALL )
+   {
+      // Like a trap, the call drops the reservation. The environment may
+      // write to the memory and stop the emulation, so the block is left.
+      clearReservation();
+      static_cast<Bus *>( m_pMemory )->environmentCall( this );
+      JUMP( pOp->address + 4 );
+   }
+
+   HANDLER( EBREAK )
+   {
+      // Stops before the instruction, so it doesn't retire
+      m_StopReason = STOP_BREAKPOINT;
+      m_InstructionsRetired += pOp - pOps;
+      m_PC = pOp->address;
+      return;
+   }
+
+   HANDLER( HOST_ROUTINE )
+   {
+      // The host carries out the routine and returns to ra like the routine,
+      // so the call retires as a single instruction
+      static_cast<Bus *>( m_pMemory )->hostRoutine( this, pOp->address );
+      JUMP( getRegister( 1 ) & ~1 );
+   }
+
+   HANDLER( EXIT )
+   {
+      // Not an instruction, so it doesn't retire
+      m_InstructionsRetired += pOp - pOps;
+      m_PC = pOp->address;
+      return;
+   }
+
+#ifndef __GNUC__
+   }
+#endif
+
+#undef HANDLER
+#undef DISPATCH
+#undef NEXT
+#undef NEXT_AFTER_STORE
+#undef JUMP
+
+done:
+   m_InstructionsRetired += pOp - pOps + 1;
+   m_PC = newPC;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2024-08-15
+Read a byte. Accesses to the RAM window are done directly in host memory.
+*/
+/*----------------------------------------------------------------------------*/
+template<class Bus>
+uint8_t RISCV::readMem8( uint32_t address )
+{
+   uint32_t offset = address - m_RAMStart;
+   if( offset < m_RAMSize )
+      return( m_pRAM[offset] );
+
+   return( static_cast<Bus *>( m_pMemory )->readMem8( address ) );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2024-08-15
+Read a half-word. Aligned accesses to the RAM window are done directly in host
+memory.
+*/
+/*----------------------------------------------------------------------------*/
+template<class Bus>
+uint16_t RISCV::readMem16( uint32_t address )
+{
+   uint32_t offset = address - m_RAMStart;
+   if( ( offset < m_RAMSize ) && !( address & 1 ) )
+      return( util::loadLE16( m_pRAM + offset ) );
+
+   return( static_cast<Bus *>( m_pMemory )->readMem16( address ) );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2024-08-15
+Read a word. Aligned accesses to the RAM window are done directly in host
+memory.
+*/
+/*----------------------------------------------------------------------------*/
+template<class Bus>
+uint32_t RISCV::readMem32( uint32_t address )
+{
+   uint32_t offset = address - m_RAMStart;
+   if( ( offset < m_RAMSize ) && !( address & 3 ) )
+      return( util::loadLE32( m_pRAM + offset ) );
+
+   return( static_cast<Bus *>( m_pMemory )->readMem32( address ) );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Called before writing directly to the RAM window. If the page written to isn't
+marked as dirty, the MemoryInterface is told about it.
+\param offset The offset in the RAM window
+*/
+/*----------------------------------------------------------------------------*/
+template<class Bus>
+inline void RISCV::trackWrite( uint32_t offset )
+{
+   if( m_pDirtyPages && !m_pDirtyPages[offset >> DIRTY_PAGE_BITS].load( std::memory_order_acquire ) )
+   {
+      static_cast<Bus *>( m_pMemory )->markDirty( m_RAMStart + offset );
+   }
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2024-08-15
+Write a byte. Accesses to the RAM window are done directly in host memory.
+*/
+/*----------------------------------------------------------------------------*/
+template<class Bus>
+void RISCV::writeMem8( uint32_t address, uint8_t d )
+{
+   invalidateReservation( address );
+   invalidateCode( address, 1 );
+
+   uint32_t offset = address - m_RAMStart;
+   if( offset < m_RAMSize )
+   {
+      trackWrite<Bus>( offset );
+      m_pRAM[offset] = d;
+      return;
+   }
+
+   static_cast<Bus *>( m_pMemory )->writeMem8( address, d );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2024-08-15
+Write a half-word. Aligned accesses to the RAM window are done directly in
+host memory.
+*/
+/*----------------------------------------------------------------------------*/
+template<class Bus>
+void RISCV::writeMem16( uint32_t address, uint16_t d )
+{
+   invalidateReservation( address, 2 );
+   invalidateCode( address, 2 );
+
+   uint32_t offset = address - m_RAMStart;
+   if( ( offset < m_RAMSize ) && !( address & 1 ) )
+   {
+      trackWrite<Bus>( offset );
+      util::storeLE16( m_pRAM + offset, d );
+      return;
+   }
+
+   static_cast<Bus *>( m_pMemory )->writeMem16( address, d );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2024-08-15
+Write a word. Aligned accesses to the RAM window are done directly in host
+memory.
+*/
+/*----------------------------------------------------------------------------*/
+template<class Bus>
+void RISCV::writeMem32( uint32_t address, uint32_t d )
+{
+   invalidateReservation( address, 4 );
+   invalidateCode( address, 4 );
+
+   uint32_t offset = address - m_RAMStart;
+   if( ( offset < m_RAMSize ) && !( address & 3 ) )
+   {
+      trackWrite<Bus>( offset );
+      util::storeLE32( m_pRAM + offset, d );
+      return;
+   }
+
+   static_cast<Bus *>( m_pMemory )->writeMem32( address, d );
+}
+
+#endif
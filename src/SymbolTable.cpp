@@ -0,0 +1,156 @@
+/*******************************************************************************
+ *  Copyright (c) 2024 Christian Nowak <chnowak@web.de>                        *
+ *   This file is part of chn's RISC-V-Emulator.                               *
+ *                                                                             *
+ *  RISC-V-Emulator is free software: you can redistribute it and/or modify it *
+ *  under the terms of the GNU General Public License as published by the Free *
+ *  Software Foundation, either version 3 of the License, or (at your option)  *
+ *  any later version.                                                         *
+ *                                                                             *          
+ *  RISC-V-Emulator is distributed in the hope that it will be useful, but     * 
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY *
+ *  or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License    *
+ *  for more details.                                                          *
+ *                                                                             *
+ *  You should have received a copy of the GNU General Public License along    *
+ *  with RISC-V-Emulator. If not, see <https://www.gnu.org/licenses/>.         *
+ *******************************************************************************/
+
+/*----------------------------------------------------------------------------*/
+/*!
+\file SymbolTable.cpp
+\author Christian Nowak <chnowak@web.de>
+\brief This implements the symbol table of a program
+*/
+/*----------------------------------------------------------------------------*/
+#include <algorithm>
+
+#include "SymbolTable.h"
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Constructor for class SymbolTable
+*/
+/*----------------------------------------------------------------------------*/
+SymbolTable::SymbolTable()
+{
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Destructor for class SymbolTable
+*/
+/*----------------------------------------------------------------------------*/
+SymbolTable::~SymbolTable()
+{
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Add a symbol. After adding all symbols, sort() has to be called before
+looking them up.
+\param address The address of the symbol
+\param size The size in bytes, 0 if unknown (e.g. a label in assembly code)
+\param name The name of the symbol
+*/
+/*----------------------------------------------------------------------------*/
+void SymbolTable::add( uint32_t address, uint32_t size, std::string name )
+{
+   Symbol symbol;
+   symbol.address = address;
+   symbol.size = size;
+   symbol.name = name;
+   m_Symbols.push_back( symbol );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Sort the symbols by their address.
+*/
+/*----------------------------------------------------------------------------*/
+void SymbolTable::sort()
+{
+   std::stable_sort( m_Symbols.begin(), m_Symbols.end(),
+      []( const Symbol &a, const Symbol &b ) { return( a.address < b.address ); } );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Remove all symbols.
+*/
+/*----------------------------------------------------------------------------*/
+void SymbolTable::clear()
+{
+   m_Symbols.clear();
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Find the symbol containing an address. A symbol of unknown size is taken to
+extend up to the next symbol.
+\param address The address, e.g. the PC
+\return The symbol with the highest address not above the given one, or
+nullptr if there is none or the address is beyond its size
+*/
+/*----------------------------------------------------------------------------*/
+const SymbolTable::Symbol *SymbolTable::lookup( uint32_t address ) const
+{
+   std::vector<Symbol>::const_iterator i = std::upper_bound( m_Symbols.begin(), m_Symbols.end(), address,
+      []( uint32_t a, const Symbol &s ) { return( a < s.address ); } );
+   if( i == m_Symbols.begin() )
+      return( 0 );
+
+   const Symbol &symbol = *( i - 1 );
+   if( ( symbol.size > 0 ) && ( address - symbol.address >= symbol.size ) )
+      return( 0 );
+
+   return( &symbol );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Find a symbol by its name. This is a linear search, as opposed to lookup().
+\param name The name of the symbol
+\return The first symbol with that name or nullptr if there is none
+*/
+/*----------------------------------------------------------------------------*/
+const SymbolTable::Symbol *SymbolTable::find( std::string name ) const
+{
+   for( size_t i = 0; i < m_Symbols.size(); i++ )
+   {
+      if( m_Symbols[i].name == name )
+         return( &m_Symbols[i] );
+   }
+
+   return( 0 );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\return The number of symbols
+*/
+/*----------------------------------------------------------------------------*/
+size_t SymbolTable::getNumSymbols() const
+{
+   return( m_Symbols.size() );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\param i The index of the symbol, from 0 to getNumSymbols() - 1
+\return The symbol, the symbols are sorted by their address
+*/
+/*----------------------------------------------------------------------------*/
+const SymbolTable::Symbol &SymbolTable::getSymbol( size_t i ) const
+{
+   return( m_Symbols[i] );
+}
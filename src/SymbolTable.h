@@ -0,0 +1,69 @@
+/*******************************************************************************
+ *  Copyright (c) 2024 Christian Nowak <chnowak@web.de>                        *
+ *   This file is part of chn's RISC-V-Emulator.                               *
+ *                                                                             *
+ *  RISC-V-Emulator is free software: you can redistribute it and/or modify it *
+ *  under the terms of the GNU General Public License as published by the Free *
+ *  Software Foundation, either version 3 of the License, or (at your option)  *
+ *  any later version.                                                         *
+ *                                                                             *          
+ *  RISC-V-Emulator is distributed in the hope that it will be useful, but     * 
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY *
+ *  or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License    *
+ *  for more details.                                                          *
+ *                                                                             *
+ *  You should have received a copy of the GNU General Public License along    *
+ *  with RISC-V-Emulator. If not, see <https://www.gnu.org/licenses/>.         *
+ *******************************************************************************/
+
+/*----------------------------------------------------------------------------*/
+/*!
+\file SymbolTable.h
+\author Christian Nowak <chnowak@web.de>
+\brief Headerfile for class SymbolTable.
+*/
+/*----------------------------------------------------------------------------*/
+#ifndef __SYMBOLTABLE_H__
+#define __SYMBOLTABLE_H__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*----------------------------------------------------------------------------*/
+/*!
+\class SymbolTable
+\date  2026-10-16
+The symbols of a program, i.e. the names of its functions and variables.
+The symbols are kept sorted by their address, so the symbol containing an
+address can be found by a binary search, e.g. by profilers and tracers for
+every sampled PC.
+*/
+/*----------------------------------------------------------------------------*/
+class SymbolTable
+{
+   public:
+      struct Symbol
+      {
+         uint32_t address;
+         uint32_t size;
+         std::string name;
+      };
+
+      SymbolTable();
+      ~SymbolTable();
+
+      void add( uint32_t address, uint32_t size, std::string name );
+      void sort();
+      void clear();
+
+      const Symbol *lookup( uint32_t address ) const;
+      const Symbol *find( std::string name ) const;
+      size_t getNumSymbols() const;
+      const Symbol &getSymbol( size_t i ) const;
+
+   private:
+      std::vector<Symbol> m_Symbols;
+};
+
+#endif
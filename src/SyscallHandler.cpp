@@ -0,0 +1,623 @@
+/*******************************************************************************
+ *  Copyright (c) 2024 Christian Nowak <chnowak@web.de>                        *
+ *   This file is part of chn's RISC-V-Emulator.                               *
+ *                                                                             *
+ *  RISC-V-Emulator is free software: you can redistribute it and/or modify it *
+ *  under the terms of the GNU General Public License as published by the Free *
+ *  Software Foundation, either version 3 of the License, or (at your option)  *
+ *  any later version.                                                         *
+ *                                                                             *          
+ *  RISC-V-Emulator is distributed in the hope that it will be useful, but     * 
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY *
+ *  or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License    *
+ *  for more details.                                                          *
+ *                                                                             *
+ *  You should have received a copy of the GNU General Public License along    *
+ *  with RISC-V-Emulator. If not, see <https://www.gnu.org/licenses/>.         *
+ *******************************************************************************/
+
+/*----------------------------------------------------------------------------*/
+/*!
+\file SyscallHandler.cpp
+\author Christian Nowak <chnowak@web.de>
+\brief This implements the system calls of the guest program
+*/
+/*----------------------------------------------------------------------------*/
+#include <errno.h>
+#include <string.h>
+#include <string>
+#include <chrono>
+
+#if !defined( _WIN32 )
+#define SYSCALLHANDLER_POSIX
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "SyscallHandler.h"
+#include "Emulator.h"
+#include "util.h"
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Constructor for class SyscallHandler
+\param pEmulator The Emulator whose RAM is accessed by the system calls
+\param pConsole The console receiving the output to stdout and stderr
+*/
+/*----------------------------------------------------------------------------*/
+SyscallHandler::SyscallHandler( Emulator *pEmulator, ConsoleDevice *pConsole ) :
+   m_pEmulator( pEmulator ),
+   m_pConsole( pConsole ),
+   m_ProgramBreak( 0 ),
+   m_InitialBreak( 0 ),
+   m_ExitStatus( 0 )
+{
+   reset( 0 );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Destructor for class SyscallHandler. The files opened by the guest program are
+closed.
+*/
+/*----------------------------------------------------------------------------*/
+SyscallHandler::~SyscallHandler()
+{
+   closeFiles();
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Prepare for a new program: the files opened by the previous one are closed,
+only stdin, stdout and stderr remain open.
+\param programBreak The initial end of the heap, i.e. the end of the program
+in the RAM
+*/
+/*----------------------------------------------------------------------------*/
+void SyscallHandler::reset( uint32_t programBreak )
+{
+   std::lock_guard<std::mutex> lock( m_Mutex );
+
+   closeFiles();
+   m_ProgramBreak = programBreak;
+   m_InitialBreak = programBreak;
+   m_ExitStatus = 0;
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\return The status passed to the exit system call, or 0 if the program hasn't
+called it
+*/
+/*----------------------------------------------------------------------------*/
+int SyscallHandler::getExitStatus() const
+{
+   return( m_ExitStatus );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Store the program break, e.g. in a snapshot. The open files of the host
+aren't part of the state.
+\param state Receives the state
+*/
+/*----------------------------------------------------------------------------*/
+void SyscallHandler::saveState( std::vector<uint8_t> &state )
+{
+   std::lock_guard<std::mutex> lock( m_Mutex );
+
+   state.resize( 8 );
+   util::storeLE32( &state[0], m_InitialBreak );
+   util::storeLE32( &state[4], m_ProgramBreak );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Restore the program break stored by saveState(). The files opened by the
+guest program since then are closed.
+\param state The state
+\return false if the state is invalid
+*/
+/*----------------------------------------------------------------------------*/
+bool SyscallHandler::restoreState( const std::vector<uint8_t> &state )
+{
+   if( state.size() != 8 )
+      return( false );
+
+   reset( util::loadLE32( &state[0] ) );
+   m_ProgramBreak = util::loadLE32( &state[4] );
+
+   return( true );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Carry out the system call requested by an ECALL instruction of a hart and
+return its result in a0. Unknown calls fail with ENOSYS.
+\param pHart The hart executing the ECALL
+*/
+/*----------------------------------------------------------------------------*/
+void SyscallHandler::handle( RISCV *pHart )
+{
+   std::lock_guard<std::mutex> lock( m_Mutex );
+
+   uint32_t a0 = pHart->getRegister( 10 );
+   uint32_t a1 = pHart->getRegister( 11 );
+   uint32_t a2 = pHart->getRegister( 12 );
+   uint32_t a3 = pHart->getRegister( 13 );
+   int32_t result;
+
+   switch( pHart->getRegister( 17 ) )
+   {
+      case SYS_OPENAT:
+         result = open( a0, a1, a2, a3 );
+         break;
+
+      case SYS_OPEN:
+         result = open( (uint32_t)GUEST_AT_FDCWD, a0, a1, a2 );
+         break;
+
+      case SYS_CLOSE:
+         result = close( a0 );
+         break;
+
+      case SYS_LSEEK:
+         result = lseek( a0, (int32_t)a1, a2 );
+         break;
+
+      case SYS_READ:
+         result = read( pHart, a0, a1, a2 );
+         break;
+
+      case SYS_WRITE:
+         result = write( a0, a1, a2 );
+         break;
+
+      case SYS_FSTAT:
+         result = fstat( pHart, a0, a1 );
+         break;
+
+      case SYS_EXIT:
+      case SYS_EXIT_GROUP:
+         exit( a0 );
+         return;
+
+      case SYS_BRK:
+         result = brk( a0 );
+         break;
+
+      case SYS_CLOCK_GETTIME:
+      case SYS_CLOCK_GETTIME64:
+         result = clockGettime( pHart, a0, a1 );
+         break;
+
+      default:
+         result = -ENOSYS;
+         break;
+   }
+
+   pHart->setRegister( 10, (uint32_t)result );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Open a file of the host. Only paths relative to the current directory of the
+host (AT_FDCWD) and absolute paths are supported. The flags are translated
+from their values on Linux to those of the host.
+\param dirFd The directory a relative path refers to
+\param pathAddress The address of the zero-terminated path
+\param flags The flags of open()
+\param mode The permissions of a created file
+\return The new file descriptor or a negated errno value
+*/
+/*----------------------------------------------------------------------------*/
+int32_t SyscallHandler::open( uint32_t dirFd, uint32_t pathAddress, uint32_t flags, uint32_t mode )
+{
+#ifdef SYSCALLHANDLER_POSIX
+   std::string path;
+   for( ;; )
+   {
+      const uint8_t *p = m_pEmulator->getRAM( pathAddress + path.size(), 1 );
+      if( !p )
+         return( -EFAULT );
+      if( *p == 0 )
+         break;
+      if( path.size() >= MAX_PATH )
+         return( -ENAMETOOLONG );
+      path.push_back( (char)*p );
+   }
+
+   if( ( (int32_t)dirFd != GUEST_AT_FDCWD ) && ( path.empty() || ( path[0] != '/' ) ) )
+      return( -EBADF );
+
+   int hostFlags = 0;
+   switch( flags & GUEST_O_ACCMODE )
+   {
+      case 0: hostFlags = O_RDONLY; break;
+      case 1: hostFlags = O_WRONLY; break;
+      case 2: hostFlags = O_RDWR; break;
+      default: return( -EINVAL );
+   }
+   hostFlags |= ( flags & GUEST_O_CREAT ) ? O_CREAT : 0;
+   hostFlags |= ( flags & GUEST_O_EXCL ) ? O_EXCL : 0;
+   hostFlags |= ( flags & GUEST_O_TRUNC ) ? O_TRUNC : 0;
+   hostFlags |= ( flags & GUEST_O_APPEND ) ? O_APPEND : 0;
+
+   int hostFd = ::open( path.c_str(), hostFlags, (mode_t)( mode & 07777 ) );
+   if( hostFd < 0 )
+      return( -errno );
+
+   // The lowest free file descriptor, as on POSIX systems
+   size_t fd = 0;
+   while( ( fd < m_Files.size() ) && ( m_Files[fd] >= 0 ) )
+   {
+      fd++;
+   }
+   if( fd == m_Files.size() )
+   {
+      m_Files.push_back( -1 );
+   }
+   m_Files[fd] = hostFd;
+
+   return( (int32_t)fd );
+#else
+   return( -ENOSYS );
+#endif
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Close a file descriptor. stdin, stdout and stderr of the host stay open even
+if the guest program closes them.
+\param fd The file descriptor
+\return 0 or a negated errno value
+*/
+/*----------------------------------------------------------------------------*/
+int32_t SyscallHandler::close( uint32_t fd )
+{
+   int hostFd = getHostFile( fd );
+   if( hostFd < 0 )
+      return( -EBADF );
+
+   m_Files[fd] = -1;
+#ifdef SYSCALLHANDLER_POSIX
+   if( ( hostFd > 2 ) && ( ::close( hostFd ) != 0 ) )
+      return( -errno );
+#endif
+
+   return( 0 );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Read from a file directly into the RAM. The buffer is filled page by page, and
+each page is only touched right before it's read into, so a large buffer
+doesn't save or unshare more pages than the file has data for. The code
+translated from the part which has been written is dropped, as with a store of
+the hart.
+\param pHart The hart making the call
+\param fd The file descriptor
+\param address The address of the buffer
+\param size The size of the buffer in bytes
+\return The number of bytes read or a negated errno value
+*/
+/*----------------------------------------------------------------------------*/
+int32_t SyscallHandler::read( RISCV *pHart, uint32_t fd, uint32_t address, uint32_t size )
+{
+   int hostFd = getHostFile( fd );
+   if( hostFd < 0 )
+      return( -EBADF );
+
+   if( size == 0 )
+      return( 0 );
+
+   // The result has to fit into a0 without looking like an error
+   if( size > 0x7fffffff )
+      size = 0x7fffffff;
+
+   if( !m_pEmulator->getRAM( address, size ) )
+      return( -EFAULT );
+
+#ifdef SYSCALLHANDLER_POSIX
+   uint32_t done = 0;
+   while( done < size )
+   {
+      uint32_t n = GuestRAM::PAGE_SIZE - ( ( address + done ) & ( GuestRAM::PAGE_SIZE - 1 ) );
+      if( n > size - done )
+         n = size - done;
+
+      ssize_t r = ::read( hostFd, m_pEmulator->touchRAM( address + done, n ), n );
+      if( r < 0 )
+      {
+         if( done > 0 )
+            break;
+
+         return( -errno );
+      }
+
+      done += (uint32_t)r;
+      if( (uint32_t)r < n )
+         break;
+   }
+
+   pHart->invalidateWritten( address, done );
+
+   return( (int32_t)done );
+#else
+   return( -ENOSYS );
+#endif
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Write to a file directly from the RAM. stdout and stderr are written to the
+console, so they are captured along with the rest of the output.
+\param fd The file descriptor
+\param address The address of the buffer
+\param size The number of bytes to write
+\return The number of bytes written or a negated errno value
+*/
+/*----------------------------------------------------------------------------*/
+int32_t SyscallHandler::write( uint32_t fd, uint32_t address, uint32_t size )
+{
+   int hostFd = getHostFile( fd );
+   if( hostFd < 0 )
+      return( -EBADF );
+
+   if( size == 0 )
+      return( 0 );
+
+   if( size > 0x7fffffff )
+      size = 0x7fffffff;
+
+   const uint8_t *p = m_pEmulator->getRAM( address, size );
+   if( !p )
+      return( -EFAULT );
+
+   if( hostFd == 1 )
+   {
+      m_pConsole->write( (const char *)p, size );
+      return( (int32_t)size );
+   } else
+   if( hostFd == 2 )
+   {
+      m_pConsole->writeError( (const char *)p, size );
+      return( (int32_t)size );
+   }
+
+#ifdef SYSCALLHANDLER_POSIX
+   ssize_t n = ::write( hostFd, p, size );
+   if( n < 0 )
+      return( -errno );
+
+   return( (int32_t)n );
+#else
+   return( -ENOSYS );
+#endif
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Move the position within a file. The offsets are 32 bits wide, as in newlib.
+\param fd The file descriptor
+\param offset The offset relative to whence
+\param whence 0 for the start of the file, 1 for the current position and 2
+for the end of the file
+\return The new position or a negated errno value
+*/
+/*----------------------------------------------------------------------------*/
+int32_t SyscallHandler::lseek( uint32_t fd, int32_t offset, uint32_t whence )
+{
+   int hostFd = getHostFile( fd );
+   if( hostFd < 0 )
+      return( -EBADF );
+
+#ifdef SYSCALLHANDLER_POSIX
+   static const int hostWhence[] = { SEEK_SET, SEEK_CUR, SEEK_END };
+   if( whence > 2 )
+      return( -EINVAL );
+
+   off_t position = ::lseek( hostFd, offset, hostWhence[whence] );
+   if( position < 0 )
+      return( -errno );
+   if( position > 0x7fffffff )
+      return( -EOVERFLOW );
+
+   return( (int32_t)position );
+#else
+   return( -ENOSYS );
+#endif
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Get the type, size and times of a file. The result is stored in the layout of
+struct kernel_stat of libgloss on RV32, with 64 bit seconds in the times.
+\param pHart The hart making the call
+\param fd The file descriptor
+\param address The address of the result
+\return 0 or a negated errno value
+*/
+/*----------------------------------------------------------------------------*/
+int32_t SyscallHandler::fstat( RISCV *pHart, uint32_t fd, uint32_t address )
+{
+   int hostFd = getHostFile( fd );
+   if( hostFd < 0 )
+      return( -EBADF );
+
+#ifdef SYSCALLHANDLER_POSIX
+   struct stat st;
+   if( ::fstat( hostFd, &st ) != 0 )
+      return( -errno );
+
+   uint8_t data[GUEST_STAT_SIZE];
+   memset( data, 0, sizeof( data ) );
+   util::storeLE32( &data[0], (uint32_t)st.st_dev );
+   util::storeLE32( &data[8], (uint32_t)st.st_ino );
+   util::storeLE32( &data[16], (uint32_t)st.st_mode );
+   util::storeLE32( &data[20], (uint32_t)st.st_nlink );
+   util::storeLE32( &data[24], (uint32_t)st.st_uid );
+   util::storeLE32( &data[28], (uint32_t)st.st_gid );
+   util::storeLE32( &data[32], (uint32_t)st.st_rdev );
+   util::storeLE32( &data[48], (uint32_t)st.st_size );
+   util::storeLE32( &data[52], (uint32_t)( (uint64_t)st.st_size >> 32 ) );
+   util::storeLE32( &data[56], (uint32_t)st.st_blksize );
+   util::storeLE32( &data[64], (uint32_t)st.st_blocks );
+   util::storeLE32( &data[68], (uint32_t)( (uint64_t)st.st_blocks >> 32 ) );
+
+   const time_t times[3] = { st.st_atime, st.st_mtime, st.st_ctime };
+   for( int i = 0; i < 3; i++ )
+   {
+      util::storeLE32( &data[72 + i * 16], (uint32_t)times[i] );
+      util::storeLE32( &data[76 + i * 16], (uint32_t)( (int64_t)times[i] >> 32 ) );
+   }
+
+   return( copyToGuest( pHart, address, data, sizeof( data ) ) ? 0 : -EFAULT );
+#else
+   return( -ENOSYS );
+#endif
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Set the end of the heap. The heap starts at the end of the program and may
+grow up to the end of the RAM. The RAM is cleared when a program is loaded,
+so there is nothing to allocate.
+\param address The new end of the heap, or 0 to query it
+\return The end of the heap, which stays as it is if address is invalid
+*/
+/*----------------------------------------------------------------------------*/
+int32_t SyscallHandler::brk( uint32_t address )
+{
+   if( ( address >= m_InitialBreak ) &&
+       ( ( address == m_InitialBreak ) || m_pEmulator->getRAM( m_InitialBreak, address - m_InitialBreak ) ) )
+   {
+      m_ProgramBreak = address;
+   }
+
+   return( (int32_t)m_ProgramBreak );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Get the time of a clock as a struct timespec with 64 bit seconds, which is
+used by both clock_gettime and clock_gettime64 on RV32.
+\param pHart The hart making the call
+\param clock 0 for the real time clock, 1 for the monotonic clock
+\param address The address of the result
+\return 0 or a negated errno value
+*/
+/*----------------------------------------------------------------------------*/
+int32_t SyscallHandler::clockGettime( RISCV *pHart, uint32_t clock, uint32_t address )
+{
+   int64_t ns;
+   if( clock == 0 )
+   {
+      ns = std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::system_clock::now().time_since_epoch() ).count();
+   } else
+   if( clock == 1 )
+   {
+      ns = std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+   } else
+   {
+      return( -EINVAL );
+   }
+
+   int64_t seconds = ns / 1000000000;
+   uint8_t data[16];
+   memset( data, 0, sizeof( data ) );
+   util::storeLE32( &data[0], (uint32_t)seconds );
+   util::storeLE32( &data[4], (uint32_t)( seconds >> 32 ) );
+   util::storeLE32( &data[8], (uint32_t)( ns % 1000000000 ) );
+
+   return( copyToGuest( pHart, address, data, sizeof( data ) ) ? 0 : -EFAULT );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+End the program with a status, which stops all harts like a write to the halt
+register.
+\param status The exit status
+*/
+/*----------------------------------------------------------------------------*/
+void SyscallHandler::exit( uint32_t status )
+{
+   m_ExitStatus = (int32_t)status;
+   m_pEmulator->halt();
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+\param fd A file descriptor of the guest program
+\return The file descriptor of the host, or -1 if fd isn't open
+*/
+/*----------------------------------------------------------------------------*/
+int SyscallHandler::getHostFile( uint32_t fd ) const
+{
+   return( fd < m_Files.size() ? m_Files[fd] : -1 );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Write the result of a system call to the RAM.
+\param pHart The hart making the call
+\param address The address to write to
+\param pData The data
+\param size The size of the data in bytes
+\return false if the range isn't completely within the RAM
+*/
+/*----------------------------------------------------------------------------*/
+bool SyscallHandler::copyToGuest( RISCV *pHart, uint32_t address, const uint8_t *pData, uint32_t size )
+{
+   uint8_t *p = m_pEmulator->touchRAM( address, size );
+   if( !p )
+      return( false );
+
+   memcpy( p, pData, size );
+   pHart->invalidateWritten( address, size );
+
+   return( true );
+}
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Close the files opened by the guest program and reopen stdin, stdout and
+stderr.
+*/
+/*----------------------------------------------------------------------------*/
+void SyscallHandler::closeFiles()
+{
+   for( size_t i = 0; i < m_Files.size(); i++ )
+   {
+#ifdef SYSCALLHANDLER_POSIX
+      if( m_Files[i] > 2 )
+      {
+         ::close( m_Files[i] );
+      }
+#endif
+   }
+
+   m_Files.assign( 3, 0 );
+   m_Files[1] = 1;
+   m_Files[2] = 2;
+}
@@ -0,0 +1,110 @@
+/*******************************************************************************
+ *  Copyright (c) 2024 Christian Nowak <chnowak@web.de>                        *
+ *   This file is part of chn's RISC-V-Emulator.                               *
+ *                                                                             *
+ *  RISC-V-Emulator is free software: you can redistribute it and/or modify it *
+ *  under the terms of the GNU General Public License as published by the Free *
+ *  Software Foundation, either version 3 of the License, or (at your option)  *
+ *  any later version.                                                         *
+ *                                                                             *          
+ *  RISC-V-Emulator is distributed in the hope that it will be useful, but     * 
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY *
+ *  or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License    *
+ *  for more details.                                                          *
+ *                                                                             *
+ *  You should have received a copy of the GNU General Public License along    *
+ *  with RISC-V-Emulator. If not, see <https://www.gnu.org/licenses/>.         *
+ *******************************************************************************/
+
+/*----------------------------------------------------------------------------*/
+/*!
+\file SyscallHandler.h
+\author Christian Nowak <chnowak@web.de>
+\brief Headerfile for class SyscallHandler.
+*/
+/*----------------------------------------------------------------------------*/
+#ifndef __SYSCALLHANDLER_H__
+#define __SYSCALLHANDLER_H__
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <mutex>
+
+class Emulator;
+class ConsoleDevice;
+class RISCV;
+
+/*----------------------------------------------------------------------------*/
+/*!
+\class SyscallHandler
+\date  2026-10-16
+The system calls a guest program makes by the ECALL instruction, which are
+carried out by the host. The calls follow the ABI of Linux and of newlib's
+libgloss on RISC-V: the number of the call is passed in a7, its arguments in
+a0 to a5, and the result or a negated errno value is returned in a0. Buffers
+are transferred directly between the host files and the RAM. Writes to the
+file descriptors 1 and 2 go to the console of the Emulator. The harts may make
+system calls concurrently, which are carried out one after another.
+*/
+/*----------------------------------------------------------------------------*/
+class SyscallHandler
+{
+   public:
+      static const uint32_t SYS_OPENAT = 56;
+      static const uint32_t SYS_CLOSE = 57;
+      static const uint32_t SYS_LSEEK = 62;
+      static const uint32_t SYS_READ = 63;
+      static const uint32_t SYS_WRITE = 64;
+      static const uint32_t SYS_FSTAT = 80;
+      static const uint32_t SYS_EXIT = 93;
+      static const uint32_t SYS_EXIT_GROUP = 94;
+      static const uint32_t SYS_CLOCK_GETTIME = 113;
+      static const uint32_t SYS_BRK = 214;
+      static const uint32_t SYS_CLOCK_GETTIME64 = 403;
+      static const uint32_t SYS_OPEN = 1024;
+
+      SyscallHandler( Emulator *pEmulator, ConsoleDevice *pConsole );
+      ~SyscallHandler();
+
+      void handle( RISCV *pHart );
+      void reset( uint32_t programBreak );
+      int getExitStatus() const;
+
+      void saveState( std::vector<uint8_t> &state );
+      bool restoreState( const std::vector<uint8_t> &state );
+
+   private:
+      // The values of the flags of open() used by the guest
+      static const uint32_t GUEST_O_ACCMODE = 0x0003;
+      static const uint32_t GUEST_O_CREAT = 0x0040;
+      static const uint32_t GUEST_O_EXCL = 0x0080;
+      static const uint32_t GUEST_O_TRUNC = 0x0200;
+      static const uint32_t GUEST_O_APPEND = 0x0400;
+      static const int32_t GUEST_AT_FDCWD = -100;
+      static const uint32_t GUEST_STAT_SIZE = 128;
+      static const uint32_t MAX_PATH = 4096;
+
+      int32_t open( uint32_t dirFd, uint32_t pathAddress, uint32_t flags, uint32_t mode );
+      int32_t close( uint32_t fd );
+      int32_t read( RISCV *pHart, uint32_t fd, uint32_t address, uint32_t size );
+      int32_t write( uint32_t fd, uint32_t address, uint32_t size );
+      int32_t lseek( uint32_t fd, int32_t offset, uint32_t whence );
+      int32_t fstat( RISCV *pHart, uint32_t fd, uint32_t address );
+      int32_t brk( uint32_t address );
+      int32_t clockGettime( RISCV *pHart, uint32_t clock, uint32_t address );
+      void exit( uint32_t status );
+      int getHostFile( uint32_t fd ) const;
+      bool copyToGuest( RISCV *pHart, uint32_t address, const uint8_t *pData, uint32_t size );
+      void closeFiles();
+
+      Emulator *m_pEmulator;
+      ConsoleDevice *m_pConsole;
+      std::mutex m_Mutex;
+      std::vector<int> m_Files;
+      uint32_t m_ProgramBreak;
+      uint32_t m_InitialBreak;
+      int m_ExitStatus;
+};
+
+#endif
@@ -17,35 +17,384 @@
  *******************************************************************************/
 
 
+#include <string.h>
+#include <stdlib.h>
+#include <chrono>
+
 #include "Emulator.h"
+#include "BatchRunner.h"
+
+// Number of instructions executed between checks for the end of the emulation
+static const uint64_t RUN_BUDGET = 10000000;
+
+// Instruction limit of batch jobs which don't specify their own
+static const uint64_t DEFAULT_JOB_LIMIT = 1000000000;
+
+static void usage( const char *pProgName )
+{
+   fprintf( stderr, "Usage: %s [OPTIONS] BINFILE\n", pProgName );
+   fprintf( stderr, "       %s [OPTIONS] -b MANIFEST\n", pProgName );
+   fprintf( stderr, "   -s         Print execution statistics to stderr\n" );
+   fprintf( stderr, "   -e ENGINE  Select the execution engine: interpreter (default), blocks or jit\n" );
+   fprintf( stderr, "   -d         Access memory through virtual calls instead of inlined code\n" );
+   fprintf( stderr, "   -R MODE    Carry out memcpy, memset, strlen and memcmp on the host: on or check\n" );
+   fprintf( stderr, "   -n HARTS   Number of harts, each running on its own thread (default: 1)\n" );
+   fprintf( stderr, "   -q QUANTUM Run the harts deterministically on one thread, switching every QUANTUM instructions\n" );
+   fprintf( stderr, "   -m MB      Size of the RAM in MB (default: %u)\n", Emulator::DEFAULT_RAM_SIZE >> 20 );
+   fprintf( stderr, "   -H         Back the RAM by transparent huge pages\n" );
+   fprintf( stderr, "   -b MANIFEST Run the binary files listed in MANIFEST and print their results as JSON\n" );
+   fprintf( stderr, "   -j THREADS Number of threads running the jobs of the manifest (default: one per CPU)\n" );
+   fprintf( stderr, "   -l LIMIT   Stop after LIMIT instructions per hart; for jobs of the manifest which\n" );
+   fprintf( stderr, "              don't specify a limit (default: unlimited, %llu for jobs)\n",
+      (unsigned long long)DEFAULT_JOB_LIMIT );
+   fprintf( stderr, "   -w FILE    Write a snapshot to FILE after the emulation has stopped\n" );
+   fprintf( stderr, "   -k FILE    Use FILE as the disk of the block device at 0x10001000\n" );
+   fprintf( stderr, "   -f ADDRESS:FILE Map FILE read-only to ADDRESS, outside of the RAM\n" );
+   fprintf( stderr, "   -D INTERVAL Share identical pages between the jobs of the manifest every INTERVAL instructions\n" );
+}
 
 int main( int argc, const char *argv[] )
 {
-   if( argc < 2 )
+   bool showStats = false;
+   bool dynamicBinding = false;
+   HostRoutines::Mode hostRoutines = HostRoutines::MODE_OFF;
+   int numHarts = 1;
+   uint64_t quantum = 0;
+   const char *pManifest = 0;
+   int numThreads = 0;
+   uint64_t limit = 0;
+   const char *pSnapshot = 0;
+   const char *pDisk = 0;
+   std::vector<std::pair<uint32_t, std::string> > fileWindows;
+   uint64_t deduplicationInterval = 0;
+   uint32_t ramSize = Emulator::DEFAULT_RAM_SIZE;
+   bool hugePages = false;
+   RISCV::Engine engine = RISCV::ENGINE_INTERPRETER;
+   int iArg = 1;
+
+   while( ( iArg < argc ) && ( argv[iArg][0] == '-' ) )
+   {
+      if( strcmp( argv[iArg], "-s" ) == 0 )
+      {
+         showStats = true;
+      } else
+      if( strcmp( argv[iArg], "-d" ) == 0 )
+      {
+         dynamicBinding = true;
+      } else
+      if( ( strcmp( argv[iArg], "-R" ) == 0 ) && ( iArg + 1 < argc ) )
+      {
+         iArg++;
+         if( strcmp( argv[iArg], "on" ) == 0 )
+         {
+            hostRoutines = HostRoutines::MODE_ON;
+         } else
+         if( strcmp( argv[iArg], "check" ) == 0 )
+         {
+            hostRoutines = HostRoutines::MODE_CHECK;
+         } else
+         {
+            fprintf( stderr, "Unknown mode %s for the host routines\n", argv[iArg] );
+            return( -1 );
+         }
+      } else
+      if( ( strcmp( argv[iArg], "-n" ) == 0 ) && ( iArg + 1 < argc ) )
+      {
+         iArg++;
+         numHarts = atoi( argv[iArg] );
+         if( ( numHarts < 1 ) || ( numHarts > Emulator::MAX_HARTS ) )
+         {
+            fprintf( stderr, "The number of harts must be between 1 and %d\n", Emulator::MAX_HARTS );
+            return( -1 );
+         }
+      } else
+      if( ( strcmp( argv[iArg], "-q" ) == 0 ) && ( iArg + 1 < argc ) )
+      {
+         iArg++;
+         quantum = strtoull( argv[iArg], 0, 0 );
+         if( quantum == 0 )
+         {
+            fprintf( stderr, "The quantum must be at least 1 instruction\n" );
+            return( -1 );
+         }
+      } else
+      if( ( strcmp( argv[iArg], "-m" ) == 0 ) && ( iArg + 1 < argc ) )
+      {
+         iArg++;
+         unsigned long long mb = strtoull( argv[iArg], 0, 0 );
+         if( ( mb < 1 ) || ( mb > ( Emulator::MAX_RAM_SIZE >> 20 ) ) )
+         {
+            fprintf( stderr, "The size of the RAM must be between 1 and %u MB\n", Emulator::MAX_RAM_SIZE >> 20 );
+            return( -1 );
+         }
+         ramSize = (uint32_t)( mb << 20 );
+      } else
+      if( strcmp( argv[iArg], "-H" ) == 0 )
+      {
+         hugePages = true;
+      } else
+      if( ( strcmp( argv[iArg], "-b" ) == 0 ) && ( iArg + 1 < argc ) )
+      {
+         iArg++;
+         pManifest = argv[iArg];
+      } else
+      if( ( strcmp( argv[iArg], "-j" ) == 0 ) && ( iArg + 1 < argc ) )
+      {
+         iArg++;
+         numThreads = atoi( argv[iArg] );
+         if( numThreads < 1 )
+         {
+            fprintf( stderr, "The number of threads must be at least 1\n" );
+            return( -1 );
+         }
+      } else
+      if( ( strcmp( argv[iArg], "-l" ) == 0 ) && ( iArg + 1 < argc ) )
+      {
+         iArg++;
+         limit = strtoull( argv[iArg], 0, 0 );
+         if( limit == 0 )
+         {
+            fprintf( stderr, "The limit must be at least 1 instruction\n" );
+            return( -1 );
+         }
+      } else
+      if( ( strcmp( argv[iArg], "-w" ) == 0 ) && ( iArg + 1 < argc ) )
+      {
+         iArg++;
+         pSnapshot = argv[iArg];
+      } else
+      if( ( strcmp( argv[iArg], "-k" ) == 0 ) && ( iArg + 1 < argc ) )
+      {
+         iArg++;
+         pDisk = argv[iArg];
+      } else
+      if( ( strcmp( argv[iArg], "-f" ) == 0 ) && ( iArg + 1 < argc ) )
+      {
+         iArg++;
+         char *pEnd;
+         unsigned long long address = strtoull( argv[iArg], &pEnd, 0 );
+         if( ( *pEnd != ':' ) || ( pEnd[1] == 0 ) || ( address > 0xffffffffULL ) )
+         {
+            fprintf( stderr, "Expected ADDRESS:FILE instead of %s\n", argv[iArg] );
+            return( -1 );
+         }
+         fileWindows.push_back( std::make_pair( (uint32_t)address, std::string( pEnd + 1 ) ) );
+      } else
+      if( ( strcmp( argv[iArg], "-D" ) == 0 ) && ( iArg + 1 < argc ) )
+      {
+         iArg++;
+         deduplicationInterval = strtoull( argv[iArg], 0, 0 );
+         if( deduplicationInterval == 0 )
+         {
+            fprintf( stderr, "The interval must be at least 1 instruction\n" );
+            return( -1 );
+         }
+      } else
+      if( ( strcmp( argv[iArg], "-e" ) == 0 ) && ( iArg + 1 < argc ) )
+      {
+         iArg++;
+         if( strcmp( argv[iArg], "interpreter" ) == 0 )
+         {
+            engine = RISCV::ENGINE_INTERPRETER;
+         } else
+         if( strcmp( argv[iArg], "blocks" ) == 0 )
+         {
+            engine = RISCV::ENGINE_BLOCKS;
+         } else
+         if( strcmp( argv[iArg], "jit" ) == 0 )
+         {
+            engine = RISCV::ENGINE_JIT;
+         } else
+         {
+            fprintf( stderr, "Unknown execution engine %s\n", argv[iArg] );
+            return( -1 );
+         }
+      } else
+      {
+         usage( argv[0] );
+         return( -1 );
+      }
+      iArg++;
+   }
+
+   if( pManifest )
    {
-      fprintf( stderr, "Usage: %s BINFILE\n", argv[0] );
+      std::vector<BatchRunner::Job> jobs;
+      if( !BatchRunner::readManifest( pManifest, limit > 0 ? limit : DEFAULT_JOB_LIMIT, jobs ) )
+      {
+         fprintf( stderr, "Couldn't read the manifest %s\n", pManifest );
+         return( -1 );
+      }
+
+      BatchRunner batch( numThreads, stdout );
+      batch.setEngine( engine );
+      batch.setDynamicBinding( dynamicBinding );
+      batch.setHostRoutines( hostRoutines );
+      batch.setRAM( ramSize, hugePages );
+      if( ( deduplicationInterval > 0 ) && !batch.setDeduplication( deduplicationInterval ) )
+      {
+         fprintf( stderr, "Sharing pages isn't supported on this platform\n" );
+      }
+
+      std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+      uint64_t instructions = batch.run( jobs );
+      double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - startTime ).count();
+
+      if( showStats )
+      {
+         fprintf( stderr, "Ran %llu jobs, executed %llu instructions in %.3f s (%.2f MIPS)\n",
+            (unsigned long long)jobs.size(), (unsigned long long)instructions, seconds,
+            seconds > 0 ? instructions / seconds / 1e6 : 0.0 );
+
+         const PageDeduplicator *pDeduplicator = batch.getDeduplicator();
+         if( pDeduplicator )
+         {
+            fprintf( stderr, "Shared pages: %.2f MB saved at most, %.2f MB at the end\n",
+               pDeduplicator->getPeakSavedBytes() / 1048576.0,
+               pDeduplicator->getSavedBytes() / 1048576.0 );
+         }
+      }
+
+      return( 0 );
+   }
+
+   if( argc <= iArg )
+   {
+      usage( argv[0] );
       return( -1 );
    }
 
-   std::string fileName = argv[1];
+   std::string fileName = argv[iArg];
 
-   Emulator *pEmu = Emulator::create( fileName );
+   Emulator *pEmu = Emulator::create( fileName, numHarts, ramSize, hugePages );
    if( !pEmu )
    {
-      fprintf( stderr, "Couldn't load binary file from %s\n", argv[1] );
+      fprintf( stderr, "Couldn't load binary file from %s\n", argv[iArg] );
+      return( -1 );
+   }
+
+   if( !pEmu->setEngine( engine ) )
+   {
+      fprintf( stderr, "The JIT isn't supported on this platform, using the block engine instead\n" );
+      pEmu->setEngine( RISCV::ENGINE_BLOCKS );
+   }
+
+   pEmu->setDynamicBinding( dynamicBinding );
+   pEmu->setQuantum( quantum );
+   pEmu->setHostRoutines( hostRoutines );
+
+   if( pDisk && !pEmu->attachDisk( pDisk ) )
+   {
+      fprintf( stderr, "Couldn't use %s as a disk\n", pDisk );
+      delete pEmu;
       return( -1 );
    }
 
+   for( size_t i = 0; i < fileWindows.size(); i++ )
+   {
+      if( !pEmu->mapFile( fileWindows[i].first, fileWindows[i].second ) )
+      {
+         fprintf( stderr, "Couldn't map %s to 0x%08x\n", fileWindows[i].second.c_str(), fileWindows[i].first );
+         delete pEmu;
+         return( -1 );
+      }
+   }
+
+   std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+   uint64_t remaining = limit;
    while( 1 )
    {
-      pEmu->step();
+      uint64_t budget = ( limit > 0 ) && ( remaining < RUN_BUDGET ) ? remaining : RUN_BUDGET;
+      RISCV::RunResult result = pEmu->run( budget );
+      if( result.reason == RISCV::STOP_BREAKPOINT )
+      {
+         break;
+      }
+
       if( pEmu->emulationStopped() )
       {
          break;
       }
+
+      if( limit > 0 )
+      {
+         remaining -= budget;
+         if( remaining == 0 )
+            break;
+      }
+   }
+
+   double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - startTime ).count();
+
+   if( pSnapshot && !pEmu->saveSnapshot( pSnapshot ) )
+   {
+      fprintf( stderr, "Couldn't write the snapshot to %s\n", pSnapshot );
+   }
+
+   if( showStats )
+   {
+      // The statistics are summed up over all harts
+      uint64_t instructions = 0;
+      uint64_t hits = 0;
+      uint64_t misses = 0;
+      uint64_t blocksTranslated = 0;
+      uint64_t blocksInvalidated = 0;
+      for( int i = 0; i < pEmu->getNumHarts(); i++ )
+      {
+         const RISCV *pCPU = pEmu->getCPU( i );
+         instructions += pCPU->getInstructionsRetired();
+         hits += pCPU->getDecodeCacheHits();
+         misses += pCPU->getDecodeCacheMisses();
+         blocksTranslated += pCPU->getBlocksTranslated();
+         blocksInvalidated += pCPU->getBlocksInvalidated();
+      }
+
+      fprintf( stderr, "Executed %llu instructions in %.3f s (%.2f MIPS)\n",
+         (unsigned long long)instructions, seconds,
+         seconds > 0 ? instructions / seconds / 1e6 : 0.0 );
+
+      fprintf( stderr, "Decode cache: %llu hits, %llu misses (%.2f%% hit rate)\n",
+         (unsigned long long)hits, (unsigned long long)misses,
+         hits + misses > 0 ? 100.0 * hits / ( hits + misses ) : 0.0 );
+
+      fprintf( stderr, "Block cache: %llu blocks translated, %llu invalidated\n",
+         (unsigned long long)blocksTranslated,
+         (unsigned long long)blocksInvalidated );
+
+      fprintf( stderr, "RAM: %u MB, %.2f MB resident\n",
+         pEmu->getRAMSize() >> 20, pEmu->getResidentRAM() / 1048576.0 );
+
+      if( hostRoutines != HostRoutines::MODE_OFF )
+      {
+         const HostRoutines &routines = pEmu->getHostRoutines();
+         fprintf( stderr, "Host routines: %llu calls, %llu differences\n",
+            (unsigned long long)routines.getCalls(),
+            (unsigned long long)routines.getMismatches() );
+      }
+
+      if( pEmu->getNumHarts() > 1 )
+      {
+         for( int i = 0; i < pEmu->getNumHarts(); i++ )
+         {
+            fprintf( stderr, "Hart %d: %llu instructions\n", i,
+               (unsigned long long)pEmu->getCPU( i )->getInstructionsRetired() );
+         }
+      }
+
+      if( ( pEmu->getNumHarts() > 1 ) && ( quantum > 0 ) )
+      {
+         uint64_t quanta = pEmu->getQuanta();
+         double overhead = pEmu->getSchedulingOverhead();
+         fprintf( stderr, "Scheduler: %llu quanta, %.3f s overhead (%.1f ns per switch, %.2f%% of the time)\n",
+            (unsigned long long)quanta, overhead,
+            quanta > 0 ? overhead / quanta * 1e9 : 0.0,
+            seconds > 0 ? 100.0 * overhead / seconds : 0.0 );
+      }
    }
 
+   int status = pEmu->getExitStatus();
    delete pEmu;
 
-   return( 0 );
+   return( status );
 }
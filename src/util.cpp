@@ -31,3 +31,40 @@ std::string util::join( const util::strvec &v, const std::string &sep )
 
    return( r );
 }
+
+
+/*----------------------------------------------------------------------------*/
+/*! 2026-10-16
+Quote a string for use in JSON, escaping quotes, backslashes and control
+characters.
+\param s The string
+\return The quoted string
+*/
+/*----------------------------------------------------------------------------*/
+std::string util::jsonString( const std::string &s )
+{
+   std::string r = "\"";
+   for( size_t i = 0; i < s.size(); i++ )
+   {
+      unsigned char c = s[i];
+      if( ( c == '"' ) || ( c == '\\' ) )
+      {
+         r += '\\';
+         r += c;
+      } else
+      if( c == '\n' )
+      {
+         r += "\\n";
+      } else
+      if( ( c < 0x20 ) || ( c >= 0x7f ) )
+      {
+         r += stdformat( "\\u{:04x}", c );
+      } else
+      {
+         r += c;
+      }
+   }
+   r += "\"";
+
+   return( r );
+}
@@ -22,6 +22,8 @@
 
 #include <string>
 #include <vector>
+#include <cstdint>
+#include <cstring>
 
 #ifdef __GNUC__
 #include <fmt/core.h>
@@ -35,6 +37,45 @@ namespace util
 {
    typedef std::vector<std::string> strvec;
    std::string join( const util::strvec &l, const std::string &sep );
+   std::string jsonString( const std::string &s );
+
+   // Access little endian values in host memory, independent of the byte
+   // order of the host
+   inline uint16_t loadLE16( const uint8_t *p )
+   {
+      uint16_t v;
+      memcpy( &v, p, sizeof( v ) );
+#if defined( __BYTE_ORDER__ ) && ( __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__ )
+      v = __builtin_bswap16( v );
+#endif
+      return( v );
+   }
+
+   inline uint32_t loadLE32( const uint8_t *p )
+   {
+      uint32_t v;
+      memcpy( &v, p, sizeof( v ) );
+#if defined( __BYTE_ORDER__ ) && ( __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__ )
+      v = __builtin_bswap32( v );
+#endif
+      return( v );
+   }
+
+   inline void storeLE16( uint8_t *p, uint16_t v )
+   {
+#if defined( __BYTE_ORDER__ ) && ( __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__ )
+      v = __builtin_bswap16( v );
+#endif
+      memcpy( p, &v, sizeof( v ) );
+   }
+
+   inline void storeLE32( uint8_t *p, uint32_t v )
+   {
+#if defined( __BYTE_ORDER__ ) && ( __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__ )
+      v = __builtin_bswap32( v );
+#endif
+      memcpy( p, &v, sizeof( v ) );
+   }
 }
 
 #endif